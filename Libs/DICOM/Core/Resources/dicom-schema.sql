@@ -15,6 +15,7 @@ DROP TABLE IF EXISTS 'Series' ;
 DROP TABLE IF EXISTS 'Studies' ;
 DROP TABLE IF EXISTS 'ColumnDisplayProperties' ;
 DROP TABLE IF EXISTS 'Directories' ;
+DROP TABLE IF EXISTS 'FileManifest' ;
 
 DROP INDEX IF EXISTS 'ImagesFilenameIndex' ;
 DROP INDEX IF EXISTS 'ImagesSeriesIndex' ;
@@ -22,7 +23,7 @@ DROP INDEX IF EXISTS 'SeriesStudyIndex' ;
 DROP INDEX IF EXISTS 'StudiesPatientIndex' ;
 
 CREATE TABLE 'SchemaInfo' ( 'Version' VARCHAR(1024) NOT NULL );
-INSERT INTO 'SchemaInfo' VALUES('0.6.2');
+INSERT INTO 'SchemaInfo' VALUES('0.6.5');
 
 CREATE TABLE 'Images' (
   'SOPInstanceUID' VARCHAR(64) NOT NULL,
@@ -30,6 +31,7 @@ CREATE TABLE 'Images' (
   'SeriesInstanceUID' VARCHAR(64) NOT NULL ,
   'InsertTimestamp' VARCHAR(20) NOT NULL ,
   'DisplayedFieldsUpdatedTimestamp' DATETIME NULL ,
+  'FromDirectoryRecords' INT NOT NULL DEFAULT 0 ,
   PRIMARY KEY ('SOPInstanceUID') );
 CREATE TABLE 'Patients' (
   'UID' INTEGER PRIMARY KEY AUTOINCREMENT,
@@ -43,7 +45,8 @@ CREATE TABLE 'Patients' (
   'InsertTimestamp' VARCHAR(20) NOT NULL ,
   'DisplayedPatientsName' VARCHAR(255) NULL ,
   'DisplayedNumberOfStudies' INT NULL ,
-  'DisplayedFieldsUpdatedTimestamp' DATETIME NULL );
+  'DisplayedFieldsUpdatedTimestamp' DATETIME NULL ,
+  'FromDirectoryRecords' INT NOT NULL DEFAULT 0 );
 CREATE TABLE 'Studies' (
   'StudyInstanceUID' VARCHAR(64) NOT NULL ,
   'PatientsUID' INT NOT NULL ,
@@ -59,6 +62,7 @@ CREATE TABLE 'Studies' (
   'InsertTimestamp' VARCHAR(20) NOT NULL ,
   'DisplayedNumberOfSeries' INT NULL ,
   'DisplayedFieldsUpdatedTimestamp' DATETIME NULL ,
+  'FromDirectoryRecords' INT NOT NULL DEFAULT 0 ,
   PRIMARY KEY ('StudyInstanceUID') );
 CREATE TABLE 'Series' (
   'SeriesInstanceUID' VARCHAR(64) NOT NULL ,
@@ -80,6 +84,7 @@ CREATE TABLE 'Series' (
   'DisplayedSize' VARCHAR(20) NULL ,
   'DisplayedNumberOfFrames' INT NULL ,
   'DisplayedFieldsUpdatedTimestamp' DATETIME NULL ,
+  'FromDirectoryRecords' INT NOT NULL DEFAULT 0 ,
   PRIMARY KEY ('SeriesInstanceUID') );
 
 CREATE UNIQUE INDEX IF NOT EXISTS 'ImagesFilenameIndex' ON 'Images' ('Filename');
@@ -91,6 +96,14 @@ CREATE TABLE 'Directories' (
   'Dirname' VARCHAR(1024) ,
   PRIMARY KEY ('Dirname') );
 
+CREATE TABLE 'FileManifest' (
+  'Filename' VARCHAR(1024) NOT NULL ,
+  'FileSize' INTEGER NOT NULL ,
+  'LastModified' INTEGER NOT NULL ,
+  'StoredFilename' VARCHAR(1024) NULL ,
+  PRIMARY KEY ('Filename') );
+CREATE INDEX IF NOT EXISTS 'FileManifestStoredFilenameIndex' ON 'FileManifest' ('StoredFilename');
+
 CREATE TABLE 'ColumnDisplayProperties' (
   'TableName' VARCHAR(64) NOT NULL,
   'FieldName' VARCHAR(64) NOT NULL ,
@@ -112,6 +125,7 @@ INSERT INTO 'ColumnDisplayProperties' VALUES('Patients', 'InsertTimestamp',
 INSERT INTO 'ColumnDisplayProperties' VALUES('Patients', 'DisplayedPatientsName',           'Patient name',         1, 1, '');
 INSERT INTO 'ColumnDisplayProperties' VALUES('Patients', 'DisplayedNumberOfStudies',        'Number of studies',    1, 5, '');
 INSERT INTO 'ColumnDisplayProperties' VALUES('Patients', 'DisplayedFieldsUpdatedTimestamp', '',                     0, 0, '');
+INSERT INTO 'ColumnDisplayProperties' VALUES('Patients', 'FromDirectoryRecords',            '',                     0, 0, '');
 
 INSERT INTO 'ColumnDisplayProperties' VALUES('Studies',  'StudyInstanceUID',                '',                     0, 0, '');
 INSERT INTO 'ColumnDisplayProperties' VALUES('Studies',  'PatientsUID',                     '',                     0, 0, '');
@@ -127,6 +141,7 @@ INSERT INTO 'ColumnDisplayProperties' VALUES('Studies',  'PerformingPhysiciansNa
 INSERT INTO 'ColumnDisplayProperties' VALUES('Studies',  'InsertTimestamp',                 'Date added',           1, 5, '');
 INSERT INTO 'ColumnDisplayProperties' VALUES('Studies',  'DisplayedNumberOfSeries',         'Number of series',     1, 4, '');
 INSERT INTO 'ColumnDisplayProperties' VALUES('Studies',  'DisplayedFieldsUpdatedTimestamp', '',                     0, 0, '');
+INSERT INTO 'ColumnDisplayProperties' VALUES('Studies',  'FromDirectoryRecords',            '',                     0, 0, '');
 
 INSERT INTO 'ColumnDisplayProperties' VALUES('Series',   'SeriesInstanceUID',               '',                     0, 0, '');
 INSERT INTO 'ColumnDisplayProperties' VALUES('Series',   'StudyInstanceUID',                '',                     0, 0, '');
@@ -147,3 +162,4 @@ INSERT INTO 'ColumnDisplayProperties' VALUES('Series',   'DisplayedCount',
 INSERT INTO 'ColumnDisplayProperties' VALUES('Series',   'DisplayedSize',                   'Size',                 1, 5, '');
 INSERT INTO 'ColumnDisplayProperties' VALUES('Series',   'DisplayedNumberOfFrames',         'Number of frames',     0, 0, '');
 INSERT INTO 'ColumnDisplayProperties' VALUES('Series',   'DisplayedFieldsUpdatedTimestamp', '',                     0, 0, '');
+INSERT INTO 'ColumnDisplayProperties' VALUES('Series',   'FromDirectoryRecords',            '',                     0, 0, '');
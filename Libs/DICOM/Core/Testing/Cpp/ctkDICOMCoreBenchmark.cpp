@@ -0,0 +1,432 @@
+/*=========================================================================
+
+  Library:   CTK
+
+  Copyright (c) Kitware Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0.txt
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=========================================================================*/
+
+/// Indexing benchmark for ctkDICOMIndexer and ctkDICOMDatabase.
+///
+/// Generates a synthetic data set with the requested number of patients, studies,
+/// series, and instances, then measures the main phases of importing it:
+/// addDirectory, updateDisplayedFields, tag precaching, and indexing with thumbnail
+/// generation. Results are written as JSON, so that they can be compared across
+/// versions:
+///
+///   ctkDICOMCoreBenchmark --patients 10 --studies 2 --series 4 --instances 100 --output results.json
+
+// Qt includes
+#include <QCoreApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QSqlQuery>
+#include <QStringList>
+#include <QTextStream>
+
+// CTK includes
+#include "ctkCommandLineParser.h"
+#include "ctkUtils.h"
+
+// ctkDICOMCore includes
+#include "ctkDICOMAbstractThumbnailGenerator.h"
+#include "ctkDICOMDatabase.h"
+#include "ctkDICOMIndexer.h"
+#include "ctkDICOMItem.h"
+
+// DCMTK includes
+#include <dcmtk/dcmdata/dcdatset.h>
+#include <dcmtk/dcmdata/dcdeftag.h>
+#include <dcmtk/dcmdata/dcuid.h>
+#include <dcmtk/dcmimgle/dcmimage.h>
+
+// STD includes
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#ifdef Q_OS_WIN32
+# include <windows.h>
+# include <psapi.h>
+#else
+# include <sys/resource.h>
+#endif
+
+namespace
+{
+
+//------------------------------------------------------------------------------
+/// Peak resident set size of the whole process since it started, in kilobytes.
+/// -1 if not available
+qint64 processPeakResidentSetSize()
+{
+#ifdef Q_OS_WIN32
+  PROCESS_MEMORY_COUNTERS counters;
+  if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+  {
+    return static_cast<qint64>(counters.PeakWorkingSetSize / 1024);
+  }
+  return -1;
+#else
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0)
+  {
+    return -1;
+  }
+# ifdef Q_OS_MAC
+  // bytes on macOS
+  return static_cast<qint64>(usage.ru_maxrss / 1024);
+# else
+  return static_cast<qint64>(usage.ru_maxrss);
+# endif
+#endif
+}
+
+//------------------------------------------------------------------------------
+QString newUID()
+{
+  char uid[100];
+  dcmGenerateUniqueIdentifier(uid, SITE_INSTANCE_UID_ROOT);
+  return QString(uid);
+}
+
+//------------------------------------------------------------------------------
+/// Writes scaled down images, so that the cost of decoding the pixel data is measured
+class ctkDICOMBenchmarkThumbnailGenerator : public ctkDICOMAbstractThumbnailGenerator
+{
+public:
+  virtual bool generateThumbnail(DicomImage* dcmImage, const QString& path)
+  {
+    if (!dcmImage || dcmImage->getStatus() != EIS_Normal)
+    {
+      return false;
+    }
+    DicomImage* scaledImage = dcmImage->createScaledImage(static_cast<unsigned long>(32));
+    if (!scaledImage)
+    {
+      return false;
+    }
+    bool success = scaledImage->writePPM(qPrintable(path), 8) != 0;
+    delete scaledImage;
+    return success;
+  }
+};
+
+//------------------------------------------------------------------------------
+struct ctkDICOMBenchmarkPhase
+{
+  QString Name;
+  double Seconds;
+  int NumberOfInstances;
+  /// Peak of the process at the end of the phase, it includes the previous phases
+  qint64 ProcessPeakResidentSetSizeKB;
+};
+
+//------------------------------------------------------------------------------
+class ctkDICOMBenchmark
+{
+public:
+  ctkDICOMBenchmark()
+    : NumberOfPatients(1), NumberOfStudies(1), NumberOfSeries(1), NumberOfInstances(1)
+    , ImageSize(64), NumberOfParsingThreads(-1)
+  {
+  }
+
+  int numberOfInstancesTotal() const
+  {
+    return this->NumberOfPatients * this->NumberOfStudies * this->NumberOfSeries * this->NumberOfInstances;
+  }
+
+  void startPhase()
+  {
+    this->Timer.start();
+  }
+
+  void endPhase(const QString& name, int numberOfInstances)
+  {
+    ctkDICOMBenchmarkPhase phase;
+    phase.Name = name;
+    phase.Seconds = this->Timer.elapsed() / 1000.0;
+    phase.NumberOfInstances = numberOfInstances;
+    phase.ProcessPeakResidentSetSizeKB = processPeakResidentSetSize();
+    this->Phases.push_back(phase);
+    std::cerr << qPrintable(name) << ": " << phase.Seconds << "s" << std::endl;
+  }
+
+  /// Write one file per instance, with a small image so that thumbnails can be generated
+  bool generateDataSet(const QString& directory);
+
+  bool run(const QString& workDirectory);
+
+  void writeResults(QTextStream& stream) const;
+
+  int NumberOfPatients;
+  int NumberOfStudies;
+  int NumberOfSeries;
+  int NumberOfInstances;
+  int ImageSize;
+  int NumberOfParsingThreads;
+  QStringList TagsToPrecache;
+  QElapsedTimer Timer;
+  std::vector<ctkDICOMBenchmarkPhase> Phases;
+};
+
+//------------------------------------------------------------------------------
+bool ctkDICOMBenchmark::generateDataSet(const QString& directory)
+{
+  ctkDICOMItem item;
+  DcmDataset* dataset = new DcmDataset;
+  item.InitializeFromItem(dataset, true /* take ownership */);
+  item.SetElementAsString(DCM_SOPClassUID, UID_SecondaryCaptureImageStorage);
+  item.SetElementAsString(DCM_Modality, "OT");
+  item.SetElementAsString(DCM_StudyDate, "20200101");
+  item.SetElementAsString(DCM_StudyTime, "120000");
+  item.SetElementAsString(DCM_PhotometricInterpretation, "MONOCHROME2");
+  item.SetElementAsUnsignedShort(DCM_SamplesPerPixel, 1);
+  item.SetElementAsUnsignedShort(DCM_Rows, this->ImageSize);
+  item.SetElementAsUnsignedShort(DCM_Columns, this->ImageSize);
+  item.SetElementAsUnsignedShort(DCM_BitsAllocated, 16);
+  item.SetElementAsUnsignedShort(DCM_BitsStored, 12);
+  item.SetElementAsUnsignedShort(DCM_HighBit, 11);
+  item.SetElementAsUnsignedShort(DCM_PixelRepresentation, 0);
+  std::vector<Uint16> pixels(this->ImageSize * this->ImageSize);
+  for (size_t i = 0; i < pixels.size(); ++i)
+  {
+    pixels[i] = static_cast<Uint16>(i % 4096);
+  }
+  dataset->putAndInsertUint16Array(DCM_PixelData, &pixels[0], static_cast<unsigned long>(pixels.size()));
+
+  for (int patient = 0; patient < this->NumberOfPatients; ++patient)
+  {
+    item.SetElementAsString(DCM_PatientName, QString("Benchmark^Patient%1").arg(patient));
+    item.SetElementAsString(DCM_PatientID, QString("BENCHMARK%1").arg(patient));
+    for (int study = 0; study < this->NumberOfStudies; ++study)
+    {
+      item.SetElementAsString(DCM_StudyInstanceUID, newUID());
+      item.SetElementAsString(DCM_StudyDescription, QString("Study %1").arg(study));
+      for (int series = 0; series < this->NumberOfSeries; ++series)
+      {
+        QString seriesInstanceUID = newUID();
+        item.SetElementAsString(DCM_SeriesInstanceUID, seriesInstanceUID);
+        item.SetElementAsString(DCM_SeriesDescription, QString("Series %1").arg(series));
+        item.SetElementAsInteger(DCM_SeriesNumber, series + 1);
+        QString seriesDirectory = QString("%1/%2/%3").arg(directory).arg(patient).arg(seriesInstanceUID);
+        QDir().mkpath(seriesDirectory);
+        for (int instance = 0; instance < this->NumberOfInstances; ++instance)
+        {
+          item.SetElementAsString(DCM_SOPInstanceUID, newUID());
+          item.SetElementAsInteger(DCM_InstanceNumber, instance + 1);
+          if (!item.SaveToFile(QString("%1/%2.dcm").arg(seriesDirectory).arg(instance, 6, 10, QLatin1Char('0'))))
+          {
+            std::cerr << "Failed to write synthetic data set to " << qPrintable(seriesDirectory) << std::endl;
+            return false;
+          }
+        }
+      }
+    }
+  }
+  return true;
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMBenchmark::run(const QString& workDirectory)
+{
+  QString dataDirectory = workDirectory + "/data";
+  int numberOfInstances = this->numberOfInstancesTotal();
+
+  this->startPhase();
+  if (!this->generateDataSet(dataDirectory))
+  {
+    return false;
+  }
+  this->endPhase("generateDataSet", numberOfInstances);
+
+  ctkDICOMIndexer indexer;
+  if (this->NumberOfParsingThreads >= 0)
+  {
+    indexer.setNumberOfParsingThreads(this->NumberOfParsingThreads);
+  }
+
+  // Indexing, without thumbnails
+  {
+    ctkDICOMDatabase database;
+    QDir().mkpath(workDirectory + "/database");
+    database.openDatabase(workDirectory + "/database/ctkDICOMDatabase.sql");
+    if (!database.isOpen())
+    {
+      std::cerr << "Failed to initialize database in " << qPrintable(workDirectory) << std::endl;
+      return false;
+    }
+
+    this->startPhase();
+    indexer.addDirectory(database, dataDirectory);
+    this->endPhase("addDirectory", numberOfInstances);
+    if (database.allFiles().count() != numberOfInstances)
+    {
+      std::cerr << "Indexed " << database.allFiles().count() << " instances instead of "
+                << numberOfInstances << std::endl;
+      return false;
+    }
+
+    // Displayed fields of all instances
+    QSqlQuery resetDisplayedFields(database.database());
+    resetDisplayedFields.exec("UPDATE Images SET DisplayedFieldsUpdatedTimestamp = NULL");
+    this->startPhase();
+    database.updateDisplayedFields();
+    this->endPhase("updateDisplayedFields", numberOfInstances);
+
+    // Precaching of tags from the indexed files
+    this->startPhase();
+    int numberOfCachedFiles = database.cacheTagsFromFiles(database.allFiles(), this->TagsToPrecache);
+    this->endPhase("precacheTags", numberOfCachedFiles);
+
+    database.closeDatabase();
+  }
+
+  // Indexing with thumbnail generation
+  {
+    ctkDICOMBenchmarkThumbnailGenerator generator;
+    ctkDICOMDatabase database;
+    QDir().mkpath(workDirectory + "/databaseWithThumbnails");
+    database.openDatabase(workDirectory + "/databaseWithThumbnails/ctkDICOMDatabase.sql");
+    if (!database.isOpen())
+    {
+      std::cerr << "Failed to initialize database in " << qPrintable(workDirectory) << std::endl;
+      return false;
+    }
+    database.setThumbnailGenerator(&generator);
+
+    this->startPhase();
+    indexer.addDirectory(database, dataDirectory);
+    database.waitForThumbnails();
+    this->endPhase("addDirectoryWithThumbnails", numberOfInstances);
+
+    database.closeDatabase();
+  }
+
+  return true;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMBenchmark::writeResults(QTextStream& stream) const
+{
+  stream << "{\n";
+  stream << "  \"configuration\": {\n";
+  stream << "    \"patients\": " << this->NumberOfPatients << ",\n";
+  stream << "    \"studiesPerPatient\": " << this->NumberOfStudies << ",\n";
+  stream << "    \"seriesPerStudy\": " << this->NumberOfSeries << ",\n";
+  stream << "    \"instancesPerSeries\": " << this->NumberOfInstances << ",\n";
+  stream << "    \"imageSize\": " << this->ImageSize << ",\n";
+  stream << "    \"parsingThreads\": " << this->NumberOfParsingThreads << ",\n";
+  stream << "    \"qtVersion\": \"" << qVersion() << "\",\n";
+  stream << "    \"dcmtkVersion\": \"" << OFFIS_DCMTK_VERSION_STRING << "\"\n";
+  stream << "  },\n";
+  stream << "  \"phases\": [\n";
+  for (size_t i = 0; i < this->Phases.size(); ++i)
+  {
+    const ctkDICOMBenchmarkPhase& phase = this->Phases[i];
+    double instancesPerSecond = phase.Seconds > 0 ? phase.NumberOfInstances / phase.Seconds : 0.;
+    stream << "    {\"name\": \"" << phase.Name << "\""
+           << ", \"seconds\": " << QString::number(phase.Seconds, 'f', 3)
+           << ", \"instances\": " << phase.NumberOfInstances
+           << ", \"instancesPerSecond\": " << QString::number(instancesPerSecond, 'f', 1)
+           << ", \"processPeakResidentSetSizeKB\": " << phase.ProcessPeakResidentSetSizeKB
+           << "}" << (i + 1 < this->Phases.size() ? "," : "") << "\n";
+  }
+  stream << "  ],\n";
+  stream << "  \"processPeakResidentSetSizeKB\": " << processPeakResidentSetSize() << "\n";
+  stream << "}\n";
+}
+
+}
+
+//------------------------------------------------------------------------------
+int main(int argc, char* argv[])
+{
+  QCoreApplication app(argc, argv);
+
+  ctkCommandLineParser parser;
+  parser.setArgumentPrefix("--", "-");
+  parser.addArgument("patients", "", QVariant::Int, "Number of patients.", 10);
+  parser.addArgument("studies", "", QVariant::Int, "Number of studies per patient.", 2);
+  parser.addArgument("series", "", QVariant::Int, "Number of series per study.", 4);
+  parser.addArgument("instances", "", QVariant::Int, "Number of instances per series.", 50);
+  parser.addArgument("image-size", "", QVariant::Int, "Number of rows and columns of the images.", 64);
+  parser.addArgument("threads", "", QVariant::Int, "Number of parsing threads of the indexer (default: indexer default).", -1);
+  parser.addArgument("tags", "", QVariant::StringList, "Tags to precache (group,element).",
+    QStringList() << "0008,0060" << "0008,103E" << "0020,0013" << "0028,0010" << "0028,0011");
+  parser.addArgument("work-dir", "", QVariant::String,
+    "Directory in which a temporary directory is created for the data set and databases.",
+    QDir::tempPath());
+  parser.addArgument("output", "o", QVariant::String, "JSON result file (default: standard output).");
+  parser.addArgument("help", "h", QVariant::Bool, "Print this help text.");
+
+  bool ok = false;
+  QHash<QString, QVariant> arguments = parser.parseArguments(argc, argv, &ok);
+  if (!ok)
+  {
+    std::cerr << "Error parsing arguments: " << qPrintable(parser.errorString()) << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (arguments.contains("help"))
+  {
+    std::cout << "Usage:\n" << qPrintable(parser.helpText());
+    return EXIT_SUCCESS;
+  }
+
+  ctkDICOMBenchmark benchmark;
+  benchmark.NumberOfPatients = qMax(1, arguments.value("patients").toInt());
+  benchmark.NumberOfStudies = qMax(1, arguments.value("studies").toInt());
+  benchmark.NumberOfSeries = qMax(1, arguments.value("series").toInt());
+  benchmark.NumberOfInstances = qMax(1, arguments.value("instances").toInt());
+  benchmark.ImageSize = qMax(8, arguments.value("image-size").toInt());
+  benchmark.NumberOfParsingThreads = arguments.value("threads").toInt();
+  benchmark.TagsToPrecache = arguments.value("tags").toStringList();
+
+  // Only the directory created here is removed, the work directory may contain other files
+  QDir workDirectory(arguments.value("work-dir").toString());
+  QString benchmarkDirectory = workDirectory.absoluteFilePath(
+    QString("ctkDICOMCoreBenchmark-%1").arg(QCoreApplication::applicationPid()));
+  if (workDirectory.exists(benchmarkDirectory) || !workDirectory.mkpath(benchmarkDirectory))
+  {
+    std::cerr << "Failed to create directory " << qPrintable(benchmarkDirectory) << std::endl;
+    return EXIT_FAILURE;
+  }
+  bool success = benchmark.run(benchmarkDirectory);
+  ctk::removeDirRecursively(benchmarkDirectory);
+  if (!success)
+  {
+    return EXIT_FAILURE;
+  }
+
+  if (arguments.contains("output"))
+  {
+    QFile outputFile(arguments.value("output").toString());
+    if (!outputFile.open(QIODevice::WriteOnly | QIODevice::Text))
+    {
+      std::cerr << "Failed to open " << qPrintable(outputFile.fileName()) << std::endl;
+      return EXIT_FAILURE;
+    }
+    QTextStream stream(&outputFile);
+    benchmark.writeResults(stream);
+  }
+  else
+  {
+    QTextStream stream(stdout);
+    benchmark.writeResults(stream);
+  }
+  return EXIT_SUCCESS;
+}
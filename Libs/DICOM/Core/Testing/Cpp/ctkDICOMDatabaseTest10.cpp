@@ -0,0 +1,138 @@
+/*=========================================================================
+
+  Library:   CTK
+
+  Copyright (c) Kitware Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0.txt
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=========================================================================*/
+
+// Qt includes
+#include <QCoreApplication>
+#include <QDir>
+#include <QSqlQuery>
+#include <QVariant>
+
+// ctkDICOMCore includes
+#include "ctkDICOMDatabase.h"
+
+// STD includes
+#include <iostream>
+#include <cstdlib>
+
+
+namespace
+{
+
+//------------------------------------------------------------------------------
+QString fieldValue(const ctkDICOMDatabase& database, const QString& queryString)
+{
+  QSqlQuery query(database.database());
+  if (!query.exec(queryString) || !query.next())
+    {
+    return QString("<missing>");
+    }
+  return query.value(0).toString();
+}
+
+}
+
+int ctkDICOMDatabaseTest10( int argc, char * argv [] )
+{
+  QCoreApplication app(argc, argv);
+
+  if (argc < 3)
+    {
+    std::cerr << "ctkDICOMDatabaseTest10: missing dicom filePath arguments";
+    std::cerr << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  ctkDICOMDatabase database;
+  QDir databaseDirectory = QDir::temp();
+  databaseDirectory.remove("ctkDICOMDatabase.sql");
+  databaseDirectory.remove("ctkDICOMTagCache.sql");
+
+  QFileInfo databaseFile(databaseDirectory, QString("database.test"));
+  database.openDatabase(databaseFile.absoluteFilePath());
+
+  if (!database.initializeDatabase())
+    {
+    std::cerr << "ctkDICOMDatabase::initializeDatabase() failed." << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  //
+  // Insert two instances of the same series and generate the displayed fields
+  //
+  database.insert(QString(argv[1]), false, false);
+  database.insert(QString(argv[2]), false, false);
+  database.updateDisplayedFields();
+
+  QString seriesUID = database.seriesForFile(argv[1]);
+  QString studyUID = database.studyForSeries(seriesUID);
+  QString patientUID = database.patientForStudy(studyUID);
+
+  if (fieldValue(database, "SELECT COUNT(*) FROM Images WHERE DisplayedFieldsUpdatedTimestamp IS NULL") != "0")
+    {
+    std::cerr << "ctkDICOMDatabase: displayed fields timestamp is not set for all images" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  QString seriesCount = fieldValue(database,
+    QString("SELECT DisplayedCount FROM Series WHERE SeriesInstanceUID='%1'").arg(seriesUID));
+  if (seriesCount != "2")
+    {
+    std::cerr << "ctkDICOMDatabase: wrong number of instances in series: "
+              << qPrintable(seriesCount) << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  QString seriesDescription = fieldValue(database,
+    QString("SELECT SeriesDescription FROM Series WHERE SeriesInstanceUID='%1'").arg(seriesUID));
+  if (seriesDescription.isEmpty() || seriesDescription == "<missing>")
+    {
+    std::cerr << "ctkDICOMDatabase: series description is not set" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  if (fieldValue(database, QString("SELECT DisplayedNumberOfSeries FROM Studies WHERE StudyInstanceUID='%1'").arg(studyUID)) != "1"
+    || fieldValue(database, QString("SELECT DisplayedFieldsUpdatedTimestamp IS NOT NULL FROM Studies WHERE StudyInstanceUID='%1'").arg(studyUID)) != "1")
+    {
+    std::cerr << "ctkDICOMDatabase: study displayed fields are not updated" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  if (fieldValue(database, QString("SELECT DisplayedNumberOfStudies FROM Patients WHERE UID='%1'").arg(patientUID)) != "1"
+    || fieldValue(database, QString("SELECT DisplayedPatientsName FROM Patients WHERE UID='%1'").arg(patientUID)).isEmpty())
+    {
+    std::cerr << "ctkDICOMDatabase: patient displayed fields are not updated" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  //
+  // Nothing is pending anymore, a second update must not change anything
+  //
+  database.updateDisplayedFields();
+  if (fieldValue(database,
+    QString("SELECT DisplayedCount FROM Series WHERE SeriesInstanceUID='%1'").arg(seriesUID)) != "2")
+    {
+    std::cerr << "ctkDICOMDatabase: repeated update changed the displayed fields" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  database.closeDatabase();
+
+  return EXIT_SUCCESS;
+}
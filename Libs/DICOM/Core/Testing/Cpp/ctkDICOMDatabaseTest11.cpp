@@ -0,0 +1,126 @@
+/*=========================================================================
+
+  Library:   CTK
+
+  Copyright (c) Kitware Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0.txt
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=========================================================================*/
+
+// Qt includes
+#include <QCoreApplication>
+#include <QDir>
+
+// ctkDICOMCore includes
+#include "ctkDICOMDatabase.h"
+
+// STD includes
+#include <iostream>
+#include <cstdlib>
+
+
+int ctkDICOMDatabaseTest11( int argc, char * argv [] )
+{
+  QCoreApplication app(argc, argv);
+
+  if (argc < 3)
+    {
+    std::cerr << "ctkDICOMDatabaseTest11: missing dicom filePath arguments";
+    std::cerr << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  ctkDICOMDatabase database;
+  QDir databaseDirectory = QDir::temp();
+  databaseDirectory.remove("ctkDICOMDatabase.sql");
+  databaseDirectory.remove("ctkDICOMTagCache.sql");
+
+  QFileInfo databaseFile(databaseDirectory, QString("database.test"));
+  database.openDatabase(databaseFile.absoluteFilePath());
+
+  if (!database.initializeDatabase())
+    {
+    std::cerr << "ctkDICOMDatabase::initializeDatabase() failed." << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  database.setTagsToPrecache(QStringList());
+  database.insert(QString(argv[1]), false, false);
+  database.insert(QString(argv[2]), false, false);
+
+  QString instanceUID("1.2.840.113619.2.135.3596.6358736.4843.1115808177.83");
+  QString seriesDescriptionTag("0008,103e");
+  QString patientIDTag("0010,0020");
+  QString badTag("0029,9999");
+  QString knownSeriesDescription("3D Cor T1 FAST IR-prepped GRE");
+
+  if (database.cachedTag(instanceUID, seriesDescriptionTag) != QString(""))
+    {
+    std::cerr << "ctkDICOMDatabase: tag should not be cached without tags to precache" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  //
+  // Extract tags of all files, unreadable files are skipped
+  //
+  QStringList fileNames;
+  fileNames << argv[1] << argv[2] << "nonexistent.dcm";
+  QStringList tags;
+  tags << patientIDTag << seriesDescriptionTag << badTag;
+  int numberOfFiles = database.cacheTagsFromFiles(fileNames, tags);
+  if (numberOfFiles != 2)
+    {
+    std::cerr << "ctkDICOMDatabase::cacheTagsFromFiles() returned " << numberOfFiles
+              << " instead of 2" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  if (database.cachedTag(instanceUID, seriesDescriptionTag) != knownSeriesDescription)
+    {
+    std::cerr << "ctkDICOMDatabase: extracted tag has wrong value: "
+              << qPrintable(database.cachedTag(instanceUID, seriesDescriptionTag)) << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  if (database.cachedTag(instanceUID, badTag) != QString("__TAG_NOT_IN_INSTANCE__"))
+    {
+    std::cerr << "ctkDICOMDatabase: missing tag should have sentinel value in cache" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  QString otherInstanceUID = database.instanceForFile(argv[2]);
+  if (database.cachedTag(otherInstanceUID, patientIDTag).isEmpty())
+    {
+    std::cerr << "ctkDICOMDatabase: tags of the second file are not cached" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  //
+  // Value read by fileValue when only the header up to the tag is parsed
+  //
+  if (database.fileValue(argv[1], 0x0010, 0x0010) != database.cachedTag(instanceUID, "0010,0010"))
+    {
+    std::cerr << "ctkDICOMDatabase: fileValue did not cache the value it read" << std::endl;
+    return EXIT_FAILURE;
+    }
+  if (database.cachedTag(instanceUID, "0010,0010").isEmpty())
+    {
+    std::cerr << "ctkDICOMDatabase: fileValue returned an empty patient name" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  database.closeDatabase();
+
+  return EXIT_SUCCESS;
+}
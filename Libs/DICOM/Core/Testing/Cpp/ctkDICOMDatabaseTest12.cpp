@@ -0,0 +1,173 @@
+/*=========================================================================
+
+  Library:   CTK
+
+  Copyright (c) Kitware Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0.txt
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=========================================================================*/
+
+// Qt includes
+#include <QCoreApplication>
+#include <QAtomicInt>
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+
+// CTK includes
+#include "ctkUtils.h"
+
+// ctkDICOMCore includes
+#include "ctkDICOMAbstractThumbnailGenerator.h"
+#include "ctkDICOMDatabase.h"
+
+// STD includes
+#include <iostream>
+#include <cstdlib>
+
+namespace
+{
+
+//------------------------------------------------------------------------------
+// Write a placeholder file instead of rendering the image
+class ctkDICOMTestThumbnailGenerator : public ctkDICOMAbstractThumbnailGenerator
+{
+public:
+  virtual bool generateThumbnail(DicomImage* dcmImage, const QString& path)
+  {
+    Q_UNUSED(dcmImage);
+    this->NumberOfThumbnails.ref();
+    QFile thumbnail(path);
+    if (!thumbnail.open(QIODevice::WriteOnly))
+      {
+      return false;
+      }
+    thumbnail.write("thumbnail");
+    return true;
+  }
+  QAtomicInt NumberOfThumbnails;
+};
+
+//------------------------------------------------------------------------------
+int numberOfFiles(const QString& directory)
+{
+  int count = 0;
+  QDirIterator it(directory, QDir::Files, QDirIterator::Subdirectories);
+  while (it.hasNext())
+    {
+    it.next();
+    ++count;
+    }
+  return count;
+}
+
+}
+
+int ctkDICOMDatabaseTest12( int argc, char * argv [] )
+{
+  QCoreApplication app(argc, argv);
+
+  if (argc < 4)
+    {
+    std::cerr << "ctkDICOMDatabaseTest12: missing dicom filePath arguments";
+    std::cerr << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  QDir databaseDirectory = QDir::temp();
+  databaseDirectory.mkdir("ctkDICOMDatabaseTest12");
+  databaseDirectory.cd("ctkDICOMDatabaseTest12");
+  ctk::removeDirRecursively(databaseDirectory.absoluteFilePath("thumbs"));
+  databaseDirectory.remove("ctkDICOMDatabase.sql");
+  databaseDirectory.remove("ctkDICOMTagCache.sql");
+
+  ctkDICOMTestThumbnailGenerator generator;
+  ctkDICOMDatabase database;
+  database.openDatabase(databaseDirectory.absoluteFilePath("ctkDICOMDatabase.sql"));
+  if (!database.initializeDatabase())
+    {
+    std::cerr << "ctkDICOMDatabase::initializeDatabase() failed." << std::endl;
+    return EXIT_FAILURE;
+    }
+  database.setThumbnailGenerator(&generator);
+  QString thumbnailsDirectory = databaseDirectory.absoluteFilePath("thumbs");
+
+  if (database.asynchronousThumbnailGeneration() || database.middleInstanceThumbnailOnly())
+    {
+    std::cerr << "ctkDICOMDatabase: unexpected default thumbnail generation options" << std::endl;
+    return EXIT_FAILURE;
+    }
+  database.setAsynchronousThumbnailGeneration(true);
+
+  //
+  // Background generation of the thumbnails of all instances
+  //
+  database.setNumberOfThumbnailThreads(2);
+  database.insert(QString(argv[1]), false, true);
+  database.insert(QString(argv[2]), false, true);
+  database.waitForThumbnails();
+  if (numberOfFiles(thumbnailsDirectory) != 2)
+    {
+    std::cerr << "ctkDICOMDatabase: expected 2 thumbnails, found "
+              << numberOfFiles(thumbnailsDirectory) << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // Up-to-date thumbnails are not generated again
+  int numberOfGeneratedThumbnails = generator.NumberOfThumbnails;
+  database.insert(QString(argv[1]), false, true);
+  database.waitForThumbnails();
+  if (generator.NumberOfThumbnails != numberOfGeneratedThumbnails)
+    {
+    std::cerr << "ctkDICOMDatabase: up-to-date thumbnail was generated again" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  //
+  // Only the middle instance of the series within a batch insert
+  //
+  ctk::removeDirRecursively(thumbnailsDirectory);
+  database.removeSeries(database.seriesForFile(argv[1]));
+  database.setMiddleInstanceThumbnailOnly(true);
+  database.beginBatchInsert();
+  for (int i = 1; i < argc; ++i)
+    {
+    database.insert(QString(argv[i]), false, true);
+    }
+  database.endBatchInsert();
+  database.waitForThumbnails();
+  if (numberOfFiles(thumbnailsDirectory) != 1)
+    {
+    std::cerr << "ctkDICOMDatabase: expected 1 thumbnail for the series, found "
+              << numberOfFiles(thumbnailsDirectory) << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  //
+  // Synchronous generation
+  //
+  ctk::removeDirRecursively(thumbnailsDirectory);
+  database.setMiddleInstanceThumbnailOnly(false);
+  database.setAsynchronousThumbnailGeneration(false);
+  database.insert(QString(argv[1]), false, true);
+  if (numberOfFiles(thumbnailsDirectory) != 1)
+    {
+    std::cerr << "ctkDICOMDatabase: thumbnail should be written before insert returns" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  database.closeDatabase();
+
+  return EXIT_SUCCESS;
+}
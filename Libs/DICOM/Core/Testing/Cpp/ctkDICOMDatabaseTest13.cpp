@@ -0,0 +1,200 @@
+/*=========================================================================
+
+  Library:   CTK
+
+  Copyright (c) Kitware Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0.txt
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=========================================================================*/
+
+// Qt includes
+#include <QCoreApplication>
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+
+// CTK includes
+#include "ctkUtils.h"
+
+// ctkDICOMCore includes
+#include "ctkDICOMDatabase.h"
+#include "ctkDICOMIndexer.h"
+
+// STD includes
+#include <iostream>
+#include <cstdlib>
+
+namespace
+{
+
+//------------------------------------------------------------------------------
+bool checkStoredFiles(ctkDICOMDatabase& database, const QStringList& inputFiles,
+                      bool inputFilesKept, const char* mode)
+{
+  foreach (const QString& inputFile, inputFiles)
+    {
+    if (QFile::exists(inputFile) != inputFilesKept)
+      {
+      std::cerr << "ctkDICOMDatabase: " << mode << " mode: input file "
+                << qPrintable(inputFile) << (inputFilesKept ? " was removed" : " was kept") << std::endl;
+      return false;
+      }
+    }
+  QStringList storedFiles = database.allFiles();
+  if (storedFiles.count() != inputFiles.count())
+    {
+    std::cerr << "ctkDICOMDatabase: " << mode << " mode: expected " << inputFiles.count()
+              << " stored files, found " << storedFiles.count() << std::endl;
+    return false;
+    }
+  foreach (const QString& storedFile, storedFiles)
+    {
+    QFileInfo storedFileInfo(storedFile);
+    if (!storedFile.startsWith(database.databaseDirectory() + "/dicom/")
+      || !storedFileInfo.exists() || storedFileInfo.size() == 0)
+      {
+      std::cerr << "ctkDICOMDatabase: " << mode << " mode: file not stored in the database folder: "
+                << qPrintable(storedFile) << std::endl;
+      return false;
+      }
+    }
+  // Files stored ahead of their insert must all be referenced
+  int numberOfFilesInDatabaseFolder = 0;
+  QDirIterator it(database.databaseDirectory() + "/dicom", QDir::Files, QDirIterator::Subdirectories);
+  while (it.hasNext())
+    {
+    it.next();
+    ++numberOfFilesInDatabaseFolder;
+    }
+  if (numberOfFilesInDatabaseFolder != storedFiles.count())
+    {
+    std::cerr << "ctkDICOMDatabase: " << mode << " mode: " << numberOfFilesInDatabaseFolder
+              << " files in the database folder, expected " << storedFiles.count() << std::endl;
+    return false;
+    }
+  return true;
+}
+
+//------------------------------------------------------------------------------
+QStringList copyInputFiles(const QDir& inputDirectory, int argc, char* argv[])
+{
+  QStringList inputFiles;
+  for (int i = 1; i < argc; ++i)
+    {
+    QString inputFile = inputDirectory.absoluteFilePath(QFileInfo(argv[i]).fileName());
+    QFile::copy(argv[i], inputFile);
+    inputFiles << inputFile;
+    }
+  return inputFiles;
+}
+
+}
+
+int ctkDICOMDatabaseTest13( int argc, char * argv [] )
+{
+  QCoreApplication app(argc, argv);
+
+  if (argc < 3)
+    {
+    std::cerr << "ctkDICOMDatabaseTest13: missing dicom filePath arguments";
+    std::cerr << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  QDir testDirectory = QDir::temp();
+  ctk::removeDirRecursively(testDirectory.absoluteFilePath("ctkDICOMDatabaseTest13"));
+  testDirectory.mkpath("ctkDICOMDatabaseTest13");
+  testDirectory.cd("ctkDICOMDatabaseTest13");
+
+  ctkDICOMDatabase database;
+  database.openDatabase(testDirectory.absoluteFilePath("ctkDICOMDatabase.sql"));
+  if (!database.initializeDatabase())
+    {
+    std::cerr << "ctkDICOMDatabase::initializeDatabase() failed." << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  if (database.storageMode() != ctkDICOMDatabase::CopyFiles)
+    {
+    std::cerr << "ctkDICOMDatabase: files should be copied by default" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  const ctkDICOMDatabase::StorageMode modes[] = {
+    ctkDICOMDatabase::CopyFiles, ctkDICOMDatabase::HardLinkFiles,
+    ctkDICOMDatabase::ReflinkFiles, ctkDICOMDatabase::MoveFiles };
+  const char* modeNames[] = { "copy", "hard link", "reflink", "move" };
+  for (int modeIndex = 0; modeIndex < 4; ++modeIndex)
+    {
+    database.setStorageMode(modes[modeIndex]);
+    bool inputFilesKept = (modes[modeIndex] != ctkDICOMDatabase::MoveFiles);
+    // Separate input directory for each mode, so that the file manifest
+    // entries of the other modes are not counted
+    QDir inputDirectory(testDirectory.absoluteFilePath(QString("input-%1").arg(modeIndex)));
+    inputDirectory.mkpath(".");
+
+    // Insert one by one
+    QStringList inputFiles = copyInputFiles(inputDirectory, argc, argv);
+    foreach (const QString& inputFile, inputFiles)
+      {
+      database.insert(inputFile, true, false);
+      }
+    if (!checkStoredFiles(database, inputFiles, inputFilesKept, modeNames[modeIndex]))
+      {
+      return EXIT_FAILURE;
+      }
+    database.removeSeries(database.seriesForFile(database.allFiles()[0]));
+    ctk::removeDirRecursively(inputDirectory.absolutePath());
+    inputDirectory.mkpath(".");
+
+    // Files parsed by the worker threads of the indexer
+    inputFiles = copyInputFiles(inputDirectory, argc, argv);
+    ctkDICOMIndexer indexer;
+    indexer.setNumberOfParsingThreads(2);
+    indexer.addListOfFiles(database, inputFiles, testDirectory.absolutePath());
+    if (!checkStoredFiles(database, inputFiles, inputFilesKept, modeNames[modeIndex]))
+      {
+      return EXIT_FAILURE;
+      }
+    // Moved files are not in the input directory anymore
+    int manifestCount = database.fileManifest(inputDirectory.absolutePath()).count();
+    if (manifestCount != (inputFilesKept ? inputFiles.count() : 0))
+      {
+      std::cerr << "ctkDICOMDatabase: " << modeNames[modeIndex] << " mode: unexpected number of"
+                << " file manifest entries: " << manifestCount << std::endl;
+      return EXIT_FAILURE;
+      }
+
+    // Importing the same instances from other files keeps the stored files,
+    // the files placed by the worker threads are discarded (or moved back)
+    QDir reimportDirectory(testDirectory.absoluteFilePath(QString("reimport-%1").arg(modeIndex)));
+    reimportDirectory.mkpath(".");
+    QStringList reimportedFiles = copyInputFiles(reimportDirectory, argc, argv);
+    indexer.addListOfFiles(database, reimportedFiles, testDirectory.absolutePath());
+    if (!checkStoredFiles(database, reimportedFiles, true, modeNames[modeIndex]))
+      {
+      return EXIT_FAILURE;
+      }
+    ctk::removeDirRecursively(reimportDirectory.absolutePath());
+
+    database.removeSeries(database.seriesForFile(database.allFiles()[0]));
+    ctk::removeDirRecursively(inputDirectory.absolutePath());
+    inputDirectory.mkpath(".");
+    }
+
+  database.closeDatabase();
+
+  return EXIT_SUCCESS;
+}
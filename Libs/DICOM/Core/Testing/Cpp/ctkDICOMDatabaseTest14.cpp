@@ -0,0 +1,120 @@
+/*=========================================================================
+
+  Library:   CTK
+
+  Copyright (c) Kitware Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0.txt
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=========================================================================*/
+
+// Qt includes
+#include <QCoreApplication>
+#include <QStringList>
+
+// ctkDICOMCore includes
+#include "ctkDICOMDatabase.h"
+
+// STD includes
+#include <iostream>
+#include <cstdlib>
+
+namespace
+{
+
+//------------------------------------------------------------------------------
+bool checkSearch(ctkDICOMDatabase& database, const QString& text, const QString& table,
+                 const QStringList& expectedUIDs, int line)
+{
+  QStringList uids = database.searchUIDs(text, table);
+  if (uids != expectedUIDs)
+    {
+    std::cerr << "Line " << line << " - Searching '" << qPrintable(text) << "' in "
+              << qPrintable(table) << " returned (" << qPrintable(uids.join(", "))
+              << ") instead of (" << qPrintable(expectedUIDs.join(", ")) << ")" << std::endl;
+    return false;
+    }
+  return true;
+}
+
+}
+
+int ctkDICOMDatabaseTest14( int argc, char * argv [] )
+{
+  QCoreApplication app(argc, argv);
+
+  if (argc < 2)
+    {
+    std::cerr << "ctkDICOMDatabaseTest14: missing dicom filePath argument";
+    std::cerr << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  QString dicomFilePath(argv[1]);
+
+  ctkDICOMDatabase database;
+  database.openDatabase(":memory:");
+  if (!database.hasSearchIndex())
+    {
+    std::cerr << "ctkDICOMDatabase: search index was not created" << std::endl;
+    return EXIT_FAILURE;
+    }
+  if (!database.search("Facial").isEmpty())
+    {
+    std::cerr << "ctkDICOMDatabase: search in an empty database returned matches" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  database.insert(dicomFilePath, false, false);
+  QString seriesUID = database.seriesForFile(dicomFilePath);
+  QString studyUID = database.studyForSeries(seriesUID);
+  QString patientUID = database.patientForStudy(studyUID);
+
+  // Patient name is "Facial Expression", series description is "3D Cor T1 FAST IR-prepped GRE"
+  if (!checkSearch(database, "facial", "Patients", QStringList() << patientUID, __LINE__)
+    || !checkSearch(database, "EXPRESS fac", "Patients", QStringList() << patientUID, __LINE__)
+    || !checkSearch(database, "facial", "Series", QStringList(), __LINE__)
+    || !checkSearch(database, "cor gre", "Series", QStringList() << seriesUID, __LINE__)
+    || !checkSearch(database, "facial unknownword", "Patients", QStringList(), __LINE__)
+    || !checkSearch(database, "\" * OR", "Patients", QStringList(), __LINE__))
+    {
+    return EXIT_FAILURE;
+    }
+  if (database.search("prepped", QString(), 1).count() != 1)
+    {
+    std::cerr << "ctkDICOMDatabase: maximum number of matches is ignored" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // Index is kept up to date by the displayed fields update and by removals
+  database.updateDisplayedFields();
+  if (!checkSearch(database, "facial", "Patients", QStringList() << patientUID, __LINE__))
+    {
+    return EXIT_FAILURE;
+    }
+  if (!database.rebuildSearchIndex()
+    || !checkSearch(database, "cor", "Series", QStringList() << seriesUID, __LINE__))
+    {
+    return EXIT_FAILURE;
+    }
+  database.removeSeries(seriesUID);
+  if (!database.search("facial").isEmpty() || !database.search("cor").isEmpty())
+    {
+    std::cerr << "ctkDICOMDatabase: removed items are still found" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  database.closeDatabase();
+
+  return EXIT_SUCCESS;
+}
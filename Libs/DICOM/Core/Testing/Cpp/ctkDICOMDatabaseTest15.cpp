@@ -0,0 +1,167 @@
+/*=========================================================================
+
+  Library:   CTK
+
+  Copyright (c) Kitware Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0.txt
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=========================================================================*/
+
+// Qt includes
+#include <QCoreApplication>
+#include <QDir>
+#include <QRunnable>
+#include <QThreadPool>
+
+// CTK includes
+#include "ctkUtils.h"
+
+// ctkDICOMCore includes
+#include "ctkDICOMDatabase.h"
+
+// STD includes
+#include <iostream>
+#include <cstdlib>
+
+namespace
+{
+
+//------------------------------------------------------------------------------
+class ctkDICOMDatabaseTest15Reader : public QRunnable
+{
+public:
+  ctkDICOMDatabaseTest15Reader(ctkDICOMDatabase* database, const QString& seriesUID)
+    : Database(database)
+    , SeriesUID(seriesUID)
+    , NumberOfInstances(-1)
+  {
+    this->setAutoDelete(false);
+  }
+
+  virtual void run()
+  {
+    this->NumberOfInstances = this->Database->instancesForSeries(this->SeriesUID).count();
+  }
+
+  ctkDICOMDatabase* Database;
+  QString SeriesUID;
+  int NumberOfInstances;
+};
+
+//------------------------------------------------------------------------------
+int numberOfInstancesInThread(QThreadPool& pool, ctkDICOMDatabase& database, const QString& seriesUID)
+{
+  ctkDICOMDatabaseTest15Reader reader(&database, seriesUID);
+  pool.start(&reader);
+  pool.waitForDone();
+  return reader.NumberOfInstances;
+}
+
+}
+
+int ctkDICOMDatabaseTest15( int argc, char * argv [] )
+{
+  QCoreApplication app(argc, argv);
+
+  if (argc < 4)
+    {
+    std::cerr << "ctkDICOMDatabaseTest15: missing dicom filePath arguments";
+    std::cerr << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  ctkDICOMDatabase inMemoryDatabase;
+  inMemoryDatabase.openDatabase(":memory:");
+  if (inMemoryDatabase.beginReadSnapshot())
+    {
+    std::cerr << "ctkDICOMDatabase: read snapshot started in memory" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  QDir databaseDirectory = QDir::temp();
+  ctk::removeDirRecursively(databaseDirectory.absoluteFilePath("ctkDICOMDatabaseTest15"));
+  databaseDirectory.mkpath("ctkDICOMDatabaseTest15");
+  databaseDirectory.cd("ctkDICOMDatabaseTest15");
+
+  // A single reader thread, kept alive while the database is reopened
+  QThreadPool readerPool;
+  readerPool.setMaxThreadCount(1);
+  readerPool.setExpiryTimeout(-1);
+
+  ctkDICOMDatabase database;
+  database.openDatabase(databaseDirectory.absoluteFilePath("ctkDICOM.sql"));
+  if (!database.isOpen() || !database.readConnection().isOpen())
+    {
+    std::cerr << "ctkDICOMDatabase: failed to open reader connection: "
+              << qPrintable(database.lastError()) << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  database.insert(argv[1], false, false);
+  QString seriesUID = database.seriesForFile(argv[1]);
+  if (numberOfInstancesInThread(readerPool, database, seriesUID) != 1)
+    {
+    std::cerr << "ctkDICOMDatabase: failed to read from another thread" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // Readers are not blocked by an uncommitted write transaction
+  database.beginBatchInsert();
+  database.insert(argv[2], false, false);
+  int readerInstances = numberOfInstancesInThread(readerPool, database, seriesUID);
+  int writerInstances = database.instancesForSeries(seriesUID).count();
+  database.endBatchInsert();
+  if (readerInstances != 1 || writerInstances != 2)
+    {
+    std::cerr << "ctkDICOMDatabase: uncommitted insert: " << readerInstances
+              << " instances read from another thread, " << writerInstances
+              << " instances read from the database thread" << std::endl;
+    return EXIT_FAILURE;
+    }
+  if (numberOfInstancesInThread(readerPool, database, seriesUID) != 2)
+    {
+    std::cerr << "ctkDICOMDatabase: committed insert not read from another thread" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // Inserts committed during a snapshot are not seen by the snapshot
+  if (!database.beginReadSnapshot())
+    {
+    std::cerr << "ctkDICOMDatabase: failed to begin read snapshot" << std::endl;
+    return EXIT_FAILURE;
+    }
+  database.insert(argv[3], false, false);
+  int snapshotInstances = database.instancesForSeries(seriesUID).count();
+  database.endReadSnapshot();
+  if (snapshotInstances != 2 || database.instancesForSeries(seriesUID).count() != 3)
+    {
+    std::cerr << "ctkDICOMDatabase: read snapshot saw " << snapshotInstances
+              << " instances" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // The reader thread replaces its connection to the closed database
+  database.closeDatabase();
+  database.openDatabase(databaseDirectory.absoluteFilePath("ctkDICOM.sql"));
+  if (numberOfInstancesInThread(readerPool, database, seriesUID) != 3)
+    {
+    std::cerr << "ctkDICOMDatabase: failed to read from another thread after reopening" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  database.closeDatabase();
+  ctk::removeDirRecursively(databaseDirectory.absolutePath());
+
+  return EXIT_SUCCESS;
+}
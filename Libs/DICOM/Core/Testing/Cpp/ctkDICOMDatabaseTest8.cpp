@@ -0,0 +1,148 @@
+/*=========================================================================
+
+  Library:   CTK
+
+  Copyright (c) Kitware Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0.txt
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=========================================================================*/
+
+// Qt includes
+#include <QCoreApplication>
+#include <QDir>
+
+// ctkDICOMCore includes
+#include "ctkDICOMDatabase.h"
+#include "ctkDICOMItem.h"
+
+// STD includes
+#include <iostream>
+#include <cstdlib>
+
+
+int ctkDICOMDatabaseTest8( int argc, char * argv [] )
+{
+  QCoreApplication app(argc, argv);
+
+  if (argc < 3)
+    {
+    std::cerr << "ctkDICOMDatabaseTest8: missing dicom filePath arguments";
+    std::cerr << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  ctkDICOMDatabase database;
+  QDir databaseDirectory = QDir::temp();
+  databaseDirectory.remove("ctkDICOMDatabase.sql");
+  databaseDirectory.remove("ctkDICOMTagCache.sql");
+
+  QFileInfo databaseFile(databaseDirectory, QString("database.test"));
+  database.openDatabase(databaseFile.absoluteFilePath());
+
+  if (!database.initializeDatabase())
+    {
+    std::cerr << "ctkDICOMDatabase::initializeDatabase() failed." << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  //
+  // Batch insert of pre-parsed datasets
+  //
+  QList<ctkDICOMDatabase::IndexingResult> indexingResults;
+  for (int i = 1; i < argc; ++i)
+    {
+    ctkDICOMDatabase::IndexingResult indexingResult;
+    indexingResult.filePath = argv[i];
+    indexingResult.dataset = QSharedPointer<ctkDICOMItem>(new ctkDICOMItem);
+    indexingResult.dataset->InitializeFromFile(indexingResult.filePath);
+    indexingResult.storeFile = false;
+    indexingResult.generateThumbnail = false;
+    indexingResults << indexingResult;
+    }
+  // invalid dataset must be skipped
+  ctkDICOMDatabase::IndexingResult invalidIndexingResult;
+  invalidIndexingResult.filePath = "invalid.dcm";
+  indexingResults << invalidIndexingResult;
+
+  database.setInsertBatchSize(1);
+  if (database.insertBatchSize() != 1)
+    {
+    std::cerr << "ctkDICOMDatabase: insertBatchSize was not set" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  database.beginBatchInsert();
+  database.insert(indexingResults);
+  database.endBatchInsert();
+
+  QStringList allFiles = database.allFiles();
+  if (allFiles.count() != argc - 1)
+    {
+    std::cerr << "ctkDICOMDatabase: batch insert should have added " << argc - 1
+              << " files, database contains " << allFiles.count() << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  for (int i = 1; i < argc; ++i)
+    {
+    QString filePath(argv[i]);
+    if (!database.fileExistsAndUpToDate(filePath))
+      {
+      std::cerr << "ctkDICOMDatabase: " << qPrintable(filePath)
+                << " should be in the database after batch insert" << std::endl;
+      return EXIT_FAILURE;
+      }
+    }
+
+  if (database.patients().count() != 1)
+    {
+    std::cerr << "ctkDICOMDatabase: files of the same patient should create one patient, got "
+              << database.patients().count() << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  //
+  // Inserting the same batch again must not duplicate anything
+  //
+  database.prepareInsert();
+  database.insert(indexingResults);
+
+  if (database.allFiles().count() != argc - 1 || database.patients().count() != 1)
+    {
+    std::cerr << "ctkDICOMDatabase: repeated batch insert changed the database" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  //
+  // Removing a series and inserting it again must recreate the hierarchy
+  //
+  QString seriesUID = database.seriesForFile(argv[1]);
+  database.removeSeries(seriesUID);
+  if (!database.allFiles().isEmpty())
+    {
+    std::cerr << "ctkDICOMDatabase: removeSeries should have removed all files" << std::endl;
+    return EXIT_FAILURE;
+    }
+  database.insert(indexingResults);
+  if (database.allFiles().count() != argc - 1
+    || database.studyForSeries(seriesUID).isEmpty())
+    {
+    std::cerr << "ctkDICOMDatabase: batch insert after removeSeries failed" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  database.closeDatabase();
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,169 @@
+/*=========================================================================
+
+  Library:   CTK
+
+  Copyright (c) Kitware Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0.txt
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=========================================================================*/
+
+// Qt includes
+#include <QCoreApplication>
+#include <QDir>
+
+// ctkDICOMCore includes
+#include "ctkDICOMDatabase.h"
+
+// STD includes
+#include <iostream>
+#include <cstdlib>
+
+
+int ctkDICOMDatabaseTest9( int argc, char * argv [] )
+{
+  QCoreApplication app(argc, argv);
+
+  if (argc < 2)
+    {
+    std::cerr << "ctkDICOMDatabaseTest9: missing dicom filePath argument";
+    std::cerr << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  QString dicomFilePath(argv[1]);
+
+  ctkDICOMDatabase database;
+  QDir databaseDirectory = QDir::temp();
+  databaseDirectory.remove("ctkDICOMDatabase.sql");
+  databaseDirectory.remove("ctkDICOMTagCache.sql");
+
+  QFileInfo databaseFile(databaseDirectory, QString("database.test"));
+  database.openDatabase(databaseFile.absoluteFilePath());
+
+  if (!database.initializeDatabase())
+    {
+    std::cerr << "ctkDICOMDatabase::initializeDatabase() failed." << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  QString instanceUID("1.2.840.113619.2.135.3596.6358736.4843.1115808177.83");
+  QString tag("0008,103e");
+  QString badTag("9999,9999");
+  QString knownSeriesDescription("3D Cor T1 FAST IR-prepped GRE");
+
+  QStringList tagsToPrecache;
+  tagsToPrecache << tag;
+  database.setTagsToPrecache(tagsToPrecache);
+  database.insert(dicomFilePath, false, false);
+  // store the sentinel value of a missing tag as well
+  if (database.instanceValue(instanceUID, badTag) != QString(""))
+    {
+    std::cerr << "ctkDICOMDatabase: bad tag should have empty value" << std::endl;
+    return EXIT_FAILURE;
+    }
+  QString seriesUID = database.seriesForFile(dicomFilePath);
+
+  //
+  // Prefetch the series, all lookups must be served from memory
+  //
+  database.setTagCacheMemoryBudget(0);
+  database.setTagCacheMemoryBudget(1024 * 1024);
+  database.resetTagCacheStatistics();
+  if (!database.prefetchCachedTagsForSeries(seriesUID))
+    {
+    std::cerr << "ctkDICOMDatabase::prefetchCachedTagsForSeries() failed." << std::endl;
+    return EXIT_FAILURE;
+    }
+  if (database.cachedTag(instanceUID, tag) != knownSeriesDescription
+    || database.cachedTag(instanceUID, badTag) != QString("__TAG_NOT_IN_INSTANCE__")
+    || database.cachedTag(instanceUID, "0010,0010") != QString(""))
+    {
+    std::cerr << "ctkDICOMDatabase: prefetched tag cache returned wrong values" << std::endl;
+    return EXIT_FAILURE;
+    }
+  QMap<QString, QString> cachedTags;
+  database.getCachedTags(instanceUID, cachedTags);
+  if (cachedTags.value(tag) != knownSeriesDescription
+    || !cachedTags.contains(badTag) || cachedTags.value(badTag) != QString(""))
+    {
+    std::cerr << "ctkDICOMDatabase: prefetched cached tags are wrong" << std::endl;
+    return EXIT_FAILURE;
+    }
+  if (database.tagCacheHitCount() != 4 || database.tagCacheMissCount() != 0)
+    {
+    std::cerr << "ctkDICOMDatabase: unexpected tag cache statistics after prefetch: "
+              << database.tagCacheHitCount() << " hits, "
+              << database.tagCacheMissCount() << " misses" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  //
+  // Without prefetch, the first lookup is a miss and the following are hits
+  //
+  database.setTagCacheMemoryBudget(0);
+  database.setTagCacheMemoryBudget(1024 * 1024);
+  database.resetTagCacheStatistics();
+  if (database.cachedTag(instanceUID, tag) != knownSeriesDescription
+    || database.cachedTag(instanceUID, tag) != knownSeriesDescription)
+    {
+    std::cerr << "ctkDICOMDatabase: tag cache returned wrong value" << std::endl;
+    return EXIT_FAILURE;
+    }
+  if (database.tagCacheHitCount() != 1 || database.tagCacheMissCount() != 1)
+    {
+    std::cerr << "ctkDICOMDatabase: unexpected tag cache statistics: "
+              << database.tagCacheHitCount() << " hits, "
+              << database.tagCacheMissCount() << " misses" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  //
+  // Writes go through to the in-memory cache
+  //
+  database.cacheTag(instanceUID, tag, "Modified description");
+  if (database.cachedTag(instanceUID, tag) != QString("Modified description"))
+    {
+    std::cerr << "ctkDICOMDatabase: cached tag was not updated in memory" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  //
+  // Removing the series invalidates the in-memory cache
+  //
+  database.resetTagCacheStatistics();
+  database.removeSeries(seriesUID);
+  database.cachedTag(instanceUID, tag);
+  if (database.tagCacheMissCount() != 1)
+    {
+    std::cerr << "ctkDICOMDatabase: removed series should not be cached in memory" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  //
+  // Disabled cache always reads the database
+  //
+  database.setTagCacheMemoryBudget(0);
+  database.resetTagCacheStatistics();
+  database.cachedTag(instanceUID, tag);
+  database.cachedTag(instanceUID, tag);
+  if (database.tagCacheHitCount() != 0 || database.tagCacheMissCount() != 2)
+    {
+    std::cerr << "ctkDICOMDatabase: disabled tag cache should not serve values from memory" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  database.closeDatabase();
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,207 @@
+/*=========================================================================
+
+  Library:   CTK
+
+  Copyright (c) Kitware Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0.txt
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=========================================================================*/
+
+// Qt includes
+#include <QCoreApplication>
+#include <QDir>
+#include <QFileInfo>
+
+// CTK includes
+#include "ctkUtils.h"
+
+// ctkDICOMCore includes
+#include "ctkDICOMDatabase.h"
+#include "ctkDICOMExporter.h"
+
+// STD includes
+#include <iostream>
+#include <cstdlib>
+
+namespace
+{
+
+//------------------------------------------------------------------------------
+bool checkExportedFiles(const QDir& exportDirectory, const QStringList& inputFiles,
+                        const QStringList& expectedFiles, const char* mode)
+{
+  if (expectedFiles.count() != inputFiles.count())
+    {
+    std::cerr << "ctkDICOMExporter: " << mode << " mode: wrong number of expected files" << std::endl;
+    return false;
+    }
+  for (int i = 0; i < expectedFiles.count(); ++i)
+    {
+    QFileInfo exportedFile(exportDirectory.absoluteFilePath(expectedFiles[i]));
+    if (!exportedFile.exists() || exportedFile.size() != QFileInfo(inputFiles[i]).size())
+      {
+      std::cerr << "ctkDICOMExporter: " << mode << " mode: file not exported: "
+                << qPrintable(exportedFile.absoluteFilePath()) << std::endl;
+      return false;
+      }
+    }
+  return true;
+}
+
+}
+
+int ctkDICOMExporterTest1( int argc, char * argv [] )
+{
+  QCoreApplication app(argc, argv);
+
+  if (argc < 3)
+    {
+    std::cerr << "ctkDICOMExporterTest1: missing dicom filePath arguments";
+    std::cerr << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  QDir testDirectory = QDir::temp();
+  ctk::removeDirRecursively(testDirectory.absoluteFilePath("ctkDICOMExporterTest1"));
+  testDirectory.mkpath("ctkDICOMExporterTest1");
+  testDirectory.cd("ctkDICOMExporterTest1");
+
+  ctkDICOMDatabase database;
+  database.openDatabase(":memory:");
+  QStringList inputFiles;
+  for (int i = 1; i < argc; ++i)
+    {
+    database.insert(argv[i], false, false);
+    inputFiles << argv[i];
+    }
+  QString seriesUID = database.seriesForFile(inputFiles[0]);
+  QStringList seriesFiles = database.filesForSeries(seriesUID);
+
+  ctkDICOMExporter exporter;
+  if (exporter.exportSeries(testDirectory.absolutePath(), QStringList() << seriesUID))
+    {
+    std::cerr << "ctkDICOMExporter: export started without database" << std::endl;
+    return EXIT_FAILURE;
+    }
+  exporter.setDatabase(&database);
+  exporter.setMaximumNumberOfThreads(2);
+
+  // Default layout
+  if (!exporter.exportSeries(testDirectory.absoluteFilePath("default"), QStringList() << seriesUID)
+    || !exporter.waitForDone()
+    || exporter.numberOfFiles() != seriesFiles.count()
+    || exporter.numberOfExportedFiles() != seriesFiles.count()
+    || !exporter.errorString().isEmpty())
+    {
+    std::cerr << "ctkDICOMExporter: default mode: export failed: "
+              << qPrintable(exporter.errorString()) << std::endl;
+    return EXIT_FAILURE;
+    }
+  QDir defaultDirectory(testDirectory.absoluteFilePath("default"));
+  // Patient, study and series directories
+  QDir seriesDirectory(defaultDirectory);
+  for (int level = 0; level < 3; ++level)
+    {
+    QStringList subdirectories = seriesDirectory.entryList(QDir::Dirs | QDir::NoDotAndDotDot);
+    if (subdirectories.count() != 1)
+      {
+      std::cerr << "ctkDICOMExporter: default mode: expected one directory in "
+                << qPrintable(seriesDirectory.absolutePath()) << std::endl;
+      return EXIT_FAILURE;
+      }
+    seriesDirectory.cd(subdirectories[0]);
+    }
+  QStringList expectedFiles;
+  for (int i = 0; i < seriesFiles.count(); ++i)
+    {
+    expectedFiles << QString("%1.dcm").arg(i, 6, 10, QChar('0'));
+    }
+  if (!checkExportedFiles(seriesDirectory, seriesFiles, expectedFiles, "default"))
+    {
+    return EXIT_FAILURE;
+    }
+
+  // Exporting again must not overwrite the exported files
+  if (!exporter.exportSeries(defaultDirectory.absolutePath(), QStringList() << seriesUID)
+    || !exporter.waitForDone()
+    || exporter.errorString().isEmpty())
+    {
+    std::cerr << "ctkDICOMExporter: existing files were overwritten" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // DICOMDIR layout
+  exporter.setWriteDICOMDIR(true);
+  QDir dicomDirDirectory(testDirectory.absoluteFilePath("dicomdir"));
+  if (!exporter.exportStudies(dicomDirDirectory.absolutePath(),
+                              QStringList() << database.studyForSeries(seriesUID))
+    || !exporter.waitForDone()
+    || !exporter.errorString().isEmpty())
+    {
+    std::cerr << "ctkDICOMExporter: DICOMDIR mode: export failed: "
+              << qPrintable(exporter.errorString()) << std::endl;
+    return EXIT_FAILURE;
+    }
+  expectedFiles.clear();
+  for (int i = 0; i < seriesFiles.count(); ++i)
+    {
+    expectedFiles << QString("DICOM/PAT00001/STU00001/SER00001/IMG%1").arg(i + 1, 5, 10, QChar('0'));
+    }
+  if (!checkExportedFiles(dicomDirDirectory, seriesFiles, expectedFiles, "DICOMDIR")
+    || !dicomDirDirectory.exists("DICOMDIR"))
+    {
+    std::cerr << "ctkDICOMExporter: DICOMDIR mode: DICOMDIR not written" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // All the files of the patients are looked up at once
+  QString studyUID = database.studyForSeries(seriesUID);
+  QString patientUID = database.patientForStudy(studyUID);
+  int numberOfPatientFiles = 0;
+  foreach (const QString& patientStudyUID, database.studiesForPatient(patientUID))
+    {
+    foreach (const QString& patientSeriesUID, database.seriesForStudy(patientStudyUID))
+      {
+      numberOfPatientFiles += database.filesForSeries(patientSeriesUID).count();
+      }
+    }
+  if (!exporter.exportPatients(testDirectory.absoluteFilePath("patients"), QStringList() << patientUID)
+    || !exporter.waitForDone()
+    || exporter.numberOfFiles() != numberOfPatientFiles
+    || exporter.numberOfExportedFiles() != numberOfPatientFiles
+    || !exporter.errorString().isEmpty())
+    {
+    std::cerr << "ctkDICOMExporter: patients export failed: " << exporter.numberOfExportedFiles()
+              << " files exported, expected " << numberOfPatientFiles << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // Canceled export
+  if (!exporter.exportSeries(testDirectory.absoluteFilePath("canceled"), QStringList() << seriesUID))
+    {
+    std::cerr << "ctkDICOMExporter: canceled export failed to start" << std::endl;
+    return EXIT_FAILURE;
+    }
+  exporter.cancel();
+  if (!exporter.waitForDone() || !exporter.wasCanceled() || exporter.isRunning())
+    {
+    std::cerr << "ctkDICOMExporter: export was not canceled" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  database.closeDatabase();
+  ctk::removeDirRecursively(testDirectory.absolutePath());
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,138 @@
+/*=========================================================================
+
+  Library:   CTK
+
+  Copyright (c) Kitware Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0.txt
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=========================================================================*/
+
+// Qt includes
+#include <QCoreApplication>
+#include <QDir>
+
+// ctkDICOMCore includes
+#include "ctkDICOMDatabase.h"
+#include "ctkDICOMIndexer.h"
+
+// STD includes
+#include <iostream>
+#include <cstdlib>
+
+namespace
+{
+
+//------------------------------------------------------------------------------
+bool openTestDatabase(ctkDICOMDatabase& database, const QString& subdirectory)
+{
+  QDir databaseDirectory = QDir::temp();
+  databaseDirectory.mkpath(subdirectory);
+  databaseDirectory.cd(subdirectory);
+  databaseDirectory.remove("ctkDICOMDatabase.sql");
+  databaseDirectory.remove("ctkDICOMTagCache.sql");
+
+  QFileInfo databaseFile(databaseDirectory, QString("ctkDICOMDatabase.sql"));
+  database.openDatabase(databaseFile.absoluteFilePath());
+  if (!database.lastError().isEmpty() || !database.initializeDatabase())
+  {
+    std::cerr << "ctkDICOMDatabase::openDatabase() failed: "
+              << qPrintable(database.lastError()) << std::endl;
+    return false;
+  }
+  return true;
+}
+
+//------------------------------------------------------------------------------
+int numberOfInstances(ctkDICOMDatabase& database)
+{
+  int count = 0;
+  foreach (const QString& patient, database.patients())
+  {
+    foreach (const QString& study, database.studiesForPatient(patient))
+    {
+      foreach (const QString& series, database.seriesForStudy(study))
+      {
+        count += database.instancesForSeries(series).count();
+      }
+    }
+  }
+  return count;
+}
+
+}
+
+int ctkDICOMIndexerTest2( int argc, char * argv [] )
+{
+  QCoreApplication app(argc, argv);
+
+  if (argc < 2)
+  {
+    std::cerr << "ctkDICOMIndexerTest2: missing dicom directory argument";
+    std::cerr << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  QString dicomDirectory(argv[1]);
+
+  // Index the same directory once serially and once with parsing workers
+  ctkDICOMDatabase serialDatabase;
+  ctkDICOMDatabase parallelDatabase;
+  if (!openTestDatabase(serialDatabase, "ctkDICOMIndexerTest2Serial")
+    || !openTestDatabase(parallelDatabase, "ctkDICOMIndexerTest2Parallel"))
+  {
+    return EXIT_FAILURE;
+  }
+
+  ctkDICOMIndexer indexer;
+  if (indexer.numberOfParsingThreads() < 1)
+  {
+    std::cerr << "ctkDICOMIndexer: parsing threads should be used by default" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  indexer.setNumberOfParsingThreads(0);
+  indexer.addDirectory(serialDatabase, dicomDirectory);
+
+  indexer.setNumberOfParsingThreads(4);
+  indexer.addDirectory(parallelDatabase, dicomDirectory);
+
+  int serialCount = numberOfInstances(serialDatabase);
+  int parallelCount = numberOfInstances(parallelDatabase);
+  if (serialCount == 0 || serialCount != parallelCount)
+  {
+    std::cerr << "ctkDICOMIndexer: parallel indexing inserted " << parallelCount
+              << " instances, serial indexing inserted " << serialCount << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  if (serialDatabase.patients().count() != parallelDatabase.patients().count())
+  {
+    std::cerr << "ctkDICOMIndexer: parallel indexing created a different number of patients"
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Indexing again must skip all files that are already up-to-date
+  indexer.addDirectory(parallelDatabase, dicomDirectory);
+  if (numberOfInstances(parallelDatabase) != parallelCount)
+  {
+    std::cerr << "ctkDICOMIndexer: re-indexing changed the number of instances" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  serialDatabase.closeDatabase();
+  parallelDatabase.closeDatabase();
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,194 @@
+/*=========================================================================
+
+  Library:   CTK
+
+  Copyright (c) Kitware Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0.txt
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=========================================================================*/
+
+// Qt includes
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+
+// ctkCore includes
+#include "ctkUtils.h"
+
+// ctkDICOMCore includes
+#include "ctkDICOMDatabase.h"
+#include "ctkDICOMIndexer.h"
+
+// STD includes
+#include <iostream>
+#include <cstdlib>
+
+namespace
+{
+
+//------------------------------------------------------------------------------
+int numberOfInstances(ctkDICOMDatabase& database)
+{
+  int count = 0;
+  foreach (const QString& patient, database.patients())
+  {
+    foreach (const QString& study, database.studiesForPatient(patient))
+    {
+      foreach (const QString& series, database.seriesForStudy(study))
+      {
+        count += database.instancesForSeries(series).count();
+      }
+    }
+  }
+  return count;
+}
+
+//------------------------------------------------------------------------------
+bool checkState(ctkDICOMDatabase& database, const QString& directory,
+                int expectedInstances, int expectedManifestEntries, const char* step)
+{
+  int instances = numberOfInstances(database);
+  int manifestEntries = database.fileManifest(directory).count();
+  if (instances != expectedInstances || manifestEntries != expectedManifestEntries)
+  {
+    std::cerr << "ctkDICOMIndexer: after " << step << " found " << instances
+              << " instances and " << manifestEntries << " manifest entries, expected "
+              << expectedInstances << " and " << expectedManifestEntries << std::endl;
+    return false;
+  }
+  return true;
+}
+
+//------------------------------------------------------------------------------
+bool testRefresh(const QDir& testDirectory, char* argv[], bool copyFiles, const char* mode)
+{
+  QString modeDirectory = testDirectory.absoluteFilePath(mode);
+  QString filesDirectory = modeDirectory + "/files";
+  QDir().mkpath(filesDirectory + "/sub");
+
+  QStringList copiedFiles;
+  for (int i = 1; i < 4; ++i)
+  {
+    QString copiedFile = filesDirectory + "/sub/" + QFileInfo(argv[i]).fileName();
+    QFile::copy(argv[i], copiedFile);
+    copiedFiles << copiedFile;
+  }
+  QFile textFile(filesDirectory + "/readme.txt");
+  textFile.open(QIODevice::WriteOnly);
+  textFile.write("not a DICOM file");
+  textFile.close();
+
+  ctkDICOMDatabase database;
+  database.openDatabase(modeDirectory + "/ctkDICOMDatabase.sql");
+  if (!database.lastError().isEmpty() || !database.initializeDatabase())
+  {
+    std::cerr << "ctkDICOMDatabase::openDatabase() failed: "
+              << qPrintable(database.lastError()) << std::endl;
+    return false;
+  }
+
+  ctkDICOMIndexer indexer;
+
+  // Inserted files are recorded in the manifest. Files stored in the database
+  // folder are referenced at their stored file, which is recorded as well.
+  indexer.addDirectory(database, filesDirectory, copyFiles ? modeDirectory : QString());
+  if (!checkState(database, filesDirectory, 3, 3, "addDirectory"))
+  {
+    return false;
+  }
+  if (database.fileManifest(modeDirectory + "/file").count() != 0)
+  {
+    std::cerr << "ctkDICOMDatabase::fileManifest returned files of another directory" << std::endl;
+    return false;
+  }
+
+  // Nothing changed, the non-DICOM file is recorded so that it is not read again
+  indexer.refreshDatabase(database, filesDirectory);
+  if (!checkState(database, filesDirectory, 3, 4, "first refresh"))
+  {
+    return false;
+  }
+
+  // Removed file
+  QFile::remove(copiedFiles[0]);
+  indexer.refreshDatabase(database, filesDirectory);
+  if (!checkState(database, filesDirectory, 2, 3, "removing a file"))
+  {
+    return false;
+  }
+
+  // New file
+  QFile::copy(argv[1], copiedFiles[0]);
+  indexer.refreshDatabase(database, filesDirectory);
+  if (!checkState(database, filesDirectory, 3, 4, "adding a file"))
+  {
+    return false;
+  }
+
+  // Modified file: overwritten by another instance
+  QFile sourceFile(argv[3]);
+  QFile modifiedFile(copiedFiles[1]);
+  if (!sourceFile.open(QIODevice::ReadOnly) || !modifiedFile.open(QIODevice::WriteOnly | QIODevice::Truncate))
+  {
+    std::cerr << "ctkDICOMIndexerTest3: failed to overwrite " << qPrintable(copiedFiles[1]) << std::endl;
+    return false;
+  }
+  modifiedFile.write(sourceFile.readAll());
+  modifiedFile.close();
+  indexer.refreshDatabase(database, filesDirectory);
+  if (!checkState(database, filesDirectory, 2, 4, "modifying a file"))
+  {
+    return false;
+  }
+
+  // Whole directory removed
+  ctk::removeDirRecursively(filesDirectory);
+  indexer.refreshDatabase(database, filesDirectory);
+  if (!checkState(database, filesDirectory, 0, 0, "removing the directory")
+    || database.patients().count() != 0)
+  {
+    return false;
+  }
+
+  database.closeDatabase();
+  return true;
+}
+
+}
+
+int ctkDICOMIndexerTest3( int argc, char * argv [] )
+{
+  QCoreApplication app(argc, argv);
+
+  if (argc < 4)
+  {
+    std::cerr << "ctkDICOMIndexerTest3: missing dicom filePath arguments";
+    std::cerr << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  QDir testDirectory = QDir::temp();
+  ctk::removeDirRecursively(testDirectory.absoluteFilePath("ctkDICOMIndexerTest3"));
+  testDirectory.mkpath("ctkDICOMIndexerTest3");
+  testDirectory.cd("ctkDICOMIndexerTest3");
+
+  if (!testRefresh(testDirectory, argv, false, "referenced")
+    || !testRefresh(testDirectory, argv, true, "stored"))
+  {
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,209 @@
+/*=========================================================================
+
+  Library:   CTK
+
+  Copyright (c) Kitware Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0.txt
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=========================================================================*/
+
+// Qt includes
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QSqlQuery>
+
+// ctkCore includes
+#include "ctkUtils.h"
+
+// ctkDICOMCore includes
+#include "ctkDICOMDatabase.h"
+#include "ctkDICOMIndexer.h"
+
+// DCMTK includes
+#include <dcmtk/dcmdata/dcddirif.h>
+
+// STD includes
+#include <iostream>
+#include <cstdlib>
+
+namespace
+{
+
+//------------------------------------------------------------------------------
+bool openTestDatabase(ctkDICOMDatabase& database, const QDir& directory)
+{
+  database.openDatabase(directory.absoluteFilePath("ctkDICOMDatabase.sql"));
+  if (!database.lastError().isEmpty() || !database.initializeDatabase())
+  {
+    std::cerr << "ctkDICOMDatabase::openDatabase() failed: "
+              << qPrintable(database.lastError()) << std::endl;
+    return false;
+  }
+  return true;
+}
+
+//------------------------------------------------------------------------------
+int numberOfUpToDateFiles(ctkDICOMDatabase& database, const QStringList& files)
+{
+  int count = 0;
+  foreach (const QString& file, files)
+  {
+    if (database.fileExistsAndUpToDate(file))
+    {
+      ++count;
+    }
+  }
+  return count;
+}
+
+//------------------------------------------------------------------------------
+bool hasRowsFromDirectoryRecords(ctkDICOMDatabase& database, bool expected)
+{
+  const char* tables[] = { "Patients", "Studies", "Series", "Images" };
+  for (int i = 0; i < 4; ++i)
+  {
+    QSqlQuery query(database.database());
+    query.exec(QString("SELECT COUNT(*) FROM %1 WHERE FromDirectoryRecords = 1").arg(tables[i]));
+    if (!query.next() || (query.value(0).toInt() > 0) != expected)
+    {
+      std::cerr << "ctkDICOMIndexer: rows of table " << tables[i]
+                << (expected ? " are not" : " are still") << " flagged as created from DICOMDIR records" << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+}
+
+int ctkDICOMIndexerTest4( int argc, char * argv [] )
+{
+  QCoreApplication app(argc, argv);
+
+  if (argc < 3)
+  {
+    std::cerr << "ctkDICOMIndexerTest4: missing dicom filePath arguments";
+    std::cerr << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  QDir testDirectory = QDir::temp();
+  ctk::removeDirRecursively(testDirectory.absoluteFilePath("ctkDICOMIndexerTest4"));
+  testDirectory.mkpath("ctkDICOMIndexerTest4/media/IMAGES");
+  testDirectory.cd("ctkDICOMIndexerTest4");
+  QString mediaDirectory = testDirectory.absoluteFilePath("media");
+
+  // Create a DICOMDIR that references copies of the input files
+  QString currentPath = QDir::currentPath();
+  QDir::setCurrent(mediaDirectory);
+  DicomDirInterface dicomDir;
+  dicomDir.enableInventMode(OFTrue);
+  if (dicomDir.createNewDicomDir(DicomDirInterface::AP_GeneralPurpose, "DICOMDIR").bad())
+  {
+    std::cerr << "ctkDICOMIndexerTest4: failed to create DICOMDIR" << std::endl;
+    return EXIT_FAILURE;
+  }
+  QStringList mediaFiles;
+  for (int i = 1; i < argc; ++i)
+  {
+    QString fileID = QString("IMAGES/IM%1").arg(i, 6, 10, QLatin1Char('0'));
+    QFile::copy(argv[i], fileID);
+    if (dicomDir.addDicomFile(fileID.toLatin1().constData()).bad())
+    {
+      std::cerr << "ctkDICOMIndexerTest4: failed to add " << argv[i] << " to DICOMDIR" << std::endl;
+      return EXIT_FAILURE;
+    }
+    mediaFiles << mediaDirectory + "/" + fileID;
+  }
+  dicomDir.writeDicomDir();
+  QDir::setCurrent(currentPath);
+
+  ctkDICOMDatabase database;
+  if (!openTestDatabase(database, testDirectory))
+  {
+    return EXIT_FAILURE;
+  }
+  ctkDICOMIndexer indexer;
+  if (!indexer.useDicomdirRecords() || !indexer.completeDicomdirInstances())
+  {
+    std::cerr << "ctkDICOMIndexer: DICOMDIR records should be used by default" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Instances are inserted from the records only, without reading the files
+  indexer.setCompleteDicomdirInstances(false);
+  if (!indexer.addDicomdir(database, mediaDirectory))
+  {
+    std::cerr << "ctkDICOMIndexer::addDicomdir failed" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (database.allFiles().count() != mediaFiles.count()
+    || database.seriesForFile(mediaFiles[0]).isEmpty()
+    || database.patients().count() != 1)
+  {
+    std::cerr << "ctkDICOMIndexer: instances were not inserted from DICOMDIR records" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (numberOfUpToDateFiles(database, mediaFiles) != 0)
+  {
+    std::cerr << "ctkDICOMIndexer: instances inserted from records must not be up-to-date" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (!hasRowsFromDirectoryRecords(database, true))
+  {
+    return EXIT_FAILURE;
+  }
+
+  // Reading the files completes the instances, also after the database is reopened
+  database.closeDatabase();
+  database.openDatabase(testDirectory.absoluteFilePath("ctkDICOMDatabase.sql"));
+  if (numberOfUpToDateFiles(database, mediaFiles) != 0)
+  {
+    std::cerr << "ctkDICOMIndexer: instances inserted from records must not be up-to-date after reopening" << std::endl;
+    return EXIT_FAILURE;
+  }
+  indexer.addListOfFiles(database, mediaFiles);
+  if (database.allFiles().count() != mediaFiles.count()
+    || numberOfUpToDateFiles(database, mediaFiles) != mediaFiles.count()
+    || database.patients().count() != 1)
+  {
+    std::cerr << "ctkDICOMIndexer: instances inserted from records were not completed" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (!hasRowsFromDirectoryRecords(database, false))
+  {
+    return EXIT_FAILURE;
+  }
+
+  // Both stages in one call
+  database.closeDatabase();
+  if (!openTestDatabase(database, testDirectory))
+  {
+    return EXIT_FAILURE;
+  }
+  indexer.setCompleteDicomdirInstances(true);
+  indexer.addDicomdir(database, mediaDirectory);
+  if (database.allFiles().count() != mediaFiles.count()
+    || numberOfUpToDateFiles(database, mediaFiles) != mediaFiles.count()
+    || database.patients().count() != 1)
+  {
+    std::cerr << "ctkDICOMIndexer: addDicomdir did not complete the instances" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  database.closeDatabase();
+
+  return EXIT_SUCCESS;
+}
@@ -21,6 +21,9 @@
 // ctkDICOMCore includes
 #include "ctkDICOMItem.h"
 
+// DCMTK includes
+#include <dcmtk/dcmdata/dcdeftag.h>
+
 // STD includes
 #include <iostream>
 
@@ -62,6 +65,29 @@ int ctkDICOMItemTest1( int argc, char * argv [] )
     //return EXIT_FAILURE;
     }
 
+  // Binary serialization round trip
+  ctkDICOMItem item;
+  item.InitializeFromItem(new DcmDataset(), true);
+  item.SetElementAsString(DCM_PatientID, "ctkDICOMItemTest1");
+  item.SetElementAsString(DCM_PatientName, "Doe^John");
+  QByteArray serializedItem = item.SerializeToByteArray();
+  ctkDICOMItem restoredItem;
+  if (serializedItem.isEmpty()
+    || !restoredItem.InitializeFromByteArray(serializedItem)
+    || restoredItem.GetElementAsString(DCM_PatientID) != "ctkDICOMItemTest1"
+    || restoredItem.GetElementAsString(DCM_PatientName) != "Doe^John")
+    {
+    std::cerr << "ctkDICOMItem::SerializeToByteArray() failed" << std::endl;
+    return EXIT_FAILURE;
+    }
+  // A caller supplied buffer is resized to the dataset
+  QByteArray buffer(1024 * 1024, '\0');
+  if (!item.SerializeToByteArray(buffer) || buffer != serializedItem)
+    {
+    std::cerr << "ctkDICOMItem::SerializeToByteArray(QByteArray&) failed" << std::endl;
+    return EXIT_FAILURE;
+    }
+
   // deactivating the lower part since it (correctly) causes
   // execptions since it calls methods on an uninitialized object
   return EXIT_SUCCESS;
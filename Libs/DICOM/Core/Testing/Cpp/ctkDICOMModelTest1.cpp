@@ -21,8 +21,11 @@
 // Qt includes
 #include <QCoreApplication>
 #include <QDebug>
+#include <QEventLoop>
+#include <QFile>
 #include <QFileInfo>
 #include <QSqlQuery>
+#include <QTimer>
 
 // ctkDICOMCore includes
 #include "ctkDICOMDatabase.h"
@@ -88,6 +91,104 @@ int ctkDICOMModelTest1( int argc, char * argv [] )
     qDebug() << model.rowCount() << model.columnCount();
     qDebug() << model.index(0,0);
 
+    QSqlQuery countQuery("SELECT COUNT(*) FROM Patients", myCTK.database());
+    countQuery.next();
+    int patientCount = countQuery.value(0).toInt();
+    countQuery.finish();
+
+    // Pages are fetched with keyset pagination, make sure every patient shows
+    // up exactly once whatever the sort.
+    model.sort(0, Qt::DescendingOrder);
+    while (model.canFetchMore(QModelIndex()))
+      {
+      model.fetchMore(QModelIndex());
+      }
+    if (model.rowCount() != patientCount)
+      {
+      std::cerr << "Line " << __LINE__ << " - Wrong number of patients: "
+                << model.rowCount() << ", expected " << patientCount << std::endl;
+      return EXIT_FAILURE;
+      }
+
+    // Searches are delayed and run in the background, only the last one is
+    // applied.
+    QEventLoop searchLoop;
+    QObject::connect(&model, SIGNAL(searchFinished()), &searchLoop, SLOT(quit()));
+    model.setSearchDelay(10);
+
+    QMap<QString, QVariant> parameters;
+    parameters["Name"] = QString("Austrialian");
+    model.setSearchParameters(parameters);
+    parameters["Name"] = QString("\"' no patient has this name");
+    model.setSearchParameters(parameters);
+    QTimer::singleShot(10000, &searchLoop, SLOT(quit()));
+    searchLoop.exec();
+    if (model.isSearching() || model.rowCount() != 0)
+      {
+      std::cerr << "Line " << __LINE__ << " - Search failed: "
+                << model.rowCount() << " patients found" << std::endl;
+      return EXIT_FAILURE;
+      }
+
+    parameters["Name"] = QString("Austrialian");
+    model.setSearchParameters(parameters);
+    QTimer::singleShot(10000, &searchLoop, SLOT(quit()));
+    searchLoop.exec();
+    if (model.rowCount() != 1 ||
+        model.data(model.index(0, 0)).toString() != "Austrialian" ||
+        !model.hasChildren(model.index(0, 0)))
+      {
+      std::cerr << "Line " << __LINE__ << " - Search failed: "
+                << model.rowCount() << " patients found" << std::endl;
+      return EXIT_FAILURE;
+      }
+
+    // A search that can't be run is reported, it doesn't empty the model.
+    // Searches open their own connection, which doesn't see the temporary
+    // table that the model shows, so they fail on a separate database.
+    QString unsearchableFileName = QFileInfo(argv[1]).absoluteFilePath() + ".unsearchable";
+    QFile::remove(unsearchableFileName);
+    bool failedSearchReported = false;
+    {
+      QSqlDatabase unsearchable = QSqlDatabase::addDatabase("QSQLITE", "ctkDICOMModelTest1_unsearchable");
+      unsearchable.setDatabaseName(unsearchableFileName);
+      bool opened = unsearchable.open();
+      QSqlQuery createQuery(unsearchable);
+      if (!opened ||
+          !createQuery.exec("CREATE TABLE Placeholder (UID INTEGER)") ||
+          !createQuery.exec("CREATE TEMP TABLE Patients (UID INTEGER PRIMARY KEY, PatientsName VARCHAR(255), "
+                            "PatientsAge VARCHAR(10), PatientsBirthDate DATE, PatientID VARCHAR(255))") ||
+          !createQuery.exec("INSERT INTO Patients VALUES (1, 'Austrialian', '', '', '1')"))
+        {
+        std::cerr << "Line " << __LINE__ << " - Cannot create database "
+                  << qPrintable(unsearchableFileName) << std::endl;
+        return EXIT_FAILURE;
+        }
+      createQuery.finish();
+
+      model.setDatabase(unsearchable);
+      QEventLoop failedSearchLoop;
+      QObject::connect(&model, SIGNAL(searchFailed(QString)), &failedSearchLoop, SLOT(quit()));
+      parameters["Name"] = QString("no patient has this name");
+      model.setSearchParameters(parameters);
+      QTimer::singleShot(10000, &failedSearchLoop, SLOT(quit()));
+      failedSearchLoop.exec();
+      failedSearchReported = !model.isSearching() && model.rowCount() == 1;
+      if (!failedSearchReported)
+        {
+        std::cerr << "Line " << __LINE__ << " - Failed search not reported: "
+                  << model.rowCount() << " patients shown" << std::endl;
+        }
+      model.setDatabase(QSqlDatabase());
+      unsearchable.close();
+    }
+    QSqlDatabase::removeDatabase("ctkDICOMModelTest1_unsearchable");
+    QFile::remove(unsearchableFileName);
+    if (!failedSearchReported)
+      {
+      return EXIT_FAILURE;
+      }
+
     return EXIT_SUCCESS;
   }
   catch (std::exception e)
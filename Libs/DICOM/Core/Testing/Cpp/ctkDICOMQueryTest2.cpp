@@ -75,5 +75,35 @@ int ctkDICOMQueryTest2( int argc, char * argv [] )
               << "No study instance retrieved" << std::endl;
     return EXIT_FAILURE;
     }
+
+  // Series level queries on parallel associations and on the study level
+  // association must find the same series
+  QStringList seriesFoundByAssociation[2];
+  int numberOfAssociations[2] = {4, 1};
+  for (int i = 0; i < 2; ++i)
+    {
+    ctkDICOMDatabase seriesDatabase;
+    seriesDatabase.openDatabase(":memory:");
+    query.setMaximumNumberOfAssociations(numberOfAssociations[i]);
+    if (!query.query(seriesDatabase))
+      {
+      std::cout << "ctkDICOMQuery::query() failed with " << numberOfAssociations[i]
+                << " associations" << std::endl;
+      return EXIT_FAILURE;
+      }
+    foreach(const QString& studyInstanceUID, query.studyInstanceUIDQueried())
+      {
+      seriesFoundByAssociation[i] << seriesDatabase.seriesForStudy(studyInstanceUID);
+      }
+    seriesFoundByAssociation[i].sort();
+    }
+  if (seriesFoundByAssociation[0].isEmpty()
+      || seriesFoundByAssociation[0] != seriesFoundByAssociation[1])
+    {
+    std::cout << "ctkDICOMQuery::query() failed."
+              << " Series found on parallel associations: " << seriesFoundByAssociation[0].count()
+              << ", on a single association: " << seriesFoundByAssociation[1].count() << std::endl;
+    return EXIT_FAILURE;
+    }
   return EXIT_SUCCESS;
 }
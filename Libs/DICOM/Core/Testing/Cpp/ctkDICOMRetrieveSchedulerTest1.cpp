@@ -0,0 +1,240 @@
+/*=========================================================================
+
+  Library:   CTK
+
+  Copyright (c) Kitware Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0.txt
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=========================================================================*/
+
+// Qt includes
+#include <QCoreApplication>
+#include <QDir>
+#include <QStringList>
+
+// ctkDICOMCore includes
+#include "ctkDICOMDatabase.h"
+#include "ctkDICOMQuery.h"
+#include "ctkDICOMRetrieveScheduler.h"
+#include "ctkDICOMRetrieveSchedulerTestHelper.h"
+#include "ctkDICOMTester.h"
+
+// STD includes
+#include <iostream>
+
+void ctkDICOMRetrieveSchedulerTest1PrintUsage()
+{
+  std::cout << " ctkDICOMRetrieveSchedulerTest1 images" << std::endl;
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMRetrieveSchedulerTest1CheckSuccess(const ctkDICOMRetrieveSchedulerTestHelper& helper,
+                                                const QString& study, const QString& series)
+{
+  int index = helper.indexOf(study, series);
+  if (index < 0 || !helper.FinishedRetrieves[index].Success)
+    {
+    std::cout << "ctkDICOMRetrieveScheduler: retrieve of study " << qPrintable(study)
+              << " series " << qPrintable(series)
+              << (index < 0 ? " was not reported" : " failed") << std::endl;
+    return false;
+    }
+  return true;
+}
+
+// Test on a real local database
+int ctkDICOMRetrieveSchedulerTest1( int argc, char * argv [] )
+{
+  QCoreApplication app(argc, argv);
+
+  ctkDICOMTester tester;
+  tester.startDCMQRSCP();
+
+  QStringList arguments = app.arguments();
+  arguments.pop_front(); // remove application name
+  arguments.pop_front(); // remove test name
+  if (!arguments.count())
+    {
+    ctkDICOMRetrieveSchedulerTest1PrintUsage();
+    return EXIT_FAILURE;
+    }
+  tester.storeData(arguments);
+
+  ctkDICOMDatabase queryDatabase;
+  queryDatabase.openDatabase(":memory:");
+
+  ctkDICOMQuery query;
+  query.setCallingAETitle("CTK_AE");
+  query.setCalledAETitle("CTK_AE");
+  query.setHost("localhost");
+  query.setPort(tester.dcmqrscpPort());
+  if (!query.query(queryDatabase) || query.studyInstanceUIDQueried().count() == 0)
+    {
+    std::cout << "ctkDICOMQuery::query() failed" << std::endl;
+    return EXIT_FAILURE;
+    }
+  QStringList studies = query.studyInstanceUIDQueried();
+  QStringList seriesOfFirstStudy = queryDatabase.seriesForStudy(studies[0]);
+
+  ctkDICOMRetrieveScheduler scheduler;
+  scheduler.setCallingAETitle("CTK_AE");
+  scheduler.setCalledAETitle("CTK_AE");
+  scheduler.setPort(tester.dcmqrscpPort());
+  scheduler.setHost("localhost");
+  scheduler.setMoveDestinationAETitle("CTK_CLIENT_AE");
+  scheduler.setPreferCGET(false);
+  scheduler.setMaximumNumberOfAssociations(2);
+  ctkDICOMRetrieveSchedulerTestHelper moveHelper;
+  QObject::connect(&scheduler, SIGNAL(retrieveFinished(QString,QString,bool)),
+                   &moveHelper, SLOT(onRetrieveFinished(QString,QString,bool)));
+
+  if (scheduler.setPriority(studies[0], "1.2.3.4", 10))
+    {
+    std::cout << "ctkDICOMRetrieveScheduler::setPriority() failed, "
+              << "no retrieve is queued" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // Retrieve the series of the first study on top of all studies
+  foreach(const QString& study, studies)
+    {
+    scheduler.retrieveStudy(study);
+    }
+  foreach(const QString& series, seriesOfFirstStudy)
+    {
+    scheduler.retrieveSeries(studies[0], series, 1);
+    }
+  if (!scheduler.waitForDone(60000) || scheduler.numberOfPendingRetrieves() != 0)
+    {
+    std::cout << "ctkDICOMRetrieveScheduler::waitForDone() failed, "
+              << scheduler.numberOfPendingRetrieves() << " retrieves are pending" << std::endl;
+    return EXIT_FAILURE;
+    }
+  if (moveHelper.FinishedRetrieves.count() != studies.count() + seriesOfFirstStudy.count())
+    {
+    std::cout << "ctkDICOMRetrieveScheduler: " << moveHelper.FinishedRetrieves.count()
+              << " retrieves were reported" << std::endl;
+    return EXIT_FAILURE;
+    }
+  foreach(const QString& study, studies)
+    {
+    if (!ctkDICOMRetrieveSchedulerTest1CheckSuccess(moveHelper, study, QString()))
+      {
+      return EXIT_FAILURE;
+      }
+    }
+  foreach(const QString& series, seriesOfFirstStudy)
+    {
+    if (!ctkDICOMRetrieveSchedulerTest1CheckSuccess(moveHelper, studies[0], series))
+      {
+      return EXIT_FAILURE;
+      }
+    }
+
+  // Canceled retrieves are finished as well
+  foreach(const QString& study, studies)
+    {
+    scheduler.retrieveStudy(study);
+    }
+  scheduler.cancel();
+  if (!scheduler.waitForDone(60000) || scheduler.numberOfPendingRetrieves() != 0)
+    {
+    std::cout << "ctkDICOMRetrieveScheduler::cancel() failed, "
+              << scheduler.numberOfPendingRetrieves() << " retrieves are pending" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // CGET inserts the instances into the database. With a single association,
+  // the queued retrieves are started by decreasing priority.
+  QDir testDirectory = QDir::temp();
+  QString retrieveDatabaseFile = testDirectory.absoluteFilePath("ctkDICOMRetrieveSchedulerTest1.sql");
+  QSharedPointer<ctkDICOMDatabase> retrieveDatabase(new ctkDICOMDatabase);
+  retrieveDatabase->openDatabase(retrieveDatabaseFile);
+  if (!retrieveDatabase->initializeDatabase())
+    {
+    std::cout << "ctkDICOMDatabase::initializeDatabase() failed" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  ctkDICOMRetrieveScheduler getScheduler;
+  getScheduler.setCallingAETitle("CTK_AE");
+  getScheduler.setCalledAETitle("CTK_AE");
+  getScheduler.setPort(tester.dcmqrscpPort());
+  getScheduler.setHost("localhost");
+  getScheduler.setPreferCGET(true);
+  getScheduler.setMaximumNumberOfAssociations(1);
+  getScheduler.setDatabase(retrieveDatabase);
+  ctkDICOMRetrieveSchedulerTestHelper getHelper;
+  QObject::connect(&getScheduler, SIGNAL(retrieveFinished(QString,QString,bool)),
+                   &getHelper, SLOT(onRetrieveFinished(QString,QString,bool)));
+
+  // The study may be started before the other retrieves are queued
+  const QString lowPrioritySeries("1.2.3.4.1");
+  const QString mediumPrioritySeries("1.2.3.4.2");
+  getScheduler.retrieveStudy(studies[0]);
+  getScheduler.retrieveSeries(studies[0], lowPrioritySeries, 0);
+  getScheduler.retrieveSeries(studies[0], seriesOfFirstStudy[0], 10);
+  getScheduler.retrieveSeries(studies[0], mediumPrioritySeries, 5);
+  if (!getScheduler.waitForDone(60000) || getHelper.FinishedRetrieves.count() != 4)
+    {
+    std::cout << "ctkDICOMRetrieveScheduler::waitForDone() failed with CGET, "
+              << getScheduler.numberOfPendingRetrieves() << " retrieves are pending" << std::endl;
+    return EXIT_FAILURE;
+    }
+  if (!ctkDICOMRetrieveSchedulerTest1CheckSuccess(getHelper, studies[0], QString())
+      || !ctkDICOMRetrieveSchedulerTest1CheckSuccess(getHelper, studies[0], seriesOfFirstStudy[0]))
+    {
+    return EXIT_FAILURE;
+    }
+  int highPriorityIndex = getHelper.indexOf(studies[0], seriesOfFirstStudy[0]);
+  int mediumPriorityIndex = getHelper.indexOf(studies[0], mediumPrioritySeries);
+  int lowPriorityIndex = getHelper.indexOf(studies[0], lowPrioritySeries);
+  if (!(highPriorityIndex < mediumPriorityIndex && mediumPriorityIndex < lowPriorityIndex))
+    {
+    std::cout << "ctkDICOMRetrieveScheduler: retrieves were not started by priority, "
+              << "finished at " << highPriorityIndex << ", " << mediumPriorityIndex
+              << ", " << lowPriorityIndex << std::endl;
+    return EXIT_FAILURE;
+    }
+  if (retrieveDatabase->allFiles().count() != arguments.count()
+      || !retrieveDatabase->seriesForStudy(studies[0]).contains(seriesOfFirstStudy[0]))
+    {
+    std::cout << "ctkDICOMRetrieveScheduler: " << retrieveDatabase->allFiles().count()
+              << " instances were inserted with CGET, expected " << arguments.count() << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // CGET fails if there is no database to insert the instances into
+  ctkDICOMRetrieveScheduler noDatabaseScheduler;
+  noDatabaseScheduler.setCallingAETitle("CTK_AE");
+  noDatabaseScheduler.setCalledAETitle("CTK_AE");
+  noDatabaseScheduler.setPort(tester.dcmqrscpPort());
+  noDatabaseScheduler.setHost("localhost");
+  noDatabaseScheduler.setPreferCGET(true);
+  ctkDICOMRetrieveSchedulerTestHelper noDatabaseHelper;
+  QObject::connect(&noDatabaseScheduler, SIGNAL(retrieveFinished(QString,QString,bool)),
+                   &noDatabaseHelper, SLOT(onRetrieveFinished(QString,QString,bool)));
+  noDatabaseScheduler.retrieveStudy(studies[0]);
+  if (!noDatabaseScheduler.waitForDone(60000)
+      || noDatabaseHelper.FinishedRetrieves.count() != 1
+      || noDatabaseHelper.FinishedRetrieves[0].Success)
+    {
+    std::cout << "ctkDICOMRetrieveScheduler: CGET without database should fail" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  retrieveDatabase->closeDatabase();
+
+  return EXIT_SUCCESS;
+}
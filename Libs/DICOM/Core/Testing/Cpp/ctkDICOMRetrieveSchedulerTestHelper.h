@@ -0,0 +1,70 @@
+/*=========================================================================
+
+  Library:   CTK
+
+  Copyright (c) Kitware Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0.txt
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=========================================================================*/
+
+#ifndef __ctkDICOMRetrieveSchedulerTestHelper_h
+#define __ctkDICOMRetrieveSchedulerTestHelper_h
+
+// Qt includes
+#include <QList>
+#include <QObject>
+#include <QString>
+
+//------------------------------------------------------------------------------
+/// Record the retrieves reported by ctkDICOMRetrieveScheduler::retrieveFinished(),
+/// in the order they are reported
+class ctkDICOMRetrieveSchedulerTestHelper : public QObject
+{
+  Q_OBJECT
+public:
+  struct FinishedRetrieve
+  {
+    QString StudyInstanceUID;
+    QString SeriesInstanceUID;
+    bool Success;
+  };
+  QList<FinishedRetrieve> FinishedRetrieves;
+
+  /// Index of the first reported retrieve of the series, -1 if not reported
+  int indexOf(const QString& studyInstanceUID, const QString& seriesInstanceUID) const
+  {
+    for (int i = 0; i < this->FinishedRetrieves.count(); ++i)
+      {
+      if (this->FinishedRetrieves[i].StudyInstanceUID == studyInstanceUID
+          && this->FinishedRetrieves[i].SeriesInstanceUID == seriesInstanceUID)
+        {
+        return i;
+        }
+      }
+    return -1;
+  }
+
+public Q_SLOTS:
+  void onRetrieveFinished(const QString& studyInstanceUID, const QString& seriesInstanceUID,
+                          bool success)
+  {
+    FinishedRetrieve finishedRetrieve;
+    finishedRetrieve.StudyInstanceUID = studyInstanceUID;
+    finishedRetrieve.SeriesInstanceUID = seriesInstanceUID;
+    finishedRetrieve.Success = success;
+    this->FinishedRetrieves << finishedRetrieve;
+  }
+};
+
+#endif
@@ -0,0 +1,167 @@
+/*=========================================================================
+
+  Library:   CTK
+
+  Copyright (c) Kitware Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0.txt
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=========================================================================*/
+
+// Qt includes
+#include <QCoreApplication>
+#include <QDir>
+#include <QStringList>
+
+// ctkCore includes
+#include "ctkUtils.h"
+
+// ctkDICOMCore includes
+#include "ctkDICOMDatabase.h"
+#include "ctkDICOMStorageListener.h"
+
+// DCMTK includes
+#include <dcmtk/dcmnet/scu.h>
+
+// STD includes
+#include <iostream>
+
+namespace
+{
+
+//------------------------------------------------------------------------------
+bool sendFiles(const QString& calledAETitle, int port, const QStringList& files)
+{
+  DcmSCU scu;
+  scu.setAETitle("CTK_SCU");
+  scu.setPeerAETitle(calledAETitle.toStdString().c_str());
+  scu.setPeerHostName("localhost");
+  scu.setPeerPort(port);
+  OFList<OFString> transferSyntaxes;
+  transferSyntaxes.push_back(UID_LittleEndianExplicitTransferSyntax);
+  transferSyntaxes.push_back(UID_LittleEndianImplicitTransferSyntax);
+  scu.addPresentationContext(UID_MRImageStorage, transferSyntaxes);
+  if (scu.initNetwork().bad() || scu.negotiateAssociation().bad())
+    {
+    return false;
+    }
+  bool success = true;
+  foreach(const QString& file, files)
+    {
+    Uint16 status = 0;
+    T_ASC_PresentationContextID presentationContextID =
+      scu.findPresentationContextID(UID_MRImageStorage, "");
+    if (scu.sendSTORERequest(presentationContextID, file.toStdString().c_str(), NULL, status).bad()
+        || status != STATUS_Success)
+      {
+      success = false;
+      }
+    }
+  scu.closeAssociation(DCMSCU_RELEASE_ASSOCIATION);
+  return success;
+}
+
+}
+
+//------------------------------------------------------------------------------
+int ctkDICOMStorageListenerTest1( int argc, char * argv [] )
+{
+  QCoreApplication app(argc, argv);
+
+  QStringList arguments = app.arguments();
+  arguments.pop_front(); // remove application name
+  arguments.pop_front(); // remove test name
+  if (arguments.count() < 2)
+    {
+    std::cerr << "Usage: ctkDICOMStorageListenerTest1 port MRImageFile..." << std::endl;
+    return EXIT_FAILURE;
+    }
+  int port = arguments.takeFirst().toInt();
+
+  QDir databaseDirectory = QDir::temp();
+  ctk::removeDirRecursively(databaseDirectory.filePath("ctkDICOMStorageListenerTest1"));
+  databaseDirectory.mkdir("ctkDICOMStorageListenerTest1");
+  databaseDirectory.cd("ctkDICOMStorageListenerTest1");
+  QSharedPointer<ctkDICOMDatabase> database(new ctkDICOMDatabase);
+  database->openDatabase(databaseDirectory.filePath("ctkDICOM.sql"));
+
+  ctkDICOMStorageListener listener;
+  listener.setAETitle("CTK_LISTENER");
+  listener.setPort(port);
+  listener.setMaximumNumberOfAssociations(2);
+
+  // Received instances would have nowhere to go
+  if (listener.start() || listener.isListening())
+    {
+    std::cerr << "ctkDICOMStorageListener::start() succeeded without database" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  listener.setDatabase(database);
+  if (!listener.start() || !listener.isListening())
+    {
+    std::cerr << "ctkDICOMStorageListener::start() failed on port " << port << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  if (sendFiles("OTHER_AE", port, arguments))
+    {
+    std::cerr << "Association calling another AE title was accepted" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  if (!sendFiles("CTK_LISTENER", port, arguments))
+    {
+    std::cerr << "Storing to ctkDICOMStorageListener failed" << std::endl;
+    return EXIT_FAILURE;
+    }
+  listener.stop();
+
+  if (listener.isListening()
+      || listener.numberOfReceivedInstances() != arguments.count()
+      || listener.numberOfInsertedInstances() != arguments.count()
+      || database->allFiles().count() != arguments.count())
+    {
+    std::cerr << "Received " << listener.numberOfReceivedInstances()
+              << " instances, inserted " << listener.numberOfInsertedInstances()
+              << ", database has " << database->allFiles().count()
+              << " files, expected " << arguments.count() << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // Instances received after the database is unset are refused
+  if (!listener.start())
+    {
+    std::cerr << "ctkDICOMStorageListener::start() failed on port " << port << std::endl;
+    return EXIT_FAILURE;
+    }
+  listener.setDatabase(QSharedPointer<ctkDICOMDatabase>());
+  if (sendFiles("CTK_LISTENER", port, arguments))
+    {
+    std::cerr << "Storing to ctkDICOMStorageListener without database succeeded" << std::endl;
+    return EXIT_FAILURE;
+    }
+  listener.stop();
+  if (listener.numberOfReceivedInstances() != 0
+      || listener.numberOfInsertedInstances() != 0)
+    {
+    std::cerr << "Without database, received " << listener.numberOfReceivedInstances()
+              << " instances, inserted " << listener.numberOfInsertedInstances()
+              << ", expected none" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  database->closeDatabase();
+  ctk::removeDirRecursively(databaseDirectory.absolutePath());
+  return EXIT_SUCCESS;
+}
@@ -62,3 +62,12 @@ ctkDICOMAbstractThumbnailGenerator::ctkDICOMAbstractThumbnailGenerator(QObject*
 ctkDICOMAbstractThumbnailGenerator::~ctkDICOMAbstractThumbnailGenerator()
 {
 }
+
+//------------------------------------------------------------------------------
+bool ctkDICOMAbstractThumbnailGenerator::generateSeriesAtlas(const QString& thumbnailDirectory,
+                                                              const QString& atlasPath)
+{
+  Q_UNUSED(thumbnailDirectory);
+  Q_UNUSED(atlasPath);
+  return false;
+}
@@ -45,6 +45,12 @@ public:
 
   virtual bool generateThumbnail(DicomImage* dcmImage, const QString& path ) = 0;
 
+  /// Pack the thumbnails of a series found in \a thumbnailDirectory into \a atlasPath.
+  /// Called by ctkDICOMDatabase once the thumbnails of a series queued for generation
+  /// in the background are done. Does nothing by default.
+  /// \return true if the atlas has been written or is up to date
+  virtual bool generateSeriesAtlas(const QString& thumbnailDirectory, const QString& atlasPath);
+
 protected:
   QScopedPointer<ctkDICOMAbstractThumbnailGeneratorPrivate> d_ptr;
 
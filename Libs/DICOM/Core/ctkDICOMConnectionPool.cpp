@@ -0,0 +1,229 @@
+/*=========================================================================
+
+  Library:   CTK
+
+  Copyright (c) Kitware Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0.txt
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=========================================================================*/
+
+// Qt includes
+#include <QAtomicInt>
+#include <QHash>
+#include <QMutexLocker>
+#include <QSet>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QThreadStorage>
+
+// ctkDICOM includes
+#include "ctkDICOMConnectionPool_p.h"
+
+#include "ctkLogger.h"
+
+static ctkLogger logger("org.commontk.dicom.DICOMConnectionPool");
+
+//------------------------------------------------------------------------------
+/// Identifiers of the threads and generations of the pools, never reused so
+/// that connection names are unique for the lifetime of the application
+static QAtomicInt ctkDICOMNextThreadConnectionsID(1);
+static QAtomicInt ctkDICOMNextConnectionPoolGeneration(1);
+
+//------------------------------------------------------------------------------
+/// Reader connections opened in a thread, removed when the thread finishes.
+/// A connection can only be removed by the thread that opened it.
+struct ctkDICOMThreadConnections
+{
+  ctkDICOMThreadConnections()
+    : ID(ctkDICOMNextThreadConnectionsID.fetchAndAddOrdered(1))
+  {
+  }
+  ~ctkDICOMThreadConnections()
+  {
+    foreach (const QString& connectionName, this->ConnectionNames)
+    {
+      if (QSqlDatabase::contains(connectionName))
+      {
+        QSqlDatabase::removeDatabase(connectionName);
+      }
+    }
+  }
+  void removeConnection(const ctkDICOMConnectionPool* pool)
+  {
+    QString connectionName = this->ConnectionNames.take(pool);
+    if (!connectionName.isEmpty() && QSqlDatabase::contains(connectionName))
+    {
+      QSqlDatabase::removeDatabase(connectionName);
+    }
+    this->Snapshots.remove(connectionName);
+  }
+  int ID;
+  /// Reader connection of each pool used in the thread
+  QHash<const ctkDICOMConnectionPool*, QString> ConnectionNames;
+  QSet<QString> Snapshots;
+};
+
+//------------------------------------------------------------------------------
+static QThreadStorage<ctkDICOMThreadConnections*> ctkDICOMThreadConnectionsStorage;
+
+//------------------------------------------------------------------------------
+static ctkDICOMThreadConnections* ctkDICOMCurrentThreadConnections()
+{
+  if (!ctkDICOMThreadConnectionsStorage.hasLocalData())
+  {
+    ctkDICOMThreadConnectionsStorage.setLocalData(new ctkDICOMThreadConnections);
+  }
+  return ctkDICOMThreadConnectionsStorage.localData();
+}
+
+//------------------------------------------------------------------------------
+ctkDICOMConnectionPool::ctkDICOMConnectionPool()
+  : Generation(ctkDICOMNextConnectionPoolGeneration.fetchAndAddOrdered(1))
+{
+}
+
+//------------------------------------------------------------------------------
+ctkDICOMConnectionPool::~ctkDICOMConnectionPool()
+{
+  this->close();
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMConnectionPool::setDatabase(const QString& databaseFileName, const QString& connectionName)
+{
+  this->close();
+  QMutexLocker locker(&this->Mutex);
+  this->DatabaseFileName = databaseFileName;
+  this->ConnectionName = connectionName;
+}
+
+//------------------------------------------------------------------------------
+QString ctkDICOMConnectionPool::readConnectionName() const
+{
+  // The address of a QThread can be reused by a thread created after it
+  // finished, the identifier of its thread local storage cannot
+  return this->ConnectionName + "_reader" + QString::number(this->Generation) + "_"
+    + QString::number(ctkDICOMCurrentThreadConnections()->ID);
+}
+
+//------------------------------------------------------------------------------
+QSqlDatabase ctkDICOMConnectionPool::readConnection()
+{
+  QMutexLocker locker(&this->Mutex);
+  if (this->DatabaseFileName.isEmpty())
+  {
+    return QSqlDatabase();
+  }
+  ctkDICOMThreadConnections* threadConnections = ctkDICOMCurrentThreadConnections();
+  QString connectionName = this->readConnectionName();
+  if (threadConnections->ConnectionNames.value(this) == connectionName
+      && QSqlDatabase::contains(connectionName))
+  {
+    return QSqlDatabase::database(connectionName, false);
+  }
+  // Connection of this thread to a previous database of the pool
+  threadConnections->removeConnection(this);
+
+  QSqlDatabase database = QSqlDatabase::addDatabase("QSQLITE", connectionName);
+  database.setDatabaseName(this->DatabaseFileName);
+  database.setConnectOptions("QSQLITE_OPEN_READONLY");
+  if (!database.open())
+  {
+    logger.error("Failed to open reader connection: " + database.lastError().text());
+    database = QSqlDatabase();
+    QSqlDatabase::removeDatabase(connectionName);
+    return QSqlDatabase();
+  }
+  threadConnections->ConnectionNames.insert(this, connectionName);
+  return database;
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMConnectionPool::beginReadSnapshot()
+{
+  QSqlDatabase database = this->readConnection();
+  if (!database.isOpen() || this->isInReadSnapshot())
+  {
+    return false;
+  }
+  if (!database.transaction())
+  {
+    logger.error("Failed to begin read snapshot: " + database.lastError().text());
+    return false;
+  }
+  // In WAL mode the snapshot is taken by the first read of the transaction
+  QSqlQuery query(database);
+  query.exec("SELECT COUNT(*) FROM sqlite_master");
+  query.finish();
+  QMutexLocker locker(&this->Mutex);
+  ctkDICOMCurrentThreadConnections()->Snapshots.insert(database.connectionName());
+  return true;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMConnectionPool::endReadSnapshot()
+{
+  if (!this->isInReadSnapshot())
+  {
+    logger.warn("endReadSnapshot called without matching beginReadSnapshot");
+    return;
+  }
+  QSqlDatabase database = this->readConnection();
+  database.commit();
+  QMutexLocker locker(&this->Mutex);
+  ctkDICOMCurrentThreadConnections()->Snapshots.remove(database.connectionName());
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMConnectionPool::isInReadSnapshot() const
+{
+  QMutexLocker locker(&this->Mutex);
+  return ctkDICOMThreadConnectionsStorage.hasLocalData()
+    && ctkDICOMThreadConnectionsStorage.localData()->Snapshots.contains(this->readConnectionName());
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMConnectionPool::close()
+{
+  QMutexLocker locker(&this->Mutex);
+  if (ctkDICOMThreadConnectionsStorage.hasLocalData())
+  {
+    ctkDICOMThreadConnectionsStorage.localData()->removeConnection(this);
+  }
+  // The connections of the other threads are no longer returned, they are
+  // removed by their thread when it uses the pool again or finishes
+  this->DatabaseFileName.clear();
+  this->Generation = ctkDICOMNextConnectionPoolGeneration.fetchAndAddOrdered(1);
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMConnectionPool::configureWriter(QSqlDatabase& database)
+{
+  QSqlQuery query(database);
+  // Readers see the last commit that preceded their read transaction,
+  // writes are appended to the log without waiting for them
+  if (!query.exec("PRAGMA journal_mode = WAL") || !query.next()
+      || query.value(0).toString().toLower() != "wal")
+  {
+    logger.warn("Write-ahead log not available for " + database.databaseName());
+    query.finish();
+    // Disable synchronous writing to make modifications faster
+    query.exec("PRAGMA synchronous = OFF");
+    return false;
+  }
+  query.finish();
+  // In WAL mode, the log is only synced at checkpoints
+  query.exec("PRAGMA synchronous = NORMAL");
+  return true;
+}
@@ -0,0 +1,82 @@
+/*=========================================================================
+
+  Library:   CTK
+
+  Copyright (c) Kitware Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0.txt
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=========================================================================*/
+
+#ifndef __ctkDICOMConnectionPool_p_h
+#define __ctkDICOMConnectionPool_p_h
+
+// Qt includes
+#include <QMutex>
+#include <QSqlDatabase>
+#include <QString>
+
+/// \ingroup DICOM_Core
+///
+/// Read-only connections to the database file of ctkDICOMDatabase, one per
+/// thread.
+///
+/// A QSqlDatabase connection can only be used and removed in the thread that
+/// opened it, readConnection() opens a connection for the calling thread on
+/// first use. close() removes the connection of the calling thread, the
+/// connections of the other threads are removed when their thread uses the
+/// pool again or finishes.
+///
+/// The database is expected to be in write-ahead log mode (see
+/// configureWriter()): readers then never block the writer and are never
+/// blocked by it, each read transaction sees the last commit that preceded it.
+class ctkDICOMConnectionPool
+{
+public:
+  ctkDICOMConnectionPool();
+  ~ctkDICOMConnectionPool();
+
+  /// Set the database file of the reader connections. Reader connections
+  /// to the previous file are removed.
+  void setDatabase(const QString& databaseFileName, const QString& connectionName);
+
+  /// Return the reader connection of the calling thread, an invalid
+  /// connection if it could not be opened.
+  QSqlDatabase readConnection();
+
+  /// Start a read transaction on the reader connection of the calling thread.
+  /// Snapshots cannot be nested.
+  bool beginReadSnapshot();
+  void endReadSnapshot();
+  /// Return true if the calling thread is in a read snapshot
+  bool isInReadSnapshot() const;
+
+  /// Stop handing out the reader connections and remove the one of the
+  /// calling thread, which must not be in use.
+  void close();
+
+  /// Enable write-ahead logging on a writer connection
+  static bool configureWriter(QSqlDatabase& database);
+
+protected:
+  QString readConnectionName() const;
+
+  mutable QMutex Mutex;
+  QString DatabaseFileName;
+  QString ConnectionName;
+  /// Changed by close(), unique among all the pools so that connection
+  /// names are never reused
+  int Generation;
+};
+
+#endif
@@ -26,18 +26,27 @@
 #include <QFile>
 #include <QFileInfo>
 #include <QFileSystemWatcher>
+#include <QHash>
+#include <QRegExp>
 #include <QSet>
 #include <QSqlError>
 #include <QSqlQuery>
 #include <QSqlRecord>
 #include <QStringList>
+#include <QThread>
+#include <QThreadPool>
 #include <QUuid>
+#include <QVector>
 #include <QVariant>
 
 // ctkDICOM includes
 #include "ctkDICOMDatabase.h"
 #include "ctkDICOMAbstractThumbnailGenerator.h"
+#include "ctkDICOMConnectionPool_p.h"
+#include "ctkDICOMFileStorage_p.h"
+#include "ctkDICOMInMemoryTagCache_p.h"
 #include "ctkDICOMItem.h"
+#include "ctkDICOMThumbnailQueue_p.h"
 
 #include "ctkLogger.h"
 
@@ -70,6 +79,66 @@ static QString ValueIsEmptyString("__VALUE_IS_EMPTY_STRING__");
 /// Separator character for table and field names to be used in display rules manager
 static QString TableFieldSeparator(":");
 
+//------------------------------------------------------------------------------
+/// Return the first tag after \a tagKey, where parsing can stop when reading \a tagKey
+static DcmTagKey tagKeyAfter(const DcmTagKey& tagKey)
+{
+  if (tagKey.getElement() < 0xffff)
+  {
+    return DcmTagKey(tagKey.getGroup(), tagKey.getElement() + 1);
+  }
+  if (tagKey.getGroup() < 0xffff)
+  {
+    return DcmTagKey(tagKey.getGroup() + 1, 0);
+  }
+  return DCM_UndefinedTagKey;
+}
+
+//------------------------------------------------------------------------------
+/// Values of a list of tags read from a file by ctkDICOMTagExtractionTask
+struct ctkDICOMExtractedTags
+{
+  QString SOPInstanceUID;
+  QStringList Values;
+};
+
+//------------------------------------------------------------------------------
+/// Read the SOP instance UID and the values of a list of tags from a file,
+/// without parsing the elements that follow the last requested tag.
+class ctkDICOMTagExtractionTask : public QRunnable
+{
+public:
+  ctkDICOMTagExtractionTask(const QString& fileName, const QList<DcmTagKey>& tagKeys,
+                            const DcmTagKey& stopParsingAtElement, ctkDICOMExtractedTags* result)
+    : FileName(fileName)
+    , TagKeys(tagKeys)
+    , StopParsingAtElement(stopParsingAtElement)
+    , Result(result)
+  {
+  }
+
+  virtual void run()
+  {
+    ctkDICOMItem dataset;
+    dataset.InitializeFromFileUntilTag(this->FileName, this->StopParsingAtElement);
+    if (!dataset.IsInitialized())
+    {
+      return;
+    }
+    this->Result->SOPInstanceUID = dataset.GetElementAsString(DCM_SOPInstanceUID);
+    foreach (const DcmTagKey& tagKey, this->TagKeys)
+    {
+      this->Result->Values << dataset.GetAllElementValuesAsString(tagKey);
+    }
+  }
+
+protected:
+  QString FileName;
+  QList<DcmTagKey> TagKeys;
+  DcmTagKey StopParsingAtElement;
+  ctkDICOMExtractedTags* Result;
+};
+
 //------------------------------------------------------------------------------
 class ctkDICOMDatabasePrivate
 {
@@ -90,13 +159,71 @@ public:
   bool loggedExecBatch(QSqlQuery& query);
   bool LoggedExecVerbose;
 
-  /// Group several inserts into a single transaction
+  /// Group several inserts into a single transaction.
+  /// Calls can be nested, only the outermost pair begins and ends the transaction.
   void beginTransaction();
   void endTransaction();
+  int TransactionDepth;
+
+  /// Return the statement prepared for \a queryString.
+  /// Statements are prepared on first use and reused until the database
+  /// is reopened or its schema is changed.
+  QSqlQuery& preparedQuery(const QString& queryString);
+  QHash<QString, QSqlQuery> PreparedQueries;
+
+  /// Execute \a queryTemplate, which contains a "%1" placeholder for a list of
+  /// bound values, for \a values. The caller has to keep \a values shorter than
+  /// the maximum number of variables that SQLite allows in a statement.
+  bool execForValues(QSqlQuery& query, const QString& queryTemplate, const QStringList& values);
 
   /// Dataset must be set always
   /// \param filePath It has to be set if this is an import of an actual file
-  void insert ( const ctkDICOMItem& ctkDataset, const QString& filePath, bool storeFile = true, bool generateThumbnail = true);
+  /// \param temporaryFilePath File placed in the database folder by ctkDICOMDatabase::storeFileInDatabaseFolder().
+  /// It replaces the stored file of the instance once the instance is inserted, and it is discarded
+  /// if the instance is referenced already. It is left to the caller if false is returned.
+  /// \return true if the instance is referenced in the database at its file
+  bool insert ( const ctkDICOMItem& ctkDataset, const QString& filePath, bool storeFile = true, bool generateThumbnail = true,
+                const QString& temporaryFilePath = QString());
+
+  /// Place the file of an accepted instance next to \a storedFilePath under a temporary name,
+  /// which is returned in \a temporaryFilePath. The dataset is saved there if \a filePath is empty.
+  /// \a temporaryFilePath is empty if the file is at \a storedFilePath already.
+  bool storeInstanceFile(const ctkDICOMItem& ctkDataset, const QString& filePath, const QString& storedFilePath,
+                         QString& temporaryFilePath);
+  /// Discard the file placed by storeInstanceFile() or ctkDICOMDatabase::storeFileInDatabaseFolder()
+  /// when the instance is not inserted. A moved file is moved back to \a filePath.
+  void unstoreInstanceFile(const QString& filePath, const QString& temporaryFilePath);
+
+  /// Path of an instance in the database folder
+  QString storagePath(const QString& studyInstanceUID, const QString& seriesInstanceUID,
+                      const QString& sopInstanceUID) const;
+  /// Places files in the database folder and caches created directories
+  ctkDICOMFileStorage FileStorage;
+
+  /// Look up with one query per table which patients, studies, series, and instances
+  /// of the given datasets already exist in the database.
+  void lookupExistingItems(const QList<ctkDICOMDatabase::IndexingResult>& indexingResults);
+  /// Commit the batch transaction if InsertBatchSize instances have been inserted
+  /// since the last commit.
+  void commitInsertBatchIfNeeded();
+  /// Queue the file manifest entry of an inserted file, which is referenced in the
+  /// Images table at \a storedFilename. The size and modification
+  /// time are read from the file if \a entry is not set.
+  void addFileToManifest(const QString& filePath, ctkDICOMDatabase::FileManifestEntry entry,
+                         const QString& storedFilename);
+  /// Write the queued file manifest entries with one batch statement
+  bool flushFileManifest();
+  QVariantList PendingManifestFilenames;
+  QVariantList PendingManifestSizes;
+  QVariantList PendingManifestLastModifiedTimes;
+  QVariantList PendingManifestStoredFilenames;
+  /// Manifest entry of the file being inserted by a batch insert
+  ctkDICOMDatabase::FileManifestEntry InsertingFileManifestEntry;
+
+  /// Incremented by beginBatchInsert and decremented by endBatchInsert
+  int BatchInsertDepth;
+  int InsertBatchSize;
+  int NumberOfUncommittedInserts;
 
   /// Copy the complete list of files to an extra table
   void createBackupFileList();
@@ -104,49 +231,97 @@ public:
   /// Remove the extra table containing the backup
   void removeBackupFileList();
 
-  /// Update database tables from the displayed fields determined by the plugin roles
+  /// Full-text search index of patients, studies, and series (see ctkDICOMDatabase::search).
+  /// SearchIndexItems maps (table, UID) to the rowid of the item in SearchIndex.
+  /// SearchIndexModule is the SQLite module of SearchIndex ("fts5" or "fts4"), or empty
+  /// if no full-text module is available and SearchIndex is a plain table searched with LIKE.
+  bool SearchIndexAvailable;
+  QString SearchIndexModule;
+  /// Create the search index tables if they do not exist yet and index the database content
+  bool createSearchIndex();
+  void dropSearchIndex();
+  /// Execute \a queryTemplate (see execForValues) for \a uids, in chunks if needed
+  bool execSearchIndexStatement(const QString& queryTemplate, const QStringList& uids);
+  /// Index again the items of \a table (Patients, Studies, or Series) identified by \a uids
+  bool updateSearchIndex(const QString& table, const QStringList& uids);
+  /// Remove the index entries of the items of \a table (Patients, Studies, or Series) identified by \a uids
+  bool removeSearchIndexEntries(const QString& table, const QStringList& uids);
+
+  /// Instance whose displayed fields have not been generated yet
+  struct PendingDisplayedFieldsInstance
+  {
+    QString SOPInstanceUID;
+    QString SeriesInstanceUID;
+    QString StudyInstanceUID;
+    QString PatientUID;
+  };
+
+  /// Displayed fields (name, value pairs) of the series, studies, and patients
+  /// affected by an update of the displayed fields. Series and studies are
+  /// identified by their instance UID, patients by their UID in the Patients table.
+  struct DisplayedFieldsUpdate
+  {
+    QHash<QString, QMap<QString, QString> > Series;
+    QHash<QString, QMap<QString, QString> > Studies;
+    QHash<QString, QMap<QString, QString> > Patients;
+  };
+
+  /// Get the instances whose displayed fields have not been generated yet
+  /// together with their series, study, and patient using a single joined query
+  bool pendingDisplayedFieldsInstances(QList<PendingDisplayedFieldsInstance>& instances);
+
+  /// Load the current field values of the patients in \a update
+  bool loadDisplayedFieldsPatients(DisplayedFieldsUpdate& update);
+
+  /// Get \a tags of all \a sopInstanceUIDs from the tag cache with one query per chunk
+  /// of instances. Values flagged as missing or empty in the tag cache are returned as empty strings.
+  bool cachedTagsForInstances(const QStringList& sopInstanceUIDs, const QStringList& tags,
+                              QHash<QString, QMap<QString, QString> >& cachedTags);
+
+  /// Execute \a queryTemplate (see execForValues) returning (key, count) rows for all \a keys
+  bool countForValues(QSqlDatabase& database, const QString& queryTemplate, const QStringList& keys,
+                      QHash<QString, int>& counts);
+
+  /// Calculate number of instances in each series, number of series in each study,
+  /// and number of studies for each patient in \a update
+  void setCountsToDisplayedFields(DisplayedFieldsUpdate& update);
+
+  /// Write the displayed fields of all items of \a table using a single prepared batch statement.
+  /// Fields that are not set for an item are left unchanged.
   /// \return Success flag
-  bool applyDisplayedFieldsChanges( QMap<QString, QMap<QString, QString> > &displayedFieldsMapSeries,
-                                    QMap<QString, QMap<QString, QString> > &displayedFieldsMapStudy,
-                                    QVector<QMap<QString, QString> > &displayedFieldsVectorPatient );
-
-  /// Find patient by both patient ID and patient name and return its index and insert it in the given fields map
-  /// \param displayedFieldsVectorPatient Vector of patient field maps (name, value pairs) to which the found patient
-  ///   is inserted on success. Also contains the generated patient index
-  /// \return Generated patient index that is an incremental UID for temporal and internal use (so that there is a single identifier for patients)
-  int getDisplayPatientFieldsIndex(QString patientsName, QString patientID, QVector<QMap<QString, QString> > &displayedFieldsVectorPatient);
-
-  /// Find study by instance UID and insert it in the given fields map
-  /// \param displayedFieldsMapStudy Map of study field maps (name, value pairs) to which the found study has been inserted on success
-  /// \return The study instance UID if successfully found, empty string otherwise
-  QString getDisplayStudyFieldsKey(QString studyInstanceUID, QMap<QString, QMap<QString, QString> > &displayedFieldsMapStudy);
-
-  /// Find series by instance UID and insert it in the given fields map
-  /// \param displayedFieldsMapSeries Map of series field maps (name, value pairs) to which the found series has been inserted on success
-  /// \return The series instance UID if successfully found, empty string otherwise
-  QString getDisplaySeriesFieldsKey(QString seriesInstanceUID, QMap<QString, QMap<QString, QString> > &displayedFieldsMapSeries);
+  bool applyDisplayedFieldsChanges(const QString& table, const QString& keyField,
+                                   const QHash<QString, QMap<QString, QString> >& displayedFields);
 
   /// Get all Filename values from table
   QStringList filenames(QString table);
 
-  QVector<QMap<QString /*DisplayField*/, QString /*Value*/> > displayedFieldsVectorPatient; // The index in the vector is the internal patient UID
-  /// Calculate count (number of objects in interest) for each series in the displayed fields container
-  /// \param displayedFieldsMapSeries (SeriesInstanceUID -> (DisplayField -> Value) )
-  void setCountToSeriesDisplayedFields(QMap<QString, QMap<QString, QString> > &displayedFieldsMapSeries);
-  /// Calculate number of series for each study in the displayed fields container
-  /// \param displayedFieldsMapStudy (StudyInstanceUID -> (DisplayField -> Value) )
-  void setNumberOfSeriesToStudyDisplayedFields(QMap<QString, QMap<QString, QString> > &displayedFieldsMapStudy);
-  /// Calculate number of studies for each patient in the displayed fields container
-  /// \param displayedFieldsVectorPatient (Internal_ID -> (DisplayField -> Value) )
-  void setNumberOfStudiesToPatientDisplayedFields(QVector<QMap<QString, QString> > &displayedFieldsVectorPatient);
-
   /// Name of the database file (i.e. for SQLITE the sqlite file)
   QString DatabaseFileName;
   QString LastError;
   QSqlDatabase Database;
+  /// Thread that opened Database, the only one allowed to use it
+  QThread* DatabaseThread;
+  /// Reader connections of the other threads and of the read snapshots
+  ctkDICOMConnectionPool ConnectionPool;
+  /// Return the connection to read from in the calling thread:
+  /// Database in the thread of the database unless a read snapshot is active,
+  /// a reader connection otherwise.
+  QSqlDatabase readDatabase();
   QMap<QString, QString> LoadedHeader;
 
   ctkDICOMAbstractThumbnailGenerator* ThumbnailGenerator;
+  ctkDICOMThumbnailQueue ThumbnailQueue;
+  bool AsynchronousThumbnailGeneration;
+  bool MiddleInstanceThumbnailOnly;
+  /// Series (and their study) whose middle instance thumbnail is generated
+  /// at the end of the current batch insert
+  QHash<QString, QString> SeriesPendingThumbnail;
+
+  /// Generate the thumbnail of an instance, in the background if AsynchronousThumbnailGeneration is set
+  void generateThumbnail(const QString& studyInstanceUID, const QString& seriesInstanceUID,
+                         const QString& sopInstanceUID, const QString& filePath);
+  /// Generate the thumbnail of the middle instance of each series of SeriesPendingThumbnail
+  void generatePendingSeriesThumbnails();
 
   ctkDICOMDisplayedFieldGenerator DisplayedFieldGenerator;
 
@@ -159,6 +334,29 @@ public:
   QString LastSeriesInstanceUID;
   int LastPatientUID;
 
+  /// Items that are known to exist in the database, so that their existence
+  /// does not have to be checked again for every inserted instance.
+  /// Items created from DICOMDIR records are not listed, as they have to be
+  /// replaced when the first file that belongs to them is inserted.
+  QHash<QString, int> KnownPatientUIDs;
+  QSet<QString> KnownStudyInstanceUIDs;
+  QSet<QString> KnownSeriesInstanceUIDs;
+  struct KnownImage
+  {
+    QString InsertTimestamp;
+    QString Filename;
+    bool FromDirectoryRecords;
+  };
+  /// Instances that have been looked up by lookupExistingItems, by SOPInstanceUID.
+  /// Instances that were looked up but are not in the database are listed in
+  /// LookedUpSOPInstanceUIDs only.
+  QHash<QString, KnownImage> KnownImages;
+  QSet<QString> LookedUpSOPInstanceUIDs;
+  /// Set while a dataset that has been assembled from DICOMDIR records is inserted.
+  /// The rows that are created for it are flagged with FromDirectoryRecords.
+  bool InsertingFromDirectoryRecords;
+  static QString patientKey(const QString& patientID, const QString& patientsName);
+
   /// resets the variables to new inserts won't be fooled by leftover values
   void resetLastInsertedValues();
 
@@ -168,10 +366,17 @@ public:
   /// with other access to the database which need to be
   /// reading while the tag cache is writing
   QSqlDatabase TagCacheDatabase;
+  /// Reader connections of the other threads to the tag cache
+  ctkDICOMConnectionPool TagCacheConnectionPool;
+  /// Return the tag cache connection to read from in the calling thread
+  QSqlDatabase readTagCacheDatabase();
   QString TagCacheDatabaseFilename;
   QStringList TagsToPrecache;
+  /// in-memory front of the tag cache database
+  ctkDICOMInMemoryTagCache InMemoryTagCache;
   bool openTagCacheDatabase();
-  void precacheTags( const QString sopInstanceUID );
+  /// Store the values of TagsToPrecache in the tag cache from the already read \a dataset
+  void precacheTags( const ctkDICOMItem& dataset, const QString sopInstanceUID );
 
   int insertPatient(const ctkDICOMItem& ctkDataset);
   void insertStudy(const ctkDICOMItem& ctkDataset, int dbPatientID);
@@ -182,11 +387,20 @@ public:
 // ctkDICOMDatabasePrivate methods
 
 //------------------------------------------------------------------------------
-ctkDICOMDatabasePrivate::ctkDICOMDatabasePrivate(ctkDICOMDatabase& o): q_ptr(&o)
+ctkDICOMDatabasePrivate::ctkDICOMDatabasePrivate(ctkDICOMDatabase& o): q_ptr(&o), ThumbnailQueue(&o)
 {
   this->ThumbnailGenerator = NULL;
+  this->DatabaseThread = NULL;
+  this->AsynchronousThumbnailGeneration = false;
+  this->MiddleInstanceThumbnailOnly = false;
   this->LoggedExecVerbose = false;
+  this->InsertingFromDirectoryRecords = false;
+  this->SearchIndexAvailable = false;
   this->TagCacheVerified = false;
+  this->TransactionDepth = 0;
+  this->BatchInsertDepth = 0;
+  this->InsertBatchSize = 1000;
+  this->NumberOfUncommittedInserts = 0;
   this->resetLastInsertedValues();
 }
 
@@ -199,6 +413,17 @@ void ctkDICOMDatabasePrivate::resetLastInsertedValues()
   this->LastStudyInstanceUID = QString("");
   this->LastSeriesInstanceUID = QString("");
   this->LastPatientUID = -1;
+  this->KnownPatientUIDs.clear();
+  this->KnownStudyInstanceUIDs.clear();
+  this->KnownSeriesInstanceUIDs.clear();
+  this->KnownImages.clear();
+  this->LookedUpSOPInstanceUIDs.clear();
+}
+
+//------------------------------------------------------------------------------
+QString ctkDICOMDatabasePrivate::patientKey(const QString& patientID, const QString& patientsName)
+{
+  return patientID + QChar('\0') + patientsName;
 }
 
 //------------------------------------------------------------------------------
@@ -229,6 +454,35 @@ ctkDICOMDatabasePrivate::~ctkDICOMDatabasePrivate()
 {
 }
 
+//------------------------------------------------------------------------------
+QSqlDatabase ctkDICOMDatabasePrivate::readDatabase()
+{
+  if (this->DatabaseFileName != ":memory:"
+      && (QThread::currentThread() != this->DatabaseThread || this->ConnectionPool.isInReadSnapshot()))
+  {
+    QSqlDatabase readConnection = this->ConnectionPool.readConnection();
+    if (readConnection.isOpen())
+    {
+      return readConnection;
+    }
+  }
+  return this->Database;
+}
+
+//------------------------------------------------------------------------------
+QSqlDatabase ctkDICOMDatabasePrivate::readTagCacheDatabase()
+{
+  if (QThread::currentThread() != this->DatabaseThread)
+  {
+    QSqlDatabase readConnection = this->TagCacheConnectionPool.readConnection();
+    if (readConnection.isOpen())
+    {
+      return readConnection;
+    }
+  }
+  return this->TagCacheDatabase;
+}
+
 //------------------------------------------------------------------------------
 bool ctkDICOMDatabasePrivate::loggedExec(QSqlQuery& query)
 {
@@ -287,6 +541,10 @@ bool ctkDICOMDatabasePrivate::loggedExecBatch(QSqlQuery& query)
 //------------------------------------------------------------------------------
 void ctkDICOMDatabasePrivate::beginTransaction()
 {
+  if (this->TransactionDepth++ > 0)
+  {
+    return;
+  }
   QSqlQuery transaction( this->Database );
   transaction.prepare( "BEGIN TRANSACTION" );
   transaction.exec();
@@ -295,9 +553,217 @@ void ctkDICOMDatabasePrivate::beginTransaction()
 //------------------------------------------------------------------------------
 void ctkDICOMDatabasePrivate::endTransaction()
 {
+  if (this->TransactionDepth == 0)
+  {
+    logger.warn("endTransaction called without matching beginTransaction");
+    return;
+  }
+  if (--this->TransactionDepth > 0)
+  {
+    return;
+  }
   QSqlQuery transaction( this->Database );
   transaction.prepare( "END TRANSACTION" );
   transaction.exec();
+  this->NumberOfUncommittedInserts = 0;
+}
+
+//------------------------------------------------------------------------------
+QSqlQuery& ctkDICOMDatabasePrivate::preparedQuery(const QString& queryString)
+{
+  QHash<QString, QSqlQuery>::iterator it = this->PreparedQueries.find(queryString);
+  if (it == this->PreparedQueries.end())
+  {
+    QSqlQuery query(this->Database);
+    if (!query.prepare(queryString))
+    {
+      logger.error("SQLITE ERROR preparing statement: " + queryString + " Error: " + query.lastError().text());
+    }
+    it = this->PreparedQueries.insert(queryString, query);
+  }
+  return it.value();
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMDatabasePrivate::execForValues(QSqlQuery& query, const QString& queryTemplate, const QStringList& values)
+{
+  QStringList placeholders;
+  for (int i = 0; i < values.size(); ++i)
+  {
+    placeholders << "?";
+  }
+  query.prepare(queryTemplate.arg(placeholders.join(",")));
+  for (int i = 0; i < values.size(); ++i)
+  {
+    query.bindValue(i, values[i]);
+  }
+  return this->loggedExec(query);
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMDatabasePrivate::lookupExistingItems(const QList<ctkDICOMDatabase::IndexingResult>& indexingResults)
+{
+  QStringList sopInstanceUIDs;
+  QSet<QString> patientIDs;
+  QSet<QString> studyInstanceUIDs;
+  QSet<QString> seriesInstanceUIDs;
+  foreach (const ctkDICOMDatabase::IndexingResult& indexingResult, indexingResults)
+  {
+    if (!indexingResult.dataset || !indexingResult.dataset->IsInitialized())
+    {
+      continue;
+    }
+    const ctkDICOMItem& dataset = *indexingResult.dataset;
+    QString sopInstanceUID = dataset.GetElementAsString(DCM_SOPInstanceUID);
+    if (!this->LookedUpSOPInstanceUIDs.contains(sopInstanceUID))
+    {
+      sopInstanceUIDs << sopInstanceUID;
+      this->LookedUpSOPInstanceUIDs.insert(sopInstanceUID);
+    }
+    QString patientKey = ctkDICOMDatabasePrivate::patientKey(
+      dataset.GetElementAsString(DCM_PatientID), dataset.GetElementAsString(DCM_PatientName));
+    if (!this->KnownPatientUIDs.contains(patientKey))
+    {
+      patientIDs.insert(dataset.GetElementAsString(DCM_PatientID));
+    }
+    QString studyInstanceUID = dataset.GetElementAsString(DCM_StudyInstanceUID);
+    if (!this->KnownStudyInstanceUIDs.contains(studyInstanceUID))
+    {
+      studyInstanceUIDs.insert(studyInstanceUID);
+    }
+    QString seriesInstanceUID = dataset.GetElementAsString(DCM_SeriesInstanceUID);
+    if (!this->KnownSeriesInstanceUIDs.contains(seriesInstanceUID))
+    {
+      seriesInstanceUIDs.insert(seriesInstanceUID);
+    }
+  }
+
+  // SQLite limits the number of bound variables in a statement (999 by default)
+  const int maxNumberOfValuesPerQuery = 500;
+  QSqlQuery query(this->Database);
+  for (int first = 0; first < sopInstanceUIDs.size(); first += maxNumberOfValuesPerQuery)
+  {
+    if (this->execForValues(query,
+      "SELECT SOPInstanceUID, InsertTimestamp, Filename, FromDirectoryRecords FROM Images WHERE SOPInstanceUID IN (%1)",
+      sopInstanceUIDs.mid(first, maxNumberOfValuesPerQuery)))
+    {
+      while (query.next())
+      {
+        KnownImage knownImage;
+        knownImage.InsertTimestamp = query.value(1).toString();
+        knownImage.Filename = query.value(2).toString();
+        knownImage.FromDirectoryRecords = query.value(3).toBool();
+        this->KnownImages.insert(query.value(0).toString(), knownImage);
+      }
+    }
+  }
+  QStringList values = patientIDs.toList();
+  for (int first = 0; first < values.size(); first += maxNumberOfValuesPerQuery)
+  {
+    if (this->execForValues(query,
+      "SELECT UID, PatientID, PatientsName FROM Patients WHERE FromDirectoryRecords = 0 AND PatientID IN (%1)",
+      values.mid(first, maxNumberOfValuesPerQuery)))
+    {
+      while (query.next())
+      {
+        this->KnownPatientUIDs.insert(
+          patientKey(query.value(1).toString(), query.value(2).toString()), query.value(0).toInt());
+      }
+    }
+  }
+  values = studyInstanceUIDs.toList();
+  for (int first = 0; first < values.size(); first += maxNumberOfValuesPerQuery)
+  {
+    if (this->execForValues(query,
+      "SELECT StudyInstanceUID FROM Studies WHERE FromDirectoryRecords = 0 AND StudyInstanceUID IN (%1)",
+      values.mid(first, maxNumberOfValuesPerQuery)))
+    {
+      while (query.next())
+      {
+        this->KnownStudyInstanceUIDs.insert(query.value(0).toString());
+      }
+    }
+  }
+  values = seriesInstanceUIDs.toList();
+  for (int first = 0; first < values.size(); first += maxNumberOfValuesPerQuery)
+  {
+    if (this->execForValues(query,
+      "SELECT SeriesInstanceUID FROM Series WHERE FromDirectoryRecords = 0 AND SeriesInstanceUID IN (%1)",
+      values.mid(first, maxNumberOfValuesPerQuery)))
+    {
+      while (query.next())
+      {
+        this->KnownSeriesInstanceUIDs.insert(query.value(0).toString());
+      }
+    }
+  }
+  query.finish();
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMDatabasePrivate::commitInsertBatchIfNeeded()
+{
+  // Only commit if the batch insert owns the outermost transaction,
+  // otherwise the commit would end a transaction started by somebody else.
+  if (this->BatchInsertDepth == 0 || this->TransactionDepth != 1
+    || this->NumberOfUncommittedInserts < this->InsertBatchSize)
+  {
+    return;
+  }
+  this->flushFileManifest();
+  QSqlQuery transaction( this->Database );
+  transaction.exec( "END TRANSACTION" );
+  transaction.exec( "BEGIN TRANSACTION" );
+  this->NumberOfUncommittedInserts = 0;
+}
+
+//------------------------------------------------------------------------------
+QString ctkDICOMDatabasePrivate::storagePath(const QString& studyInstanceUID, const QString& seriesInstanceUID,
+                                             const QString& sopInstanceUID) const
+{
+  Q_Q(const ctkDICOMDatabase);
+  return q->databaseDirectory() + "/dicom/" +
+    studyInstanceUID + "/" +
+    seriesInstanceUID + "/" +
+    sopInstanceUID;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMDatabasePrivate::addFileToManifest(const QString& filePath, ctkDICOMDatabase::FileManifestEntry entry,
+                                                const QString& storedFilename)
+{
+  QFileInfo fileInfo(filePath);
+  if (entry.size < 0 || entry.lastModified < 0)
+  {
+    entry.size = fileInfo.size();
+    entry.lastModified = fileInfo.lastModified().toMSecsSinceEpoch();
+  }
+  this->PendingManifestFilenames << fileInfo.absoluteFilePath();
+  this->PendingManifestSizes << entry.size;
+  this->PendingManifestLastModifiedTimes << entry.lastModified;
+  this->PendingManifestStoredFilenames << storedFilename;
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMDatabasePrivate::flushFileManifest()
+{
+  if (this->PendingManifestFilenames.isEmpty())
+  {
+    return true;
+  }
+  QSqlQuery& insertManifestEntries = this->preparedQuery(
+    "INSERT OR REPLACE INTO FileManifest ( 'Filename', 'FileSize', 'LastModified', 'StoredFilename' ) "
+    "VALUES ( ?, ?, ?, ? )" );
+  insertManifestEntries.bindValue(0, this->PendingManifestFilenames);
+  insertManifestEntries.bindValue(1, this->PendingManifestSizes);
+  insertManifestEntries.bindValue(2, this->PendingManifestLastModifiedTimes);
+  insertManifestEntries.bindValue(3, this->PendingManifestStoredFilenames);
+  bool success = this->loggedExecBatch(insertManifestEntries);
+  this->PendingManifestFilenames.clear();
+  this->PendingManifestSizes.clear();
+  this->PendingManifestLastModifiedTimes.clear();
+  this->PendingManifestStoredFilenames.clear();
+  return success;
 }
 
 //------------------------------------------------------------------------------
@@ -315,6 +781,172 @@ void ctkDICOMDatabasePrivate::removeBackupFileList()
   loggedExec(query, "DROP TABLE main.Filenames_backup; " );
 }
 
+//------------------------------------------------------------------------------
+// Key column and indexed content of the tables covered by the search index
+static bool ctkDICOMSearchIndexTable(const QString& table, QString& keyColumn, QStringList& fields)
+{
+  if (table == "Patients")
+  {
+    keyColumn = "UID";
+    fields << "PatientsName" << "PatientID" << "DisplayedPatientsName" << "PatientsBirthDate";
+  }
+  else if (table == "Studies")
+  {
+    keyColumn = "StudyInstanceUID";
+    fields << "StudyDescription" << "StudyID" << "AccessionNumber" << "ModalitiesInStudy"
+           << "InstitutionName" << "ReferringPhysician" << "PerformingPhysiciansName" << "StudyDate";
+  }
+  else if (table == "Series")
+  {
+    keyColumn = "SeriesInstanceUID";
+    fields << "SeriesDescription" << "Modality" << "BodyPartExamined" << "SeriesNumber"
+           << "ContrastAgent" << "SeriesDate";
+  }
+  else
+  {
+    return false;
+  }
+  return true;
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMDatabasePrivate::createSearchIndex()
+{
+  Q_Q(ctkDICOMDatabase);
+  this->SearchIndexAvailable = false;
+  this->SearchIndexModule.clear();
+
+  QSqlQuery query(this->Database);
+  if (!loggedExec(query, "SELECT sql FROM sqlite_master WHERE name = 'SearchIndex'"))
+  {
+    return false;
+  }
+  if (query.next())
+  {
+    QString createStatement = query.value(0).toString().toLower();
+    query.finish();
+    this->SearchIndexModule = createStatement.contains("fts5") ? QString("fts5")
+      : (createStatement.contains("fts4") ? QString("fts4") : QString());
+    this->SearchIndexAvailable = true;
+    return true;
+  }
+  query.finish();
+  if (!this->Database.tables().contains("Patients"))
+  {
+    return false;
+  }
+
+  // Use the best full-text search module the SQLite library has been built with
+  QStringList modules;
+  QStringList createStatements;
+  modules << "fts5";
+  createStatements << "CREATE VIRTUAL TABLE SearchIndex USING fts5(Content)";
+  modules << "fts4";
+  createStatements << "CREATE VIRTUAL TABLE SearchIndex USING fts4(Content, tokenize=unicode61)";
+  modules << "fts4";
+  createStatements << "CREATE VIRTUAL TABLE SearchIndex USING fts4(Content)";
+  modules << "";
+  createStatements << "CREATE TABLE SearchIndex ( 'ItemID' INTEGER PRIMARY KEY, 'Content' TEXT )";
+  bool created = false;
+  for (int i = 0; i < createStatements.size() && !created; ++i)
+  {
+    created = query.exec(createStatements[i]);
+    if (created)
+    {
+      this->SearchIndexModule = modules[i];
+    }
+  }
+  if (!created
+    || !loggedExec(query, "CREATE TABLE IF NOT EXISTS SearchIndexItems ( "
+                          "'ItemID' INTEGER PRIMARY KEY, 'Level' VARCHAR(16) NOT NULL, 'UID' VARCHAR(64) NOT NULL, "
+                          "UNIQUE ('Level', 'UID') )"))
+  {
+    logger.error("Failed to create the search index");
+    return false;
+  }
+  logger.debug("Search index created using module: " + this->SearchIndexModule);
+  this->SearchIndexAvailable = true;
+  return q->rebuildSearchIndex();
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMDatabasePrivate::dropSearchIndex()
+{
+  QSqlQuery query(this->Database);
+  loggedExec(query, "DROP TABLE IF EXISTS SearchIndex");
+  loggedExec(query, "DROP TABLE IF EXISTS SearchIndexItems");
+  this->SearchIndexAvailable = false;
+  this->SearchIndexModule.clear();
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMDatabasePrivate::execSearchIndexStatement(const QString& queryTemplate, const QStringList& uids)
+{
+  if (uids.size() == 1)
+  {
+    // New patients, studies, and series are indexed one by one during insert
+    QSqlQuery& query = this->preparedQuery(queryTemplate.arg("?"));
+    query.bindValue(0, uids[0]);
+    bool success = loggedExec(query);
+    query.finish();
+    return success;
+  }
+  bool success = true;
+  const int chunkSize = 500;
+  for (int start = 0; start < uids.size(); start += chunkSize)
+  {
+    QSqlQuery query(this->Database);
+    success = this->execForValues(query, queryTemplate, uids.mid(start, chunkSize)) && success;
+  }
+  return success;
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMDatabasePrivate::updateSearchIndex(const QString& table, const QStringList& uids)
+{
+  QString keyColumn;
+  QStringList fields;
+  if (!this->SearchIndexAvailable || uids.isEmpty()
+    || !ctkDICOMSearchIndexTable(table, keyColumn, fields))
+  {
+    return false;
+  }
+  QStringList content;
+  foreach (const QString& field, fields)
+  {
+    content << QString("IFNULL(t.%1,'')").arg(field);
+  }
+  QString itemUID = (table == "Patients" ? QString("CAST(t.UID AS TEXT)") : QString("t.") + keyColumn);
+
+  // Items keep their ItemID, their content is replaced
+  bool success = this->execSearchIndexStatement(
+    "INSERT OR IGNORE INTO SearchIndexItems (Level, UID) SELECT '" + table + "', " + itemUID
+    + " FROM " + table + " t WHERE t." + keyColumn + " IN (%1)", uids);
+  success = success && this->execSearchIndexStatement(
+    "DELETE FROM SearchIndex WHERE rowid IN (SELECT ItemID FROM SearchIndexItems WHERE Level = '" + table
+    + "' AND UID IN (%1))", uids);
+  success = success && this->execSearchIndexStatement(
+    "INSERT INTO SearchIndex (rowid, Content) SELECT i.ItemID, " + content.join(" || ' ' || ")
+    + " FROM " + table + " t, SearchIndexItems i WHERE i.Level = '" + table + "' AND i.UID = " + itemUID
+    + " AND t." + keyColumn + " IN (%1)", uids);
+  return success;
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMDatabasePrivate::removeSearchIndexEntries(const QString& table, const QStringList& uids)
+{
+  if (!this->SearchIndexAvailable || uids.isEmpty())
+  {
+    return false;
+  }
+  bool success = this->execSearchIndexStatement(
+    "DELETE FROM SearchIndex WHERE rowid IN (SELECT ItemID FROM SearchIndexItems WHERE Level = '" + table
+    + "' AND UID IN (%1))", uids);
+  success = this->execSearchIndexStatement(
+    "DELETE FROM SearchIndexItems WHERE Level = '" + table + "' AND UID IN (%1)", uids) && success;
+  return success;
+}
+
 //------------------------------------------------------------------------------
 bool ctkDICOMDatabasePrivate::executeScript(const QString script) {
   QFile scriptFile(script);
@@ -380,31 +1012,62 @@ int ctkDICOMDatabasePrivate::insertPatient(const ctkDICOMItem& ctkDataset)
   QString patientsName(ctkDataset.GetElementAsString(DCM_PatientName) );
   QString patientsBirthDate(ctkDataset.GetElementAsString(DCM_PatientBirthDate) );
 
-  QSqlQuery checkPatientExistsQuery(this->Database);
-  checkPatientExistsQuery.prepare( "SELECT * FROM Patients WHERE PatientID = ? AND PatientsName = ?" );
+  QString patientKey = ctkDICOMDatabasePrivate::patientKey(patientID, patientsName);
+  QHash<QString, int>::const_iterator knownPatientIt = this->KnownPatientUIDs.constFind(patientKey);
+  if (knownPatientIt != this->KnownPatientUIDs.constEnd())
+  {
+    return knownPatientIt.value();
+  }
+
+  QSqlQuery& checkPatientExistsQuery = this->preparedQuery(
+    "SELECT UID, FromDirectoryRecords FROM Patients WHERE PatientID = ? AND PatientsName = ?" );
   checkPatientExistsQuery.bindValue( 0, patientID );
   checkPatientExistsQuery.bindValue( 1, patientsName );
   loggedExec(checkPatientExistsQuery);
 
+  QString patientsBirthTime(ctkDataset.GetElementAsString(DCM_PatientBirthTime) );
+  QString patientsSex(ctkDataset.GetElementAsString(DCM_PatientSex) );
+  QString patientsAge(ctkDataset.GetElementAsString(DCM_PatientAge) );
+  QString patientComments(ctkDataset.GetElementAsString(DCM_PatientComments) );
+
+  bool patientFromDirectoryRecords = this->InsertingFromDirectoryRecords;
   if (checkPatientExistsQuery.next())
   {
     // we found him
-    dbPatientID = checkPatientExistsQuery.value(checkPatientExistsQuery.record().indexOf("UID")).toInt();
+    dbPatientID = checkPatientExistsQuery.value(0).toInt();
+    bool existingFromDirectoryRecords = checkPatientExistsQuery.value(1).toBool();
+    checkPatientExistsQuery.finish();
     qDebug() << "Found patient in the database as UId: " << dbPatientID;
+
+    if (existingFromDirectoryRecords && !this->InsertingFromDirectoryRecords)
+    {
+      // Replace the attributes of the patient that has been created from DICOMDIR records.
+      // The row is kept, as its studies refer to its UID.
+      QSqlQuery& updatePatientStatement = this->preparedQuery( "UPDATE Patients SET "
+        "PatientsBirthDate = ?, PatientsBirthTime = ?, PatientsSex = ?, PatientsComments = ?, "
+        "InsertTimestamp = ?, DisplayedFieldsUpdatedTimestamp = NULL, FromDirectoryRecords = 0 "
+        "WHERE UID = ?" );
+      updatePatientStatement.bindValue( 0, QDate::fromString ( patientsBirthDate, "yyyyMMdd" ) );
+      updatePatientStatement.bindValue( 1, patientsBirthTime );
+      updatePatientStatement.bindValue( 2, patientsSex );
+      updatePatientStatement.bindValue( 3, patientComments );
+      updatePatientStatement.bindValue( 4, QDateTime::currentDateTime() );
+      updatePatientStatement.bindValue( 5, dbPatientID );
+      if (loggedExec(updatePatientStatement))
+      {
+        this->updateSearchIndex("Patients", QStringList() << QString::number(dbPatientID));
+        existingFromDirectoryRecords = false;
+      }
+    }
+    patientFromDirectoryRecords = existingFromDirectoryRecords;
   }
   else
   {
     // Insert it
-    QString patientsBirthTime(ctkDataset.GetElementAsString(DCM_PatientBirthTime) );
-    QString patientsSex(ctkDataset.GetElementAsString(DCM_PatientSex) );
-    QString patientsAge(ctkDataset.GetElementAsString(DCM_PatientAge) );
-    QString patientComments(ctkDataset.GetElementAsString(DCM_PatientComments) );
-
-    QSqlQuery insertPatientStatement(this->Database);
-    insertPatientStatement.prepare ( "INSERT INTO Patients "
+    QSqlQuery& insertPatientStatement = this->preparedQuery( "INSERT INTO Patients "
       "( 'UID', 'PatientsName', 'PatientID', 'PatientsBirthDate', 'PatientsBirthTime', 'PatientsSex', 'PatientsAge', 'PatientsComments', "
-        "'InsertTimestamp', 'DisplayedPatientsName', 'DisplayedNumberOfStudies', 'DisplayedFieldsUpdatedTimestamp' ) "
-      "VALUES ( NULL, ?, ?, ?, ?, ?, ?, ?, ?, NULL, NULL, NULL )" );
+        "'InsertTimestamp', 'DisplayedPatientsName', 'DisplayedNumberOfStudies', 'DisplayedFieldsUpdatedTimestamp', 'FromDirectoryRecords' ) "
+      "VALUES ( NULL, ?, ?, ?, ?, ?, ?, ?, ?, NULL, NULL, NULL, ? )" );
     insertPatientStatement.bindValue( 0, patientsName );
     insertPatientStatement.bindValue( 1, patientID );
     insertPatientStatement.bindValue( 2, QDate::fromString ( patientsBirthDate, "yyyyMMdd" ) );
@@ -413,14 +1076,21 @@ int ctkDICOMDatabasePrivate::insertPatient(const ctkDICOMItem& ctkDataset)
     // TODO: shift patient's age to study,
     // since this is not a patient level attribute in images
     // insertPatientStatement.bindValue( 5, patientsAge );
+    insertPatientStatement.bindValue( 5, QVariant(QVariant::String) );
     insertPatientStatement.bindValue( 6, patientComments );
     insertPatientStatement.bindValue( 7, QDateTime::currentDateTime() );
+    insertPatientStatement.bindValue( 8, this->InsertingFromDirectoryRecords ? 1 : 0 );
     loggedExec(insertPatientStatement);
     dbPatientID = insertPatientStatement.lastInsertId().toInt();
+    this->updateSearchIndex("Patients", QStringList() << QString::number(dbPatientID));
     logger.debug( "New patient inserted: " + QString().setNum ( dbPatientID ) );
     qDebug() << "New patient inserted as : " << dbPatientID;
   }
 
+  if (!patientFromDirectoryRecords)
+  {
+    this->KnownPatientUIDs.insert(patientKey, dbPatientID);
+  }
   return dbPatientID;
 }
 
@@ -428,11 +1098,26 @@ int ctkDICOMDatabasePrivate::insertPatient(const ctkDICOMItem& ctkDataset)
 void ctkDICOMDatabasePrivate::insertStudy(const ctkDICOMItem& ctkDataset, int dbPatientID)
 {
   QString studyInstanceUID(ctkDataset.GetElementAsString(DCM_StudyInstanceUID) );
-  QSqlQuery checkStudyExistsQuery(this->Database);
-  checkStudyExistsQuery.prepare( "SELECT * FROM Studies WHERE StudyInstanceUID = ?" );
+  if (this->KnownStudyInstanceUIDs.contains(studyInstanceUID))
+  {
+    this->LastStudyInstanceUID = studyInstanceUID;
+    return;
+  }
+  QSqlQuery& checkStudyExistsQuery = this->preparedQuery(
+    "SELECT FromDirectoryRecords FROM Studies WHERE StudyInstanceUID = ?" );
   checkStudyExistsQuery.bindValue( 0, studyInstanceUID );
   checkStudyExistsQuery.exec();
-  if (!checkStudyExistsQuery.next())
+  bool studyExists = checkStudyExistsQuery.next();
+  bool studyFromDirectoryRecords = studyExists && checkStudyExistsQuery.value(0).toBool();
+  checkStudyExistsQuery.finish();
+  if (studyFromDirectoryRecords && !this->InsertingFromDirectoryRecords)
+  {
+    // Replace the study that has been created from DICOMDIR records
+    QSqlQuery& deleteStudyStatement = this->preparedQuery("DELETE FROM Studies WHERE StudyInstanceUID = ?");
+    deleteStudyStatement.bindValue( 0, studyInstanceUID );
+    studyExists = !loggedExec(deleteStudyStatement);
+  }
+  if (!studyExists)
   {
     qDebug() << "Need to insert new study: " << studyInstanceUID;
 
@@ -446,11 +1131,10 @@ void ctkDICOMDatabasePrivate::insertStudy(const ctkDICOMItem& ctkDataset, int db
     QString referringPhysician(ctkDataset.GetElementAsString(DCM_ReferringPhysicianName) );
     QString studyDescription(ctkDataset.GetElementAsString(DCM_StudyDescription) );
 
-    QSqlQuery insertStudyStatement(this->Database);
-    insertStudyStatement.prepare( "INSERT INTO Studies "
+    QSqlQuery& insertStudyStatement = this->preparedQuery( "INSERT INTO Studies "
       "( 'StudyInstanceUID', 'PatientsUID', 'StudyID', 'StudyDate', 'StudyTime', 'AccessionNumber', 'ModalitiesInStudy', 'InstitutionName', 'ReferringPhysician', 'PerformingPhysiciansName', "
-        "'StudyDescription', 'InsertTimestamp', 'DisplayedNumberOfSeries', 'DisplayedFieldsUpdatedTimestamp' ) "
-      "VALUES ( ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, NULL, NULL )" );
+        "'StudyDescription', 'InsertTimestamp', 'DisplayedNumberOfSeries', 'DisplayedFieldsUpdatedTimestamp', 'FromDirectoryRecords' ) "
+      "VALUES ( ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, NULL, NULL, ? )" );
     insertStudyStatement.bindValue( 0, studyInstanceUID );
     insertStudyStatement.bindValue( 1, dbPatientID );
     insertStudyStatement.bindValue( 2, studyID );
@@ -463,6 +1147,7 @@ void ctkDICOMDatabasePrivate::insertStudy(const ctkDICOMItem& ctkDataset, int db
     insertStudyStatement.bindValue( 9, performingPhysiciansName );
     insertStudyStatement.bindValue( 10, studyDescription );
     insertStudyStatement.bindValue( 11, QDateTime::currentDateTime() );
+    insertStudyStatement.bindValue( 12, this->InsertingFromDirectoryRecords ? 1 : 0 );
     if (!insertStudyStatement.exec())
     {
       logger.error( "Error executing statement: " + insertStudyStatement.lastQuery() + " Error: " + insertStudyStatement.lastError().text() );
@@ -470,11 +1155,21 @@ void ctkDICOMDatabasePrivate::insertStudy(const ctkDICOMItem& ctkDataset, int db
     else
     {
       this->LastStudyInstanceUID = studyInstanceUID;
+      if (!this->InsertingFromDirectoryRecords)
+      {
+        this->KnownStudyInstanceUIDs.insert(studyInstanceUID);
+      }
+      this->updateSearchIndex("Studies", QStringList() << studyInstanceUID);
     }
   }
   else
   {
     qDebug() << "Used existing study: " << studyInstanceUID;
+    this->LastStudyInstanceUID = studyInstanceUID;
+    if (!studyFromDirectoryRecords)
+    {
+      this->KnownStudyInstanceUIDs.insert(studyInstanceUID);
+    }
   }
 }
 
@@ -482,15 +1177,30 @@ void ctkDICOMDatabasePrivate::insertStudy(const ctkDICOMItem& ctkDataset, int db
 void ctkDICOMDatabasePrivate::insertSeries(const ctkDICOMItem& ctkDataset, QString studyInstanceUID)
 {
   QString seriesInstanceUID(ctkDataset.GetElementAsString(DCM_SeriesInstanceUID) );
-  QSqlQuery checkSeriesExistsQuery(this->Database);
-  checkSeriesExistsQuery.prepare( "SELECT * FROM Series WHERE SeriesInstanceUID = ?" );
+  if (this->KnownSeriesInstanceUIDs.contains(seriesInstanceUID))
+  {
+    this->LastSeriesInstanceUID = seriesInstanceUID;
+    return;
+  }
+  QSqlQuery& checkSeriesExistsQuery = this->preparedQuery(
+    "SELECT FromDirectoryRecords FROM Series WHERE SeriesInstanceUID = ?" );
   checkSeriesExistsQuery.bindValue( 0, seriesInstanceUID );
   if (this->LoggedExecVerbose)
   {
     logger.warn( "Statement: " + checkSeriesExistsQuery.lastQuery() );
   }
   checkSeriesExistsQuery.exec();
-  if (!checkSeriesExistsQuery.next())
+  bool seriesExists = checkSeriesExistsQuery.next();
+  bool seriesFromDirectoryRecords = seriesExists && checkSeriesExistsQuery.value(0).toBool();
+  checkSeriesExistsQuery.finish();
+  if (seriesFromDirectoryRecords && !this->InsertingFromDirectoryRecords)
+  {
+    // Replace the series that has been created from DICOMDIR records
+    QSqlQuery& deleteSeriesStatement = this->preparedQuery("DELETE FROM Series WHERE SeriesInstanceUID = ?");
+    deleteSeriesStatement.bindValue( 0, seriesInstanceUID );
+    seriesExists = !loggedExec(deleteSeriesStatement);
+  }
+  if (!seriesExists)
   {
     qDebug() << "Need to insert new series: " << seriesInstanceUID;
 
@@ -507,11 +1217,11 @@ void ctkDICOMDatabasePrivate::insertSeries(const ctkDICOMItem& ctkDataset, QStri
     long echoNumber(ctkDataset.GetElementAsInteger(DCM_EchoNumbers) );
     long temporalPosition(ctkDataset.GetElementAsInteger(DCM_TemporalPositionIdentifier) );
 
-    QSqlQuery insertSeriesStatement(this->Database);
-    insertSeriesStatement.prepare( "INSERT INTO Series "
+    QSqlQuery& insertSeriesStatement = this->preparedQuery( "INSERT INTO Series "
       "( 'SeriesInstanceUID', 'StudyInstanceUID', 'SeriesNumber', 'SeriesDate', 'SeriesTime', 'SeriesDescription', 'Modality', 'BodyPartExamined', "
-        "'FrameOfReferenceUID', 'AcquisitionNumber', 'ContrastAgent', 'ScanningSequence', 'EchoNumber', 'TemporalPosition', 'InsertTimestamp' ) "
-      "VALUES ( ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ? )" );
+        "'FrameOfReferenceUID', 'AcquisitionNumber', 'ContrastAgent', 'ScanningSequence', 'EchoNumber', 'TemporalPosition', 'InsertTimestamp', "
+        "'FromDirectoryRecords' ) "
+      "VALUES ( ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ? )" );
     insertSeriesStatement.bindValue( 0, seriesInstanceUID );
     insertSeriesStatement.bindValue( 1, studyInstanceUID );
     insertSeriesStatement.bindValue( 2, static_cast<int>(seriesNumber) );
@@ -527,6 +1237,7 @@ void ctkDICOMDatabasePrivate::insertSeries(const ctkDICOMItem& ctkDataset, QStri
     insertSeriesStatement.bindValue( 12, static_cast<int>(echoNumber) );
     insertSeriesStatement.bindValue( 13, static_cast<int>(temporalPosition) );
     insertSeriesStatement.bindValue( 14, QDateTime::currentDateTime() );
+    insertSeriesStatement.bindValue( 15, this->InsertingFromDirectoryRecords ? 1 : 0 );
     if ( !insertSeriesStatement.exec() )
     {
       logger.error( "Error executing statement: "
@@ -537,11 +1248,21 @@ void ctkDICOMDatabasePrivate::insertSeries(const ctkDICOMItem& ctkDataset, QStri
     else
     {
       this->LastSeriesInstanceUID = seriesInstanceUID;
+      if (!this->InsertingFromDirectoryRecords)
+      {
+        this->KnownSeriesInstanceUIDs.insert(seriesInstanceUID);
+      }
+      this->updateSearchIndex("Series", QStringList() << seriesInstanceUID);
     }
   }
   else
   {
     qDebug() << "Used existing series: " << seriesInstanceUID;
+    this->LastSeriesInstanceUID = seriesInstanceUID;
+    if (!seriesFromDirectoryRecords)
+    {
+      this->KnownSeriesInstanceUIDs.insert(seriesInstanceUID);
+    }
   }
 }
 
@@ -563,30 +1284,34 @@ bool ctkDICOMDatabasePrivate::openTagCacheDatabase()
     return false;
   }
 
-  // Disable synchronous writing to make modifications faster
-  QSqlQuery pragmaSyncQuery(this->TagCacheDatabase);
-  pragmaSyncQuery.exec("PRAGMA synchronous = OFF");
-  pragmaSyncQuery.finish();
+  // The tag cache is written while the database is browsed
+  ctkDICOMConnectionPool::configureWriter(this->TagCacheDatabase);
+  this->TagCacheConnectionPool.setDatabase(this->TagCacheDatabaseFilename,
+                                           this->TagCacheDatabase.connectionName());
 
   return true;
 }
 
 //------------------------------------------------------------------------------
-void ctkDICOMDatabasePrivate::precacheTags( const QString sopInstanceUID )
+void ctkDICOMDatabasePrivate::precacheTags( const ctkDICOMItem& dataset, const QString sopInstanceUID )
 {
   Q_Q(ctkDICOMDatabase);
 
-  ctkDICOMItem dataset;
-  QString fileName = q->fileForInstance(sopInstanceUID);
-  dataset.InitializeFromFile(fileName);
-
-
   QStringList sopInstanceUIDs, tags, values;
   foreach (const QString &tag, this->TagsToPrecache)
     {
     unsigned short group, element;
     q->tagToGroupElement(tag, group, element);
     DcmTagKey tagKey(group, element);
+    if (this->InsertingFromDirectoryRecords)
+    {
+      // Tags that are not in the records may still be in the file
+      DcmElement* dcmElement = 0;
+      if (dataset.findAndGetElement(tagKey, dcmElement).bad())
+      {
+        continue;
+      }
+    }
     QString value = dataset.GetAllElementValuesAsString(tagKey);
     sopInstanceUIDs << sopInstanceUID;
     tags << tag;
@@ -605,7 +1330,8 @@ void ctkDICOMDatabasePrivate::precacheTags( const QString sopInstanceUID )
 }
 
 //------------------------------------------------------------------------------
-void ctkDICOMDatabasePrivate::insert(const ctkDICOMItem& ctkDataset, const QString& filePath, bool storeFile, bool generateThumbnail)
+bool ctkDICOMDatabasePrivate::insert(const ctkDICOMItem& ctkDataset, const QString& filePath, bool storeFile, bool generateThumbnail,
+                                     const QString& temporaryFilePath)
 {
   Q_Q(ctkDICOMDatabase);
 
@@ -619,17 +1345,43 @@ void ctkDICOMDatabasePrivate::insert(const ctkDICOMItem& ctkDataset, const QStri
 
   QString sopInstanceUID ( ctkDataset.GetElementAsString(DCM_SOPInstanceUID) );
 
-  QSqlQuery fileExistsQuery ( Database );
-  fileExistsQuery.prepare("SELECT InsertTimestamp,Filename FROM Images WHERE SOPInstanceUID == :sopInstanceUID");
-  fileExistsQuery.bindValue(":sopInstanceUID",sopInstanceUID);
   {
-    bool success = fileExistsQuery.exec();
-    if (!success)
+    bool found = false;
+    QString databaseInsertTimestampString;
+    QString databaseFilename;
+    bool databaseFromDirectoryRecords = false;
+    if (this->LookedUpSOPInstanceUIDs.contains(sopInstanceUID))
     {
-      logger.error("SQLITE ERROR: " + fileExistsQuery.lastError().driverText());
-      return;
+      // Existence has been checked already for the whole batch
+      QHash<QString, KnownImage>::const_iterator knownImageIt = this->KnownImages.constFind(sopInstanceUID);
+      found = (knownImageIt != this->KnownImages.constEnd());
+      if (found)
+      {
+        databaseInsertTimestampString = knownImageIt.value().InsertTimestamp;
+        databaseFilename = knownImageIt.value().Filename;
+        databaseFromDirectoryRecords = knownImageIt.value().FromDirectoryRecords;
+      }
+    }
+    else
+    {
+      QSqlQuery& fileExistsQuery = this->preparedQuery(
+        "SELECT InsertTimestamp,Filename,FromDirectoryRecords FROM Images WHERE SOPInstanceUID == :sopInstanceUID");
+      fileExistsQuery.bindValue(":sopInstanceUID",sopInstanceUID);
+      bool success = fileExistsQuery.exec();
+      if (!success)
+      {
+        logger.error("SQLITE ERROR: " + fileExistsQuery.lastError().driverText());
+        return false;
+      }
+      found = fileExistsQuery.next();
+      if (found)
+      {
+        databaseInsertTimestampString = fileExistsQuery.value(0).toString();
+        databaseFilename = fileExistsQuery.value(1).toString();
+        databaseFromDirectoryRecords = fileExistsQuery.value(2).toBool();
+      }
+      fileExistsQuery.finish();
     }
-    bool found = fileExistsQuery.next();
     if (this->LoggedExecVerbose)
     {
       qDebug() << "inserting filePath: " << filePath;
@@ -643,26 +1395,28 @@ void ctkDICOMDatabasePrivate::insert(const ctkDICOMItem& ctkDataset, const QStri
     }
     else
     {
-      QString databaseFilename(fileExistsQuery.value(1).toString());
       QDateTime fileLastModified(QFileInfo(databaseFilename).lastModified());
-      QDateTime databaseInsertTimestamp(QDateTime::fromString(fileExistsQuery.value(0).toString(),Qt::ISODate));
+      QDateTime databaseInsertTimestamp(QDateTime::fromString(databaseInsertTimestampString,Qt::ISODate));
 
-      if ( databaseFilename == filePath && fileLastModified < databaseInsertTimestamp )
+      // An instance created from DICOMDIR records is only up-to-date
+      // for another insert from the records
+      if ( databaseFilename == filePath && fileLastModified < databaseInsertTimestamp
+        && (!databaseFromDirectoryRecords || this->InsertingFromDirectoryRecords) )
       {
         logger.debug ( "File " + databaseFilename + " already added" );
-        return;
+        return false;
       }
       else
       {
-        QSqlQuery deleteFile ( Database );
-        deleteFile.prepare("DELETE FROM Images WHERE SOPInstanceUID == :sopInstanceUID");
+        QSqlQuery& deleteFile = this->preparedQuery("DELETE FROM Images WHERE SOPInstanceUID == :sopInstanceUID");
         deleteFile.bindValue(":sopInstanceUID",sopInstanceUID);
         bool success = deleteFile.exec();
         if (!success)
         {
           logger.error("SQLITE ERROR deleting old image row: " + deleteFile.lastError().driverText());
-          return;
+          return false;
         }
+        this->KnownImages.remove(sopInstanceUID);
       }
     }
   }
@@ -686,50 +1440,20 @@ void ctkDICOMDatabasePrivate::insert(const ctkDICOMItem& ctkDataset, const QStri
   if ( patientsName.isEmpty() || studyInstanceUID.isEmpty() || patientID.isEmpty() )
   {
     logger.error("Dataset is missing necessary information (patient name, study instance UID, or patient ID)!");
-    return;
+    return false;
   }
 
-  // store the file if the database is not in memory
-  // TODO: if we are called from insert(file) we
-  // have to do something else
-  //
+  // store the file if the database is not in memory.
+  // Unless it has been placed while the next files were parsed, the file is
+  // only placed in the database folder right before its row is inserted.
+  // It is placed under a temporary name and only replaces the stored file,
+  // which may be referenced by an existing row, once its row is inserted.
   QString filename = filePath;
-  if ( storeFile && !q->isInMemory() && !seriesInstanceUID.isEmpty() )
+  QString placedFilePath = temporaryFilePath;
+  bool storeInDatabaseFolder = ( storeFile && !q->isInMemory() && !seriesInstanceUID.isEmpty() );
+  if ( storeInDatabaseFolder )
   {
-    // QString studySeriesDirectory = studyInstanceUID + "/" + seriesInstanceUID;
-    QString destinationDirectoryName = q->databaseDirectory() + "/dicom/";
-    QDir destinationDir(destinationDirectoryName);
-    filename = destinationDirectoryName +
-        studyInstanceUID + "/" +
-        seriesInstanceUID + "/" +
-        sopInstanceUID;
-
-    destinationDir.mkpath(studyInstanceUID + "/" +
-                          seriesInstanceUID);
-
-    if (filePath.isEmpty())
-    {
-      if (this->LoggedExecVerbose)
-      {
-        logger.debug("Saving file: " + filename);
-      }
-
-      if ( !ctkDataset.SaveToFile( filename) )
-      {
-        logger.error("Error saving file: " + filename);
-        return;
-      }
-    }
-    else
-    {
-      // we're inserting an existing file
-      QFile currentFile( filePath );
-      currentFile.copy(filename);
-      if (this->LoggedExecVerbose)
-      {
-        logger.debug("Copy file from: " + filePath + " to: " + filename);
-      }
-    }
+    filename = this->storagePath(studyInstanceUID, seriesInstanceUID, sopInstanceUID);
   }
 
   //The dbPatientID  is a unique number within the database,
@@ -794,26 +1518,85 @@ void ctkDICOMDatabasePrivate::insert(const ctkDICOMItem& ctkDataset, const QStri
     //
     if ( !filename.isEmpty() && !seriesInstanceUID.isEmpty() )
     {
-      QSqlQuery checkImageExistsQuery (Database);
-      checkImageExistsQuery.prepare ( "SELECT * FROM Images WHERE Filename = ?" );
+      QSqlQuery& checkImageExistsQuery = this->preparedQuery( "SELECT SOPInstanceUID FROM Images WHERE Filename = ?" );
       checkImageExistsQuery.bindValue ( 0, filename );
       checkImageExistsQuery.exec();
       if (this->LoggedExecVerbose)
       {
         qDebug() << "Maybe add Instance";
       }
-      if (!checkImageExistsQuery.next())
+      bool imageExists = checkImageExistsQuery.next();
+      checkImageExistsQuery.finish();
+      if (!imageExists && storeInDatabaseFolder && temporaryFilePath.isEmpty()
+        && !this->storeInstanceFile(ctkDataset, filePath, filename, placedFilePath))
+      {
+        return false;
+      }
+      if (imageExists && !temporaryFilePath.isEmpty())
+      {
+        // the instance is referenced at its stored file already, which is kept
+        this->unstoreInstanceFile(filePath, temporaryFilePath);
+      }
+      if (!imageExists)
       {
-        QSqlQuery insertImageStatement ( Database );
-        insertImageStatement.prepare ( "INSERT INTO Images ( 'SOPInstanceUID', 'Filename', 'SeriesInstanceUID', 'InsertTimestamp' ) VALUES ( ?, ?, ?, ? )" );
+        QDateTime insertTimestamp = QDateTime::currentDateTime();
+        QSqlQuery& insertImageStatement = this->preparedQuery(
+          "INSERT INTO Images ( 'SOPInstanceUID', 'Filename', 'SeriesInstanceUID', 'InsertTimestamp', 'FromDirectoryRecords' ) "
+          "VALUES ( ?, ?, ?, ?, ? )" );
         insertImageStatement.bindValue ( 0, sopInstanceUID );
         insertImageStatement.bindValue ( 1, filename );
         insertImageStatement.bindValue ( 2, seriesInstanceUID );
-        insertImageStatement.bindValue ( 3, QDateTime::currentDateTime() );
-        insertImageStatement.exec();
+        insertImageStatement.bindValue ( 3, insertTimestamp );
+        // The file has not been read yet, so it must not be considered up-to-date
+        insertImageStatement.bindValue ( 4, this->InsertingFromDirectoryRecords ? 1 : 0 );
+        if (insertImageStatement.exec())
+        {
+          if (!placedFilePath.isEmpty() && !ctkDICOMFileStorage::replaceFile(placedFilePath, filename))
+          {
+            logger.error("Error storing file: " + placedFilePath + " as: " + filename);
+            QSqlQuery& deleteImageStatement = this->preparedQuery( "DELETE FROM Images WHERE Filename = ?" );
+            deleteImageStatement.bindValue ( 0, filename );
+            this->loggedExec(deleteImageStatement);
+            if (temporaryFilePath.isEmpty())
+            {
+              this->unstoreInstanceFile(filePath, placedFilePath);
+            }
+            return false;
+          }
+          if (this->LookedUpSOPInstanceUIDs.contains(sopInstanceUID))
+          {
+            KnownImage knownImage;
+            knownImage.InsertTimestamp = insertTimestamp.toString(Qt::ISODate);
+            knownImage.Filename = filename;
+            knownImage.FromDirectoryRecords = this->InsertingFromDirectoryRecords;
+            this->KnownImages.insert(sopInstanceUID, knownImage);
+          }
+          bool fileMoved = ( storeInDatabaseFolder && !filePath.isEmpty()
+            && this->FileStorage.storageMode() == ctkDICOMDatabase::MoveFiles );
+          if (!filePath.isEmpty() && !fileMoved && !this->InsertingFromDirectoryRecords)
+          {
+            this->addFileToManifest(filePath, this->InsertingFileManifestEntry, filename);
+            if (this->BatchInsertDepth == 0)
+            {
+              this->flushFileManifest();
+            }
+          }
+          this->NumberOfUncommittedInserts++;
+          this->commitInsertBatchIfNeeded();
+        }
+        else
+        {
+          logger.error("SQLITE ERROR inserting image: " + insertImageStatement.lastError().driverText());
+          // A file placed ahead of the insert is handled by the caller
+          if (!placedFilePath.isEmpty() && temporaryFilePath.isEmpty())
+          {
+            this->unstoreInstanceFile(filePath, placedFilePath);
+          }
+          return false;
+        }
 
         // insert was needed, so cache any application-requested tags
-        this->precacheTags(sopInstanceUID);
+        this->precacheTags(ctkDataset, sopInstanceUID);
 
         // let users of this class track when things happen
         emit q->instanceAdded(sopInstanceUID);
@@ -824,19 +1607,20 @@ void ctkDICOMDatabasePrivate::insert(const ctkDICOMItem& ctkDataset, const QStri
       }
     }
 
-    if ( generateThumbnail && ThumbnailGenerator && !seriesInstanceUID.isEmpty() )
+    if ( generateThumbnail && ThumbnailGenerator && !seriesInstanceUID.isEmpty() && !this->InsertingFromDirectoryRecords )
     {
-      QString studySeriesDirectory = studyInstanceUID + "/" + seriesInstanceUID;
-      //Create thumbnail here
-      QString thumbnailPath = q->databaseDirectory() +
-          "/thumbs/" + studyInstanceUID + "/" + seriesInstanceUID
-          + "/" + sopInstanceUID + ".png";
-      QFileInfo thumbnailInfo(thumbnailPath);
-      if ( !(thumbnailInfo.exists() && (thumbnailInfo.lastModified() > QFileInfo(filename).lastModified())) )
+      if (this->MiddleInstanceThumbnailOnly)
       {
-        QDir(q->databaseDirectory() + "/thumbs/").mkpath(studySeriesDirectory);
-        DicomImage dcmImage(QDir::toNativeSeparators(filename).toLatin1());
-        ThumbnailGenerator->generateThumbnail(&dcmImage, thumbnailPath);
+        // The middle instance is only known once all instances of the series are inserted
+        this->SeriesPendingThumbnail.insert(seriesInstanceUID, studyInstanceUID);
+        if (this->BatchInsertDepth == 0)
+        {
+          this->generatePendingSeriesThumbnails();
+        }
+      }
+      else
+      {
+        this->generateThumbnail(studyInstanceUID, seriesInstanceUID, sopInstanceUID, filename);
       }
     }
 
@@ -848,349 +1632,338 @@ void ctkDICOMDatabasePrivate::insert(const ctkDICOMItem& ctkDataset, const QStri
   else
   {
     qDebug() << "No patient name or no patient id - not inserting!";
+    return false;
   }
+  return true;
 }
 
 //------------------------------------------------------------------------------
-int ctkDICOMDatabasePrivate::getDisplayPatientFieldsIndex(QString patientsName, QString patientID, QVector<QMap<QString, QString> > &displayedFieldsVectorPatient)
+bool ctkDICOMDatabasePrivate::storeInstanceFile(const ctkDICOMItem& ctkDataset, const QString& filePath,
+                                                const QString& storedFilePath, QString& temporaryFilePath)
 {
-  // Look for the patient in the displayed fields cache first
-  for (int patientIndex=0; patientIndex < displayedFieldsVectorPatient.size(); ++patientIndex)
+  temporaryFilePath = QString();
+  if (filePath.isEmpty())
   {
-    QMap<QString, QString> currentPatient = displayedFieldsVectorPatient[patientIndex];
-    if ( !currentPatient["PatientID"].compare(patientID)
-      && !currentPatient["PatientsName"].compare(patientsName) )
+    if (this->LoggedExecVerbose)
     {
-      return patientIndex;
+      logger.debug("Saving file: " + storedFilePath);
     }
+    if ( !this->FileStorage.makePath(QFileInfo(storedFilePath).path()) )
+    {
+      logger.error("Error saving file: " + storedFilePath);
+      return false;
+    }
+    QString savedFilePath = this->FileStorage.temporaryFilePath(storedFilePath);
+    if ( !ctkDataset.SaveToFile(savedFilePath) )
+    {
+      logger.error("Error saving file: " + savedFilePath);
+      QFile::remove(savedFilePath);
+      return false;
+    }
+    temporaryFilePath = savedFilePath;
+    return true;
   }
 
-  // Look for the patient in the display database
-  QSqlQuery displayPatientsQuery(this->Database);
-  displayPatientsQuery.prepare( "SELECT * FROM Patients WHERE PatientID = :patientID AND PatientsName = :patientsName ;" );
-  displayPatientsQuery.bindValue(":patientID", patientID);
-  displayPatientsQuery.bindValue(":patientsName", patientsName);
-  if (!displayPatientsQuery.exec())
+  if (QFileInfo(filePath).absoluteFilePath() == QFileInfo(storedFilePath).absoluteFilePath())
   {
-    logger.error("SQLITE ERROR: " + displayPatientsQuery.lastError().driverText());
-    return -1;
+    // File is in the database folder already
+    return true;
   }
-  if (displayPatientsQuery.size() > 1)
+
+  // we're inserting an existing file
+  if (this->LoggedExecVerbose)
   {
-    logger.warn("Multiple patients found with PatientsName=" + patientsName + " and PatientID=" + patientID);
+    logger.debug("Store file from: " + filePath + " to: " + storedFilePath);
   }
-  if (displayPatientsQuery.next())
+  temporaryFilePath = this->FileStorage.storeTemporaryFile(filePath, storedFilePath);
+  if (temporaryFilePath.isEmpty())
   {
-    QSqlRecord patientRecord = displayPatientsQuery.record();
-    QMap<QString, QString> patientFieldsMap;
-    for (int fieldIndex=0; fieldIndex<patientRecord.count(); ++fieldIndex)
-    {
-      patientFieldsMap.insert(patientRecord.fieldName(fieldIndex), patientRecord.value(fieldIndex).toString());
-    }
-    // The index of the patient represents its UID for this update of the display tables
-    int patientIndex = displayedFieldsVectorPatient.size();
-    patientFieldsMap["PatientIndex"] = patientIndex; // Index as a single UID for internal temporal use
-    displayedFieldsVectorPatient.append(patientFieldsMap);
-    return patientIndex;
+    logger.error("Error storing file: " + filePath + " to: " + storedFilePath);
+    return false;
   }
-
-  logger.error("Failed to find patient with PatientsName=" + patientsName + " and PatientID=" + patientID);
-  return -1;
+  return true;
 }
 
 //------------------------------------------------------------------------------
-QString ctkDICOMDatabasePrivate::getDisplayStudyFieldsKey(QString studyInstanceUID, QMap<QString, QMap<QString, QString> > &displayedFieldsMapStudy)
+void ctkDICOMDatabasePrivate::unstoreInstanceFile(const QString& filePath, const QString& temporaryFilePath)
 {
-  // Look for the study in the displayed fields cache first
-  foreach (QString currentStudyInstanceUid, displayedFieldsMapStudy.keys())
+  if (!filePath.isEmpty() && this->FileStorage.storageMode() == ctkDICOMDatabase::MoveFiles)
   {
-    if ( !displayedFieldsMapStudy[currentStudyInstanceUid]["StudyInstanceUID"].compare(studyInstanceUID) )
+    if (!QFile::rename(temporaryFilePath, filePath))
     {
-      return studyInstanceUID;
+      logger.error("Error moving file back from: " + temporaryFilePath + " to: " + filePath);
     }
+    return;
   }
+  QFile::remove(temporaryFilePath);
+}
 
-  // Look for the study in the display database
-  QSqlQuery displayStudiesQuery(this->Database);
-  displayStudiesQuery.prepare( QString("SELECT StudyInstanceUID FROM Studies WHERE StudyInstanceUID = :studyInstanceUID ;") );
-  displayStudiesQuery.bindValue(":studyInstanceUID", studyInstanceUID);
-  if (!displayStudiesQuery.exec())
+//------------------------------------------------------------------------------
+void ctkDICOMDatabasePrivate::generateThumbnail(const QString& studyInstanceUID, const QString& seriesInstanceUID,
+                                                const QString& sopInstanceUID, const QString& filePath)
+{
+  Q_Q(ctkDICOMDatabase);
+  if (!this->ThumbnailGenerator)
   {
-    logger.error("SQLITE ERROR: " + displayStudiesQuery.lastError().driverText());
-    return QString();
+    return;
   }
-  if (displayStudiesQuery.size() > 1)
+  QString thumbnailPath = q->databaseDirectory() +
+      "/thumbs/" + studyInstanceUID + "/" + seriesInstanceUID
+      + "/" + sopInstanceUID + ".png";
+  if (this->AsynchronousThumbnailGeneration)
   {
-    logger.warn("Multiple studies found with StudyInstanceUID=" + studyInstanceUID);
+    this->ThumbnailQueue.enqueue(this->ThumbnailGenerator, sopInstanceUID, filePath, thumbnailPath);
   }
-  if (displayStudiesQuery.next())
+  else if (ctkDICOMThumbnailTask::generateThumbnail(this->ThumbnailGenerator, filePath, thumbnailPath))
   {
-    QSqlRecord studyRecord = displayStudiesQuery.record();
-    QMap<QString, QString> studyFieldsMap;
-    for (int fieldIndex=0; fieldIndex<studyRecord.count(); ++fieldIndex)
-    {
-      studyFieldsMap.insert(studyRecord.fieldName(fieldIndex), studyRecord.value(fieldIndex).toString());
-    }
-    displayedFieldsMapStudy.insert(studyInstanceUID, studyFieldsMap);
-    return studyInstanceUID;
+    emit q->thumbnailReady(sopInstanceUID, thumbnailPath);
   }
-
-  logger.error("Failed to find study with StudyInstanceUID=" + studyInstanceUID);
-  return QString();
 }
 
 //------------------------------------------------------------------------------
-QString ctkDICOMDatabasePrivate::getDisplaySeriesFieldsKey(QString seriesInstanceUID, QMap<QString, QMap<QString, QString> > &displayedFieldsMapSeries)
+void ctkDICOMDatabasePrivate::generatePendingSeriesThumbnails()
 {
-  // Look for the series in the displayed fields cache first
-  foreach (QString currentSeriesInstanceUid, displayedFieldsMapSeries.keys())
+  QHash<QString, QString> seriesPendingThumbnail = this->SeriesPendingThumbnail;
+  this->SeriesPendingThumbnail.clear();
+  QHash<QString, QString>::const_iterator it;
+  for (it = seriesPendingThumbnail.constBegin(); it != seriesPendingThumbnail.constEnd(); ++it)
   {
-    if ( !displayedFieldsMapSeries[currentSeriesInstanceUid]["SeriesInstanceUID"].compare(seriesInstanceUID) )
+    QSqlQuery& instancesQuery = this->preparedQuery(
+      "SELECT SOPInstanceUID, Filename FROM Images WHERE SeriesInstanceUID = ? ORDER BY Filename");
+    instancesQuery.bindValue(0, it.key());
+    if (!this->loggedExec(instancesQuery))
+    {
+      continue;
+    }
+    QList<QPair<QString, QString> > instances;
+    while (instancesQuery.next())
     {
-      return seriesInstanceUID;
+      instances << qMakePair(instancesQuery.value(0).toString(), instancesQuery.value(1).toString());
     }
+    instancesQuery.finish();
+    if (instances.isEmpty())
+    {
+      continue;
+    }
+    const QPair<QString, QString>& middleInstance = instances[instances.size() / 2];
+    this->generateThumbnail(it.value(), it.key(), middleInstance.first, middleInstance.second);
   }
+}
 
-  // Look for the series in the display database
-  QSqlQuery displaySeriesQuery(this->Database);
-  displaySeriesQuery.prepare( QString("SELECT SeriesInstanceUID FROM Series WHERE SeriesInstanceUID = :seriesInstanceUID ;") );
-  displaySeriesQuery.bindValue(":seriesInstanceUID", seriesInstanceUID);
-  if (!displaySeriesQuery.exec())
-  {
-    logger.error("SQLITE ERROR: " + displaySeriesQuery.lastError().driverText());
-    return QString();
-  }
-  if (displaySeriesQuery.size() > 1)
+//------------------------------------------------------------------------------
+bool ctkDICOMDatabasePrivate::pendingDisplayedFieldsInstances(QList<PendingDisplayedFieldsInstance>& instances)
+{
+  //TODO: handle cases when the values actually changed; now we only cover insertion and schema update
+  QSqlQuery newFilesQuery(this->Database);
+  if (!this->loggedExec(newFilesQuery, QString(
+    "SELECT Images.SOPInstanceUID, Images.SeriesInstanceUID, Series.StudyInstanceUID, Studies.PatientsUID "
+    "FROM Images "
+    "LEFT JOIN Series ON Images.SeriesInstanceUID = Series.SeriesInstanceUID "
+    "LEFT JOIN Studies ON Series.StudyInstanceUID = Studies.StudyInstanceUID "
+    "WHERE Images.DisplayedFieldsUpdatedTimestamp IS NULL;")))
   {
-    logger.warn("Multiple series found with SeriesInstanceUID=" + seriesInstanceUID);
+    return false;
   }
-  if (displaySeriesQuery.next())
+  while (newFilesQuery.next())
   {
-    QSqlRecord seriesRecord = displaySeriesQuery.record();
-    QMap<QString, QString> seriesFieldsMap;
-    for (int fieldIndex=0; fieldIndex<seriesRecord.count(); ++fieldIndex)
-    {
-      seriesFieldsMap.insert(seriesRecord.fieldName(fieldIndex), seriesRecord.value(fieldIndex).toString());
-    }
-    displayedFieldsMapSeries.insert(seriesInstanceUID, seriesFieldsMap);
-    return seriesInstanceUID;
+    PendingDisplayedFieldsInstance instance;
+    instance.SOPInstanceUID = newFilesQuery.value(0).toString();
+    instance.SeriesInstanceUID = newFilesQuery.value(1).toString();
+    instance.StudyInstanceUID = newFilesQuery.value(2).toString();
+    instance.PatientUID = newFilesQuery.value(3).toString();
+    instances << instance;
   }
-
-  logger.error("Failed to find series with SeriesInstanceUID=" + seriesInstanceUID);
-  return QString();
+  return true;
 }
 
 //------------------------------------------------------------------------------
-bool ctkDICOMDatabasePrivate::applyDisplayedFieldsChanges( QMap<QString, QMap<QString, QString> > &displayedFieldsMapSeries,
-                                                           QMap<QString, QMap<QString, QString> > &displayedFieldsMapStudy,
-                                                           QVector<QMap<QString, QString> > &displayedFieldsVectorPatient )
+bool ctkDICOMDatabasePrivate::loadDisplayedFieldsPatients(DisplayedFieldsUpdate& update)
 {
-  QMap<int, int> patientIndexToPatientUidMap;
-
-  // Update patient fields
-  for (int patientIndex=0; patientIndex < displayedFieldsVectorPatient.size(); ++patientIndex)
+  QStringList patientUIDs = update.Patients.keys();
+  const int chunkSize = 500;
+  for (int start = 0; start < patientUIDs.size(); start += chunkSize)
   {
-    QMap<QString, QString> currentPatient = displayedFieldsVectorPatient[patientIndex];
     QSqlQuery displayPatientsQuery(this->Database);
-    displayPatientsQuery.prepare( "SELECT * FROM Patients WHERE PatientID=:patientID AND PatientsName=:patientsName ;" );
-    displayPatientsQuery.bindValue(":patientID", currentPatient["PatientID"]);
-    displayPatientsQuery.bindValue(":patientsName", currentPatient["PatientsName"]);
-    if (!displayPatientsQuery.exec())
+    if (!this->execForValues(displayPatientsQuery, "SELECT * FROM Patients WHERE UID IN (%1);",
+      patientUIDs.mid(start, chunkSize)))
     {
-      logger.error("SQLITE ERROR: " + displayPatientsQuery.lastError().driverText());
       return false;
     }
-    if (displayPatientsQuery.next())
+    while (displayPatientsQuery.next())
     {
-      QString displayPatientsFieldUpdateList;
-      foreach (QString tagName, currentPatient.keys())
+      QSqlRecord patientRecord = displayPatientsQuery.record();
+      QMap<QString, QString>& patientFieldsMap = update.Patients[patientRecord.value("UID").toString()];
+      for (int fieldIndex=0; fieldIndex<patientRecord.count(); ++fieldIndex)
       {
-        if (tagName == "PatientIndex")
-        {
-          continue; // Do not write patient index that is only used internally and temporarily
-        }
-        displayPatientsFieldUpdateList.append( tagName + "='" + (currentPatient[tagName].isEmpty() ? "" : currentPatient[tagName]) + "', " );
+        patientFieldsMap.insert(patientRecord.fieldName(fieldIndex), patientRecord.value(fieldIndex).toString());
       }
-
-      // Trim the separators from the end
-      displayPatientsFieldUpdateList = displayPatientsFieldUpdateList.left(displayPatientsFieldUpdateList.size() - 2);
-
-      QSqlRecord patientRecord = displayPatientsQuery.record();
-      int patientUID = patientRecord.value("UID").toInt();
-
-      QSqlQuery updateDisplayPatientStatement(this->Database);
-      QString updateDisplayPatientStatementString = 
-        QString("UPDATE Patients SET %1 WHERE UID='%2';").arg(displayPatientsFieldUpdateList).arg(patientUID);
-      this->loggedExec(updateDisplayPatientStatement, updateDisplayPatientStatementString);
-
-      QSqlQuery updateDisplayedFieldsUpdatedTimestampStatement(this->Database);
-      QString updateDisplayedFieldsUpdatedTimestampStatementString = 
-        QString("UPDATE Patients SET DisplayedFieldsUpdatedTimestamp=CURRENT_TIMESTAMP WHERE UID='%1';").arg(patientUID);
-      this->loggedExec(updateDisplayedFieldsUpdatedTimestampStatement, updateDisplayedFieldsUpdatedTimestampStatementString);
-
-      patientIndexToPatientUidMap[patientIndex] = patientUID;
-    }
-    else
-    {
-      logger.error("Failed to find patient with PatientsName=" + currentPatient["PatientsName"] + " and PatientID=" + currentPatient["PatientID"]);
-      return false;
     }
-  } // For each patient in displayedFieldsVectorPatient
+  }
 
-  // Update study fields
-  foreach (QString currentStudyInstanceUid, displayedFieldsMapStudy.keys())
+  // Patients that are not in the database are not updated
+  QMutableHashIterator<QString, QMap<QString, QString> > it(update.Patients);
+  while (it.hasNext())
   {
-    QMap<QString, QString> currentStudy = displayedFieldsMapStudy[currentStudyInstanceUid];
-    QSqlQuery displayStudiesQuery(QString("SELECT StudyInstanceUID FROM Studies WHERE StudyInstanceUID='%1' ;").arg(currentStudyInstanceUid), this->Database);
-    if (!displayStudiesQuery.exec())
+    if (it.next().value().isEmpty())
     {
-      logger.error("SQLITE ERROR: " + displayStudiesQuery.lastError().driverText());
-      return false;
+      it.remove();
     }
-    if (displayStudiesQuery.next())
-    {
-      QString displayStudiesFieldUpdateList;
-      foreach (QString tagName, currentStudy.keys())
-      {
-        if (!tagName.compare("PatientIndex"))
-        {
-          displayStudiesFieldUpdateList.append( "PatientsUID=" + QString::number(patientIndexToPatientUidMap[currentStudy["PatientIndex"].toInt()]) + ", " );
-        }
-        else
-        {
-          displayStudiesFieldUpdateList.append( tagName + "='" + (currentStudy[tagName].isEmpty() ? "" : currentStudy[tagName]) + "', " );
-        }
-      }
-      // Trim the separators from the end
-      displayStudiesFieldUpdateList = displayStudiesFieldUpdateList.left(displayStudiesFieldUpdateList.size() - 2);
+  }
+  return true;
+}
 
-      QSqlQuery updateDisplayStudyStatement(this->Database);
-      QString updateDisplayStudyStatementString = 
-        QString("UPDATE Studies SET %1 WHERE StudyInstanceUID='%2';").arg(displayStudiesFieldUpdateList).arg(currentStudy["StudyInstanceUID"]);
-      this->loggedExec(updateDisplayStudyStatement, updateDisplayStudyStatementString);
+//------------------------------------------------------------------------------
+bool ctkDICOMDatabasePrivate::cachedTagsForInstances(const QStringList& sopInstanceUIDs, const QStringList& tags,
+                                                     QHash<QString, QMap<QString, QString> >& cachedTags)
+{
+  Q_Q(ctkDICOMDatabase);
+  if ( !q->tagCacheExists() )
+  {
+    return false;
+  }
 
-      QSqlQuery updateDisplayedFieldsUpdatedTimestampStatement(this->Database);
-      QString updateDisplayedFieldsUpdatedTimestampStatementString = 
-        QString("UPDATE Studies SET DisplayedFieldsUpdatedTimestamp=CURRENT_TIMESTAMP WHERE StudyInstanceUID='%1';").arg(currentStudy["StudyInstanceUID"]);
-      this->loggedExec(updateDisplayedFieldsUpdatedTimestampStatement, updateDisplayedFieldsUpdatedTimestampStatementString);
-    }
-    else
-    {
-      logger.error("Failed to find study with StudyInstanceUID=" + currentStudyInstanceUid);
-      return false;
-    }
-  } // For each study in displayedFieldsMapStudy
+  // Tags are zero-filled hex group,element pairs, so they can be part of the statement
+  QString queryTemplate("SELECT SOPInstanceUID, Tag, Value FROM TagCache WHERE SOPInstanceUID IN (%1)");
+  if (!tags.isEmpty())
+  {
+    queryTemplate += QString(" AND Tag IN ('%1')").arg(tags.join("','"));
+  }
 
-  // Update series fields
-  foreach (QString currentSeriesInstanceUid, displayedFieldsMapSeries.keys())
+  const int chunkSize = 500;
+  for (int start = 0; start < sopInstanceUIDs.size(); start += chunkSize)
   {
-    // Insert row into Series if does not exist
-    QMap<QString, QString> currentSeries = displayedFieldsMapSeries[currentSeriesInstanceUid];
-    QSqlQuery displaySeriesQuery(QString("SELECT SeriesInstanceUID FROM Series WHERE SeriesInstanceUID='%1' ;").arg(currentSeriesInstanceUid), this->Database);
-    if (!displaySeriesQuery.exec())
+    QSqlQuery selectValues(this->TagCacheDatabase);
+    if (!this->execForValues(selectValues, queryTemplate, sopInstanceUIDs.mid(start, chunkSize)))
     {
-      logger.error("SQLITE ERROR: " + displaySeriesQuery.lastError().driverText());
       return false;
     }
-    if (displaySeriesQuery.next())
+    while (selectValues.next())
     {
-      QString displaySeriesFieldUpdateList;
-      foreach (QString tagName, currentSeries.keys())
+      QString value = selectValues.value(2).toString();
+      if (value.isNull() || value == TagNotInInstance || value == ValueIsEmptyString)
       {
-        displaySeriesFieldUpdateList.append( tagName + "='" + (currentSeries[tagName].isEmpty() ? "" : currentSeries[tagName]) + "', " );
+        value = QString("");
       }
-      // Trim the separators from the end
-      displaySeriesFieldUpdateList = displaySeriesFieldUpdateList.left(displaySeriesFieldUpdateList.size() - 2);
-
-      QSqlQuery updateDisplaySeriesStatement(this->Database);
-      QString updateDisplaySeriesStatementString = 
-        QString("UPDATE Series SET %1 WHERE SeriesInstanceUID='%2';").arg(displaySeriesFieldUpdateList).arg(currentSeries["SeriesInstanceUID"]);
-      this->loggedExec(updateDisplaySeriesStatement, updateDisplaySeriesStatementString);
-
-      QSqlQuery updateDisplayedFieldsUpdatedTimestampStatement(this->Database);
-      QString updateDisplayedFieldsUpdatedTimestampStatementString = 
-        QString("UPDATE Series SET DisplayedFieldsUpdatedTimestamp=CURRENT_TIMESTAMP WHERE SeriesInstanceUID='%1';").arg(currentSeries["SeriesInstanceUID"]);
-      this->loggedExec(updateDisplayedFieldsUpdatedTimestampStatement, updateDisplayedFieldsUpdatedTimestampStatementString);
-    }
-    else
-    {
-      logger.error("Failed to find series with SeriesInstanceUID=" + currentSeriesInstanceUid);
-      return false;
+      cachedTags[selectValues.value(0).toString()].insert(selectValues.value(1).toString(), value);
     }
-  } // For each series in displayedFieldsMapSeries
-
+  }
   return true;
 }
 
 //------------------------------------------------------------------------------
-void ctkDICOMDatabasePrivate::setCountToSeriesDisplayedFields(QMap<QString, QMap<QString, QString> > &displayedFieldsMapSeries)
+bool ctkDICOMDatabasePrivate::countForValues(QSqlDatabase& database, const QString& queryTemplate,
+                                             const QStringList& keys, QHash<QString, int>& counts)
 {
-  foreach (QString currentSeriesInstanceUid, displayedFieldsMapSeries.keys())
+  const int chunkSize = 500;
+  for (int start = 0; start < keys.size(); start += chunkSize)
   {
-    QSqlQuery countQuery(
-      QString("SELECT COUNT(*) FROM TagCache WHERE Tag='%1' AND Value='%2';")
-        .arg(ctkDICOMItem::TagKeyStripped(DCM_SeriesInstanceUID)).arg(currentSeriesInstanceUid),
-      this->TagCacheDatabase );
-    if (!countQuery.exec())
+    QSqlQuery countQuery(database);
+    if (!this->execForValues(countQuery, queryTemplate, keys.mid(start, chunkSize)))
     {
-      logger.error("SQLITE ERROR: " + countQuery.lastError().driverText());
-      continue;
+      return false;
+    }
+    while (countQuery.next())
+    {
+      counts[countQuery.value(0).toString()] = countQuery.value(1).toInt();
     }
-
-    countQuery.first();
-    int currentCount = countQuery.value(0).toInt();
-
-    QMap<QString, QString> displayedFieldsForCurrentSeries = displayedFieldsMapSeries[currentSeriesInstanceUid];
-    displayedFieldsForCurrentSeries["DisplayedCount"] = QString::number(currentCount);
-    displayedFieldsMapSeries[currentSeriesInstanceUid] = displayedFieldsForCurrentSeries;
   }
+  return true;
 }
 
 //------------------------------------------------------------------------------
-void ctkDICOMDatabasePrivate::setNumberOfSeriesToStudyDisplayedFields(QMap<QString, QMap<QString, QString> > &displayedFieldsMapStudy)
+void ctkDICOMDatabasePrivate::setCountsToDisplayedFields(DisplayedFieldsUpdate& update)
 {
-  foreach (QString currentStudyInstanceUid, displayedFieldsMapStudy.keys())
+  QHash<QString, int> numberOfInstances;
+  this->countForValues(this->TagCacheDatabase,
+    QString("SELECT Value, COUNT(*) FROM TagCache WHERE Tag='%1' AND Value IN (%2) GROUP BY Value;")
+      .arg(ctkDICOMItem::TagKeyStripped(DCM_SeriesInstanceUID)).arg("%1"),
+    update.Series.keys(), numberOfInstances);
+  QHash<QString, QMap<QString, QString> >::iterator it;
+  for (it = update.Series.begin(); it != update.Series.end(); ++it)
   {
-    QSqlQuery numberOfSeriesQuery(
-      QString("SELECT COUNT(*) FROM Series WHERE StudyInstanceUID='%1';").arg(currentStudyInstanceUid),
-      this->Database );
-    if (!numberOfSeriesQuery.exec())
-    {
-      logger.error("SQLITE ERROR: " + numberOfSeriesQuery.lastError().driverText());
-      continue;
-    }
+    it.value()["DisplayedCount"] = QString::number(numberOfInstances.value(it.key(), 0));
+  }
 
-    numberOfSeriesQuery.first();
-    int currentNumberOfSeries = numberOfSeriesQuery.value(0).toInt();
+  QHash<QString, int> numberOfSeries;
+  this->countForValues(this->Database,
+    "SELECT StudyInstanceUID, COUNT(*) FROM Series WHERE StudyInstanceUID IN (%1) GROUP BY StudyInstanceUID;",
+    update.Studies.keys(), numberOfSeries);
+  for (it = update.Studies.begin(); it != update.Studies.end(); ++it)
+  {
+    it.value()["DisplayedNumberOfSeries"] = QString::number(numberOfSeries.value(it.key(), 0));
+  }
 
-    QMap<QString, QString> displayedFieldsForCurrentStudy = displayedFieldsMapStudy[currentStudyInstanceUid];
-    displayedFieldsForCurrentStudy["DisplayedNumberOfSeries"] = QString::number(currentNumberOfSeries);
-    displayedFieldsMapStudy[currentStudyInstanceUid] = displayedFieldsForCurrentStudy;
+  QHash<QString, int> numberOfStudies;
+  this->countForValues(this->Database,
+    "SELECT PatientsUID, COUNT(*) FROM Studies WHERE PatientsUID IN (%1) GROUP BY PatientsUID;",
+    update.Patients.keys(), numberOfStudies);
+  for (it = update.Patients.begin(); it != update.Patients.end(); ++it)
+  {
+    it.value()["DisplayedNumberOfStudies"] = QString::number(numberOfStudies.value(it.key(), 0));
   }
 }
 
 //------------------------------------------------------------------------------
-void ctkDICOMDatabasePrivate::setNumberOfStudiesToPatientDisplayedFields(QVector<QMap<QString, QString> > &displayedFieldsVectorPatient)
+bool ctkDICOMDatabasePrivate::applyDisplayedFieldsChanges(const QString& table, const QString& keyField,
+                                                          const QHash<QString, QMap<QString, QString> >& displayedFields)
 {
-  for (int patientIndex=0; patientIndex<displayedFieldsVectorPatient.size(); ++patientIndex)
+  if (displayedFields.isEmpty())
+  {
+    return true;
+  }
+
+  // A single statement is prepared for the union of the fields of all items
+  QSet<QString> fieldNameSet;
+  QHash<QString, QMap<QString, QString> >::const_iterator it;
+  for (it = displayedFields.constBegin(); it != displayedFields.constEnd(); ++it)
   {
-    QMap<QString, QString> displayedFieldsForCurrentPatient = displayedFieldsVectorPatient[patientIndex];
-    int patientUID = displayedFieldsForCurrentPatient["UID"].toInt();
-    QSqlQuery numberOfStudiesQuery(
-      QString("SELECT COUNT(*) FROM Studies WHERE PatientsUID='%1';").arg(patientUID),
-      this->Database );
-    if (!numberOfStudiesQuery.exec())
+    foreach (const QString& fieldName, it.value().keys())
     {
-      logger.error("SQLITE ERROR: " + numberOfStudiesQuery.lastError().driverText());
-      continue;
+      fieldNameSet.insert(fieldName);
     }
+  }
+  fieldNameSet.remove(keyField);
+  fieldNameSet.remove("UID");
+  fieldNameSet.remove("DisplayedFieldsUpdatedTimestamp");
+  QStringList fieldNames = fieldNameSet.toList();
+  fieldNames.sort();
+
+  QStringList assignments;
+  foreach (const QString& fieldName, fieldNames)
+  {
+    // Binding NULL keeps the current value
+    assignments << QString("%1=COALESCE(?,%1)").arg(fieldName);
+  }
+  assignments << "DisplayedFieldsUpdatedTimestamp=CURRENT_TIMESTAMP";
 
-    numberOfStudiesQuery.first();
-    int currentNumberOfStudies = numberOfStudiesQuery.value(0).toInt();
+  QVector<QVariantList> boundValues(fieldNames.size() + 1);
+  for (it = displayedFields.constBegin(); it != displayedFields.constEnd(); ++it)
+  {
+    const QMap<QString, QString>& fields = it.value();
+    for (int fieldIndex = 0; fieldIndex < fieldNames.size(); ++fieldIndex)
+    {
+      QMap<QString, QString>::const_iterator fieldIt = fields.constFind(fieldNames[fieldIndex]);
+      if (fieldIt == fields.constEnd())
+      {
+        boundValues[fieldIndex] << QVariant(QVariant::String);
+      }
+      else
+      {
+        // Empty values are stored as empty strings, not NULL
+        boundValues[fieldIndex] << (fieldIt.value().isNull() ? QString("") : fieldIt.value());
+      }
+    }
+    boundValues[fieldNames.size()] << it.key();
+  }
 
-    displayedFieldsForCurrentPatient["DisplayedNumberOfStudies"] = QString::number(currentNumberOfStudies);
-    displayedFieldsVectorPatient[patientIndex] = displayedFieldsForCurrentPatient;
+  QSqlQuery updateDisplayedFieldsStatement(this->Database);
+  updateDisplayedFieldsStatement.prepare(QString("UPDATE %1 SET %2 WHERE %3=?;")
+    .arg(table).arg(assignments.join(", ")).arg(keyField));
+  foreach (const QVariantList& values, boundValues)
+  {
+    updateDisplayedFieldsStatement.addBindValue(values);
   }
+  return this->loggedExecBatch(updateDisplayedFieldsStatement);
 }
 
 
@@ -1218,13 +1991,19 @@ ctkDICOMDatabase::ctkDICOMDatabase(QObject* parent)
 //------------------------------------------------------------------------------
 ctkDICOMDatabase::~ctkDICOMDatabase()
 {
+  Q_D(ctkDICOMDatabase);
+  d->ThumbnailQueue.waitForDone();
 }
 
 //------------------------------------------------------------------------------
 void ctkDICOMDatabase::openDatabase(const QString databaseFile, const QString& connectionName )
 {
   Q_D(ctkDICOMDatabase);
+  d->ConnectionPool.close();
+  d->PreparedQueries.clear();
+  d->TransactionDepth = 0;
   d->DatabaseFileName = databaseFile;
+  d->FileStorage.clearDirectoryCache();
   QString verifiedConnectionName = connectionName;
   if (verifiedConnectionName.isEmpty())
   {
@@ -1232,6 +2011,7 @@ void ctkDICOMDatabase::openDatabase(const QString databaseFile, const QString& c
   }
   d->Database = QSqlDatabase::addDatabase("QSQLITE", verifiedConnectionName);
   d->Database.setDatabaseName(databaseFile);
+  d->DatabaseThread = QThread::currentThread();
   if ( ! (d->Database.open()) )
   {
     d->LastError = d->Database.lastError().text();
@@ -1246,22 +2026,36 @@ void ctkDICOMDatabase::openDatabase(const QString databaseFile, const QString& c
     }
   }
   d->resetLastInsertedValues();
+  d->createSearchIndex();
 
   if (!isInMemory())
   {
-    QFileSystemWatcher* watcher = new QFileSystemWatcher(QStringList(databaseFile),this);
+    // Other threads read through their own connection without blocking the writes
+    ctkDICOMConnectionPool::configureWriter(d->Database);
+    d->ConnectionPool.setDatabase(databaseFile, verifiedConnectionName);
+
+    // Commits are written to the log file until it is checkpointed
+    QStringList watchedFiles(databaseFile);
+    if (QFile::exists(databaseFile + "-wal"))
+    {
+      watchedFiles << databaseFile + "-wal";
+    }
+    QFileSystemWatcher* watcher = new QFileSystemWatcher(watchedFiles,this);
     connect(watcher, SIGNAL(fileChanged(QString)),this, SIGNAL (databaseChanged()) );
   }
-
-  // Disable synchronous writing to make modifications faster
-  QSqlQuery pragmaSyncQuery(d->Database);
-  pragmaSyncQuery.exec("PRAGMA synchronous = OFF");
-  pragmaSyncQuery.finish();
+  else
+  {
+    // Disable synchronous writing to make modifications faster
+    QSqlQuery pragmaSyncQuery(d->Database);
+    pragmaSyncQuery.exec("PRAGMA synchronous = OFF");
+    pragmaSyncQuery.finish();
+  }
 
   // Set up the tag cache for use later
   QFileInfo fileInfo(d->DatabaseFileName);
   d->TagCacheDatabaseFilename = QString( fileInfo.dir().path() + "/ctkDICOMTagCache.sql" );
   d->TagCacheVerified = false;
+  d->InMemoryTagCache.clear();
   if ( !this->tagCacheExists() )
   {
     this->initializeTagCache();
@@ -1298,9 +2092,43 @@ const QSqlDatabase& ctkDICOMDatabase::database() const {
   return d->Database;
 }
 
+//------------------------------------------------------------------------------
+QSqlDatabase ctkDICOMDatabase::readConnection()
+{
+  Q_D(ctkDICOMDatabase);
+  if (this->isInMemory())
+  {
+    return d->Database;
+  }
+  return d->ConnectionPool.readConnection();
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMDatabase::beginReadSnapshot()
+{
+  Q_D(ctkDICOMDatabase);
+  if (this->isInMemory())
+  {
+    return false;
+  }
+  return d->ConnectionPool.beginReadSnapshot();
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMDatabase::endReadSnapshot()
+{
+  Q_D(ctkDICOMDatabase);
+  d->ConnectionPool.endReadSnapshot();
+}
+
 //------------------------------------------------------------------------------
 void ctkDICOMDatabase::setThumbnailGenerator(ctkDICOMAbstractThumbnailGenerator *generator){
   Q_D(ctkDICOMDatabase);
+  if (generator != d->ThumbnailGenerator)
+  {
+    // Queued thumbnails still use the previous generator
+    d->ThumbnailQueue.waitForDone();
+  }
   d->ThumbnailGenerator = generator;
 }
 
@@ -1311,64 +2139,162 @@ ctkDICOMAbstractThumbnailGenerator* ctkDICOMDatabase::thumbnailGenerator(){
 }
 
 //------------------------------------------------------------------------------
-bool ctkDICOMDatabase::initializeDatabase(const char* sqlFileName/* = ":/dicom/dicom-schema.sql" */)
+void ctkDICOMDatabase::setAsynchronousThumbnailGeneration(bool asynchronous)
 {
   Q_D(ctkDICOMDatabase);
+  d->AsynchronousThumbnailGeneration = asynchronous;
+}
 
-  d->resetLastInsertedValues();
-
-  // remove any existing schema info - this handles the case where an
-  // old schema should be loaded for testing.
-  QSqlQuery dropSchemaInfo(d->Database);
-  d->loggedExec( dropSchemaInfo, QString("DROP TABLE IF EXISTS 'SchemaInfo';") );
-  return d->executeScript(sqlFileName);
+//------------------------------------------------------------------------------
+bool ctkDICOMDatabase::asynchronousThumbnailGeneration() const
+{
+  Q_D(const ctkDICOMDatabase);
+  return d->AsynchronousThumbnailGeneration;
 }
 
 //------------------------------------------------------------------------------
-QString ctkDICOMDatabase::schemaVersionLoaded()
+void ctkDICOMDatabase::setMiddleInstanceThumbnailOnly(bool middleInstanceOnly)
 {
   Q_D(ctkDICOMDatabase);
-  /// look for the version info in the database
-  QSqlQuery versionQuery(d->Database);
-  if ( !d->loggedExec( versionQuery, QString("SELECT Version from SchemaInfo;") ) )
-  {
-    return QString("");
-  }
-
-  if (versionQuery.next())
+  if (!middleInstanceOnly)
   {
-    return versionQuery.value(0).toString();
+    d->generatePendingSeriesThumbnails();
   }
-
-  return QString("");
+  d->MiddleInstanceThumbnailOnly = middleInstanceOnly;
 }
 
 //------------------------------------------------------------------------------
-QString ctkDICOMDatabase::schemaVersion()
+bool ctkDICOMDatabase::middleInstanceThumbnailOnly() const
 {
-  // When changing schema version:
-  // * make sure this matches the Version value in the
-  //   SchemaInfo table defined in Resources/dicom-schema.sql
-  // * make sure the 'Images' contains a 'Filename' column
-  //   so that the ctkDICOMDatabasePrivate::filenames method
-  //   still works.
-  //
-  return QString("0.6.2");
-};
+  Q_D(const ctkDICOMDatabase);
+  return d->MiddleInstanceThumbnailOnly;
+}
 
 //------------------------------------------------------------------------------
-bool ctkDICOMDatabase::updateSchemaIfNeeded(const char* schemaFile/* = ":/dicom/dicom-schema.sql" */)
+void ctkDICOMDatabase::setNumberOfThumbnailThreads(int numberOfThreads)
 {
-  if ( schemaVersionLoaded() != schemaVersion() )
-  {
-    return this->updateSchema(schemaFile);
-  }
-  else
-  {
-    emit schemaUpdateStarted(0);
-    emit schemaUpdated();
-    return false;
-  }
+  Q_D(ctkDICOMDatabase);
+  d->ThumbnailQueue.setMaximumThreadCount(numberOfThreads);
+}
+
+//------------------------------------------------------------------------------
+int ctkDICOMDatabase::numberOfThumbnailThreads() const
+{
+  Q_D(const ctkDICOMDatabase);
+  return d->ThumbnailQueue.maximumThreadCount();
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMDatabase::setStorageMode(StorageMode mode)
+{
+  Q_D(ctkDICOMDatabase);
+  d->FileStorage.setStorageMode(mode);
+}
+
+//------------------------------------------------------------------------------
+ctkDICOMDatabase::StorageMode ctkDICOMDatabase::storageMode() const
+{
+  Q_D(const ctkDICOMDatabase);
+  return d->FileStorage.storageMode();
+}
+
+//------------------------------------------------------------------------------
+QString ctkDICOMDatabase::storeFileInDatabaseFolder(const QString& filePath, const ctkDICOMItem& dataset)
+{
+  Q_D(ctkDICOMDatabase);
+  // insert() rejects datasets without study instance UID, and
+  // does not store the files of datasets without series instance UID
+  QString studyInstanceUID(dataset.GetElementAsString(DCM_StudyInstanceUID));
+  QString seriesInstanceUID(dataset.GetElementAsString(DCM_SeriesInstanceUID));
+  QString sopInstanceUID(dataset.GetElementAsString(DCM_SOPInstanceUID));
+  if (this->isInMemory() || filePath.isEmpty()
+    || studyInstanceUID.isEmpty() || seriesInstanceUID.isEmpty() || sopInstanceUID.isEmpty())
+  {
+    return QString();
+  }
+  QString storedFilePath = d->storagePath(studyInstanceUID, seriesInstanceUID, sopInstanceUID);
+  if (QFileInfo(filePath).absoluteFilePath() == QFileInfo(storedFilePath).absoluteFilePath())
+  {
+    // the file is in the database folder already, it must not be removed if it is not inserted
+    return QString();
+  }
+  return d->FileStorage.storeTemporaryFile(filePath, storedFilePath);
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMDatabase::waitForThumbnails()
+{
+  Q_D(ctkDICOMDatabase);
+  d->ThumbnailQueue.waitForDone();
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMDatabase::initializeDatabase(const char* sqlFileName/* = ":/dicom/dicom-schema.sql" */)
+{
+  Q_D(ctkDICOMDatabase);
+
+  d->resetLastInsertedValues();
+  // Statements prepared for the old schema must not be reused
+  d->PreparedQueries.clear();
+
+  // remove any existing schema info - this handles the case where an
+  // old schema should be loaded for testing.
+  QSqlQuery dropSchemaInfo(d->Database);
+  d->loggedExec( dropSchemaInfo, QString("DROP TABLE IF EXISTS 'SchemaInfo';") );
+  d->dropSearchIndex();
+  if (!d->executeScript(sqlFileName))
+  {
+    return false;
+  }
+  d->createSearchIndex();
+  return true;
+}
+
+//------------------------------------------------------------------------------
+QString ctkDICOMDatabase::schemaVersionLoaded()
+{
+  Q_D(ctkDICOMDatabase);
+  /// look for the version info in the database
+  QSqlQuery versionQuery(d->Database);
+  if ( !d->loggedExec( versionQuery, QString("SELECT Version from SchemaInfo;") ) )
+  {
+    return QString("");
+  }
+
+  if (versionQuery.next())
+  {
+    return versionQuery.value(0).toString();
+  }
+
+  return QString("");
+}
+
+//------------------------------------------------------------------------------
+QString ctkDICOMDatabase::schemaVersion()
+{
+  // When changing schema version:
+  // * make sure this matches the Version value in the
+  //   SchemaInfo table defined in Resources/dicom-schema.sql
+  // * make sure the 'Images' contains a 'Filename' column
+  //   so that the ctkDICOMDatabasePrivate::filenames method
+  //   still works.
+  //
+  return QString("0.6.5");
+};
+
+//------------------------------------------------------------------------------
+bool ctkDICOMDatabase::updateSchemaIfNeeded(const char* schemaFile/* = ":/dicom/dicom-schema.sql" */)
+{
+  if ( schemaVersionLoaded() != schemaVersion() )
+  {
+    return this->updateSchema(schemaFile);
+  }
+  else
+  {
+    emit schemaUpdateStarted(0);
+    emit schemaUpdated();
+    return false;
+  }
 }
 
 //------------------------------------------------------------------------------
@@ -1388,6 +2314,7 @@ bool ctkDICOMDatabase::updateSchema(const char* schemaFile/* = ":/dicom/dicom-sc
   emit schemaUpdateStarted(allFiles.length());
 
   int progressValue = 0;
+  this->beginBatchInsert();
   foreach(QString file, allFiles)
   {
     emit schemaUpdateProgress(progressValue);
@@ -1398,6 +2325,7 @@ bool ctkDICOMDatabase::updateSchema(const char* schemaFile/* = ":/dicom/dicom-sc
 
     progressValue++;
   }
+  this->endBatchInsert();
 
   // Update displayed fields in the updated database
   emit displayedFieldsUpdateStarted();
@@ -1414,8 +2342,21 @@ bool ctkDICOMDatabase::updateSchema(const char* schemaFile/* = ":/dicom/dicom-sc
 void ctkDICOMDatabase::closeDatabase()
 {
   Q_D(ctkDICOMDatabase);
+  if (d->TransactionDepth > 0)
+  {
+    logger.warn("Closing database while a transaction is in progress, pending changes are committed");
+    d->TransactionDepth = 1;
+    d->endTransaction();
+  }
+  d->SeriesPendingThumbnail.clear();
+  d->ThumbnailQueue.waitForDone();
+  d->PreparedQueries.clear();
+  d->ConnectionPool.close();
+  d->TagCacheConnectionPool.close();
   d->Database.close();
   d->TagCacheDatabase.close();
+  d->InMemoryTagCache.clear();
+  d->FileStorage.clearDirectoryCache();
 }
 
 //
@@ -1426,7 +2367,7 @@ void ctkDICOMDatabase::closeDatabase()
 QStringList ctkDICOMDatabase::patients()
 {
   Q_D(ctkDICOMDatabase);
-  QSqlQuery query(d->Database);
+  QSqlQuery query(d->readDatabase());
   query.prepare ( "SELECT UID FROM Patients" );
   query.exec();
   QStringList result;
@@ -1441,7 +2382,7 @@ QStringList ctkDICOMDatabase::patients()
 QStringList ctkDICOMDatabase::studiesForPatient(QString dbPatientID)
 {
   Q_D(ctkDICOMDatabase);
-  QSqlQuery query(d->Database);
+  QSqlQuery query(d->readDatabase());
   query.prepare ( "SELECT StudyInstanceUID FROM Studies WHERE PatientsUID = ?" );
   query.bindValue ( 0, dbPatientID );
   query.exec();
@@ -1457,7 +2398,7 @@ QStringList ctkDICOMDatabase::studiesForPatient(QString dbPatientID)
 QString ctkDICOMDatabase::studyForSeries(QString seriesUID)
 {
   Q_D(ctkDICOMDatabase);
-  QSqlQuery query(d->Database);
+  QSqlQuery query(d->readDatabase());
   query.prepare ( "SELECT StudyInstanceUID FROM Series WHERE SeriesInstanceUID= ?" );
   query.bindValue ( 0, seriesUID);
   query.exec();
@@ -1473,7 +2414,7 @@ QString ctkDICOMDatabase::studyForSeries(QString seriesUID)
 QString ctkDICOMDatabase::patientForStudy(QString studyUID)
 {
   Q_D(ctkDICOMDatabase);
-  QSqlQuery query(d->Database);
+  QSqlQuery query(d->readDatabase());
   query.prepare ( "SELECT PatientsUID FROM Studies WHERE StudyInstanceUID= ?" );
   query.bindValue ( 0, studyUID);
   query.exec();
@@ -1494,7 +2435,7 @@ QHash<QString,QString> ctkDICOMDatabase::descriptionsForFile(QString fileName)
   QString studyUID(this->studyForSeries(seriesUID));
   QString patientID(this->patientForStudy(studyUID));
 
-  QSqlQuery query(d->Database);
+  QSqlQuery query(d->readDatabase());
   query.prepare ( "SELECT SeriesDescription FROM Series WHERE SeriesInstanceUID= ?" );
   query.bindValue ( 0, seriesUID);
   query.exec();
@@ -1527,7 +2468,7 @@ QString ctkDICOMDatabase::descriptionForSeries(const QString seriesUID)
 
   QString result;
 
-  QSqlQuery query(d->Database);
+  QSqlQuery query(d->readDatabase());
   query.prepare ( "SELECT SeriesDescription FROM Series WHERE SeriesInstanceUID= ?" );
   query.bindValue ( 0, seriesUID);
   query.exec();
@@ -1546,7 +2487,7 @@ QString ctkDICOMDatabase::descriptionForStudy(const QString studyUID)
 
   QString result;
 
-  QSqlQuery query(d->Database);
+  QSqlQuery query(d->readDatabase());
   query.prepare ( "SELECT StudyDescription FROM Studies WHERE StudyInstanceUID= ?" );
   query.bindValue ( 0, studyUID);
   query.exec();
@@ -1565,7 +2506,7 @@ QString ctkDICOMDatabase::nameForPatient(const QString patientUID)
 
   QString result;
 
-  QSqlQuery query(d->Database);
+  QSqlQuery query(d->readDatabase());
   query.prepare ( "SELECT PatientsName FROM Patients WHERE UID= ?" );
   query.bindValue ( 0, patientUID);
   query.exec();
@@ -1581,7 +2522,7 @@ QString ctkDICOMDatabase::nameForPatient(const QString patientUID)
 QStringList ctkDICOMDatabase::seriesForStudy(QString studyUID)
 {
   Q_D(ctkDICOMDatabase);
-  QSqlQuery query(d->Database);
+  QSqlQuery query(d->readDatabase());
   query.prepare ( "SELECT SeriesInstanceUID FROM Series WHERE StudyInstanceUID=?");
   query.bindValue ( 0, studyUID );
   query.exec();
@@ -1597,7 +2538,7 @@ QStringList ctkDICOMDatabase::seriesForStudy(QString studyUID)
 QStringList ctkDICOMDatabase::instancesForSeries(const QString seriesUID)
 {
   Q_D(ctkDICOMDatabase);
-  QSqlQuery query(d->Database);
+  QSqlQuery query(d->readDatabase());
   query.prepare("SELECT SOPInstanceUID FROM Images WHERE SeriesInstanceUID= ?");
   query.bindValue(0, seriesUID);
   query.exec();
@@ -1614,7 +2555,7 @@ QStringList ctkDICOMDatabase::instancesForSeries(const QString seriesUID)
 QStringList ctkDICOMDatabase::filesForSeries(QString seriesUID)
 {
   Q_D(ctkDICOMDatabase);
-  QSqlQuery query(d->Database);
+  QSqlQuery query(d->readDatabase());
   query.prepare ( "SELECT Filename FROM Images WHERE SeriesInstanceUID=?");
   query.bindValue ( 0, seriesUID );
   query.exec();
@@ -1630,7 +2571,7 @@ QStringList ctkDICOMDatabase::filesForSeries(QString seriesUID)
 QString ctkDICOMDatabase::fileForInstance(QString sopInstanceUID)
 {
   Q_D(ctkDICOMDatabase);
-  QSqlQuery query(d->Database);
+  QSqlQuery query(d->readDatabase());
   query.prepare ( "SELECT Filename FROM Images WHERE SOPInstanceUID=?");
   query.bindValue ( 0, sopInstanceUID );
   query.exec();
@@ -1646,7 +2587,7 @@ QString ctkDICOMDatabase::fileForInstance(QString sopInstanceUID)
 QString ctkDICOMDatabase::seriesForFile(QString fileName)
 {
   Q_D(ctkDICOMDatabase);
-  QSqlQuery query(d->Database);
+  QSqlQuery query(d->readDatabase());
   query.prepare ( "SELECT SeriesInstanceUID FROM Images WHERE Filename=?");
   query.bindValue ( 0, fileName );
   query.exec();
@@ -1662,7 +2603,7 @@ QString ctkDICOMDatabase::seriesForFile(QString fileName)
 QString ctkDICOMDatabase::instanceForFile(QString fileName)
 {
   Q_D(ctkDICOMDatabase);
-  QSqlQuery query(d->Database);
+  QSqlQuery query(d->readDatabase());
   query.prepare ( "SELECT SOPInstanceUID FROM Images WHERE Filename=?");
   query.bindValue ( 0, fileName );
   query.exec();
@@ -1678,7 +2619,7 @@ QString ctkDICOMDatabase::instanceForFile(QString fileName)
 QDateTime ctkDICOMDatabase::insertDateTimeForInstance(QString sopInstanceUID)
 {
   Q_D(ctkDICOMDatabase);
-  QSqlQuery query(d->Database);
+  QSqlQuery query(d->readDatabase());
   query.prepare ( "SELECT InsertTimestamp FROM Images WHERE SOPInstanceUID=?");
   query.bindValue ( 0, sopInstanceUID );
   query.exec();
@@ -1706,7 +2647,7 @@ QStringList ctkDICOMDatabase::allFiles()
 void ctkDICOMDatabase::loadInstanceHeader (QString sopInstanceUID)
 {
   Q_D(ctkDICOMDatabase);
-  QSqlQuery query(d->Database);
+  QSqlQuery query(d->readDatabase());
   query.prepare ( "SELECT Filename FROM Images WHERE SOPInstanceUID=?");
   query.bindValue ( 0, sopInstanceUID );
   query.exec();
@@ -1851,15 +2792,15 @@ QString ctkDICOMDatabase::fileValue(const QString fileName, const unsigned short
     return value;
   }
 
+  DcmTagKey tagKey(group, element);
   ctkDICOMItem dataset;
-  dataset.InitializeFromFile(fileName);
+  dataset.InitializeFromFileUntilTag(fileName, tagKeyAfter(tagKey));
   if (!dataset.IsInitialized())
   {
     logger.error( "File " + fileName + " could not be initialized.");
     return "";
   }
 
-  DcmTagKey tagKey(group, element);
   value = dataset.GetAllElementValuesAsString(tagKey);
   this->cacheTag(sopInstanceUID, tag, value);
   return value;
@@ -1903,6 +2844,80 @@ void ctkDICOMDatabase::prepareInsert()
   d->resetLastInsertedValues();
 }
 
+//------------------------------------------------------------------------------
+void ctkDICOMDatabase::beginBatchInsert()
+{
+  Q_D(ctkDICOMDatabase);
+  if (d->BatchInsertDepth++ == 0)
+  {
+    d->beginTransaction();
+  }
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMDatabase::endBatchInsert()
+{
+  Q_D(ctkDICOMDatabase);
+  if (d->BatchInsertDepth == 0)
+  {
+    logger.warn("endBatchInsert called without matching beginBatchInsert");
+    return;
+  }
+  if (--d->BatchInsertDepth == 0)
+  {
+    d->flushFileManifest();
+    d->endTransaction();
+    d->generatePendingSeriesThumbnails();
+  }
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMDatabase::setInsertBatchSize(int numberOfInstances)
+{
+  Q_D(ctkDICOMDatabase);
+  d->InsertBatchSize = qMax(1, numberOfInstances);
+}
+
+//------------------------------------------------------------------------------
+int ctkDICOMDatabase::insertBatchSize() const
+{
+  Q_D(const ctkDICOMDatabase);
+  return d->InsertBatchSize;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMDatabase::insert(const QList<ctkDICOMDatabase::IndexingResult>& indexingResults)
+{
+  Q_D(ctkDICOMDatabase);
+  if (indexingResults.isEmpty())
+  {
+    return;
+  }
+
+  this->beginBatchInsert();
+  d->lookupExistingItems(indexingResults);
+  foreach (const ctkDICOMDatabase::IndexingResult& indexingResult, indexingResults)
+  {
+    if (!indexingResult.dataset || !indexingResult.dataset->IsInitialized())
+    {
+      logger.warn(QString("Could not read DICOM file:") + indexingResult.filePath);
+      continue;
+    }
+    d->InsertingFromDirectoryRecords = indexingResult.fromDirectoryRecords;
+    d->InsertingFileManifestEntry = indexingResult.fileManifestEntry;
+    if (!d->insert(*indexingResult.dataset, indexingResult.filePath,
+          indexingResult.storeFile, indexingResult.generateThumbnail, indexingResult.temporaryFilePath)
+      && !indexingResult.temporaryFilePath.isEmpty())
+    {
+      // the file has been placed while it was parsed, but it is not referenced
+      d->unstoreInstanceFile(indexingResult.filePath, indexingResult.temporaryFilePath);
+    }
+    d->InsertingFromDirectoryRecords = false;
+    d->InsertingFileManifestEntry = ctkDICOMDatabase::FileManifestEntry();
+  }
+  this->endBatchInsert();
+}
+
 //------------------------------------------------------------------------------
 void ctkDICOMDatabase::insert( DcmItem *item, bool storeFile, bool generateThumbnail)
 {
@@ -1954,6 +2969,18 @@ void ctkDICOMDatabase::insert( const QString& filePath, bool storeFile, bool gen
   }
 }
 
+//------------------------------------------------------------------------------
+void ctkDICOMDatabase::insert( const QString& filePath, const ctkDICOMItem& ctkDataset, bool storeFile, bool generateThumbnail)
+{
+  Q_D(ctkDICOMDatabase);
+  if ( !ctkDataset.IsInitialized() )
+  {
+    logger.warn(QString("Could not read DICOM file:") + filePath);
+    return;
+  }
+  d->insert( ctkDataset, filePath, storeFile, generateThumbnail );
+}
+
 //------------------------------------------------------------------------------
 void ctkDICOMDatabase::setTagsToPrecache( const QStringList tags)
 {
@@ -1968,14 +2995,83 @@ const QStringList ctkDICOMDatabase::tagsToPrecache()
   return d->TagsToPrecache;
 }
 
+//------------------------------------------------------------------------------
+int ctkDICOMDatabase::cacheTagsFromFiles(const QStringList& fileNames, const QStringList& tags)
+{
+  Q_D(ctkDICOMDatabase);
+  QStringList tagsToCache = tags.isEmpty() ? d->TagsToPrecache : tags;
+  tagsToCache.removeDuplicates();
+
+  QList<DcmTagKey> tagKeys;
+  DcmTagKey lastTagKey = DCM_SOPInstanceUID;
+  foreach (const QString& tag, tagsToCache)
+  {
+    unsigned short group, element;
+    if (!this->tagToGroupElement(tag, group, element))
+    {
+      logger.error("Invalid tag: " + tag);
+      return 0;
+    }
+    tagKeys << DcmTagKey(group, element);
+    if (lastTagKey < tagKeys.last())
+    {
+      lastTagKey = tagKeys.last();
+    }
+  }
+  DcmTagKey stopParsingAtElement = tagKeyAfter(lastTagKey);
+
+  // Each task writes only its own result, they are collected once all tasks are done
+  QVector<ctkDICOMExtractedTags> results(fileNames.size());
+  QThreadPool pool;
+  pool.setMaxThreadCount(qMax(1, QThread::idealThreadCount()));
+  for (int fileIndex = 0; fileIndex < fileNames.size(); ++fileIndex)
+  {
+    pool.start(new ctkDICOMTagExtractionTask(fileNames[fileIndex], tagKeys, stopParsingAtElement, &results[fileIndex]));
+  }
+  pool.waitForDone();
+
+  QStringList sopInstanceUIDs, tagsForValues, values;
+  int numberOfFiles = 0;
+  foreach (const ctkDICOMExtractedTags& result, results)
+  {
+    if (result.SOPInstanceUID.isEmpty())
+    {
+      continue;
+    }
+    for (int tagIndex = 0; tagIndex < tagsToCache.size(); ++tagIndex)
+    {
+      sopInstanceUIDs << result.SOPInstanceUID;
+      tagsForValues << tagsToCache[tagIndex];
+      values << result.Values[tagIndex];
+    }
+    ++numberOfFiles;
+  }
+  if (sopInstanceUIDs.isEmpty())
+  {
+    return numberOfFiles;
+  }
+
+  QSqlQuery transaction( d->TagCacheDatabase );
+  transaction.prepare( "BEGIN TRANSACTION" );
+  transaction.exec();
+
+  bool success = this->cacheTags(sopInstanceUIDs, tagsForValues, values);
+
+  transaction = QSqlQuery( d->TagCacheDatabase );
+  transaction.prepare( "END TRANSACTION" );
+  transaction.exec();
+
+  return success ? numberOfFiles : 0;
+}
+
 //------------------------------------------------------------------------------
 bool ctkDICOMDatabase::fileExistsAndUpToDate(const QString& filePath)
 {
   Q_D(ctkDICOMDatabase);
   bool result(false);
 
-  QSqlQuery check_filename_query(database());
-  check_filename_query.prepare("SELECT InsertTimestamp FROM Images WHERE Filename == ?");
+  QSqlQuery check_filename_query(d->readDatabase());
+  check_filename_query.prepare("SELECT InsertTimestamp FROM Images WHERE Filename == ? AND FromDirectoryRecords = 0");
   check_filename_query.bindValue(0,filePath);
   d->loggedExec(check_filename_query);
   if ( check_filename_query.next() &&
@@ -1987,6 +3083,166 @@ bool ctkDICOMDatabase::fileExistsAndUpToDate(const QString& filePath)
   return result;
 }
 
+//------------------------------------------------------------------------------
+ctkDICOMDatabase::FileManifest ctkDICOMDatabase::fileManifest(const QString& directoryName)
+{
+  Q_D(ctkDICOMDatabase);
+  FileManifest manifest;
+
+  // Range condition instead of LIKE, so that the primary key index is used
+  // ('0' is the character that follows '/')
+  QString directoryPath = QFileInfo(directoryName).absoluteFilePath();
+  QSqlQuery manifestQuery( d->Database );
+  manifestQuery.prepare("SELECT Filename, FileSize, LastModified, StoredFilename FROM FileManifest "
+                        "WHERE Filename >= ? AND Filename < ?");
+  manifestQuery.bindValue(0, directoryPath + "/");
+  manifestQuery.bindValue(1, directoryPath + "0");
+  if (!d->loggedExec(manifestQuery))
+  {
+    return manifest;
+  }
+  while (manifestQuery.next())
+  {
+    FileManifestEntry entry;
+    entry.size = manifestQuery.value(1).toLongLong();
+    entry.lastModified = manifestQuery.value(2).toLongLong();
+    entry.storedFilename = manifestQuery.value(3).toString();
+    manifest.insert(manifestQuery.value(0).toString(), entry);
+  }
+  return manifest;
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMDatabase::updateFileManifest(const FileManifest& entries)
+{
+  Q_D(ctkDICOMDatabase);
+  if (entries.isEmpty())
+  {
+    return true;
+  }
+  QVariantList filenames, sizes, lastModifiedTimes, storedFilenames;
+  for (FileManifest::const_iterator it = entries.constBegin(); it != entries.constEnd(); ++it)
+  {
+    filenames << QFileInfo(it.key()).absoluteFilePath();
+    sizes << it.value().size;
+    lastModifiedTimes << it.value().lastModified;
+    storedFilenames << it.value().storedFilename;
+  }
+  d->beginTransaction();
+  // The stored filename that the insert has recorded is kept if the entry has none
+  QSqlQuery insertManifestEntries( d->Database );
+  insertManifestEntries.prepare(
+    "INSERT OR REPLACE INTO FileManifest ( 'Filename', 'FileSize', 'LastModified', 'StoredFilename' ) "
+    "VALUES ( ?, ?, ?, COALESCE(NULLIF(?, ''), (SELECT StoredFilename FROM FileManifest WHERE Filename = ?)) )" );
+  insertManifestEntries.addBindValue(filenames);
+  insertManifestEntries.addBindValue(sizes);
+  insertManifestEntries.addBindValue(lastModifiedTimes);
+  insertManifestEntries.addBindValue(storedFilenames);
+  insertManifestEntries.addBindValue(filenames);
+  bool success = d->loggedExecBatch(insertManifestEntries);
+  d->endTransaction();
+  return success;
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMDatabase::removeFiles(const QStringList& filePaths)
+{
+  Q_D(ctkDICOMDatabase);
+  if (filePaths.isEmpty())
+  {
+    return true;
+  }
+
+  d->beginTransaction();
+
+  bool success = true;
+  QStringList removedSOPInstanceUIDs;
+  QStringList thumbnailsToRemove;
+  QSet<QString> atlasesToRemove;
+  QSet<QString> affectedSeriesInstanceUIDs;
+  const int chunkSize = 500;
+  for (int start = 0; start < filePaths.size() && success; start += chunkSize)
+  {
+    QStringList filePathsChunk = filePaths.mid(start, chunkSize);
+    QSqlQuery imagesQuery( d->Database );
+    success = d->execForValues(imagesQuery,
+      "SELECT Images.SOPInstanceUID, Images.SeriesInstanceUID, Series.StudyInstanceUID FROM Images "
+      "LEFT JOIN Series ON Images.SeriesInstanceUID = Series.SeriesInstanceUID "
+      "WHERE Images.Filename IN (%1)", filePathsChunk);
+    while (success && imagesQuery.next())
+    {
+      QString sopInstanceUID = imagesQuery.value(0).toString();
+      QString seriesInstanceUID = imagesQuery.value(1).toString();
+      QString studyInstanceUID = imagesQuery.value(2).toString();
+      removedSOPInstanceUIDs << sopInstanceUID;
+      affectedSeriesInstanceUIDs.insert(seriesInstanceUID);
+      QString seriesThumbnailDirectory = databaseDirectory() + "/thumbs/" + studyInstanceUID + "/" + seriesInstanceUID;
+      thumbnailsToRemove << seriesThumbnailDirectory + "/" + sopInstanceUID + ".png";
+      atlasesToRemove.insert(ctkDICOMThumbnailTask::seriesAtlasPath(seriesThumbnailDirectory));
+    }
+
+    QSqlQuery imagesRemove( d->Database );
+    success = success && d->execForValues(imagesRemove, "DELETE FROM Images WHERE Filename IN (%1)", filePathsChunk);
+    QStringList absoluteFilePathsChunk;
+    foreach (const QString& filePath, filePathsChunk)
+    {
+      absoluteFilePathsChunk << QFileInfo(filePath).absoluteFilePath();
+    }
+    QSqlQuery manifestRemove( d->Database );
+    success = success && d->execForValues(manifestRemove, "DELETE FROM FileManifest WHERE Filename IN (%1)", absoluteFilePathsChunk);
+    // Entries of the files that the instances have been stored from
+    QSqlQuery storedManifestRemove( d->Database );
+    success = success && d->execForValues(storedManifestRemove,
+      "DELETE FROM FileManifest WHERE StoredFilename IN (%1)", absoluteFilePathsChunk);
+  }
+
+  // Instances are counted from the tag cache (see setCountsToDisplayedFields),
+  // so the cached tags of the removed instances must go as well
+  if (d->TagCacheDatabase.isOpen() && !removedSOPInstanceUIDs.isEmpty())
+  {
+    QSqlQuery tagCacheTransaction( d->TagCacheDatabase );
+    tagCacheTransaction.exec( "BEGIN TRANSACTION" );
+    for (int start = 0; start < removedSOPInstanceUIDs.size() && success; start += chunkSize)
+    {
+      QSqlQuery tagCacheRemove( d->TagCacheDatabase );
+      success = d->execForValues(tagCacheRemove, "DELETE FROM TagCache WHERE SOPInstanceUID IN (%1)",
+        removedSOPInstanceUIDs.mid(start, chunkSize));
+    }
+    tagCacheTransaction.exec( success ? "END TRANSACTION" : "ROLLBACK TRANSACTION" );
+  }
+
+  // Number of instances of the series that are kept has changed,
+  // make the next updateDisplayedFields() call recompute them
+  QStringList affectedSeries = affectedSeriesInstanceUIDs.toList();
+  for (int start = 0; start < affectedSeries.size() && success; start += chunkSize)
+  {
+    QSqlQuery resetDisplayedFields( d->Database );
+    success = d->execForValues(resetDisplayedFields,
+      "UPDATE Images SET DisplayedFieldsUpdatedTimestamp = NULL WHERE SeriesInstanceUID IN (%1)",
+      affectedSeries.mid(start, chunkSize));
+  }
+
+  d->endTransaction();
+
+  d->InMemoryTagCache.remove(removedSOPInstanceUIDs);
+  foreach (const QString& thumbnailToRemove, thumbnailsToRemove)
+  {
+    QFile thumbnailFile(thumbnailToRemove);
+    if (thumbnailFile.exists() && !thumbnailFile.remove())
+    {
+      logger.warn("Failed to remove thumbnail " + thumbnailToRemove);
+    }
+  }
+  foreach (const QString& atlasToRemove, atlasesToRemove)
+  {
+    QFile::remove(atlasToRemove);
+  }
+
+  this->cleanup();
+  d->resetLastInsertedValues();
+
+  return success;
+}
 
 //------------------------------------------------------------------------------
 bool ctkDICOMDatabase::isOpen() const
@@ -2019,14 +3275,19 @@ bool ctkDICOMDatabase::removeSeries(const QString& seriesInstanceUID)
   }
 
   QList< QPair<QString,QString> > removeList;
+  QStringList removedSOPInstanceUIDs;
+  QString studyInstanceUID;
   while ( fileExistsQuery.next() )
   {
     QString dbFilePath = fileExistsQuery.value(fileExistsQuery.record().indexOf("Filename")).toString();
     QString sopInstanceUID = fileExistsQuery.value(fileExistsQuery.record().indexOf("SOPInstanceUID")).toString();
-    QString studyInstanceUID = fileExistsQuery.value(fileExistsQuery.record().indexOf("StudyInstanceUID")).toString();
+    studyInstanceUID = fileExistsQuery.value(fileExistsQuery.record().indexOf("StudyInstanceUID")).toString();
     QString internalFilePath = studyInstanceUID + "/" + seriesInstanceUID + "/" + sopInstanceUID;
     removeList << qMakePair(dbFilePath,internalFilePath);
+    removedSOPInstanceUIDs << sopInstanceUID;
   }
+  d->InMemoryTagCache.remove(removedSOPInstanceUIDs);
+  d->SeriesPendingThumbnail.remove(seriesInstanceUID);
 
   QSqlQuery fileRemove ( d->Database );
   fileRemove.prepare("DELETE FROM Images WHERE SeriesInstanceUID == :seriesID");
@@ -2039,6 +3300,24 @@ bool ctkDICOMDatabase::removeSeries(const QString& seriesInstanceUID)
     logger.error("SQLITE ERROR: " + fileRemove.lastError().driverText());
   }
 
+  // Removed files are indexed again by the next refresh if they still exist
+  QStringList removedFilePaths;
+  QPair<QString,QString> removedFile;
+  foreach (removedFile, removeList)
+  {
+    removedFilePaths << QFileInfo(removedFile.first).absoluteFilePath();
+  }
+  const int chunkSize = 500;
+  for (int start = 0; start < removedFilePaths.size(); start += chunkSize)
+  {
+    QSqlQuery manifestRemove( d->Database );
+    d->execForValues(manifestRemove, "DELETE FROM FileManifest WHERE Filename IN (%1)",
+      removedFilePaths.mid(start, chunkSize));
+    QSqlQuery storedManifestRemove( d->Database );
+    d->execForValues(storedManifestRemove, "DELETE FROM FileManifest WHERE StoredFilename IN (%1)",
+      removedFilePaths.mid(start, chunkSize));
+  }
+
   QPair<QString,QString> fileToRemove;
   foreach (fileToRemove, removeList)
   {
@@ -2075,6 +3354,11 @@ bool ctkDICOMDatabase::removeSeries(const QString& seriesInstanceUID)
       }
     }
   }
+  if (!removeList.isEmpty())
+  {
+    QFile::remove(ctkDICOMThumbnailTask::seriesAtlasPath(
+      databaseDirectory() + "/thumbs/" + studyInstanceUID + "/" + seriesInstanceUID));
+  }
 
   this->cleanup();
 
@@ -2088,9 +3372,30 @@ bool ctkDICOMDatabase::cleanup()
 {
   Q_D(ctkDICOMDatabase);
   QSqlQuery seriesCleanup ( d->Database );
-  seriesCleanup.exec("DELETE FROM Series WHERE ( SELECT COUNT(*) FROM Images WHERE Images.SeriesInstanceUID = Series.SeriesInstanceUID ) = 0;");
-  seriesCleanup.exec("DELETE FROM Studies WHERE ( SELECT COUNT(*) FROM Series WHERE Series.StudyInstanceUID = Studies.StudyInstanceUID ) = 0;");
-  seriesCleanup.exec("DELETE FROM Patients WHERE ( SELECT COUNT(*) FROM Studies WHERE Studies.PatientsUID = Patients.UID ) = 0;");
+  QStringList tables;
+  tables << "Series" << "Studies" << "Patients";
+  QStringList emptyItems;
+  emptyItems << "( SELECT COUNT(*) FROM Images WHERE Images.SeriesInstanceUID = Series.SeriesInstanceUID ) = 0"
+             << "( SELECT COUNT(*) FROM Series WHERE Series.StudyInstanceUID = Studies.StudyInstanceUID ) = 0"
+             << "( SELECT COUNT(*) FROM Studies WHERE Studies.PatientsUID = Patients.UID ) = 0";
+  for (int i = 0; i < tables.size(); ++i)
+  {
+    if (d->SearchIndexAvailable)
+    {
+      // Only the index entries of the removed items are looked up, not the whole index
+      QString keyColumn;
+      QStringList fields;
+      ctkDICOMSearchIndexTable(tables[i], keyColumn, fields);
+      QStringList removedUIDs;
+      seriesCleanup.exec("SELECT " + keyColumn + " FROM " + tables[i] + " WHERE " + emptyItems[i]);
+      while (seriesCleanup.next())
+      {
+        removedUIDs << seriesCleanup.value(0).toString();
+      }
+      d->removeSearchIndexEntries(tables[i], removedUIDs);
+    }
+    seriesCleanup.exec("DELETE FROM " + tables[i] + " WHERE " + emptyItems[i] + ";");
+  }
 
   return true;
 }
@@ -2211,6 +3516,7 @@ bool ctkDICOMDatabase::initializeTagCache()
     return false;
   }
 
+  d->InMemoryTagCache.clear();
   d->TagCacheVerified = true;
   return true;
 }
@@ -2226,21 +3532,39 @@ QString ctkDICOMDatabase::cachedTag(const QString sopInstanceUID, const QString
       return( "" );
     }
   }
-  QSqlQuery selectValue( d->TagCacheDatabase );
-  selectValue.prepare( "SELECT Value FROM TagCache WHERE SOPInstanceUID = :sopInstanceUID AND Tag = :tag" );
-  selectValue.bindValue(":sopInstanceUID",sopInstanceUID);
-  selectValue.bindValue(":tag",tag);
-  d->loggedExec(selectValue);
-  QString result("");
-  if (selectValue.next())
+  // Null value means that the tag is not in the tag cache
+  QString value;
+  if (!d->InMemoryTagCache.tag(sopInstanceUID, tag, value))
   {
-    result = selectValue.value(0).toString();
-    if (result == QString(""))
+    int version = d->InMemoryTagCache.version(sopInstanceUID);
+    QSqlQuery selectValue( d->readTagCacheDatabase() );
+    selectValue.prepare( "SELECT Value FROM TagCache WHERE SOPInstanceUID = :sopInstanceUID AND Tag = :tag" );
+    selectValue.bindValue(":sopInstanceUID",sopInstanceUID);
+    selectValue.bindValue(":tag",tag);
+    if (!d->loggedExec(selectValue))
+    {
+      return( "" );
+    }
+    if (selectValue.next())
     {
-      result = ValueIsEmptyString;
+      // toString() of a non-null empty value is an empty, but not null, string
+      value = selectValue.value(0).toString();
+      if (value.isNull())
+      {
+        value = QString("");
+      }
     }
+    d->InMemoryTagCache.addTag(sopInstanceUID, tag, value, version);
   }
-  return( result );
+  if (value.isNull())
+  {
+    return( "" );
+  }
+  if (value.isEmpty())
+  {
+    return( ValueIsEmptyString );
+  }
+  return( value );
 }
 
 //------------------------------------------------------------------------------
@@ -2256,22 +3580,126 @@ void ctkDICOMDatabase::getCachedTags(const QString sopInstanceUID, QMap<QString,
       return;
     }
   }
-  QSqlQuery selectValue( d->TagCacheDatabase );
-  selectValue.prepare( "SELECT Tag, Value FROM TagCache WHERE SOPInstanceUID = :sopInstanceUID" );
-  selectValue.bindValue(":sopInstanceUID",sopInstanceUID);
-  d->loggedExec(selectValue);
-  QString tag;
-  QString value;
-  while (selectValue.next())
+  QMap<QString, QString> values;
+  if (!d->InMemoryTagCache.tags(sopInstanceUID, values))
+  {
+    int version = d->InMemoryTagCache.version(sopInstanceUID);
+    QSqlQuery selectValue( d->readTagCacheDatabase() );
+    selectValue.prepare( "SELECT Tag, Value FROM TagCache WHERE SOPInstanceUID = :sopInstanceUID" );
+    selectValue.bindValue(":sopInstanceUID",sopInstanceUID);
+    if (!d->loggedExec(selectValue))
+    {
+      return;
+    }
+    while (selectValue.next())
+    {
+      QString value = selectValue.value(1).toString();
+      values.insert(selectValue.value(0).toString(), value.isNull() ? QString("") : value);
+    }
+    d->InMemoryTagCache.addTags(sopInstanceUID, values, version);
+  }
+  QMap<QString, QString>::const_iterator it;
+  for (it = values.constBegin(); it != values.constEnd(); ++it)
   {
-    tag = selectValue.value(0).toString();
-    value = selectValue.value(1).toString();
+    QString value = it.value();
     if (value == TagNotInInstance || value == ValueIsEmptyString)
     {
       value = QString("");
     }
-    cachedTags.insert(tag, value);
+    cachedTags.insert(it.key(), value);
+  }
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMDatabase::prefetchCachedTagsForSeries(const QString& seriesInstanceUID)
+{
+  Q_D(ctkDICOMDatabase);
+  if ( !this->tagCacheExists() )
+  {
+    if ( !this->initializeTagCache() )
+    {
+      return false;
+    }
+  }
+  if (d->InMemoryTagCache.memoryBudget() == 0)
+  {
+    return true;
   }
+
+  // Instances without any cached tag must be remembered as well
+  QStringList sopInstanceUIDs = this->instancesForSeries(seriesInstanceUID);
+  QHash<QString, QMap<QString, QString> > tagsForInstance;
+  QHash<QString, int> versions;
+  foreach (const QString& sopInstanceUID, sopInstanceUIDs)
+  {
+    tagsForInstance.insert(sopInstanceUID, QMap<QString, QString>());
+    versions.insert(sopInstanceUID, d->InMemoryTagCache.version(sopInstanceUID));
+  }
+
+  // Keep the number of bound values below the SQLite limit
+  const int chunkSize = 500;
+  for (int start = 0; start < sopInstanceUIDs.size(); start += chunkSize)
+  {
+    QSqlQuery selectValues( d->readTagCacheDatabase() );
+    if (!d->execForValues(selectValues,
+      "SELECT SOPInstanceUID, Tag, Value FROM TagCache WHERE SOPInstanceUID IN (%1)",
+      sopInstanceUIDs.mid(start, chunkSize)))
+    {
+      return false;
+    }
+    while (selectValues.next())
+    {
+      QString value = selectValues.value(2).toString();
+      tagsForInstance[selectValues.value(0).toString()].insert(
+        selectValues.value(1).toString(), value.isNull() ? QString("") : value);
+    }
+  }
+
+  QHash<QString, QMap<QString, QString> >::const_iterator it;
+  for (it = tagsForInstance.constBegin(); it != tagsForInstance.constEnd(); ++it)
+  {
+    d->InMemoryTagCache.addTags(it.key(), it.value(), versions.value(it.key()));
+  }
+  return true;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMDatabase::setTagCacheMemoryBudget(qint64 bytes)
+{
+  Q_D(ctkDICOMDatabase);
+  d->InMemoryTagCache.setMemoryBudget(bytes);
+  if (bytes <= 0)
+  {
+    d->InMemoryTagCache.clear();
+  }
+}
+
+//------------------------------------------------------------------------------
+qint64 ctkDICOMDatabase::tagCacheMemoryBudget() const
+{
+  Q_D(const ctkDICOMDatabase);
+  return d->InMemoryTagCache.memoryBudget();
+}
+
+//------------------------------------------------------------------------------
+qint64 ctkDICOMDatabase::tagCacheHitCount() const
+{
+  Q_D(const ctkDICOMDatabase);
+  return d->InMemoryTagCache.hitCount();
+}
+
+//------------------------------------------------------------------------------
+qint64 ctkDICOMDatabase::tagCacheMissCount() const
+{
+  Q_D(const ctkDICOMDatabase);
+  return d->InMemoryTagCache.missCount();
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMDatabase::resetTagCacheStatistics()
+{
+  Q_D(ctkDICOMDatabase);
+  d->InMemoryTagCache.resetStatistics();
 }
 
 //------------------------------------------------------------------------------
@@ -2311,7 +3739,15 @@ bool ctkDICOMDatabase::cacheTags(const QStringList sopInstanceUIDs, const QStrin
   insertTags.addBindValue(sopInstanceUIDs);
   insertTags.addBindValue(tags);
   insertTags.addBindValue(values);
-  return d->loggedExecBatch(insertTags);
+  if (!d->loggedExecBatch(insertTags))
+  {
+    return false;
+  }
+  for (int index = 0; index < sopInstanceUIDs.size() && index < tags.size() && index < values.size(); ++index)
+  {
+    d->InMemoryTagCache.setTag(sopInstanceUIDs[index], tags[index], values[index]);
+  }
+  return true;
 }
 
 //------------------------------------------------------------------------------
@@ -2320,117 +3756,248 @@ void ctkDICOMDatabase::updateDisplayedFields()
   Q_D(ctkDICOMDatabase);
 
   // Get the files for which the displayed fields have not been created yet (DisplayedFieldsUpdatedTimestamp is NULL)
-  //TODO: handle cases when the values actually changed; now we only cover insertion and schema update
-  QSqlQuery newFilesQuery(d->Database);
-  d->loggedExec(newFilesQuery,QString("SELECT SOPInstanceUID, SeriesInstanceUID FROM Images WHERE DisplayedFieldsUpdatedTimestamp IS NULL;"));
-
-  // Populate displayed fields maps from the current display tables
-  QMap<QString /*SeriesInstanceUID*/, QMap<QString /*DisplayField*/, QString /*Value*/> > displayedFieldsMapSeries;
-  QMap<QString /*StudyInstanceUID*/, QMap<QString /*DisplayField*/, QString /*Value*/> > displayedFieldsMapStudy;
-  QVector<QMap<QString /*DisplayField*/, QString /*Value*/> > displayedFieldsVectorPatient; // The index in the vector is the internal patient UID
+  QList<ctkDICOMDatabasePrivate::PendingDisplayedFieldsInstance> pendingInstances;
+  d->pendingDisplayedFieldsInstances(pendingInstances);
 
   d->DisplayedFieldGenerator.setDatabase(this);
 
   int progressValue = 0;
   emit displayedFieldsUpdateProgress(++progressValue);
 
-  // Get display names for newly added files and add them into the display tables
-  while (newFilesQuery.next())
+  // Populate displayed fields from the current display tables
+  ctkDICOMDatabasePrivate::DisplayedFieldsUpdate update;
+  QStringList processedSOPInstanceUIDs;
+  foreach (const ctkDICOMDatabasePrivate::PendingDisplayedFieldsInstance& instance, pendingInstances)
   {
-    QString sopInstanceUID = newFilesQuery.value(0).toString();
-    QString seriesInstanceUID = newFilesQuery.value(1).toString();
-    QMap<QString, QString> cachedTags;
-    this->getCachedTags(sopInstanceUID, cachedTags);
-
-    // Patient
-    int displayedFieldsIndexForCurrentPatient = d->getDisplayPatientFieldsIndex(
-      cachedTags[ctkDICOMItem::TagKeyStripped(DCM_PatientName)],
-      cachedTags[ctkDICOMItem::TagKeyStripped(DCM_PatientID)],
-      displayedFieldsVectorPatient );
-    if (displayedFieldsIndexForCurrentPatient < 0)
+    processedSOPInstanceUIDs << instance.SOPInstanceUID;
+    if (instance.StudyInstanceUID.isEmpty() || instance.PatientUID.isEmpty())
     {
-      logger.error("Failed to find patient for SOP Instance UID = " + sopInstanceUID);
       continue;
     }
-    QMap<QString, QString> displayedFieldsForCurrentPatient = displayedFieldsVectorPatient[ displayedFieldsIndexForCurrentPatient ];
-
-    // Study
-    QString displayedFieldsKeyForCurrentStudy = d->getDisplayStudyFieldsKey(
-      cachedTags[ctkDICOMItem::TagKeyStripped(DCM_StudyInstanceUID)],
-      displayedFieldsMapStudy );
-    if (displayedFieldsKeyForCurrentStudy.isEmpty())
+    if (!update.Series.contains(instance.SeriesInstanceUID))
     {
-      logger.error("Failed to find study for SOP Instance UID = " + sopInstanceUID);
-      continue;
+      update.Series[instance.SeriesInstanceUID].insert("SeriesInstanceUID", instance.SeriesInstanceUID);
     }
-    QMap<QString, QString> displayedFieldsForCurrentStudy = displayedFieldsMapStudy[ displayedFieldsKeyForCurrentStudy ];
-    displayedFieldsForCurrentStudy["PatientIndex"] = QString::number(displayedFieldsIndexForCurrentPatient);
-
-    // Series
-    QString displayedFieldsKeyForCurrentSeries = d->getDisplaySeriesFieldsKey(
-      seriesInstanceUID,
-      displayedFieldsMapSeries );
-    if (displayedFieldsKeyForCurrentSeries.isEmpty())
+    if (!update.Studies.contains(instance.StudyInstanceUID))
     {
-      logger.error("Failed to find series for SOP Instance UID = " + sopInstanceUID);
-      continue;
+      update.Studies[instance.StudyInstanceUID].insert("StudyInstanceUID", instance.StudyInstanceUID);
+    }
+    if (!update.Patients.contains(instance.PatientUID))
+    {
+      update.Patients.insert(instance.PatientUID, QMap<QString, QString>());
     }
-    QMap<QString, QString> displayedFieldsForCurrentSeries = displayedFieldsMapSeries[ displayedFieldsKeyForCurrentSeries ];
+  }
+  d->loadDisplayedFieldsPatients(update);
 
-    // Do the update of the displayed fields using the roles
-    d->DisplayedFieldGenerator.updateDisplayedFieldsForInstance(sopInstanceUID,
-      displayedFieldsForCurrentSeries, displayedFieldsForCurrentStudy, displayedFieldsForCurrentPatient);
+  QStringList requiredTags = d->DisplayedFieldGenerator.getRequiredTags();
+  requiredTags.removeDuplicates();
 
-    // Set updated fields to the series / study / patient displayed fields maps
-    displayedFieldsMapSeries[ displayedFieldsKeyForCurrentSeries ] = displayedFieldsForCurrentSeries;
-    displayedFieldsMapStudy[ displayedFieldsKeyForCurrentStudy ] = displayedFieldsForCurrentStudy;
-    displayedFieldsVectorPatient[ displayedFieldsIndexForCurrentPatient ] = displayedFieldsForCurrentPatient;
-  } // For each instance
+  // Get display names for newly added files, fetching the cached tags for a chunk of instances at a time
+  const int chunkSize = 500;
+  for (int start = 0; start < pendingInstances.size(); start += chunkSize)
+  {
+    QList<ctkDICOMDatabasePrivate::PendingDisplayedFieldsInstance> chunk = pendingInstances.mid(start, chunkSize);
+    QStringList sopInstanceUIDs;
+    foreach (const ctkDICOMDatabasePrivate::PendingDisplayedFieldsInstance& instance, chunk)
+    {
+      sopInstanceUIDs << instance.SOPInstanceUID;
+    }
+    QHash<QString, QMap<QString, QString> > cachedTags;
+    d->cachedTagsForInstances(sopInstanceUIDs, requiredTags, cachedTags);
 
-  emit displayedFieldsUpdateProgress(++progressValue);
+    foreach (const ctkDICOMDatabasePrivate::PendingDisplayedFieldsInstance& instance, chunk)
+    {
+      if (instance.StudyInstanceUID.isEmpty())
+      {
+        logger.error("Failed to find series or study for SOP Instance UID = " + instance.SOPInstanceUID);
+        continue;
+      }
+      if (!update.Patients.contains(instance.PatientUID))
+      {
+        logger.error("Failed to find patient for SOP Instance UID = " + instance.SOPInstanceUID);
+        continue;
+      }
 
-  // Calculate number of images in each updated series
-  d->setCountToSeriesDisplayedFields(displayedFieldsMapSeries);
+      // Do the update of the displayed fields using the roles
+      d->DisplayedFieldGenerator.updateDisplayedFieldsForInstance(cachedTags.value(instance.SOPInstanceUID),
+        update.Series[instance.SeriesInstanceUID], update.Studies[instance.StudyInstanceUID],
+        update.Patients[instance.PatientUID]);
+    }
+  } // For each instance
 
   emit displayedFieldsUpdateProgress(++progressValue);
 
-  // Calculate number of series in each updated study
-  d->setNumberOfSeriesToStudyDisplayedFields(displayedFieldsMapStudy);
-  // Calculate number of studies in each updated patient
-  d->setNumberOfStudiesToPatientDisplayedFields(displayedFieldsVectorPatient);
+  // Calculate number of images in each updated series, number of series in each
+  // updated study, and number of studies in each updated patient
+  d->setCountsToDisplayedFields(update);
 
   emit displayedFieldsUpdateProgress(++progressValue);
 
-  // Update/insert the display values
-  if (displayedFieldsMapSeries.count() > 0)
+  // Update the display values
+  if (update.Series.count() > 0)
   {
-    QSqlQuery transaction(d->Database);
-    transaction.prepare("BEGIN TRANSACTION");
-    transaction.exec();
+    d->beginTransaction();
 
-    if (d->applyDisplayedFieldsChanges(displayedFieldsMapSeries, displayedFieldsMapStudy, displayedFieldsVectorPatient))
+    if ( d->applyDisplayedFieldsChanges("Patients", "UID", update.Patients)
+      && d->applyDisplayedFieldsChanges("Studies", "StudyInstanceUID", update.Studies)
+      && d->applyDisplayedFieldsChanges("Series", "SeriesInstanceUID", update.Series) )
     {
       // Update image timestamp
-      newFilesQuery.first();
-      newFilesQuery.previous(); // Need to go one before the first record
-      while (newFilesQuery.next())
-      {
-        QSqlQuery updateDisplayedFieldsUpdatedTimestampStatement(d->Database);
-        QString updateDisplayedFieldsUpdatedTimestampStatementString = 
-          QString("UPDATE IMAGES SET DisplayedFieldsUpdatedTimestamp=CURRENT_TIMESTAMP WHERE SOPInstanceUID='%1';").arg(newFilesQuery.value(0).toString());
-        d->loggedExec(updateDisplayedFieldsUpdatedTimestampStatement, updateDisplayedFieldsUpdatedTimestampStatementString);
-      }
+      QSqlQuery updateDisplayedFieldsUpdatedTimestampStatement(d->Database);
+      updateDisplayedFieldsUpdatedTimestampStatement.prepare(
+        "UPDATE Images SET DisplayedFieldsUpdatedTimestamp=CURRENT_TIMESTAMP WHERE SOPInstanceUID=?;");
+      updateDisplayedFieldsUpdatedTimestampStatement.addBindValue(processedSOPInstanceUIDs);
+      d->loggedExecBatch(updateDisplayedFieldsUpdatedTimestampStatement);
+
+      // Displayed fields are searchable as well
+      d->updateSearchIndex("Patients", update.Patients.keys());
+      d->updateSearchIndex("Studies", update.Studies.keys());
+      d->updateSearchIndex("Series", update.Series.keys());
     }
 
-    transaction = QSqlQuery(d->Database);
-    transaction.prepare("END TRANSACTION");
-    transaction.exec();
+    d->endTransaction();
   }
 
+  emit displayedFieldsUpdateProgress(++progressValue);
+
   emit displayedFieldsUpdated();
   emit databaseChanged();
 }
 
+//------------------------------------------------------------------------------
+bool ctkDICOMDatabase::hasSearchIndex() const
+{
+  Q_D(const ctkDICOMDatabase);
+  return d->SearchIndexAvailable;
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMDatabase::rebuildSearchIndex()
+{
+  Q_D(ctkDICOMDatabase);
+  if (!d->SearchIndexAvailable)
+  {
+    return false;
+  }
+  d->beginTransaction();
+  QSqlQuery query(d->Database);
+  bool success = d->loggedExec(query, "DELETE FROM SearchIndex")
+    && d->loggedExec(query, "DELETE FROM SearchIndexItems");
+  QStringList tables;
+  tables << "Patients" << "Studies" << "Series";
+  foreach (const QString& table, tables)
+  {
+    if (!success)
+    {
+      break;
+    }
+    QString keyColumn;
+    QStringList fields;
+    ctkDICOMSearchIndexTable(table, keyColumn, fields);
+    QStringList content;
+    foreach (const QString& field, fields)
+    {
+      content << QString("IFNULL(t.%1,'')").arg(field);
+    }
+    QString itemUID = (table == "Patients" ? QString("CAST(t.UID AS TEXT)") : QString("t.") + keyColumn);
+    success = d->loggedExec(query, "INSERT INTO SearchIndexItems (Level, UID) SELECT '" + table + "', "
+                                   + itemUID + " FROM " + table + " t")
+      && d->loggedExec(query, "INSERT INTO SearchIndex (rowid, Content) SELECT i.ItemID, "
+                              + content.join(" || ' ' || ") + " FROM " + table + " t, SearchIndexItems i "
+                              "WHERE i.Level = '" + table + "' AND i.UID = " + itemUID);
+  }
+  d->endTransaction();
+  if (!success)
+  {
+    logger.error("Failed to rebuild the search index");
+  }
+  return success;
+}
+
+//------------------------------------------------------------------------------
+QList<ctkDICOMDatabase::SearchMatch> ctkDICOMDatabase::search(const QString& text, const QString& table,
+                                                              int maximumNumberOfMatches)
+{
+  Q_D(ctkDICOMDatabase);
+  QList<SearchMatch> matches;
+  // Only words are searched for, the search syntax of the full-text module is not exposed
+  QStringList words = text.toLower().split(QRegExp("[^\\w]+"), QString::SkipEmptyParts);
+  if (!d->SearchIndexAvailable || words.isEmpty())
+  {
+    return matches;
+  }
+
+  QString score = "1.0";
+  QString condition;
+  QString order = "i.Level, i.ItemID";
+  QVariantList values;
+  if (d->SearchIndexModule.isEmpty())
+  {
+    QStringList conditions;
+    foreach (const QString& word, words)
+    {
+      conditions << "SearchIndex.Content LIKE ?";
+      values << QString("%" + word + "%");
+    }
+    condition = conditions.join(" AND ");
+  }
+  else
+  {
+    QStringList prefixes;
+    foreach (const QString& word, words)
+    {
+      prefixes << word + "*";
+    }
+    condition = "SearchIndex MATCH ?";
+    values << prefixes.join(" ");
+    if (d->SearchIndexModule == "fts5")
+    {
+      // bm25 is lower for better matches
+      score = "-bm25(SearchIndex)";
+      order = "bm25(SearchIndex)";
+    }
+  }
+  if (!table.isEmpty())
+  {
+    condition += " AND i.Level = ?";
+    values << table;
+  }
+  values << maximumNumberOfMatches;
+
+  QSqlQuery query(d->Database);
+  query.setForwardOnly(true);
+  query.prepare("SELECT i.Level, i.UID, " + score + " FROM SearchIndex, SearchIndexItems i "
+                "WHERE i.ItemID = SearchIndex.rowid AND " + condition + " ORDER BY " + order + " LIMIT ?");
+  for (int i = 0; i < values.size(); ++i)
+  {
+    query.bindValue(i, values[i]);
+  }
+  if (!d->loggedExec(query))
+  {
+    return matches;
+  }
+  while (query.next())
+  {
+    SearchMatch match;
+    match.table = query.value(0).toString();
+    match.uid = query.value(1).toString();
+    match.score = query.value(2).toDouble();
+    matches << match;
+  }
+  return matches;
+}
+
+//------------------------------------------------------------------------------
+QStringList ctkDICOMDatabase::searchUIDs(const QString& text, const QString& table, int maximumNumberOfMatches)
+{
+  QStringList uids;
+  foreach (const SearchMatch& match, this->search(text, table, maximumNumberOfMatches))
+  {
+    uids << match.uid;
+  }
+  return uids;
+}
+
 //------------------------------------------------------------------------------
 QString ctkDICOMDatabase::displayedNameForField(QString table, QString field) const
 {
@@ -22,7 +22,9 @@
 #define __ctkDICOMDatabase_h
 
 // Qt includes
+#include <QHash>
 #include <QObject>
+#include <QSharedPointer>
 #include <QStringList>
 #include <QSqlDatabase>
 
@@ -53,12 +55,19 @@ class CTK_DICOM_CORE_EXPORT ctkDICOMDatabase : public QObject
 {
 
   Q_OBJECT
+  Q_ENUMS(StorageMode)
   Q_PROPERTY(bool isOpen READ isOpen)
   Q_PROPERTY(bool isInMemory READ isInMemory)
   Q_PROPERTY(QString lastError READ lastError)
   Q_PROPERTY(QString databaseFilename READ databaseFilename)
   Q_PROPERTY(QString databaseDirectory READ databaseDirectory)
   Q_PROPERTY(QStringList tagsToPrecache READ tagsToPrecache WRITE setTagsToPrecache)
+  Q_PROPERTY(int insertBatchSize READ insertBatchSize WRITE setInsertBatchSize)
+  Q_PROPERTY(qint64 tagCacheMemoryBudget READ tagCacheMemoryBudget WRITE setTagCacheMemoryBudget)
+  Q_PROPERTY(bool asynchronousThumbnailGeneration READ asynchronousThumbnailGeneration WRITE setAsynchronousThumbnailGeneration)
+  Q_PROPERTY(bool middleInstanceThumbnailOnly READ middleInstanceThumbnailOnly WRITE setMiddleInstanceThumbnailOnly)
+  Q_PROPERTY(int numberOfThumbnailThreads READ numberOfThumbnailThreads WRITE setNumberOfThumbnailThreads)
+  Q_PROPERTY(StorageMode storageMode READ storageMode WRITE setStorageMode)
 
 public:
   explicit ctkDICOMDatabase(QObject *parent = 0);
@@ -66,6 +75,30 @@ public:
   virtual ~ctkDICOMDatabase();
 
   const QSqlDatabase& database() const;
+
+  ///
+  /// Return a read-only connection to the database for the calling thread.
+  /// database() can only be used in the thread that opened the database,
+  /// the connection returned here can be used in the calling thread while
+  /// the database is written in another thread: database files are opened
+  /// in write-ahead log mode, readers do not block the writer and are not
+  /// blocked by it.
+  /// The read-only convenience methods (patients(), filesForSeries(),
+  /// fileExistsAndUpToDate(), ...) use it when called from another thread
+  /// than the one of the database, cachedTag() and getCachedTags() read the
+  /// tag cache through a reader connection of their own in that case.
+  /// For in-memory databases, database() is returned.
+  QSqlDatabase readConnection();
+
+  ///
+  /// Start a read snapshot in the calling thread: until endReadSnapshot(),
+  /// readConnection() and the read-only convenience methods called in this
+  /// thread see the database as it was when the snapshot started, even if
+  /// inserts are committed in the meantime. Snapshots cannot be nested.
+  /// @return false for in-memory databases, or if the snapshot could not be started.
+  Q_INVOKABLE bool beginReadSnapshot();
+  Q_INVOKABLE void endReadSnapshot();
+
   const QString lastError() const;
   const QString databaseFilename() const;
 
@@ -94,6 +127,62 @@ public:
   /// get thumbnail genrator object
   Q_INVOKABLE ctkDICOMAbstractThumbnailGenerator* thumbnailGenerator();
 
+  /// If enabled, thumbnails of inserted instances are generated on background
+  /// threads so that pixel data decoding does not slow down insertion. The thumbnail
+  /// generator must be reentrant in this case. Disabled by default, so that thumbnails
+  /// are written when insert returns. thumbnailReady is emitted for each thumbnail,
+  /// and seriesThumbnailsReady once no thumbnail of the series is waiting anymore.
+  /// Views showing thumbnails of inserted series should refresh on these signals.
+  /// Thumbnails are queued per series: an instance waiting for its thumbnail is not
+  /// queued again when it is inserted again.
+  void setAsynchronousThumbnailGeneration(bool asynchronous);
+  bool asynchronousThumbnailGeneration() const;
+
+  /// If enabled, only the thumbnail of the middle instance (sorted by file name)
+  /// of each inserted series is generated, once the series is inserted
+  /// (at endBatchInsert, or right after the insert if no batch insert is in progress).
+  /// Disabled by default.
+  void setMiddleInstanceThumbnailOnly(bool middleInstanceOnly);
+  bool middleInstanceThumbnailOnly() const;
+
+  /// Maximum number of threads generating thumbnails in the background.
+  /// Default is half of the ideal thread count.
+  void setNumberOfThumbnailThreads(int numberOfThreads);
+  int numberOfThumbnailThreads() const;
+
+  /// Block until all thumbnails queued for generation in the background are written
+  Q_INVOKABLE void waitForThumbnails();
+
+  /// How files are placed in the database folder when they are inserted with storeFile=true
+  enum StorageMode
+  {
+    /// Copy the file (default)
+    CopyFiles,
+    /// Create a hard link to the file, which takes no space. The stored file
+    /// changes if the original file is modified in place.
+    HardLinkFiles,
+    /// Create a copy-on-write clone of the file, which takes no space until either
+    /// file is modified. Only supported on Linux file systems that support it (Btrfs, XFS, ...).
+    ReflinkFiles,
+    /// Move the file into the database folder
+    MoveFiles
+  };
+  /// Files are copied if the chosen mode is not supported by the file system
+  /// or if the file is on another file system than the database folder.
+  void setStorageMode(StorageMode mode);
+  StorageMode storageMode() const;
+
+  /// Store the file that \a dataset has been read from in the database folder,
+  /// as insert() would do it with storeFile=true. The file is placed next to its
+  /// destination under a temporary name, which is returned. It is renamed to its
+  /// destination by insert() once the instance is inserted, so that a stored file
+  /// that is referenced already is never removed before it is replaced.
+  /// The file is only stored if the dataset has the information that insert() requires.
+  /// Returns an empty string if the file is not stored or the database is in memory.
+  /// This method is thread-safe, so that files can be stored while other files are
+  /// parsed and inserted (see IndexingResult::temporaryFilePath).
+  QString storeFileInDatabaseFolder(const QString& filePath, const ctkDICOMItem& dataset);
+
   ///
   /// open the SQLite database in @param databaseFile . If the file does not
   /// exist, a new database is created and initialized with the
@@ -175,6 +264,14 @@ public:
   void setTagsToPrecache(const QStringList tags);
   const QStringList tagsToPrecache();
 
+  /// Read the values of \a tags (or of tagsToPrecache() if \a tags is empty)
+  /// from \a fileNames and store them in the tag cache in a single batch.
+  /// Files are parsed on a thread pool, each only up to the highest requested
+  /// tag, so that pixel data and other trailing elements are not read.
+  /// Files that cannot be read are skipped.
+  /// \return Number of files whose tags have been stored in the tag cache
+  Q_INVOKABLE int cacheTagsFromFiles(const QStringList& fileNames, const QStringList& tags = QStringList());
+
   /// Insert into the database if not already existing.
   /// @param dataset The dataset to store into the database. Usually, this is
   ///                is a complete DICOM object, like a complete image. However
@@ -198,6 +295,72 @@ public:
                             bool storeFile = true, bool generateThumbnail = true,
                             bool createHierarchy = true,
                             const QString& destinationDirectoryName = QString() );
+  /// Insert a dataset that the caller has already read from \a filePath.
+  /// This is the same as inserting the file itself, but the file is not
+  /// parsed again. The caller is responsible for checking
+  /// fileExistsAndUpToDate() before reading the file.
+  void insert ( const QString& filePath, const ctkDICOMItem& ctkDataset,
+                bool storeFile = true, bool generateThumbnail = true );
+
+  /// Size and modification time of a file as it was last seen by the indexer
+  struct FileManifestEntry
+  {
+    FileManifestEntry() : size(-1), lastModified(-1) {}
+    qint64 size;
+    /// Milliseconds since epoch
+    qint64 lastModified;
+    /// Filename that the instance read from the file is referenced at in the database,
+    /// which is in the database folder if the file has been stored there.
+    /// Empty if the file has not been inserted.
+    QString storedFilename;
+  };
+  typedef QHash<QString, FileManifestEntry> FileManifest;
+
+  /// Dataset read from a file, to be inserted into the database in a batch
+  struct IndexingResult
+  {
+    IndexingResult() : storeFile(false), generateThumbnail(true), fromDirectoryRecords(false) {}
+    QString filePath;
+    /// Null or uninitialized if the file could not be read
+    QSharedPointer<ctkDICOMItem> dataset;
+    bool storeFile;
+    /// If not empty then the file has already been placed in the database folder
+    /// at this temporary path by storeFileInDatabaseFolder(). It is removed (or moved back)
+    /// if the instance is not inserted or is referenced at its stored file already.
+    QString temporaryFilePath;
+    bool generateThumbnail;
+    /// Dataset has been assembled from DICOMDIR records instead of being read from the file.
+    /// The instance is not considered up-to-date (see fileExistsAndUpToDate()) until the file
+    /// is inserted, which also replaces the patient, study and series that were created from
+    /// the records. These rows are flagged in the FromDirectoryRecords column of their table.
+    bool fromDirectoryRecords;
+    /// Size and modification time of the file when it was read, recorded in the file manifest.
+    /// If not set, they are read from the file when it is inserted.
+    FileManifestEntry fileManifestEntry;
+  };
+
+  /// Insert a batch of datasets.
+  /// Existence of the patients, studies, series, and instances of the batch
+  /// is checked with one query per table instead of one query per instance,
+  /// and all rows are inserted with statements prepared only once.
+  /// Datasets whose file is already in the database and up-to-date are skipped.
+  void insert ( const QList<IndexingResult>& indexingResults );
+
+  /// Group all subsequent inserts into transactions of insertBatchSize()
+  /// instances until endBatchInsert() is called. Grouping inserts into
+  /// transactions greatly reduces the time spent in writing to the database
+  /// file. Calls can be nested.
+  /// \sa ctkDICOMIndexer::startIndexing
+  Q_INVOKABLE void beginBatchInsert();
+  /// Commit all inserts since the last commit and stop grouping inserts
+  /// into transactions (unless there are unmatched beginBatchInsert() calls).
+  Q_INVOKABLE void endBatchInsert();
+
+  /// Number of inserted instances after which the batch transaction
+  /// is committed between beginBatchInsert() and endBatchInsert().
+  /// Default is 1000.
+  void setInsertBatchSize(int numberOfInstances);
+  int insertBatchSize() const;
 
   /// Update the fields in the database that are used for displaying information
   /// from information stored in the tag-cache.
@@ -206,6 +369,39 @@ public:
   /// number of studies in a patient).
   Q_INVOKABLE void updateDisplayedFields();
 
+  /// Patient, study, or series found by search()
+  struct SearchMatch
+  {
+    SearchMatch() : score(0.0) {}
+    /// Table of the item: Patients, Studies, or Series
+    QString table;
+    /// UID of the patient, StudyInstanceUID, or SeriesInstanceUID
+    QString uid;
+    /// Relevance of the match, higher is better. Only meaningful if the
+    /// SQLite library supports FTS5, otherwise all matches have the same score.
+    double score;
+  };
+
+  /// Find the patients, studies, and series that match all the words of \a text.
+  /// Words are matched as prefixes, case-insensitively, against names, IDs,
+  /// descriptions, and dates of the items (including their displayed fields).
+  /// The search uses a full-text index that is kept up to date by insert(),
+  /// updateDisplayedFields(), and the remove methods, so it does not scan the tables.
+  /// \param table If not empty, only return items of this table
+  /// \param maximumNumberOfMatches No limit if negative
+  /// \return Matches sorted by decreasing relevance
+  QList<SearchMatch> search(const QString& text, const QString& table = QString(),
+                            int maximumNumberOfMatches = -1);
+  /// UIDs of the items of \a table that match \a text (see search())
+  Q_INVOKABLE QStringList searchUIDs(const QString& text, const QString& table,
+                                     int maximumNumberOfMatches = -1);
+  /// Returns true if the database has a search index
+  bool hasSearchIndex() const;
+  /// Index all patients, studies, and series of the database again.
+  /// The index is created and populated automatically when a database
+  /// without index is opened.
+  Q_INVOKABLE bool rebuildSearchIndex();
+
   /// Reset cached item IDs to make sure previous
   /// inserts do not interfere with upcoming insert operations.
   /// Typically, it should be call just before a batch of files
@@ -221,6 +417,24 @@ public:
   /// Check if file is already in database and up-to-date
   Q_INVOKABLE bool fileExistsAndUpToDate(const QString& filePath);
 
+  /// Get the file manifest entries of all files in \a directoryName
+  /// and its subdirectories, by absolute file path. Each inserted file is recorded in the manifest,
+  /// so that new, changed, and removed files can be found by comparing
+  /// the manifest to the file system, without reading any files.
+  FileManifest fileManifest(const QString& directoryName);
+  /// Add or replace entries of the file manifest.
+  /// Files that are not DICOM files may be added as well, so that they
+  /// are not read again as long as they are not modified.
+  bool updateFileManifest(const FileManifest& entries);
+
+  /// Remove the instances that are stored in the listed files, along with
+  /// their thumbnails and file manifest entries, in one transaction.
+  /// Files are matched by the filename that the instances are referenced at,
+  /// see FileManifestEntry::storedFilename.
+  /// Series, studies, and patients that have no instances left are removed.
+  /// The files themselves are not deleted.
+  Q_INVOKABLE bool removeFiles(const QStringList& filePaths);
+
   /// remove the series from the database, including images and
   /// thumbnails
   Q_INVOKABLE bool removeSeries(const QString& seriesInstanceUID);
@@ -266,6 +480,21 @@ public:
   Q_INVOKABLE bool cacheTag (const QString sopInstanceUID, const QString tag, const QString value);
   /// Insert lists of tags into the cache as a batch query operation
   Q_INVOKABLE bool cacheTags (const QStringList sopInstanceUIDs, const QStringList tags, const QStringList values);
+  /// Load all cached tags of all instances of a series into memory at once
+  /// so that subsequent cachedTag() and getCachedTags() calls for the series
+  /// do not need to access the tag cache database.
+  Q_INVOKABLE bool prefetchCachedTagsForSeries(const QString& seriesInstanceUID);
+
+  /// Approximate maximum memory, in bytes, used for keeping cached tags in memory.
+  /// Least recently used instances are evicted first. Default is 64MB, 0 disables
+  /// the in-memory cache.
+  void setTagCacheMemoryBudget(qint64 bytes);
+  qint64 tagCacheMemoryBudget() const;
+  /// Number of cachedTag() and getCachedTags() calls answered from memory
+  qint64 tagCacheHitCount() const;
+  /// Number of cachedTag() and getCachedTags() calls that required a database query
+  qint64 tagCacheMissCount() const;
+  void resetTagCacheStatistics();
 
   /// Get displayed name of a given field
   Q_INVOKABLE QString displayedNameForField(QString table, QString field) const;
@@ -308,6 +537,18 @@ Q_SIGNALS:
   /// Indicate that an in-memory database has been updated
   void databaseChanged();
 
+  /// Indicate that the thumbnail of an instance has been generated
+  /// thumbnailReady arguments:
+  ///  - instanceUID
+  ///  - path of the thumbnail image file
+  void thumbnailReady(QString, QString);
+  /// Indicate that the thumbnails of a series queued for generation in the background
+  /// are all done, and at least one of them is available
+  /// seriesThumbnailsReady arguments:
+  ///  - studyInstanceUID
+  ///  - seriesInstanceUID
+  void seriesThumbnailsReady(QString, QString);
+
   /// Indicate that the schema is about to be updated and how many files will be processed
   void schemaUpdateStarted(int);
   /// Indicate progress in updating schema (int is file number, string is file name)
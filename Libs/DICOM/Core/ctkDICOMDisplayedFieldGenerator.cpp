@@ -103,6 +103,15 @@ void ctkDICOMDisplayedFieldGenerator::updateDisplayedFieldsForInstance( QString
 
   QMap<QString, QString> cachedTagsForInstance;
   d->Database->getCachedTags(sopInstanceUID, cachedTagsForInstance);
+  this->updateDisplayedFieldsForInstance(cachedTagsForInstance,
+    displayedFieldsForCurrentSeries, displayedFieldsForCurrentStudy, displayedFieldsForCurrentPatient);
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMDisplayedFieldGenerator::updateDisplayedFieldsForInstance( const QMap<QString, QString> &cachedTagsForInstance,
+  QMap<QString, QString> &displayedFieldsForCurrentSeries, QMap<QString, QString> &displayedFieldsForCurrentStudy, QMap<QString, QString> &displayedFieldsForCurrentPatient )
+{
+  Q_D(ctkDICOMDisplayedFieldGenerator);
 
   QMap<QString, QString> newFieldsSeries;
   QMap<QString, QString> newFieldsStudy;
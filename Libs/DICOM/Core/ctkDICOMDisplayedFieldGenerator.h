@@ -66,6 +66,14 @@ public:
                                                     QMap<QString, QString> &displayedFieldsForCurrentStudy,
                                                     QMap<QString, QString> &displayedFieldsForCurrentPatient);
 
+  /// Update displayed fields for an instance from its already retrieved cached tags,
+  /// invoking all registered rules. Allows the caller to get the cached tags of many
+  /// instances at once.
+  void updateDisplayedFieldsForInstance(const QMap<QString, QString> &cachedTagsForInstance,
+                                        QMap<QString, QString> &displayedFieldsForCurrentSeries,
+                                        QMap<QString, QString> &displayedFieldsForCurrentStudy,
+                                        QMap<QString, QString> &displayedFieldsForCurrentPatient);
+
   /// Register new displayed field generator rule
   void registerDisplayedFieldGeneratorRule(ctkDICOMDisplayedFieldGeneratorAbstractRule* rule);
 
@@ -0,0 +1,704 @@
+/*=========================================================================
+
+  Library:   CTK
+
+  Copyright (c) Kitware Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0.txt
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=========================================================================*/
+
+// Qt includes
+#include <QDate>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QHash>
+#include <QMutex>
+#include <QRunnable>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QThreadPool>
+
+// ctkDICOMCore includes
+#include "ctkDICOMDatabase.h"
+#include "ctkDICOMExporter.h"
+#include "ctkLogger.h"
+
+// DCMTK includes
+#include <dcmtk/dcmdata/dcddirif.h>
+
+static ctkLogger logger("org.commontk.dicom.DICOMExporter");
+
+//------------------------------------------------------------------------------
+/// Maximum number of series UIDs bound to a single query
+static const int ctkDICOMExporterMaximumNumberOfBoundValues = 500;
+
+//------------------------------------------------------------------------------
+struct ctkDICOMExporterFile
+{
+  QString Source;
+  /// Path of the destination file relative to the destination directory
+  QString FileID;
+};
+
+//------------------------------------------------------------------------------
+/// Destination directory of an exported series, relative to the destination directory
+struct ctkDICOMExporterSeries
+{
+  QString Directory;
+  int NumberOfFiles;
+};
+
+//------------------------------------------------------------------------------
+class ctkDICOMExporterPrivate
+{
+  Q_DECLARE_PUBLIC(ctkDICOMExporter);
+
+protected:
+  ctkDICOMExporter* const q_ptr;
+
+public:
+  ctkDICOMExporterPrivate(ctkDICOMExporter& obj);
+
+  /// Start exporting the series whose \a uidColumn (Images.SeriesInstanceUID,
+  /// Series.StudyInstanceUID or Studies.PatientsUID) is one of \a uids
+  bool startExport(const QString& destinationDirectory,
+                   const QString& uidColumn, const QStringList& uids);
+  /// Compute the destination of the files of the series and create the
+  /// destination directories. Called in the thread of the exporter.
+  /// The files of all the series are looked up with one query per
+  /// ctkDICOMExporterMaximumNumberOfBoundValues \a uids.
+  bool planExport(const QString& uidColumn, const QStringList& uids);
+  bool planExport(const QString& uidColumn, const QStringList& uids,
+                  QHash<QString, ctkDICOMExporterSeries>& series,
+                  QHash<QString, int>& numberOfChildren);
+
+  /// Called by workers. Returns false if no file is left or the export is stopped.
+  bool takeFile(int& index);
+  /// Called by workers. Returns an error message, empty if the file is copied.
+  QString copyFile(const ctkDICOMExporterFile& file)const;
+  /// Called by workers when a file is copied or failed to be copied
+  void finishFile(const QString& errorString);
+  /// Called by workers when no file is left. The last worker writes the DICOMDIR.
+  void finishWorker();
+  /// Returns an error message, empty if the DICOMDIR is written or the export canceled.
+  QString writeDICOMDIR()const;
+
+  bool isCanceled()const;
+  void scheduleReport();
+
+  ctkDICOMDatabase* Database;
+  bool WriteDICOMDIR;
+  int MaximumNumberOfThreads;
+
+  // State of the current export, the destination and the files are not
+  // modified while the workers run
+  QString DestinationDirectory;
+  bool ExportDICOMDIR;
+  QList<ctkDICOMExporterFile> Files;
+  bool Running;
+  int NumberOfReportedFiles;
+
+  mutable QMutex Mutex;
+  int NextFile;
+  int NumberOfExportedFiles;
+  int NumberOfWorkers;
+  bool Canceled;
+  bool Done;
+  bool ReportScheduled;
+  QString ErrorString;
+  QThreadPool Pool;
+};
+
+//------------------------------------------------------------------------------
+/// Copies files until no file is left or the export is stopped
+class ctkDICOMExporterWorker : public QRunnable
+{
+public:
+  ctkDICOMExporterWorker(ctkDICOMExporterPrivate* exporter)
+    : Exporter(exporter)
+    {
+    }
+  virtual void run();
+
+protected:
+  ctkDICOMExporterPrivate* Exporter;
+};
+
+//------------------------------------------------------------------------------
+void ctkDICOMExporterWorker::run()
+{
+  int index = -1;
+  while (this->Exporter->takeFile(index))
+    {
+    this->Exporter->finishFile(this->Exporter->copyFile(this->Exporter->Files[index]));
+    }
+  this->Exporter->finishWorker();
+}
+
+//------------------------------------------------------------------------------
+/// Replace the characters that are not printable ASCII or not allowed in
+/// file names by underscores.
+static QString ctkDICOMExporterFileName(const QString& name)
+{
+  QString fileName = name.trimmed();
+  for (int i = 0; i < fileName.size(); ++i)
+    {
+    ushort c = fileName[i].unicode();
+    if (c < 0x20 || c > 0x7e || QString("\\/:*?\"<>|").contains(fileName[i]))
+      {
+      fileName[i] = QChar('_');
+      }
+    }
+  return fileName;
+}
+
+//------------------------------------------------------------------------------
+/// File ID component following the DICOM media storage rules: 8 characters at most
+static QString ctkDICOMExporterFileID(const char* prefix, int number)
+{
+  return QString("%1%2").arg(prefix).arg(number, 5, 10, QChar('0'));
+}
+
+//------------------------------------------------------------------------------
+// ctkDICOMExporterPrivate methods
+
+//------------------------------------------------------------------------------
+ctkDICOMExporterPrivate::ctkDICOMExporterPrivate(ctkDICOMExporter& obj)
+  : q_ptr(&obj)
+  , Database(0)
+  , WriteDICOMDIR(false)
+  , MaximumNumberOfThreads(4)
+  , ExportDICOMDIR(false)
+  , Running(false)
+  , NumberOfReportedFiles(0)
+  , NextFile(0)
+  , NumberOfExportedFiles(0)
+  , NumberOfWorkers(0)
+  , Canceled(false)
+  , Done(false)
+  , ReportScheduled(false)
+{
+  this->Pool.setMaxThreadCount(this->MaximumNumberOfThreads);
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMExporterPrivate::planExport(const QString& uidColumn, const QStringList& uids)
+{
+  this->Files.clear();
+  QHash<QString, ctkDICOMExporterSeries> series;
+  QHash<QString, int> numberOfChildren;
+  for (int first = 0; first < uids.count();
+       first += ctkDICOMExporterMaximumNumberOfBoundValues)
+    {
+    if (!this->planExport(uidColumn, uids.mid(first, ctkDICOMExporterMaximumNumberOfBoundValues),
+                          series, numberOfChildren))
+      {
+      this->Files.clear();
+      return false;
+      }
+    }
+  return true;
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMExporterPrivate::planExport(const QString& uidColumn, const QStringList& uids,
+                                         QHash<QString, ctkDICOMExporterSeries>& series,
+                                         QHash<QString, int>& numberOfChildren)
+{
+  QStringList placeholders;
+  for (int i = 0; i < uids.count(); ++i)
+    {
+    placeholders << "?";
+    }
+  // Everything needed to name the files, without reading them
+  QSqlQuery query(this->Database->database());
+  query.setForwardOnly(true);
+  query.prepare(QString(
+    "SELECT Images.Filename, Images.SeriesInstanceUID, Series.SeriesNumber, Series.SeriesDescription, "
+    "Studies.StudyInstanceUID, Studies.StudyDate, Studies.StudyDescription, "
+    "Patients.UID, Patients.PatientID, Patients.PatientsName "
+    "FROM Images "
+    "JOIN Series ON Images.SeriesInstanceUID = Series.SeriesInstanceUID "
+    "JOIN Studies ON Series.StudyInstanceUID = Studies.StudyInstanceUID "
+    "JOIN Patients ON Studies.PatientsUID = Patients.UID "
+    "WHERE %1 IN (%2) "
+    "ORDER BY Patients.UID, Studies.StudyInstanceUID, Images.SeriesInstanceUID, Images.rowid")
+    .arg(uidColumn).arg(placeholders.join(", ")));
+  for (int i = 0; i < uids.count(); ++i)
+    {
+    query.bindValue(i, uids[i]);
+    }
+  if (!query.exec())
+    {
+    this->ErrorString = QString("Failed to look up the exported series:\n\n")
+      + query.lastError().text();
+    logger.error(this->ErrorString);
+    return false;
+    }
+
+  QDir destination(this->DestinationDirectory);
+  while (query.next())
+    {
+    QString fileName = query.value(0).toString();
+    if (fileName.isEmpty())
+      {
+      continue;
+      }
+    QString seriesInstanceUID = query.value(1).toString();
+    if (!series.contains(seriesInstanceUID))
+      {
+      QString studyInstanceUID = query.value(4).toString();
+      QString patientUID = query.value(7).toString();
+      QStringList directories;
+      if (this->ExportDICOMDIR)
+        {
+        // Number the patients, the studies of each patient and the series of each study
+        QString patientKey = "Patient:" + patientUID;
+        QString studyKey = "Study:" + studyInstanceUID;
+        if (!numberOfChildren.contains(patientKey))
+          {
+          int patientNumber = ++numberOfChildren["Patients"];
+          numberOfChildren[patientKey] = patientNumber;
+          }
+        if (!numberOfChildren.contains(studyKey))
+          {
+          int studyNumber = ++numberOfChildren["Studies of " + patientKey];
+          numberOfChildren[studyKey] = studyNumber;
+          }
+        int seriesNumber = ++numberOfChildren["Series of " + studyKey];
+        directories << "DICOM"
+                    << ctkDICOMExporterFileID("PAT", numberOfChildren.value(patientKey))
+                    << ctkDICOMExporterFileID("STU", numberOfChildren.value(studyKey))
+                    << ctkDICOMExporterFileID("SER", seriesNumber);
+        }
+      else
+        {
+        QString patientID = query.value(8).toString();
+        QString patientsName = query.value(9).toString();
+        // Dates are stored as ISO dates, name the directory as in the DICOM file
+        QString studyDate = query.value(5).toString();
+        QDate date = QDate::fromString(studyDate, Qt::ISODate);
+        if (date.isValid())
+          {
+          studyDate = date.toString("yyyyMMdd");
+          }
+        QString studyDescription = query.value(6).toString();
+        QString seriesNumber = query.value(2).toString();
+        QString seriesDescription = query.value(3).toString();
+        QString nameSep = "-";
+        directories << patientID + (patientsName.isEmpty() ? QString() : nameSep + patientsName)
+                    << studyDate + (studyDescription.isEmpty() ? QString() : nameSep + studyDescription)
+                    << seriesNumber + (seriesDescription.isEmpty() ? QString() : nameSep + seriesDescription);
+        }
+      for (int i = 0; i < directories.count(); ++i)
+        {
+        directories[i] = ctkDICOMExporterFileName(directories[i]);
+        }
+      ctkDICOMExporterSeries exportedSeries;
+      exportedSeries.Directory = directories.join("/");
+      exportedSeries.NumberOfFiles = 0;
+      if (!destination.mkpath(exportedSeries.Directory))
+        {
+        this->ErrorString = QString("Unable to create export destination directory:\n\n")
+          + destination.absoluteFilePath(exportedSeries.Directory);
+        logger.error(this->ErrorString);
+        return false;
+        }
+      series[seriesInstanceUID] = exportedSeries;
+      }
+
+    ctkDICOMExporterSeries& exportedSeries = series[seriesInstanceUID];
+    ctkDICOMExporterFile file;
+    file.Source = fileName;
+    // sequentially number the files
+    if (this->ExportDICOMDIR)
+      {
+      file.FileID = exportedSeries.Directory + "/"
+        + ctkDICOMExporterFileID("IMG", ++exportedSeries.NumberOfFiles);
+      }
+    else
+      {
+      file.FileID = exportedSeries.Directory + "/"
+        + QString("%1.dcm").arg(exportedSeries.NumberOfFiles++, 6, 10, QChar('0'));
+      }
+    this->Files << file;
+    }
+  return true;
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMExporterPrivate::startExport(const QString& destinationDirectory,
+                                          const QString& uidColumn, const QStringList& uids)
+{
+  if (this->Running)
+    {
+    logger.error("Cannot start export: an export is already running.");
+    return false;
+    }
+  QMutexLocker locker(&this->Mutex);
+  this->NextFile = 0;
+  this->NumberOfExportedFiles = 0;
+  this->NumberOfReportedFiles = 0;
+  this->Canceled = false;
+  this->Done = false;
+  this->ErrorString.clear();
+  this->DestinationDirectory = destinationDirectory;
+  this->ExportDICOMDIR = this->WriteDICOMDIR;
+  if (!this->Database)
+    {
+    this->ErrorString = "Cannot start export: no database.";
+    logger.error(this->ErrorString);
+    return false;
+    }
+  QStringList uniqueUIDs = uids;
+  uniqueUIDs.removeDuplicates();
+  if (!this->planExport(uidColumn, uniqueUIDs))
+    {
+    return false;
+    }
+
+  this->Running = true;
+  this->NumberOfWorkers = qMin(this->MaximumNumberOfThreads, this->Files.count());
+  if (this->NumberOfWorkers == 0)
+    {
+    this->Done = true;
+    this->scheduleReport();
+    return true;
+    }
+  for (int i = 0; i < this->NumberOfWorkers; ++i)
+    {
+    this->Pool.start(new ctkDICOMExporterWorker(this));
+    }
+  return true;
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMExporterPrivate::takeFile(int& index)
+{
+  QMutexLocker locker(&this->Mutex);
+  if (this->Canceled || !this->ErrorString.isEmpty() || this->NextFile >= this->Files.count())
+    {
+    return false;
+    }
+  index = this->NextFile++;
+  return true;
+}
+
+//------------------------------------------------------------------------------
+QString ctkDICOMExporterPrivate::copyFile(const ctkDICOMExporterFile& file)const
+{
+  QString destinationFileName = QDir(this->DestinationDirectory).absoluteFilePath(file.FileID);
+  if (!QFile::exists(file.Source))
+    {
+    return QString("Export source file not found:\n\n")
+      + file.Source
+      + QString("\n\nError may be fixed via Repair.");
+    }
+  if (QFile::exists(destinationFileName))
+    {
+    return QString("Export destination file already exists:\n\n")
+      + destinationFileName;
+    }
+  if (!QFile::copy(file.Source, destinationFileName))
+    {
+    return QString("Failed to copy\n\n")
+      + file.Source
+      + QString("\n\nto\n\n")
+      + destinationFileName;
+    }
+  return QString();
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMExporterPrivate::finishFile(const QString& errorString)
+{
+  QMutexLocker locker(&this->Mutex);
+  if (errorString.isEmpty())
+    {
+    ++this->NumberOfExportedFiles;
+    }
+  else if (this->ErrorString.isEmpty())
+    {
+    logger.error(errorString);
+    this->ErrorString = errorString;
+    }
+  this->scheduleReport();
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMExporterPrivate::finishWorker()
+{
+  QMutexLocker locker(&this->Mutex);
+  if (--this->NumberOfWorkers > 0)
+    {
+    return;
+    }
+  if (this->ExportDICOMDIR && !this->Canceled && this->ErrorString.isEmpty())
+    {
+    locker.unlock();
+    QString errorString = this->writeDICOMDIR();
+    locker.relock();
+    if (!errorString.isEmpty() && this->ErrorString.isEmpty())
+      {
+      logger.error(errorString);
+      this->ErrorString = errorString;
+      }
+    }
+  this->Done = true;
+  this->scheduleReport();
+}
+
+//------------------------------------------------------------------------------
+QString ctkDICOMExporterPrivate::writeDICOMDIR()const
+{
+  QDir destination(this->DestinationDirectory);
+  QString dicomDirFileName = destination.absoluteFilePath("DICOMDIR");
+  QByteArray directory = QDir::toNativeSeparators(destination.absolutePath()).toLocal8Bit();
+
+  DicomDirInterface dicomDir;
+  // Files are exported as they were stored, whatever their transfer syntax
+  dicomDir.disableTransferSyntaxCheck();
+  // Missing type 1 attributes of the directory records are invented
+  dicomDir.enableInventMode();
+  OFCondition status = dicomDir.createNewDicomDir(
+    DicomDirInterface::AP_GeneralPurpose,
+    QDir::toNativeSeparators(dicomDirFileName).toLocal8Bit().constData(), "CTK_EXPORT");
+  foreach (const ctkDICOMExporterFile& file, this->Files)
+    {
+    if (status.bad() || this->isCanceled())
+      {
+      break;
+      }
+    status = dicomDir.addDicomFile(QDir::toNativeSeparators(file.FileID).toLocal8Bit().constData(),
+                                   directory.constData());
+    }
+  if (status.good() && !this->isCanceled())
+    {
+    status = dicomDir.writeDicomDir();
+    }
+  if (status.bad())
+    {
+    return QString("Failed to write ") + dicomDirFileName
+      + QString(":\n\n") + QString(status.text());
+    }
+  return QString();
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMExporterPrivate::isCanceled()const
+{
+  QMutexLocker locker(&this->Mutex);
+  return this->Canceled;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMExporterPrivate::scheduleReport()
+{
+  Q_Q(ctkDICOMExporter);
+  // Mutex is locked by the caller
+  if (!this->ReportScheduled)
+    {
+    this->ReportScheduled = true;
+    QMetaObject::invokeMethod(q, "reportProgress", Qt::QueuedConnection);
+    }
+}
+
+//------------------------------------------------------------------------------
+// ctkDICOMExporter methods
+
+//------------------------------------------------------------------------------
+ctkDICOMExporter::ctkDICOMExporter(QObject* parent)
+  : QObject(parent)
+  , d_ptr(new ctkDICOMExporterPrivate(*this))
+{
+}
+
+//------------------------------------------------------------------------------
+ctkDICOMExporter::~ctkDICOMExporter()
+{
+  Q_D(ctkDICOMExporter);
+  this->cancel();
+  d->Pool.waitForDone();
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMExporter::setDatabase(ctkDICOMDatabase* database)
+{
+  Q_D(ctkDICOMExporter);
+  d->Database = database;
+}
+
+//------------------------------------------------------------------------------
+ctkDICOMDatabase* ctkDICOMExporter::database()const
+{
+  Q_D(const ctkDICOMExporter);
+  return d->Database;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMExporter::setWriteDICOMDIR(bool writeDICOMDIR)
+{
+  Q_D(ctkDICOMExporter);
+  d->WriteDICOMDIR = writeDICOMDIR;
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMExporter::writeDICOMDIR()const
+{
+  Q_D(const ctkDICOMExporter);
+  return d->WriteDICOMDIR;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMExporter::setMaximumNumberOfThreads(int maximumNumberOfThreads)
+{
+  Q_D(ctkDICOMExporter);
+  d->MaximumNumberOfThreads = qMax(1, maximumNumberOfThreads);
+  d->Pool.setMaxThreadCount(d->MaximumNumberOfThreads);
+}
+
+//------------------------------------------------------------------------------
+int ctkDICOMExporter::maximumNumberOfThreads()const
+{
+  Q_D(const ctkDICOMExporter);
+  return d->MaximumNumberOfThreads;
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMExporter::exportSeries(const QString& destinationDirectory,
+                                    const QStringList& seriesInstanceUIDs)
+{
+  Q_D(ctkDICOMExporter);
+  return d->startExport(destinationDirectory, "Images.SeriesInstanceUID", seriesInstanceUIDs);
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMExporter::exportStudies(const QString& destinationDirectory,
+                                     const QStringList& studyInstanceUIDs)
+{
+  Q_D(ctkDICOMExporter);
+  return d->startExport(destinationDirectory, "Series.StudyInstanceUID", studyInstanceUIDs);
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMExporter::exportPatients(const QString& destinationDirectory,
+                                      const QStringList& patientUIDs)
+{
+  Q_D(ctkDICOMExporter);
+  return d->startExport(destinationDirectory, "Studies.PatientsUID", patientUIDs);
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMExporter::isRunning()const
+{
+  Q_D(const ctkDICOMExporter);
+  return d->Running;
+}
+
+//------------------------------------------------------------------------------
+int ctkDICOMExporter::numberOfFiles()const
+{
+  Q_D(const ctkDICOMExporter);
+  return d->Files.count();
+}
+
+//------------------------------------------------------------------------------
+int ctkDICOMExporter::numberOfExportedFiles()const
+{
+  Q_D(const ctkDICOMExporter);
+  QMutexLocker locker(&d->Mutex);
+  return d->NumberOfExportedFiles;
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMExporter::wasCanceled()const
+{
+  Q_D(const ctkDICOMExporter);
+  return d->isCanceled();
+}
+
+//------------------------------------------------------------------------------
+QString ctkDICOMExporter::errorString()const
+{
+  Q_D(const ctkDICOMExporter);
+  QMutexLocker locker(&d->Mutex);
+  return d->ErrorString;
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMExporter::waitForDone(int msecs)
+{
+  Q_D(ctkDICOMExporter);
+  QElapsedTimer timer;
+  timer.start();
+  forever
+    {
+    this->reportProgress();
+    if (!d->Running)
+      {
+      return true;
+      }
+    qint64 remaining = 100;
+    if (msecs >= 0)
+      {
+      remaining = qMin(remaining, msecs - timer.elapsed());
+      if (remaining <= 0)
+        {
+        return false;
+        }
+      }
+    d->Pool.waitForDone(static_cast<int>(remaining));
+    }
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMExporter::cancel()
+{
+  Q_D(ctkDICOMExporter);
+  QMutexLocker locker(&d->Mutex);
+  if (d->Running)
+    {
+    d->Canceled = true;
+    }
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMExporter::reportProgress()
+{
+  Q_D(ctkDICOMExporter);
+  int numberOfExportedFiles = 0;
+  bool done = false;
+  bool success = false;
+  {
+    QMutexLocker locker(&d->Mutex);
+    d->ReportScheduled = false;
+    numberOfExportedFiles = d->NumberOfExportedFiles;
+    if (d->Done && d->Running)
+      {
+      d->Running = false;
+      done = true;
+      success = !d->Canceled && d->ErrorString.isEmpty();
+      }
+  }
+  if (numberOfExportedFiles != d->NumberOfReportedFiles)
+    {
+    d->NumberOfReportedFiles = numberOfExportedFiles;
+    emit progress(numberOfExportedFiles);
+    }
+  if (done)
+    {
+    emit finished(success);
+    }
+}
@@ -0,0 +1,123 @@
+/*=========================================================================
+
+  Library:   CTK
+
+  Copyright (c) Kitware Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0.txt
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=========================================================================*/
+
+#ifndef __ctkDICOMExporter_h
+#define __ctkDICOMExporter_h
+
+// Qt includes
+#include <QObject>
+#include <QStringList>
+
+#include "ctkDICOMCoreExport.h"
+
+class ctkDICOMDatabase;
+class ctkDICOMExporterPrivate;
+
+/// \ingroup DICOM_Core
+///
+/// Copies the files of series from a database to a directory.
+///
+/// The destination of each file is computed from the database tables in a
+/// single query, the files are not read. Files are then copied on
+/// maximumNumberOfThreads worker threads, progress() and finished() are
+/// emitted in the thread of the exporter when its event loop runs, or in
+/// waitForDone().
+///
+/// By default files are exported as
+/// <tt>PatientID-PatientsName/StudyDate-StudyDescription/SeriesNumber-SeriesDescription/000000.dcm</tt>.
+/// If writeDICOMDIR is enabled, the file IDs must follow the DICOM media
+/// storage rules instead: files are exported as
+/// <tt>DICOM/PAT00001/STU00001/SER00001/IMG00001</tt> and a DICOMDIR file
+/// indexing them is written at the root of the destination directory.
+class CTK_DICOM_CORE_EXPORT ctkDICOMExporter : public QObject
+{
+  Q_OBJECT
+  Q_PROPERTY(bool writeDICOMDIR READ writeDICOMDIR WRITE setWriteDICOMDIR);
+  Q_PROPERTY(int maximumNumberOfThreads READ maximumNumberOfThreads WRITE setMaximumNumberOfThreads);
+
+public:
+  explicit ctkDICOMExporter(QObject* parent = 0);
+  /// Cancel the export and wait for the workers
+  virtual ~ctkDICOMExporter();
+
+  /// Database the exported series are looked up in.
+  /// It must be used from the thread of the exporter only.
+  Q_INVOKABLE void setDatabase(ctkDICOMDatabase* database);
+  Q_INVOKABLE ctkDICOMDatabase* database()const;
+
+  /// Write a DICOMDIR file in the destination directory, false by default.
+  /// Changes apply to the exports started afterwards.
+  Q_INVOKABLE void setWriteDICOMDIR(bool writeDICOMDIR);
+  Q_INVOKABLE bool writeDICOMDIR()const;
+
+  /// Maximum number of files copied in parallel. 4 by default.
+  Q_INVOKABLE void setMaximumNumberOfThreads(int maximumNumberOfThreads);
+  Q_INVOKABLE int maximumNumberOfThreads()const;
+
+  /// Start exporting the series to \a destinationDirectory.
+  /// \return false if the export could not be started, see errorString().
+  Q_INVOKABLE bool exportSeries(const QString& destinationDirectory, const QStringList& seriesInstanceUIDs);
+  /// Start exporting all the series of the studies
+  Q_INVOKABLE bool exportStudies(const QString& destinationDirectory, const QStringList& studyInstanceUIDs);
+  /// Start exporting all the series of the patients. \a patientUIDs are
+  /// database identifiers, as returned by ctkDICOMDatabase::patients().
+  Q_INVOKABLE bool exportPatients(const QString& destinationDirectory, const QStringList& patientUIDs);
+
+  /// Return true from the start of an export until finished() is emitted
+  Q_INVOKABLE bool isRunning()const;
+  /// Number of files of the current or last export
+  Q_INVOKABLE int numberOfFiles()const;
+  /// Number of files copied so far by the current or last export
+  Q_INVOKABLE int numberOfExportedFiles()const;
+  /// Return true if the current or last export was canceled
+  Q_INVOKABLE bool wasCanceled()const;
+  /// Description of the error that stopped the current or last export,
+  /// empty if none.
+  Q_INVOKABLE QString errorString()const;
+
+  /// Report progress until the export is finished or until \a msecs
+  /// milliseconds have passed (no time limit if negative).
+  /// \return true if the export is finished
+  Q_INVOKABLE bool waitForDone(int msecs = -1);
+
+public Q_SLOTS:
+  /// Stop copying files. finished() is emitted once the workers are done.
+  void cancel();
+
+Q_SIGNALS:
+  /// Emitted while files are copied
+  void progress(int numberOfExportedFiles);
+  /// Emitted when all the files are copied and the DICOMDIR is written,
+  /// or when the export is stopped by an error or canceled.
+  void finished(bool success);
+
+protected Q_SLOTS:
+  /// Emit progress() and finished() for the work done by the workers
+  void reportProgress();
+
+protected:
+  QScopedPointer<ctkDICOMExporterPrivate> d_ptr;
+
+private:
+  Q_DECLARE_PRIVATE(ctkDICOMExporter);
+  Q_DISABLE_COPY(ctkDICOMExporter);
+};
+
+#endif
@@ -0,0 +1,228 @@
+/*=========================================================================
+
+  Library:   CTK
+
+  Copyright (c) Kitware Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0.txt
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=========================================================================*/
+
+// Qt includes
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutexLocker>
+
+// ctkDICOM includes
+#include "ctkDICOMFileStorage_p.h"
+#include "ctkLogger.h"
+
+// STD includes
+#ifdef Q_OS_WIN32
+# include <windows.h>
+#else
+# include <cstdio>
+# include <fcntl.h>
+# include <sys/stat.h>
+# include <unistd.h>
+#endif
+#ifdef Q_OS_LINUX
+# include <sys/ioctl.h>
+# include <linux/fs.h>
+#endif
+
+//------------------------------------------------------------------------------
+static ctkLogger logger("org.commontk.dicom.DICOMFileStorage");
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+ctkDICOMFileStorage::ctkDICOMFileStorage()
+  : Mode(ctkDICOMDatabase::CopyFiles)
+  , NextTemporaryFileIndex(0)
+{
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMFileStorage::setStorageMode(ctkDICOMDatabase::StorageMode mode)
+{
+  QMutexLocker locker(&this->Mutex);
+  this->Mode = mode;
+}
+
+//------------------------------------------------------------------------------
+ctkDICOMDatabase::StorageMode ctkDICOMFileStorage::storageMode() const
+{
+  QMutexLocker locker(&this->Mutex);
+  return this->Mode;
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMFileStorage::makePath(const QString& directoryPath)
+{
+  {
+    QMutexLocker locker(&this->Mutex);
+    if (this->ExistingDirectories.contains(directoryPath))
+    {
+      return true;
+    }
+  }
+  // Creating directories is not serialized, mkpath succeeds
+  // if another thread has created the directory in the meantime
+  if (!QDir().mkpath(directoryPath))
+  {
+    logger.error("Failed to create directory " + directoryPath);
+    return false;
+  }
+  QMutexLocker locker(&this->Mutex);
+  this->ExistingDirectories.insert(directoryPath);
+  return true;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMFileStorage::clearDirectoryCache()
+{
+  QMutexLocker locker(&this->Mutex);
+  this->ExistingDirectories.clear();
+}
+
+//------------------------------------------------------------------------------
+QString ctkDICOMFileStorage::storeTemporaryFile(const QString& sourceFilePath, const QString& destinationFilePath)
+{
+  QString directoryPath = QFileInfo(destinationFilePath).path();
+  if (!this->makePath(directoryPath))
+  {
+    return QString();
+  }
+  ctkDICOMDatabase::StorageMode mode = this->storageMode();
+  QString temporaryFilePath = this->temporaryFilePath(destinationFilePath);
+  if (this->placeFile(mode, sourceFilePath, temporaryFilePath))
+  {
+    return temporaryFilePath;
+  }
+  if (!QDir(directoryPath).exists())
+  {
+    // Directory has been removed since it has been created, try once more
+    {
+      QMutexLocker locker(&this->Mutex);
+      this->ExistingDirectories.remove(directoryPath);
+    }
+    if (this->makePath(directoryPath) && this->placeFile(mode, sourceFilePath, temporaryFilePath))
+    {
+      return temporaryFilePath;
+    }
+  }
+  logger.error("Failed to store file " + sourceFilePath + " as " + temporaryFilePath);
+  return QString();
+}
+
+//------------------------------------------------------------------------------
+QString ctkDICOMFileStorage::temporaryFilePath(const QString& destinationFilePath)
+{
+  // The same instance may be stored by several threads at once
+  QString temporaryFilePath;
+  do
+  {
+    QMutexLocker locker(&this->Mutex);
+    temporaryFilePath = destinationFilePath + QString(".%1.tmp").arg(this->NextTemporaryFileIndex++);
+  } while (QFile::exists(temporaryFilePath));
+  return temporaryFilePath;
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMFileStorage::replaceFile(const QString& temporaryFilePath, const QString& destinationFilePath)
+{
+#ifdef Q_OS_WIN32
+  return MoveFileExW(reinterpret_cast<const wchar_t*>(QDir::toNativeSeparators(temporaryFilePath).utf16()),
+                     reinterpret_cast<const wchar_t*>(QDir::toNativeSeparators(destinationFilePath).utf16()),
+                     MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+  // The destination is replaced atomically, it is never missing
+  return ::rename(QFile::encodeName(temporaryFilePath).constData(),
+                  QFile::encodeName(destinationFilePath).constData()) == 0;
+#endif
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMFileStorage::placeFile(ctkDICOMDatabase::StorageMode mode,
+                                    const QString& sourceFilePath, const QString& destinationFilePath)
+{
+  switch (mode)
+  {
+    case ctkDICOMDatabase::HardLinkFiles:
+      if (ctkDICOMFileStorage::hardLinkFile(sourceFilePath, destinationFilePath))
+      {
+        return true;
+      }
+      break;
+    case ctkDICOMDatabase::ReflinkFiles:
+      if (ctkDICOMFileStorage::reflinkFile(sourceFilePath, destinationFilePath))
+      {
+        return true;
+      }
+      break;
+    case ctkDICOMDatabase::MoveFiles:
+      // QFile::rename copies and removes the file if it cannot be renamed
+      return QFile::rename(sourceFilePath, destinationFilePath);
+    case ctkDICOMDatabase::CopyFiles:
+    default:
+      break;
+  }
+  return QFile::copy(sourceFilePath, destinationFilePath);
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMFileStorage::hardLinkFile(const QString& sourceFilePath, const QString& destinationFilePath)
+{
+#ifdef Q_OS_WIN32
+  return CreateHardLinkW(reinterpret_cast<const wchar_t*>(QDir::toNativeSeparators(destinationFilePath).utf16()),
+                         reinterpret_cast<const wchar_t*>(QDir::toNativeSeparators(sourceFilePath).utf16()),
+                         NULL) != 0;
+#else
+  return ::link(QFile::encodeName(sourceFilePath).constData(),
+                QFile::encodeName(destinationFilePath).constData()) == 0;
+#endif
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMFileStorage::reflinkFile(const QString& sourceFilePath, const QString& destinationFilePath)
+{
+#if defined(Q_OS_LINUX) && defined(FICLONE)
+  int sourceFd = ::open(QFile::encodeName(sourceFilePath).constData(), O_RDONLY);
+  if (sourceFd < 0)
+  {
+    return false;
+  }
+  struct stat sourceStat;
+  mode_t mode = (::fstat(sourceFd, &sourceStat) == 0 ? sourceStat.st_mode & 0777 : 0644);
+  QByteArray encodedDestinationFilePath = QFile::encodeName(destinationFilePath);
+  int destinationFd = ::open(encodedDestinationFilePath.constData(), O_WRONLY | O_CREAT | O_EXCL, mode);
+  if (destinationFd < 0)
+  {
+    ::close(sourceFd);
+    return false;
+  }
+  bool success = (::ioctl(destinationFd, FICLONE, sourceFd) == 0);
+  ::close(destinationFd);
+  ::close(sourceFd);
+  if (!success)
+  {
+    ::unlink(encodedDestinationFilePath.constData());
+  }
+  return success;
+#else
+  Q_UNUSED(sourceFilePath);
+  Q_UNUSED(destinationFilePath);
+  return false;
+#endif
+}
@@ -0,0 +1,83 @@
+/*=========================================================================
+
+  Library:   CTK
+
+  Copyright (c) Kitware Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0.txt
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=========================================================================*/
+
+#ifndef __ctkDICOMFileStorage_p_h
+#define __ctkDICOMFileStorage_p_h
+
+// Qt includes
+#include <QMutex>
+#include <QSet>
+#include <QString>
+
+// ctkDICOM includes
+#include "ctkDICOMDatabase.h"
+
+//------------------------------------------------------------------------------
+/// \ingroup DICOM_Core
+///
+/// Place files in the database folder of ctkDICOMDatabase, according to
+/// ctkDICOMDatabase::StorageMode. Directories that are known to exist are
+/// remembered, so that they are not checked again for every stored file.
+/// Files are placed next to their destination under a temporary name, and
+/// only replace the destination once their instance has been inserted.
+/// All methods are thread-safe.
+class ctkDICOMFileStorage
+{
+public:
+  ctkDICOMFileStorage();
+
+  void setStorageMode(ctkDICOMDatabase::StorageMode mode);
+  ctkDICOMDatabase::StorageMode storageMode() const;
+
+  /// Create \a directoryPath unless it is known to exist already
+  bool makePath(const QString& directoryPath);
+
+  /// Place \a sourceFilePath next to \a destinationFilePath under a temporary name
+  /// and return the path of the placed file, or an empty string if it could not be placed.
+  /// If the storage mode is not supported by the file system (or the
+  /// files are on different file systems) then the file is copied instead.
+  QString storeTemporaryFile(const QString& sourceFilePath, const QString& destinationFilePath);
+
+  /// Path next to \a destinationFilePath that no file exists at
+  QString temporaryFilePath(const QString& destinationFilePath);
+
+  /// Rename \a temporaryFilePath to \a destinationFilePath, replacing any existing file
+  static bool replaceFile(const QString& temporaryFilePath, const QString& destinationFilePath);
+
+  /// Forget the directories that are known to exist
+  void clearDirectoryCache();
+
+  /// Create a hard link at \a destinationFilePath to \a sourceFilePath
+  static bool hardLinkFile(const QString& sourceFilePath, const QString& destinationFilePath);
+  /// Create a copy-on-write clone of \a sourceFilePath at \a destinationFilePath.
+  /// Only supported on Linux, by file systems that support FICLONE (Btrfs, XFS, ...)
+  static bool reflinkFile(const QString& sourceFilePath, const QString& destinationFilePath);
+
+protected:
+  bool placeFile(ctkDICOMDatabase::StorageMode mode,
+                 const QString& sourceFilePath, const QString& destinationFilePath);
+
+  mutable QMutex Mutex;
+  ctkDICOMDatabase::StorageMode Mode;
+  QSet<QString> ExistingDirectories;
+  int NextTemporaryFileIndex;
+};
+
+#endif
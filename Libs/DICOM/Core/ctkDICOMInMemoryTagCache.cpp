@@ -0,0 +1,276 @@
+/*=========================================================================
+
+  Library:   CTK
+
+  Copyright (c) Kitware Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0.txt
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=========================================================================*/
+
+// Qt includes
+#include <QMutexLocker>
+
+// STD includes
+#include <climits>
+
+// ctkDICOM includes
+#include "ctkDICOMInMemoryTagCache_p.h"
+
+//------------------------------------------------------------------------------
+ctkDICOMInMemoryTagCache::ctkDICOMInMemoryTagCache()
+  : MemoryBudget(0)
+{
+  this->setMemoryBudget(64 * 1024 * 1024);
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMInMemoryTagCache::setMemoryBudget(qint64 bytes)
+{
+  this->MemoryBudget = qMax(qint64(0), bytes);
+  qint64 shardBudget = qMin(this->MemoryBudget / NumberOfShards, qint64(INT_MAX));
+  for (int i = 0; i < NumberOfShards; ++i)
+  {
+    QMutexLocker locker(&this->Shards[i].Mutex);
+    // setMaxCost evicts least recently used instances if needed
+    this->Shards[i].Instances.setMaxCost(static_cast<int>(shardBudget));
+  }
+}
+
+//------------------------------------------------------------------------------
+qint64 ctkDICOMInMemoryTagCache::memoryBudget() const
+{
+  return this->MemoryBudget;
+}
+
+//------------------------------------------------------------------------------
+ctkDICOMInMemoryTagCache::Shard& ctkDICOMInMemoryTagCache::shard(const QString& sopInstanceUID)
+{
+  return this->Shards[qHash(sopInstanceUID) % NumberOfShards];
+}
+
+//------------------------------------------------------------------------------
+int ctkDICOMInMemoryTagCache::cost(const QString& sopInstanceUID, const InstanceTags& instanceTags)
+{
+  // Rough estimate of the heap memory used by the strings and the hash nodes
+  const int nodeOverhead = 48;
+  int cost = nodeOverhead + sopInstanceUID.size() * static_cast<int>(sizeof(QChar));
+  QHash<QString, QString>::const_iterator it;
+  for (it = instanceTags.Values.constBegin(); it != instanceTags.Values.constEnd(); ++it)
+  {
+    cost += nodeOverhead + (it.key().size() + it.value().size()) * static_cast<int>(sizeof(QChar));
+  }
+  return cost;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMInMemoryTagCache::insert(Shard& shard, const QString& sopInstanceUID, InstanceTags* instanceTags)
+{
+  // QCache deletes the object right away if it is more expensive than the whole shard
+  shard.Instances.insert(sopInstanceUID, instanceTags, cost(sopInstanceUID, *instanceTags));
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMInMemoryTagCache::tag(const QString& sopInstanceUID, const QString& tag, QString& value)
+{
+  Shard& shard = this->shard(sopInstanceUID);
+  QMutexLocker locker(&shard.Mutex);
+  InstanceTags* instanceTags = shard.Instances.object(sopInstanceUID);
+  if (instanceTags)
+  {
+    QHash<QString, QString>::const_iterator it = instanceTags->Values.constFind(tag);
+    if (it != instanceTags->Values.constEnd())
+    {
+      value = it.value();
+      shard.Hits++;
+      return true;
+    }
+    if (instanceTags->Complete)
+    {
+      value = QString();
+      shard.Hits++;
+      return true;
+    }
+  }
+  shard.Misses++;
+  return false;
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMInMemoryTagCache::tags(const QString& sopInstanceUID, QMap<QString, QString>& values)
+{
+  Shard& shard = this->shard(sopInstanceUID);
+  QMutexLocker locker(&shard.Mutex);
+  InstanceTags* instanceTags = shard.Instances.object(sopInstanceUID);
+  if (!instanceTags || !instanceTags->Complete)
+  {
+    shard.Misses++;
+    return false;
+  }
+  values.clear();
+  QHash<QString, QString>::const_iterator it;
+  for (it = instanceTags->Values.constBegin(); it != instanceTags->Values.constEnd(); ++it)
+  {
+    if (!it.value().isNull())
+    {
+      values.insert(it.key(), it.value());
+    }
+  }
+  shard.Hits++;
+  return true;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMInMemoryTagCache::setTag(const QString& sopInstanceUID, const QString& tag, const QString& value)
+{
+  if (this->MemoryBudget == 0)
+  {
+    return;
+  }
+  Shard& shard = this->shard(sopInstanceUID);
+  QMutexLocker locker(&shard.Mutex);
+  // Values read from the database before this one was written are outdated
+  shard.Version++;
+  // Take the instance out and insert it again so that its cost is updated
+  InstanceTags* instanceTags = shard.Instances.take(sopInstanceUID);
+  if (!instanceTags)
+  {
+    instanceTags = new InstanceTags;
+  }
+  instanceTags->Values.insert(tag, value);
+  this->insert(shard, sopInstanceUID, instanceTags);
+}
+
+//------------------------------------------------------------------------------
+int ctkDICOMInMemoryTagCache::version(const QString& sopInstanceUID)
+{
+  Shard& shard = this->shard(sopInstanceUID);
+  QMutexLocker locker(&shard.Mutex);
+  return shard.Version;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMInMemoryTagCache::addTag(const QString& sopInstanceUID, const QString& tag,
+                                      const QString& value, int version)
+{
+  if (this->MemoryBudget == 0)
+  {
+    return;
+  }
+  Shard& shard = this->shard(sopInstanceUID);
+  QMutexLocker locker(&shard.Mutex);
+  if (shard.Version != version)
+  {
+    return;
+  }
+  InstanceTags* instanceTags = shard.Instances.take(sopInstanceUID);
+  if (!instanceTags)
+  {
+    instanceTags = new InstanceTags;
+  }
+  // A complete instance knows all of its tags already
+  if (!instanceTags->Complete && !instanceTags->Values.contains(tag))
+  {
+    instanceTags->Values.insert(tag, value);
+  }
+  this->insert(shard, sopInstanceUID, instanceTags);
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMInMemoryTagCache::addTags(const QString& sopInstanceUID,
+                                       const QMap<QString, QString>& values, int version)
+{
+  if (this->MemoryBudget == 0)
+  {
+    return;
+  }
+  Shard& shard = this->shard(sopInstanceUID);
+  QMutexLocker locker(&shard.Mutex);
+  if (shard.Version != version)
+  {
+    return;
+  }
+  InstanceTags* instanceTags = shard.Instances.take(sopInstanceUID);
+  if (!instanceTags)
+  {
+    instanceTags = new InstanceTags;
+  }
+  QMap<QString, QString>::const_iterator it;
+  for (it = values.constBegin(); it != values.constEnd(); ++it)
+  {
+    if (!instanceTags->Values.contains(it.key()))
+    {
+      instanceTags->Values.insert(it.key(), it.value());
+    }
+  }
+  instanceTags->Complete = true;
+  this->insert(shard, sopInstanceUID, instanceTags);
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMInMemoryTagCache::remove(const QStringList& sopInstanceUIDs)
+{
+  foreach (const QString& sopInstanceUID, sopInstanceUIDs)
+  {
+    Shard& shard = this->shard(sopInstanceUID);
+    QMutexLocker locker(&shard.Mutex);
+    shard.Version++;
+    shard.Instances.remove(sopInstanceUID);
+  }
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMInMemoryTagCache::clear()
+{
+  for (int i = 0; i < NumberOfShards; ++i)
+  {
+    QMutexLocker locker(&this->Shards[i].Mutex);
+    this->Shards[i].Version++;
+    this->Shards[i].Instances.clear();
+  }
+}
+
+//------------------------------------------------------------------------------
+qint64 ctkDICOMInMemoryTagCache::hitCount() const
+{
+  qint64 hits = 0;
+  for (int i = 0; i < NumberOfShards; ++i)
+  {
+    QMutexLocker locker(&this->Shards[i].Mutex);
+    hits += this->Shards[i].Hits;
+  }
+  return hits;
+}
+
+//------------------------------------------------------------------------------
+qint64 ctkDICOMInMemoryTagCache::missCount() const
+{
+  qint64 misses = 0;
+  for (int i = 0; i < NumberOfShards; ++i)
+  {
+    QMutexLocker locker(&this->Shards[i].Mutex);
+    misses += this->Shards[i].Misses;
+  }
+  return misses;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMInMemoryTagCache::resetStatistics()
+{
+  for (int i = 0; i < NumberOfShards; ++i)
+  {
+    QMutexLocker locker(&this->Shards[i].Mutex);
+    this->Shards[i].Hits = 0;
+    this->Shards[i].Misses = 0;
+  }
+}
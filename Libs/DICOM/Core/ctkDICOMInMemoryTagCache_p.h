@@ -0,0 +1,117 @@
+/*=========================================================================
+
+  Library:   CTK
+
+  Copyright (c) Kitware Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0.txt
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=========================================================================*/
+
+#ifndef __ctkDICOMInMemoryTagCache_p_h
+#define __ctkDICOMInMemoryTagCache_p_h
+
+// Qt includes
+#include <QCache>
+#include <QHash>
+#include <QMap>
+#include <QMutex>
+#include <QString>
+#include <QStringList>
+
+/// \ingroup DICOM_Core
+///
+/// In-process cache in front of the tag cache database of ctkDICOMDatabase.
+///
+/// Values are stored exactly as they are stored in the TagCache table.
+/// A null value means that the tag is known to be missing from the TagCache table.
+/// An instance is "complete" if all of its rows of the TagCache table are
+/// in memory, in that case lookups of any tag of the instance can be answered
+/// without accessing the database.
+///
+/// Instances are distributed over several shards, each protected by its own
+/// mutex and evicted in least-recently-used order once the shard exceeds its
+/// share of the memory budget.
+///
+/// Values written to the database are stored with setTag(). Values read from
+/// the database by another thread may be outdated by the time they are stored,
+/// they are added with addTag() or addTags() instead, which only add them if
+/// nothing has been stored or removed since version() was taken, before the
+/// database was read, and never replace a value that is in memory already.
+class ctkDICOMInMemoryTagCache
+{
+public:
+  ctkDICOMInMemoryTagCache();
+
+  /// Approximate maximum memory used by the cache, in bytes.
+  /// 0 disables the cache.
+  void setMemoryBudget(qint64 bytes);
+  qint64 memoryBudget() const;
+
+  /// Return true if the value of \a tag is known for \a sopInstanceUID.
+  bool tag(const QString& sopInstanceUID, const QString& tag, QString& value);
+  /// Return true if all the cached tags of \a sopInstanceUID are known.
+  bool tags(const QString& sopInstanceUID, QMap<QString, QString>& values);
+
+  /// Store a single tag value that has been written to the database.
+  void setTag(const QString& sopInstanceUID, const QString& tag, const QString& value);
+
+  /// Incremented whenever a value of an instance of the same shard is stored
+  /// with setTag() or removed. Take it before reading the database.
+  int version(const QString& sopInstanceUID);
+  /// Add a single tag value read from the database. Null \a value means
+  /// the tag is not in the database.
+  void addTag(const QString& sopInstanceUID, const QString& tag, const QString& value, int version);
+  /// Add all cached tags of an instance read from the database and mark the instance complete.
+  void addTags(const QString& sopInstanceUID, const QMap<QString, QString>& values, int version);
+
+  void remove(const QStringList& sopInstanceUIDs);
+  void clear();
+
+  qint64 hitCount() const;
+  qint64 missCount() const;
+  void resetStatistics();
+
+protected:
+  struct InstanceTags
+  {
+    InstanceTags() : Complete(false) {}
+    QHash<QString, QString> Values;
+    bool Complete;
+  };
+
+  struct Shard
+  {
+    Shard() : Hits(0), Misses(0), Version(0) {}
+    mutable QMutex Mutex;
+    QCache<QString, InstanceTags> Instances;
+    qint64 Hits;
+    qint64 Misses;
+    int Version;
+  };
+
+  enum
+  {
+    NumberOfShards = 16
+  };
+
+  Shard& shard(const QString& sopInstanceUID);
+  /// Insert \a instanceTags into \a shard, the shard takes ownership.
+  void insert(Shard& shard, const QString& sopInstanceUID, InstanceTags* instanceTags);
+  static int cost(const QString& sopInstanceUID, const InstanceTags& instanceTags);
+
+  Shard Shards[NumberOfShards];
+  qint64 MemoryBudget;
+};
+
+#endif
@@ -30,6 +30,8 @@
 #include <QDirIterator>
 #include <QFileInfo>
 #include <QDebug>
+#include <QThread>
+#include <QThreadPool>
 
 // ctkDICOM includes
 #include "ctkLogger.h"
@@ -56,140 +58,228 @@ static ctkLogger logger("org.commontk.dicom.DICOMIndexer" );
 
 
 //------------------------------------------------------------------------------
-// ctkDICOMIndexerPrivate methods
+// ctkDICOMIndexerParsedFileQueue methods
 
 //------------------------------------------------------------------------------
-ctkDICOMIndexerPrivate::ctkDICOMIndexerPrivate(ctkDICOMIndexer& o)
-  : q_ptr(&o)
-  , Canceled(false)
-  , StartedIndexing(0)
+ctkDICOMIndexerParsedFileQueue::ctkDICOMIndexerParsedFileQueue()
+  : Canceled(false)
 {
 }
 
 //------------------------------------------------------------------------------
-ctkDICOMIndexerPrivate::~ctkDICOMIndexerPrivate()
+void ctkDICOMIndexerParsedFileQueue::push(const ctkDICOMIndexerParsedFile& parsedFile)
 {
+  QMutexLocker locker(&this->Mutex);
+  this->ParsedFiles.enqueue(parsedFile);
+  this->NotEmpty.wakeOne();
 }
 
 //------------------------------------------------------------------------------
+QList<ctkDICOMIndexerParsedFile> ctkDICOMIndexerParsedFileQueue::popAll()
+{
+  QMutexLocker locker(&this->Mutex);
+  while (this->ParsedFiles.isEmpty())
+  {
+    this->NotEmpty.wait(&this->Mutex);
+  }
+  QList<ctkDICOMIndexerParsedFile> parsedFiles = this->ParsedFiles;
+  this->ParsedFiles.clear();
+  return parsedFiles;
+}
 
 //------------------------------------------------------------------------------
-// ctkDICOMIndexer methods
+QList<ctkDICOMIndexerParsedFile> ctkDICOMIndexerParsedFileQueue::takeAll()
+{
+  QMutexLocker locker(&this->Mutex);
+  QList<ctkDICOMIndexerParsedFile> parsedFiles = this->ParsedFiles;
+  this->ParsedFiles.clear();
+  return parsedFiles;
+}
 
 //------------------------------------------------------------------------------
-ctkDICOMIndexer::ctkDICOMIndexer(QObject *parent):d_ptr(new ctkDICOMIndexerPrivate(*this))
+void ctkDICOMIndexerParsedFileQueue::cancel()
 {
-  Q_UNUSED(parent);
+  QMutexLocker locker(&this->Mutex);
+  this->Canceled = true;
 }
 
 //------------------------------------------------------------------------------
-ctkDICOMIndexer::~ctkDICOMIndexer()
+bool ctkDICOMIndexerParsedFileQueue::isCanceled() const
 {
+  QMutexLocker locker(&this->Mutex);
+  return this->Canceled;
 }
 
 //------------------------------------------------------------------------------
-void ctkDICOMIndexer::addFile(ctkDICOMDatabase& database,
-                                   const QString filePath,
-                                   const QString& destinationDirectoryName)
+// ctkDICOMIndexerParseTask methods
+
+//------------------------------------------------------------------------------
+ctkDICOMIndexerParseTask::ctkDICOMIndexerParseTask(const QString& filePath,
+                                                   ctkDICOMIndexerParsedFileQueue* queue,
+                                                   ctkDICOMDatabase* database)
+  : FilePath(filePath)
+  , Queue(queue)
+  , Database(database)
 {
-  ctkDICOMIndexer::ScopedIndexing indexingBatch(*this, database);
-  emit indexingFilePath(filePath);
-  // Ignoring destinationDirectoryName parameter, just taking it as indication we should copy
-  bool copyFileToDatabase = !destinationDirectoryName.isEmpty();
-  database.insert(filePath, copyFileToDatabase, true);
 }
 
 //------------------------------------------------------------------------------
-void ctkDICOMIndexer::addDirectory(ctkDICOMDatabase& database,
-                                   const QString& directoryName,
-                                   const QString& destinationDirectoryName,
-                                   bool includeHidden/*=true*/)
+void ctkDICOMIndexerParseTask::run()
 {
-  ctkDICOMIndexer::ScopedIndexing indexingBatch(*this, database);
-  QStringList listOfFiles;
-  QDir directory(directoryName);
-
-  if(directory.exists("DICOMDIR"))
-  {
-    addDicomdir(database,directoryName,destinationDirectoryName);
-  }
-  else
+  ctkDICOMIndexerParsedFile parsedFile;
+  parsedFile.FilePath = this->FilePath;
+  if (!this->Queue->isCanceled())
   {
-    QDir::Filters filters = QDir::Files;
-    if (includeHidden)
-    {
-      filters |= QDir::Hidden;
-    }
-    QDirIterator it(directoryName, filters, QDirIterator::Subdirectories);
-    while(it.hasNext())
+    QFileInfo fileInfo(this->FilePath);
+    parsedFile.FileManifestEntry.size = fileInfo.size();
+    parsedFile.FileManifestEntry.lastModified = fileInfo.lastModified().toMSecsSinceEpoch();
+
+    QSharedPointer<ctkDICOMItem> dataset(new ctkDICOMItem);
+    dataset->InitializeFromFile(this->FilePath);
+    if (dataset->IsInitialized())
     {
-      listOfFiles << it.next();
+      parsedFile.Dataset = dataset;
+      if (this->Database)
+      {
+        parsedFile.TemporaryFilePath = this->Database->storeFileInDatabaseFolder(this->FilePath, *dataset);
+      }
     }
-    emit foundFilesToIndex(listOfFiles.count());
-    addListOfFiles(database,listOfFiles,destinationDirectoryName);
   }
+  this->Queue->push(parsedFile);
 }
 
 //------------------------------------------------------------------------------
-void ctkDICOMIndexer::addListOfFiles(ctkDICOMDatabase& database,
-                                     const QStringList& listOfFiles,
-                                     const QString& destinationDirectoryName)
+// ctkDICOMIndexerPrivate methods
+
+//------------------------------------------------------------------------------
+ctkDICOMIndexerPrivate::ctkDICOMIndexerPrivate(ctkDICOMIndexer& o)
+  : q_ptr(&o)
+  , Canceled(false)
+  , StartedIndexing(0)
+  , NumberOfParsingThreads(QThread::idealThreadCount())
+  , UseDicomdirRecords(true)
+  , CompleteDicomdirInstances(true)
 {
-  Q_D(ctkDICOMIndexer);
-  ctkDICOMIndexer::ScopedIndexing indexingBatch(*this, database);
-  QTime timeProbe;
-  timeProbe.start();
-  d->Canceled = false;
+  if (this->NumberOfParsingThreads < 1)
+  {
+    this->NumberOfParsingThreads = 1;
+  }
+}
+
+//------------------------------------------------------------------------------
+ctkDICOMIndexerPrivate::~ctkDICOMIndexerPrivate()
+{
+}
+
+//------------------------------------------------------------------------------
+int ctkDICOMIndexerPrivate::addListOfFilesInParallel(ctkDICOMDatabase& database,
+                                                     const QStringList& listOfFiles,
+                                                     bool copyFileToDatabase)
+{
+  Q_Q(ctkDICOMIndexer);
+
+  QThreadPool parsingThreadPool;
+  parsingThreadPool.setMaxThreadCount(this->NumberOfParsingThreads);
+  ctkDICOMIndexerParsedFileQueue parsedFiles;
+
+  // Only a limited number of files are submitted ahead of the inserts
+  // so that parsed headers do not pile up in memory when parsing
+  // is faster than inserting.
+  const int maxNumberOfPendingFiles = 8 * this->NumberOfParsingThreads;
+
+  int nextFileIndex = 0;
+  int numberOfPendingFiles = 0;
   int currentFileIndex = 0;
   int lastReportedPercent = 0;
-  foreach(QString filePath, listOfFiles)
+  while (!this->Canceled)
   {
+    while (nextFileIndex < listOfFiles.size() && numberOfPendingFiles < maxNumberOfPendingFiles)
+    {
+      const QString& filePath = listOfFiles[nextFileIndex++];
+      if (database.fileExistsAndUpToDate(filePath))
+      {
+        logger.debug( "File " + filePath + " already added.");
+        currentFileIndex++;
+        continue;
+      }
+      parsingThreadPool.start(new ctkDICOMIndexerParseTask(filePath, &parsedFiles,
+        copyFileToDatabase ? &database : 0));
+      numberOfPendingFiles++;
+    }
+    if (numberOfPendingFiles == 0)
+    {
+      break;
+    }
+
     int percent = ( 100 * currentFileIndex ) / listOfFiles.size();
     if (lastReportedPercent / 10 < percent / 10)
     {
       // Reporting progress has a huge overhead (pending events are processed,
       // database is updated), therefore only report progress at every 10% increase
-      emit this->progress(percent);
+      emit q->progress(percent);
       lastReportedPercent = percent;
     }
-    this->addFile(database, filePath, destinationDirectoryName);
-    currentFileIndex++;
 
-    if (d->Canceled)
+    // Insert all headers that have been parsed so far in one batch
+    QList<ctkDICOMDatabase::IndexingResult> indexingResults;
+    foreach (const ctkDICOMIndexerParsedFile& parsedFile, parsedFiles.popAll())
     {
-      break;
+      emit q->indexingFilePath(parsedFile.FilePath);
+      ctkDICOMDatabase::IndexingResult indexingResult;
+      indexingResult.filePath = parsedFile.FilePath;
+      indexingResult.dataset = parsedFile.Dataset;
+      indexingResult.storeFile = copyFileToDatabase;
+      indexingResult.temporaryFilePath = parsedFile.TemporaryFilePath;
+      indexingResult.fileManifestEntry = parsedFile.FileManifestEntry;
+      indexingResults << indexingResult;
     }
+    database.insert(indexingResults);
+    numberOfPendingFiles -= indexingResults.size();
+    currentFileIndex += indexingResults.size();
   }
 
-  // Update displayed fields according to inserted DICOM datasets
-  emit displayedFieldsUpdateStarted();
-  database.updateDisplayedFields();
+  // Files that are still queued are skipped by the workers
+  parsedFiles.cancel();
+  parsingThreadPool.waitForDone();
 
-  float elapsedTimeInSeconds = timeProbe.elapsed() / 1000.0;
-  qDebug() << QString("DICOM indexer has successfully processed %1 files [%2s]")
-    .arg(currentFileIndex).arg(QString::number(elapsedTimeInSeconds,'f', 2));
+  // Files that the workers have stored already are inserted,
+  // so that they are not left unreferenced in the database folder
+  QList<ctkDICOMDatabase::IndexingResult> storedIndexingResults;
+  foreach (const ctkDICOMIndexerParsedFile& parsedFile, parsedFiles.takeAll())
+  {
+    if (parsedFile.TemporaryFilePath.isEmpty())
+    {
+      continue;
+    }
+    ctkDICOMDatabase::IndexingResult indexingResult;
+    indexingResult.filePath = parsedFile.FilePath;
+    indexingResult.dataset = parsedFile.Dataset;
+    indexingResult.storeFile = copyFileToDatabase;
+    indexingResult.temporaryFilePath = parsedFile.TemporaryFilePath;
+    indexingResult.fileManifestEntry = parsedFile.FileManifestEntry;
+    storedIndexingResults << indexingResult;
+  }
+  database.insert(storedIndexingResults);
+
+  return currentFileIndex;
 }
 
 //------------------------------------------------------------------------------
-bool ctkDICOMIndexer::addDicomdir(ctkDICOMDatabase& database,
-                 const QString& directoryName,
-                 const QString& destinationDirectoryName
-                 )
+bool ctkDICOMIndexerPrivate::readDicomdir(const QString& directoryName, QStringList& listOfInstances,
+                                          QList<ctkDICOMDatabase::IndexingResult>* recordIndexingResults)
 {
-  ctkDICOMIndexer::ScopedIndexing indexingBatch(*this, database);
   //Initialize dicomdir with directory path
   QString dcmFilePath = directoryName;
   dcmFilePath.append("/DICOMDIR");
-  DcmDicomDir* dicomDir = new DcmDicomDir(dcmFilePath.toStdString().c_str());
+  DcmDicomDir dicomDir(dcmFilePath.toStdString().c_str());
 
   //Values to store records data at the moment only uid needed
   OFString patientsName, studyInstanceUID, seriesInstanceUID, sopInstanceUID, referencedFileName ;
 
   //Variables for progress operations
   QString instanceFilePath;
-  QStringList listOfInstances;
 
-  DcmDirectoryRecord* rootRecord = &(dicomDir->getRootRecord());
+  DcmDirectoryRecord* rootRecord = &(dicomDir.getRootRecord());
   DcmDirectoryRecord* patientRecord = NULL;
   DcmDirectoryRecord* studyRecord = NULL;
   DcmDirectoryRecord* seriesRecord = NULL;
@@ -254,6 +344,17 @@ bool ctkDICOMIndexer::addDicomdir(ctkDICOMDatabase& database,
             instanceFilePath.append(QString( referencedFileName.c_str() ));
             instanceFilePath.replace("\\","/");
             listOfInstances << instanceFilePath;
+
+            if (recordIndexingResults)
+            {
+              ctkDICOMDatabase::IndexingResult indexingResult;
+              indexingResult.filePath = instanceFilePath;
+              indexingResult.dataset = ctkDICOMIndexerPrivate::datasetFromRecords(
+                patientRecord, studyRecord, seriesRecord, fileRecord);
+              indexingResult.generateThumbnail = false;
+              indexingResult.fromDirectoryRecords = true;
+              recordIndexingResults->append(indexingResult);
+            }
           }
         }
       }
@@ -263,52 +364,321 @@ bool ctkDICOMIndexer::addDicomdir(ctkDICOMDatabase& database,
         << QString("DICOM indexer has successfully processed DICOMDIR in %1 [%2s]")
            .arg(directoryName)
            .arg(QString::number(elapsedTimeInSeconds,'f', 2));
-    emit foundFilesToIndex(listOfInstances.count());
-    addListOfFiles(database,listOfInstances,destinationDirectoryName);
   }
   return success;
 }
 
 //------------------------------------------------------------------------------
-void ctkDICOMIndexer::refreshDatabase(ctkDICOMDatabase& database, const QString& directoryName)
+QSharedPointer<ctkDICOMItem> ctkDICOMIndexerPrivate::datasetFromRecords(DcmDirectoryRecord* patientRecord,
+  DcmDirectoryRecord* studyRecord, DcmDirectoryRecord* seriesRecord, DcmDirectoryRecord* fileRecord)
 {
-  Q_UNUSED(database);
-  Q_UNUSED(directoryName);
-  /*
-   * Probably this should go to the database class as well
-   * Or we have to extend the interface to make possible what we do here
-   * without using SQL directly
-
-  /// get all filenames from the database
-  QSqlQuery allFilesQuery(database.database());
-  QStringList databaseFileNames;
-  QStringList filesToRemove;
-  this->loggedExec(allFilesQuery, "SELECT Filename from Images;");
+  DcmDataset* dataset = new DcmDataset;
+  // Attributes of lower level records take precedence
+  DcmDirectoryRecord* records[] = { patientRecord, studyRecord, seriesRecord, fileRecord };
+  for (int recordIndex = 0; recordIndex < 4; ++recordIndex)
+  {
+    DcmDirectoryRecord* record = records[recordIndex];
+    for (unsigned long elementIndex = 0; elementIndex < record->card(); ++elementIndex)
+    {
+      DcmElement* element = record->getElement(elementIndex);
+      // Skip directory record attributes (group 0004) and sequences
+      if (!element || element->getGTag() == 0x0004 || element->ident() == EVR_SQ)
+      {
+        continue;
+      }
+      dataset->insert(OFstatic_cast(DcmElement*, element->clone()), OFTrue);
+    }
+  }
+  OFString value;
+  if (fileRecord->findAndGetOFStringArray(DCM_ReferencedSOPInstanceUIDInFile, value).good())
+  {
+    dataset->putAndInsertOFStringArray(DCM_SOPInstanceUID, value);
+  }
+  if (fileRecord->findAndGetOFStringArray(DCM_ReferencedSOPClassUIDInFile, value).good())
+  {
+    dataset->putAndInsertOFStringArray(DCM_SOPClassUID, value);
+  }
+  QSharedPointer<ctkDICOMItem> item(new ctkDICOMItem);
+  item->InitializeFromItem(dataset, true /* take ownership */);
+  return item;
+}
+
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// ctkDICOMIndexer methods
+
+//------------------------------------------------------------------------------
+ctkDICOMIndexer::ctkDICOMIndexer(QObject *parent):d_ptr(new ctkDICOMIndexerPrivate(*this))
+{
+  Q_UNUSED(parent);
+}
+
+//------------------------------------------------------------------------------
+ctkDICOMIndexer::~ctkDICOMIndexer()
+{
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMIndexer::setNumberOfParsingThreads(int numberOfThreads)
+{
+  Q_D(ctkDICOMIndexer);
+  d->NumberOfParsingThreads = qMax(0, numberOfThreads);
+}
 
-  while (allFilesQuery.next())
+//------------------------------------------------------------------------------
+int ctkDICOMIndexer::numberOfParsingThreads() const
+{
+  Q_D(const ctkDICOMIndexer);
+  return d->NumberOfParsingThreads;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMIndexer::setUseDicomdirRecords(bool useRecords)
+{
+  Q_D(ctkDICOMIndexer);
+  d->UseDicomdirRecords = useRecords;
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMIndexer::useDicomdirRecords() const
+{
+  Q_D(const ctkDICOMIndexer);
+  return d->UseDicomdirRecords;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMIndexer::setCompleteDicomdirInstances(bool complete)
+{
+  Q_D(ctkDICOMIndexer);
+  d->CompleteDicomdirInstances = complete;
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMIndexer::completeDicomdirInstances() const
+{
+  Q_D(const ctkDICOMIndexer);
+  return d->CompleteDicomdirInstances;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMIndexer::addFile(ctkDICOMDatabase& database,
+                                   const QString filePath,
+                                   const QString& destinationDirectoryName)
+{
+  ctkDICOMIndexer::ScopedIndexing indexingBatch(*this, database);
+  emit indexingFilePath(filePath);
+  // Ignoring destinationDirectoryName parameter, just taking it as indication we should copy
+  bool copyFileToDatabase = !destinationDirectoryName.isEmpty();
+  database.insert(filePath, copyFileToDatabase, true);
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMIndexer::addDirectory(ctkDICOMDatabase& database,
+                                   const QString& directoryName,
+                                   const QString& destinationDirectoryName,
+                                   bool includeHidden/*=true*/)
+{
+  ctkDICOMIndexer::ScopedIndexing indexingBatch(*this, database);
+  QStringList listOfFiles;
+  QDir directory(directoryName);
+
+  if(directory.exists("DICOMDIR"))
+  {
+    addDicomdir(database,directoryName,destinationDirectoryName);
+  }
+  else
+  {
+    QDir::Filters filters = QDir::Files;
+    if (includeHidden)
+    {
+      filters |= QDir::Hidden;
+    }
+    QDirIterator it(directoryName, filters, QDirIterator::Subdirectories);
+    while(it.hasNext())
+    {
+      listOfFiles << it.next();
+    }
+    emit foundFilesToIndex(listOfFiles.count());
+    addListOfFiles(database,listOfFiles,destinationDirectoryName);
+  }
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMIndexer::addListOfFiles(ctkDICOMDatabase& database,
+                                     const QStringList& listOfFiles,
+                                     const QString& destinationDirectoryName)
+{
+  Q_D(ctkDICOMIndexer);
+  ctkDICOMIndexer::ScopedIndexing indexingBatch(*this, database);
+  QTime timeProbe;
+  timeProbe.start();
+  d->Canceled = false;
+  int currentFileIndex = 0;
+  if (d->NumberOfParsingThreads > 0 && listOfFiles.size() > 1)
+  {
+    // Ignoring destinationDirectoryName parameter, just taking it as indication we should copy
+    bool copyFileToDatabase = !destinationDirectoryName.isEmpty();
+    currentFileIndex = d->addListOfFilesInParallel(database, listOfFiles, copyFileToDatabase);
+  }
+  else
+  {
+    int lastReportedPercent = 0;
+    foreach(QString filePath, listOfFiles)
     {
-    QString fileName = allFilesQuery.value(0).toString();
-    databaseFileNames.append(fileName);
-    if (! QFile::exists(fileName) )
+      int percent = ( 100 * currentFileIndex ) / listOfFiles.size();
+      if (lastReportedPercent / 10 < percent / 10)
+      {
+        // Reporting progress has a huge overhead (pending events are processed,
+        // database is updated), therefore only report progress at every 10% increase
+        emit this->progress(percent);
+        lastReportedPercent = percent;
+      }
+      this->addFile(database, filePath, destinationDirectoryName);
+      currentFileIndex++;
+
+      if (d->Canceled)
       {
-      filesToRemove.append(fileName);
+        break;
       }
     }
+  }
+
+  // Update displayed fields according to inserted DICOM datasets
+  emit displayedFieldsUpdateStarted();
+  database.updateDisplayedFields();
 
-  QSet<QString> filesytemFiles;
-  QDirIterator dirIt(directoryName);
-  while (dirIt.hasNext())
+  float elapsedTimeInSeconds = timeProbe.elapsed() / 1000.0;
+  qDebug() << QString("DICOM indexer has successfully processed %1 files [%2s]")
+    .arg(currentFileIndex).arg(QString::number(elapsedTimeInSeconds,'f', 2));
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMIndexer::addDicomdir(ctkDICOMDatabase& database,
+                 const QString& directoryName,
+                 const QString& destinationDirectoryName
+                 )
+{
+  Q_D(ctkDICOMIndexer);
+  d->Canceled = false;
+  // Files have to be read anyway if they are copied into the database folder
+  bool insertFromRecords = d->UseDicomdirRecords && destinationDirectoryName.isEmpty();
+
+  QStringList listOfInstances;
+  bool success = true;
+  {
+    ctkDICOMIndexer::ScopedIndexing indexingBatch(*this, database);
+    QList<ctkDICOMDatabase::IndexingResult> recordIndexingResults;
+    success = d->readDicomdir(directoryName, listOfInstances,
+      insertFromRecords ? &recordIndexingResults : 0);
+    emit foundFilesToIndex(listOfInstances.count());
+
+    if (!insertFromRecords)
     {
-    filesytemFiles.insert(dirIt.next());
+      addListOfFiles(database,listOfInstances,destinationDirectoryName);
+      return success;
     }
 
-  // TODO: it looks like this function was never finished...
-  //
-  // I guess the next step is to remove all filesToRemove from the database
-  // and also to add filesystemFiles into the database tables
-  */
+    QTime timeProbe;
+    timeProbe.start();
+    database.insert(recordIndexingResults);
+    emit displayedFieldsUpdateStarted();
+    database.updateDisplayedFields();
+    qDebug() << QString("DICOM indexer has inserted %1 instances from DICOMDIR records [%2s]")
+      .arg(recordIndexingResults.count())
+      .arg(QString::number(timeProbe.elapsed() / 1000.0,'f', 2));
+  } // inserted records are committed and can be browsed while the files are read
+
+  if (d->CompleteDicomdirInstances && !d->Canceled)
+  {
+    ctkDICOMIndexer::ScopedIndexing indexingBatch(*this, database);
+    database.prepareInsert();
+    addListOfFiles(database,listOfInstances);
+  }
+  return success;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMIndexer::refreshDatabase(ctkDICOMDatabase& database, const QString& directoryName)
+{
+  Q_D(ctkDICOMIndexer);
+  ctkDICOMIndexer::ScopedIndexing indexingBatch(*this, database);
+  QTime timeProbe;
+  timeProbe.start();
+  d->Canceled = false;
+
+  // Compare the file system to the manifest of the last indexing:
+  // only new and modified files need to be read.
+  // The manifest is keyed by absolute file path
+  QString directoryPath = QFileInfo(directoryName).absoluteFilePath();
+  ctkDICOMDatabase::FileManifest manifest = database.fileManifest(directoryPath);
+  ctkDICOMDatabase::FileManifest scannedFiles;
+  QStringList filesToAdd;
+  QStringList filesToRemove;
+  QDirIterator it(directoryPath, QDir::Files | QDir::Hidden, QDirIterator::Subdirectories);
+  while (it.hasNext())
+  {
+    QString filePath = it.next();
+    QFileInfo fileInfo = it.fileInfo();
+    ctkDICOMDatabase::FileManifestEntry entry;
+    entry.size = fileInfo.size();
+    entry.lastModified = fileInfo.lastModified().toMSecsSinceEpoch();
+
+    ctkDICOMDatabase::FileManifest::iterator manifestIt = manifest.find(filePath);
+    if (manifestIt != manifest.end())
+    {
+      bool unchanged = (manifestIt.value().size == entry.size
+        && manifestIt.value().lastModified == entry.lastModified);
+      if (unchanged)
+      {
+        manifest.erase(manifestIt);
+        continue;
+      }
+      // Content of the file may be a different instance now.
+      // Its instance is referenced at the file it has been stored as.
+      filesToRemove << (manifestIt.value().storedFilename.isEmpty() ? filePath : manifestIt.value().storedFilename);
+      manifest.erase(manifestIt);
+    }
+    filesToAdd << filePath;
+    scannedFiles.insert(filePath, entry);
+  }
+  // Files that are left in the manifest do not exist anymore
+  for (ctkDICOMDatabase::FileManifest::const_iterator manifestIt = manifest.constBegin();
+       manifestIt != manifest.constEnd(); ++manifestIt)
+  {
+    filesToRemove << (manifestIt.value().storedFilename.isEmpty() ? manifestIt.key() : manifestIt.value().storedFilename);
+  }
+  filesToRemove.removeDuplicates();
+
+  logger.debug(QString("Refreshing %1: %2 new or modified files, %3 modified or removed files")
+    .arg(directoryName).arg(filesToAdd.size()).arg(filesToRemove.size()));
+
+  database.removeFiles(filesToRemove);
+
+  emit foundFilesToIndex(filesToAdd.count());
+  if (!filesToAdd.isEmpty())
+  {
+    this->addListOfFiles(database, filesToAdd);
+  }
+  else if (!filesToRemove.isEmpty())
+  {
+    emit displayedFieldsUpdateStarted();
+    database.updateDisplayedFields();
   }
 
+  if (!d->Canceled)
+  {
+    // Non-DICOM files are recorded as well so that they are not read again.
+    // The size and time seen before reading the files is recorded, so that
+    // files that are modified while being indexed are read again next time.
+    database.updateFileManifest(scannedFiles);
+  }
+
+  float elapsedTimeInSeconds = timeProbe.elapsed() / 1000.0;
+  qDebug() << QString("DICOM indexer has refreshed %1 [%2s]")
+    .arg(directoryName).arg(QString::number(elapsedTimeInSeconds,'f', 2));
+}
+
 //------------------------------------------------------------------------------
 void ctkDICOMIndexer::waitForImportFinished()
 {
@@ -331,6 +701,8 @@ void ctkDICOMIndexer::startIndexing(ctkDICOMDatabase& database)
   {
     // Indexing has just been started
     database.prepareInsert();
+    database.beginBatchInsert();
+    d->IndexingDatabase = &database;
   }
   d->StartedIndexing++;
 }
@@ -343,6 +715,11 @@ void ctkDICOMIndexer::endIndexing()
   if (d->StartedIndexing == 0)
   {
     // Indexing has just been completed
+    if (d->IndexingDatabase)
+    {
+      d->IndexingDatabase->endBatchInsert();
+      d->IndexingDatabase = 0;
+    }
     emit this->indexingComplete();
   }
   if (d->StartedIndexing < 0)
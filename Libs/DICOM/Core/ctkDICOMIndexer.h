@@ -37,10 +37,50 @@ class ctkDICOMIndexerPrivate;
 class CTK_DICOM_CORE_EXPORT ctkDICOMIndexer : public QObject
 {
   Q_OBJECT
+  Q_PROPERTY(int numberOfParsingThreads READ numberOfParsingThreads WRITE setNumberOfParsingThreads)
+  Q_PROPERTY(bool useDicomdirRecords READ useDicomdirRecords WRITE setUseDicomdirRecords)
+  Q_PROPERTY(bool completeDicomdirInstances READ completeDicomdirInstances WRITE setCompleteDicomdirInstances)
 public:
   explicit ctkDICOMIndexer(QObject *parent = 0);
   virtual ~ctkDICOMIndexer();
 
+  ///
+  /// \brief Number of worker threads that parse DICOM file headers
+  /// in addListOfFiles (and therefore in addDirectory and addDicomdir).
+  ///
+  /// Parsed datasets are inserted into the database by the calling thread,
+  /// which owns the database connection, while the workers already read the
+  /// next files. If set to 0 then files are read and inserted one by one
+  /// on the calling thread. Default is QThread::idealThreadCount().
+  ///
+  void setNumberOfParsingThreads(int numberOfThreads);
+  int numberOfParsingThreads() const;
+
+  ///
+  /// \brief Insert patients, studies, series, and instances from the
+  /// DICOMDIR records in addDicomdir, without opening the referenced files.
+  ///
+  /// The inserted records are committed (and indexingComplete() is emitted,
+  /// unless a batch started by startIndexing() is in progress) before any
+  /// file is read, so that large media can be browsed right away.
+  /// Not used if files are copied to the database folder. Enabled by default.
+  ///
+  void setUseDicomdirRecords(bool useRecords);
+  bool useDicomdirRecords() const;
+
+  ///
+  /// \brief Read the files of the instances that addDicomdir inserted from
+  /// DICOMDIR records, on the parsing threads, once the records are inserted.
+  ///
+  /// This completes the studies and series with attributes that are not in the
+  /// records, caches the tags to precache, and generates thumbnails.
+  /// If disabled, then the instances remain incomplete until their files are
+  /// indexed again, for example by addDirectory() or refreshDatabase().
+  /// Enabled by default.
+  ///
+  void setCompleteDicomdirInstances(bool complete);
+  bool completeDicomdirInstances() const;
+
   ///
   /// \brief Adds directory to database and optionally copies files to
   /// destinationDirectory.
@@ -88,6 +128,17 @@ public:
   Q_INVOKABLE void addFile(ctkDICOMDatabase& database, const QString filePath,
                     const QString& destinationDirectoryName = "");
 
+  ///
+  /// \brief Brings the database up-to-date with the content of a directory
+  /// that has been added before.
+  ///
+  /// The size and modification time of the files in the directory (and its
+  /// subdirectories) are compared to the file manifest of the database
+  /// (see ctkDICOMDatabase::fileManifest()). Only new and modified files are read,
+  /// and instances of modified and removed files are removed from the database
+  /// in one batch. Files that are not DICOM files are not read again until they
+  /// are modified.
+  ///
   Q_INVOKABLE void refreshDatabase(ctkDICOMDatabase& database, const QString& directoryName);
 
   ///
@@ -99,8 +150,10 @@ public:
   Q_INVOKABLE void waitForImportFinished();
 
   /// Call this before performing multiple add...() calls in one batch
-  /// to slightly increase indexing performance and to make only a single
+  /// to increase indexing performance and to make only a single
   /// indexingComplete() signal emitted for multiple add...() operations.
+  /// Inserts between startIndexing() and endIndexing() are grouped into
+  /// database transactions (see ctkDICOMDatabase::beginBatchInsert()).
   /// 
   /// If startIndexing() is called before a batch of insertions, then
   /// endIndexing() method must be called after the insertions are completed.
@@ -21,10 +21,77 @@
 #ifndef CTKDICOMINDEXERPRIVATE_H
 #define CTKDICOMINDEXERPRIVATE_H
 
+#include <QMutex>
 #include <QObject>
+#include <QPointer>
+#include <QQueue>
+#include <QRunnable>
+#include <QSharedPointer>
+#include <QWaitCondition>
 
+#include "ctkDICOMDatabase.h"
 #include "ctkDICOMIndexer.h"
 
+class DcmDirectoryRecord;
+
+//------------------------------------------------------------------------------
+/// Header of a single file, parsed by a worker thread and waiting
+/// to be inserted into the database.
+struct ctkDICOMIndexerParsedFile
+{
+  QString FilePath;
+  /// Null if the file could not be read as a DICOM file
+  QSharedPointer<ctkDICOMItem> Dataset;
+  /// Size and modification time of the file, read by the worker
+  ctkDICOMDatabase::FileManifestEntry FileManifestEntry;
+  /// Path of the file placed in the database folder by the worker, under a temporary name
+  QString TemporaryFilePath;
+};
+
+//------------------------------------------------------------------------------
+/// Hands parsed headers from the parsing workers over to the thread that
+/// owns the database connection. The indexer never submits more files than
+/// it is willing to keep in memory, therefore the queue itself is unbounded.
+class ctkDICOMIndexerParsedFileQueue
+{
+public:
+  ctkDICOMIndexerParsedFileQueue();
+
+  void push(const ctkDICOMIndexerParsedFile& parsedFile);
+  /// Blocks until at least one parsed file is available,
+  /// then returns all parsed files that are available.
+  QList<ctkDICOMIndexerParsedFile> popAll();
+  /// Returns all parsed files that are available, without waiting
+  QList<ctkDICOMIndexerParsedFile> takeAll();
+
+  /// Workers skip parsing of files that are still queued after cancel()
+  void cancel();
+  bool isCanceled() const;
+
+protected:
+  mutable QMutex Mutex;
+  QWaitCondition NotEmpty;
+  QQueue<ctkDICOMIndexerParsedFile> ParsedFiles;
+  bool Canceled;
+};
+
+//------------------------------------------------------------------------------
+/// Parse the header of a file and, if \a database is set, store the file
+/// in its database folder, so that only the insert is left to the thread
+/// that owns the database connection.
+class ctkDICOMIndexerParseTask : public QRunnable
+{
+public:
+  ctkDICOMIndexerParseTask(const QString& filePath, ctkDICOMIndexerParsedFileQueue* queue,
+                           ctkDICOMDatabase* database = 0);
+  virtual void run();
+
+protected:
+  QString FilePath;
+  ctkDICOMIndexerParsedFileQueue* Queue;
+  ctkDICOMDatabase* Database;
+};
+
 //------------------------------------------------------------------------------
 class ctkDICOMIndexerPrivate : public QObject
 {
@@ -39,6 +106,24 @@ public:
   ctkDICOMIndexerPrivate(ctkDICOMIndexer&);
   ~ctkDICOMIndexerPrivate();
 
+  /// Parse file headers on a pool of NumberOfParsingThreads workers
+  /// while inserting the parsed datasets on the calling thread.
+  /// If \a copyFileToDatabase is set then the workers also store the files
+  /// in the database folder.
+  /// \return Number of processed files
+  int addListOfFilesInParallel(ctkDICOMDatabase& database, const QStringList& listOfFiles,
+                               bool copyFileToDatabase);
+
+  /// Get the files referenced by the DICOMDIR file of \a directoryName.
+  /// If \a recordIndexingResults is set then a dataset is assembled for each
+  /// file from its DICOMDIR records, so that it can be inserted without reading the file.
+  /// \return false if records of the DICOMDIR file are invalid
+  bool readDicomdir(const QString& directoryName, QStringList& listOfInstances,
+                    QList<ctkDICOMDatabase::IndexingResult>* recordIndexingResults);
+  /// Merge the attributes of the patient, study, series, and instance level records
+  static QSharedPointer<ctkDICOMItem> datasetFromRecords(DcmDirectoryRecord* patientRecord,
+    DcmDirectoryRecord* studyRecord, DcmDirectoryRecord* seriesRecord, DcmDirectoryRecord* fileRecord);
+
 public:
   ctkDICOMAbstractThumbnailGenerator* thumbnailGenerator;
   bool                    Canceled;
@@ -51,6 +136,18 @@ public:
   // batch processing initialization and finalization
   // are performed exactly once.
   int                     StartedIndexing;
+
+  // Database that startIndexing was called with
+  QPointer<ctkDICOMDatabase> IndexingDatabase;
+
+  // Number of worker threads parsing file headers.
+  // If 0 then files are parsed on the calling thread.
+  int                     NumberOfParsingThreads;
+
+  // Insert instances from DICOMDIR records before reading the files
+  bool                    UseDicomdirRecords;
+  // Read the files of instances that have been inserted from DICOMDIR records
+  bool                    CompleteDicomdirInstances;
 };
 
 
@@ -129,42 +129,115 @@ void ctkDICOMItem::InitializeFromFile(const QString& filename,
   InitializeFromItem(dataset, true);
 }
 
+void ctkDICOMItem::InitializeFromFileUntilTag(const QString& filename, const DcmTagKey& stopParsingAtElement)
+{
+#if OFFIS_DCMTK_VERSION_NUMBER < 362
+  Q_UNUSED(stopParsingAtElement);
+  this->InitializeFromFile(filename);
+#else
+  DcmDataset *dataset;
+
+  DcmFileFormat fileformat;
+  OFCondition status = fileformat.loadFileUntilTag(filename.toLatin1().data(),
+    EXS_Unknown, EGL_noChange, DCM_MaxReadLength, ERM_autoDetect, stopParsingAtElement);
+  dataset = fileformat.getAndRemoveDataset();
+
+  if (!status.good())
+  {
+    qDebug() << "Could not load " << filename << "\nDCMTK says: " << status.text();
+    delete dataset;
+    return;
+  }
+
+  InitializeFromItem(dataset, true);
+#endif
+}
+
 void ctkDICOMItem::Serialize()
 {
-  Q_D(ctkDICOMItem);
-  EnsureDcmDataSetIsInitialized();
+  this->SetStoredBinarySerialization( this->SerializeToByteArray() );
+}
 
-  // store content of current DcmDataset (our parent) as QByteArray into m_ctkDICOMItem
-  Uint32 buffersize = 1024*1024; // reserve 1MB
-  char* writebuffer = new char[buffersize];
+bool ctkDICOMItem::SerializeToByteArray(QByteArray& buffer) const
+{
+  Q_D(const ctkDICOMItem);
+  EnsureDcmDataSetIsInitialized();
 
-  // write into buffer
-  DcmOutputBufferStream dcmbuffer(writebuffer, buffersize);
+  // write directly into the buffer, sized for the dataset (plus the item
+  // header and delimiter written for items that are not a dataset)
+  const E_TransferSyntax xfer = EXS_LittleEndianImplicit;
+  buffer.resize( static_cast<int>(d->m_DcmItem->getLength(xfer, EET_UndefinedLength)) + 16 );
+  DcmOutputBufferStream dcmbuffer(buffer.data(), buffer.size());
   d->m_DcmItem->transferInit();
-  OFCondition condition = d->m_DcmItem->write(dcmbuffer, EXS_LittleEndianImplicit, EET_UndefinedLength, NULL );
+  OFCondition condition = d->m_DcmItem->write(dcmbuffer, xfer, EET_UndefinedLength, NULL );
+  // the stream asks to be flushed if the buffer is too small after all
+  QByteArray overflow;
+  void* writtenbuffer = NULL;
+  offile_off_t writtensize = 0;
+  while ( condition == EC_StreamNotifyClient )
+  {
+    dcmbuffer.flushBuffer(writtenbuffer, writtensize);
+    overflow.append( static_cast<const char*>(writtenbuffer), writtensize );
+    condition = d->m_DcmItem->write(dcmbuffer, xfer, EET_UndefinedLength, NULL );
+  }
   d->m_DcmItem->transferEnd();
+
+  dcmbuffer.flushBuffer(writtenbuffer, writtensize);
+  if ( overflow.isEmpty() )
+  {
+    buffer.resize(writtensize);
+  }
+  else
+  {
+    overflow.append( static_cast<const char*>(writtenbuffer), writtensize );
+    buffer = overflow;
+  }
+
   if ( condition.bad() )
   {
     std::cerr << "Could not DcmDataset::write(..): " << condition.text() << std::endl;
+    return false;
   }
+  return true;
+}
 
-  // get written contents of buffer
-  offile_off_t datasetsize = 0;
-  void* readbuffer = NULL;
-  dcmbuffer.flushBuffer(readbuffer, datasetsize);
-
-  //std::cerr << "** " << (void*)this << " ctkDICOMItem: Serializing Dataset into " << datasetsize << " bytes" << std::endl;
+QByteArray ctkDICOMItem::SerializeToByteArray() const
+{
+  QByteArray buffer;
+  this->SerializeToByteArray(buffer);
+  return buffer;
+}
 
-  // construct Qt type from that contents
-  QByteArray qtArray = QByteArray::fromRawData( static_cast<const char*>(readbuffer), datasetsize );
-  //std::cerr << "** Buffer size: " << qtArray.size() << std::endl;
-  QString stringbuffer = QString::fromLatin1(qtArray.toBase64());
+bool ctkDICOMItem::InitializeFromByteArray(const QByteArray& serializedDataset)
+{
+  DcmInputBufferStream dcmbuffer;
+  dcmbuffer.setBuffer( serializedDataset.constData(), serializedDataset.size() );
+  dcmbuffer.setEos();
 
-  //std::cerr << "** String of size " << stringbuffer.size() << " looks like this:\n" << stringbuffer.toStdString() << std::endl << std::endl;
+  DcmDataset* dataset = new DcmDataset();
+  dataset->transferInit();
+  OFCondition condition = dataset->read( dcmbuffer, EXS_LittleEndianImplicit );
+  dataset->transferEnd();
 
-  this->SetStoredSerialization( stringbuffer );
+  // do this in all cases, even when reading reported an error
+  this->InitializeFromItem(dataset, true);
 
-  delete[] writebuffer;
+  if ( condition.bad() )
+  {
+    std::cerr << "** Condition code of Dataset::read() is "
+              << condition.code() << std::endl;
+    std::cerr << "** Buffer state: " << dcmbuffer.status().code()
+              << " " <<  dcmbuffer.good()
+              << " " << dcmbuffer.eos()
+              << " tell " << dcmbuffer.tell()
+              << " avail " << dcmbuffer.avail() << std::endl;
+    std::cerr << "** Dataset state: "
+              << static_cast<int>(dataset->transferState()) << std::endl;
+    std::cerr << "Could not DcmDataset::read(..): "
+              << condition.text() << std::endl;
+    return false;
+  }
+  return true;
 }
 
 void ctkDICOMItem::MarkForInitialization()
@@ -198,47 +271,14 @@ void ctkDICOMItem::Deserialize()
 
   if (d->m_DICOMDataSetInitialized) return; // only need to do this once
 
-  QString stringbuffer = this->GetStoredSerialization();
-  if ( stringbuffer.isEmpty() )
+  QByteArray serializedDataset = this->GetStoredBinarySerialization();
+  if ( serializedDataset.isEmpty() )
   {
     d->m_DICOMDataSetInitialized = true;
     return; // TODO nicer: hold three states: newly created / loaded but not initialized / restored from DB
   }
 
-
-  //std::cerr << "** " << (void*)this << " ctkDICOMItem: Deserialize Dataset from string of size " << stringbuffer.size() << "\n" << stringbuffer.toStdString() << std::endl;
-
-  QByteArray qtArray = QByteArray::fromBase64( stringbuffer.toLatin1() );
-  //std::cerr << "** " << (void*)this << " ctkDICOMItem: Deserialize Dataset from byte array of size " << qtArray.size() << std::endl;
-
-  DcmInputBufferStream dcmbuffer;
-  dcmbuffer.setBuffer( qtArray.data(), qtArray.size() );
-  //std::cerr << "** Buffer state: " << dcmbuffer.status().code() << " " <<  dcmbuffer.good() << " " << dcmbuffer.eos() << " tell " << dcmbuffer.tell() << " avail " << dcmbuffer.avail() << std::endl;
-
-  DcmDataset dataset;
-  dataset.transferInit();
-  //std::cerr << "** Dataset state: " << dataset.transferState() << std::endl << std::endl;
-  OFCondition condition = dataset.read( dcmbuffer, EXS_LittleEndianImplicit );
-  dataset.transferEnd();
-
-  // do this in all cases, even when reading reported an error
-  this->InitializeFromItem(&dataset);
-
-  if ( condition.bad() )
-  {
-    std::cerr << "** Condition code of Dataset::read() is "
-              << condition.code() << std::endl;
-    std::cerr << "** Buffer state: " << dcmbuffer.status().code()
-              << " " <<  dcmbuffer.good()
-              << " " << dcmbuffer.eos()
-              << " tell " << dcmbuffer.tell()
-              << " avail " << dcmbuffer.avail() << std::endl;
-    std::cerr << "** Dataset state: "
-              << static_cast<int>(dataset.transferState()) << std::endl;
-    std::cerr << "Could not DcmDataset::read(..): "
-              << condition.text() << std::endl;
-    //throw std::invalid_argument( std::string("Could not DcmDataset::read(..): ") + condition.text() );
-  }
+  this->InitializeFromByteArray( serializedDataset );
 }
 
 DcmItem& ctkDICOMItem::GetDcmItem() const
@@ -995,6 +1035,17 @@ void ctkDICOMItem::SetStoredSerialization(QString serializedDataset)
   throw std::runtime_error("No serialization implemented for this object!");
 }
 
+QByteArray ctkDICOMItem::GetStoredBinarySerialization()
+{
+  return QByteArray::fromBase64( this->GetStoredSerialization().toLatin1() );
+}
+
+void ctkDICOMItem::SetStoredBinarySerialization(const QByteArray& serializedDataset)
+{
+  // base64 prevents errors from encoding conversions made by QString or the database etc.
+  this->SetStoredSerialization( QString::fromLatin1(serializedDataset.toBase64()) );
+}
+
 bool ctkDICOMItem::SaveToFile(const QString& filePath) const
 {
   Q_D(const ctkDICOMItem);
@@ -59,6 +59,9 @@ class ctkDICOMItemPrivate;
 ///  A subclass could possibly want to store the internal DcmDataset.
 ///  For this purpose, the internal DcmDataset is serialized into a memory buffer using DcmDataset::write(..). This buffer
 ///  is stored in a base64 encoded string. For deserialization we decode the string and use DcmDataset::read(..).
+///  Subclasses able to store bytes can override the binary callbacks instead, which skips the base64 encoding.
+///  SerializeToByteArray() and InitializeFromByteArray() give direct access to the memory buffer, e.g. to
+///  pass datasets between threads.
 class ctkDICOMItem;
 
 typedef ctkDICOMItem ctkDICOMItem;
@@ -93,6 +96,15 @@ public:
                     const Uint32 maxReadLength = DCM_MaxReadLength,
                     const E_FileReadMode readMode = ERM_autoDetect);
 
+    ///
+    /// \brief Initialize from file, parsing only the elements of the main dataset
+    /// that precede \a stopParsingAtElement.
+    ///
+    /// Reading a few header tags this way is much faster than reading the whole
+    /// file, as the remaining elements (such as the pixel data) are not parsed.
+    /// Requires DCMTK 3.6.2 or later, with older versions the whole file is parsed.
+    void InitializeFromFileUntilTag(const QString& filename, const DcmTagKey& stopParsingAtElement);
+
 
 
     /// \brief Save dataset to file
@@ -114,6 +126,24 @@ public:
     /// the internal DcmDataset is created using DcmDataset::read(..).
     void Deserialize();
 
+    /// \brief Serialize the dataset into \a buffer, in implicit little endian.
+    ///
+    /// \a buffer is resized to the length of the dataset, its allocation is
+    /// reused when it is large enough.
+    /// \returns false if the dataset could not be written.
+    bool SerializeToByteArray(QByteArray& buffer) const;
+
+    /// \brief Return the dataset serialized in implicit little endian.
+    ///
+    /// The buffer is allocated once, to the length of the dataset.
+    QByteArray SerializeToByteArray() const;
+
+    /// \brief Initialize from a buffer written by SerializeToByteArray().
+    ///
+    /// The bytes are parsed in place, \a serializedDataset is not copied.
+    /// \returns false if the dataset could not be read completely.
+    bool InitializeFromByteArray(const QByteArray& serializedDataset);
+
 
     /// \brief To be called from InitializeData, flags status as dirty.
     ///
@@ -255,6 +285,22 @@ protected:
     ///
     virtual void SetStoredSerialization(QString serializedDataset);
 
+    ///
+    /// \brief Callback for retrieving a binary serialized version of this class
+    ///
+    /// Called by Deserialize(). The default implementation decodes the base64
+    /// string returned by GetStoredSerialization().
+    ///
+    virtual QByteArray GetStoredBinarySerialization();
+
+    ///
+    /// \brief Callback for storing a binary serialized version of this class
+    ///
+    /// Called by Serialize(). The default implementation passes a base64
+    /// encoded string to SetStoredSerialization().
+    ///
+    virtual void SetStoredBinarySerialization(const QByteArray& serializedDataset);
+
   QScopedPointer<ctkDICOMItemPrivate> d_ptr;
 
   DcmItem& GetDcmItem() const;
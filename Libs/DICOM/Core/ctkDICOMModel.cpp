@@ -19,12 +19,18 @@
 =========================================================================*/
 
 // Qt includes
+#include <QDate>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QRunnable>
 #include <QStringList>
 #include <QSqlDriver>
 #include <QSqlError>
 #include <QSqlQuery>
 #include <QSqlRecord>
 #include <QSqlResult>
+#include <QThreadPool>
+#include <QTimer>
 
 #include <QTime>
 #include <QDebug>
@@ -38,14 +44,30 @@
 
 static ctkLogger logger ( "org.commontk.dicom.DICOMModel" );
 struct Node;
+class ctkDICOMModelSearchTask;
 
 Q_DECLARE_METATYPE(Qt::CheckState);
 Q_DECLARE_METATYPE(QStringList);
 
+typedef QVector<QVector<QVariant> > ctkDICOMModelRows;
+
+//------------------------------------------------------------------------------
+// Describes the children of a node of a given type: the table they come from,
+// the column referencing the parent UID and the selected columns. The first
+// column is always the UID of the child.
+struct ctkDICOMModelLevel
+{
+  QString     Table;
+  QString     ParentColumn;
+  QStringList Columns;
+  QStringList Aliases;
+};
+
 //------------------------------------------------------------------------------
 class ctkDICOMModelPrivate
 {
   Q_DECLARE_PUBLIC(ctkDICOMModel);
+  friend class ctkDICOMModelSearchTask;
 protected:
   ctkDICOMModel* const q_ptr;
 
@@ -63,14 +85,46 @@ public:
   // move it in the Node struct
   QVariant value(Node* parentValue, int row, int field)const;
   QVariant value(const QModelIndex& indexValue, int row, int field)const;
-  QString  generateQuery(const QString& fields, const QString& table, const QString& conditions = QString())const;
-  void updateQueries(Node* node)const;
+
+  /// Build the statement selecting the next \a limit children of \a node.
+  /// Search parameters and keyset values are returned in \a bindings, in the
+  /// order of the placeholders.
+  QString pageQuery(const Node* node, const QMap<QString, QVariant>& parameters,
+                    int limit, QVariantList& bindings)const;
+  /// Return the prepared query for \a statement, preparing it on first use.
+  QSqlQuery& preparedQuery(const QString& statement)const;
+  /// Run the page query of \a node on the model database.
+  bool fetchRows(const Node* node, int limit, ctkDICOMModelRows& rows)const;
+  static bool execPageQuery(QSqlQuery& query, const QVariantList& bindings,
+                            ctkDICOMModelRows& rows);
+
+  void resetRootNode();
+  bool canSearchInBackground()const;
+  bool isCurrentSearch(int generation)const;
+  int cancelSearch();
 
   Node*        RootNode;
   QSqlDatabase DataBase;
   QList<QMap<int, QVariant> > Headers;
-  QString      Sort;
+  QString      SortColumn;
+  Qt::SortOrder SortOrder;
   QMap<QString, QVariant> SearchParameters;
+  QVector<ctkDICOMModelLevel> Levels;
+  int          PageSize;
+
+  mutable QHash<QString, QSqlQuery> PreparedQueries;
+
+  QTimer       SearchTimer;
+  QMap<QString, QVariant> PendingSearchParameters;
+  QThreadPool  SearchPool;
+  mutable QMutex SearchMutex;
+  int          SearchGeneration;
+  int          SearchResultGeneration;
+  /// Generation of the search running in the background until its results are applied
+  int          RunningSearchGeneration;
+  ctkDICOMModelRows SearchResult;
+  /// Error of the search whose results are ready, empty if it succeeded
+  QString      SearchError;
 
   ctkDICOMModel::IndexType StartLevel;
   ctkDICOMModel::IndexType EndLevel;
@@ -92,19 +146,48 @@ struct Node
   ctkDICOMModel::IndexType Type;
   Node*                           Parent;
   QVector<Node*>                  Children;
+  QHash<QString, Node*>           ChildrenByUID;
   int                             Row;
-  QSqlQuery                       Query;
+  // Rows of the children fetched so far, in the order of the page query
+  ctkDICOMModelRows               Rows;
   QString                         UID;
   int                             RowCount;
   bool                            AtEnd;
   bool                            Fetching;
+  // Set once hasChildren() found a child that is not fetched yet
+  bool                            HasUnfetchedChildren;
   QMap<int, QVariant>             Data;
 };
 
+//------------------------------------------------------------------------------
+// Run the first page of the patient query on a dedicated connection so that
+// typing in the search fields doesn't block the GUI thread.
+class ctkDICOMModelSearchTask : public QRunnable
+{
+public:
+  ctkDICOMModelSearchTask(ctkDICOMModelPrivate* d, int generation,
+                          const QString& statement, const QVariantList& bindings);
+  virtual void run();
+
+protected:
+  ctkDICOMModelPrivate* d;
+  int Generation;
+  QString DriverName;
+  QString DatabaseName;
+  QString ConnectOptions;
+  QString Statement;
+  QVariantList Bindings;
+};
+
 //------------------------------------------------------------------------------
 ctkDICOMModelPrivate::ctkDICOMModelPrivate(ctkDICOMModel& o):q_ptr(&o)
 {
   this->RootNode     = 0;
+  this->SortOrder = Qt::AscendingOrder;
+  this->PageSize = 256;
+  this->SearchGeneration = 0;
+  this->SearchResultGeneration = -1;
+  this->RunningSearchGeneration = -1;
   this->StartLevel = ctkDICOMModel::RootType;
   this->EndLevel = ctkDICOMModel::ImageType;
 }
@@ -119,6 +202,7 @@ ctkDICOMModelPrivate::~ctkDICOMModelPrivate()
 //------------------------------------------------------------------------------
 void ctkDICOMModelPrivate::init()
 {
+  Q_Q(ctkDICOMModel);
   QMap<int, QVariant> data;
   data[Qt::DisplayRole] = QString("Name");
   this->Headers << data;
@@ -138,6 +222,43 @@ void ctkDICOMModelPrivate::init()
   this->Headers << data;
   data[Qt::DisplayRole] = QString("Performer");
   this->Headers << data;
+
+  this->Levels.resize(ctkDICOMModel::ImageType);
+  ctkDICOMModelLevel& patients = this->Levels[ctkDICOMModel::RootType];
+  patients.Table = "Patients";
+  patients.Columns << "UID" << "PatientsName" << "PatientsAge"
+                   << "PatientsBirthDate" << "PatientID";
+  patients.Aliases << "UID" << "Name" << "Age" << "Date" << "Subject ID";
+
+  ctkDICOMModelLevel& studies = this->Levels[ctkDICOMModel::PatientType];
+  studies.Table = "Studies";
+  studies.ParentColumn = "PatientsUID";
+  studies.Columns << "StudyInstanceUID" << "StudyDescription" << "ModalitiesInStudy"
+                  << "StudyDate" << "AccessionNumber" << "InstitutionName"
+                  << "ReferringPhysician" << "PerformingPhysiciansName";
+  studies.Aliases << "UID" << "Name" << "Scan" << "Date" << "Number"
+                  << "Institution" << "Referrer" << "Performer";
+
+  ctkDICOMModelLevel& series = this->Levels[ctkDICOMModel::StudyType];
+  series.Table = "Series";
+  series.ParentColumn = "StudyInstanceUID";
+  series.Columns << "SeriesInstanceUID" << "SeriesDescription" << "Modality"
+                 << "SeriesNumber" << "BodyPartExamined" << "SeriesDate"
+                 << "AcquisitionNumber";
+  series.Aliases << "UID" << "Name" << "Age" << "Scan" << "Subject ID"
+                 << "Date" << "Number";
+
+  ctkDICOMModelLevel& images = this->Levels[ctkDICOMModel::SeriesType];
+  images.Table = "Images";
+  images.ParentColumn = "SeriesInstanceUID";
+  images.Columns << "SOPInstanceUID" << "Filename" << "SeriesInstanceUID";
+  images.Aliases << "UID" << "Name" << "Date";
+
+  this->SearchPool.setMaxThreadCount(1);
+  this->SearchTimer.setSingleShot(true);
+  this->SearchTimer.setInterval(300);
+  QObject::connect(&this->SearchTimer, SIGNAL(timeout()),
+                   q, SLOT(startSearch()));
 }
 
 //------------------------------------------------------------------------------
@@ -241,19 +362,21 @@ Node* ctkDICOMModelPrivate::createNode(int row, const QModelIndex& parentValue)c
   node->Row = row;
   if (node->Type != ctkDICOMModel::RootType)
     {
-    int field = 0;//nodeParent->Query.record().indexOf("UID");
+    int field = 0; // UID is always the first column
     node->UID = this->value(parentValue, row, field).toString();
+    nodeParent->ChildrenByUID.insert(node->UID, node);
 #if CHECKABLE_COLUMNS
     node->Data[Qt::CheckStateRole] = node->Parent->Data[Qt::CheckStateRole];
 #endif
     }
 
   node->RowCount = 0;
-  node->AtEnd = false;
+  node->AtEnd = node->Type >= ctkDICOMModel::ImageType;
   node->Fetching = false;
+  node->HasUnfetchedChildren = false;
 
-  this->updateQueries(node);
-
+  // No query is run here: the children are only queried when the node is
+  // expanded (see fetch() and hasChildren()).
   return node;
 }
 
@@ -263,7 +386,7 @@ QVariant ctkDICOMModelPrivate::value(const QModelIndex& parentValue, int row, in
   Node* node = this->nodeFromIndex(parentValue);
   if (row >= node->RowCount)
     {
-    const_cast<ctkDICOMModelPrivate *>(this)->fetch(parentValue, row + 256);
+    const_cast<ctkDICOMModelPrivate *>(this)->fetch(parentValue, row + this->PageSize);
     }
   return this->value(node, row, column);
 }
@@ -275,98 +398,189 @@ QVariant ctkDICOMModelPrivate::value(Node* parentNode, int row, int column) cons
     {
     return QVariant();
     }
-
-  if (!parentNode->Query.seek(row))
-    {
-    qDebug() << parentNode->Query.lastError();
-    Q_ASSERT(parentNode->Query.seek(row));
-    return QVariant();
-    }
-  QVariant res = parentNode->Query.value(column);
-  Q_ASSERT(res.isValid());
-  return res;
+  const QVector<QVariant>& rowValues = parentNode->Rows[row];
+  return column < rowValues.size() ? rowValues[column] : QVariant();
 }
 
 //------------------------------------------------------------------------------
-QString ctkDICOMModelPrivate::generateQuery(const QString& fields, const QString& table, const QString& conditions)const
+QString ctkDICOMModelPrivate::pageQuery(const Node* node,
+                                        const QMap<QString, QVariant>& parameters,
+                                        int limit, QVariantList& bindings)const
 {
-  QString res = QString("SELECT ") + fields + QString(" FROM ") + table;
-  if (!conditions.isEmpty())
-    {
-    res += QString(" WHERE ") + conditions;
-    }
-  if (!this->Sort.isEmpty())
-    {
-    res += QString(" ORDER BY ") + this->Sort;
-    }
-  logger.debug ( "ctkDICOMModelPrivate::generateQuery: query is: " + res );
-  return res;
-}
+  Q_ASSERT(node->Type < this->Levels.size());
+  const ctkDICOMModelLevel& level = this->Levels[node->Type];
 
-//------------------------------------------------------------------------------
-void ctkDICOMModelPrivate::updateQueries(Node* node)const
-{
-  // are you kidding me, it should be virtualized here :-)
-  QString query;
-  QString condition;
+  // Search parameters are always bound, never concatenated into the statement.
+  QStringList conditions;
   switch(node->Type)
     {
-    default:
-      Q_ASSERT(node->Type == ctkDICOMModel::RootType);
-      break;
     case ctkDICOMModel::RootType:
-      //query = QString("SELECT  FROM ");
-      if(this->SearchParameters["Name"].toString() != ""){
-        condition.append("PatientsName LIKE \"%" + this->SearchParameters["Name"].toString() + "%\"");
-      }
-      query = this->generateQuery("UID as UID, PatientsName as Name, PatientsAge as Age, PatientsBirthDate as Date, PatientID as \"Subject ID\"","Patients", condition);
-      logger.debug ( "ctkDICOMModelPrivate::updateQueries for Root: query is: " + query );
+      if (!parameters["Name"].toString().isEmpty())
+        {
+        conditions << "PatientsName LIKE ?";
+        bindings << QString("%" + parameters["Name"].toString() + "%");
+        }
       break;
     case ctkDICOMModel::PatientType:
-      //query = QString("SELECT  FROM Studies WHERE PatientsUID='%1'").arg(node->UID);
-      if(this->SearchParameters["Study"].toString() != "")
+      {
+      if (!parameters["Study"].toString().isEmpty())
         {
-        condition.append("StudyDescription LIKE \"%" + this->SearchParameters["Study"].toString() + "%\"" + " AND ");
+        conditions << "StudyDescription LIKE ?";
+        bindings << QString("%" + parameters["Study"].toString() + "%");
         }
-      if(this->SearchParameters["Modalities"].value<QStringList>().count() > 0)
+      QStringList modalities = parameters["Modalities"].value<QStringList>();
+      if (modalities.count() > 0)
         {
-        condition.append("ModalitiesInStudy IN (\"" + this->SearchParameters["Modalities"].value<QStringList>().join("\",\"") + "\") AND ");
+        QStringList placeholders;
+        foreach(const QString& modality, modalities)
+          {
+          placeholders << "?";
+          bindings << modality;
+          }
+        conditions << QString("ModalitiesInStudy IN (%1)").arg(placeholders.join(","));
         }
-      if(this->SearchParameters["StartDate"].toString() != "" &&
-         this->SearchParameters["EndDate"].toString() != "")
+      if (!parameters["StartDate"].toString().isEmpty() &&
+          !parameters["EndDate"].toString().isEmpty())
         {
-          condition.append(" ( StudyDate BETWEEN \'" + QDate::fromString(this->SearchParameters["StartDate"].toString(), "yyyyMMdd").toString("yyyy-MM-dd")
-                           + "\' AND \'" + QDate::fromString(this->SearchParameters["EndDate"].toString(), "yyyyMMdd").toString("yyyy-MM-dd") + "\' ) AND ");
+        conditions << "StudyDate BETWEEN ? AND ?";
+        bindings << QDate::fromString(parameters["StartDate"].toString(), "yyyyMMdd").toString("yyyy-MM-dd")
+                 << QDate::fromString(parameters["EndDate"].toString(), "yyyyMMdd").toString("yyyy-MM-dd");
         }
-      query = this->generateQuery("StudyInstanceUID as UID, StudyDescription as Name, ModalitiesInStudy as Scan, StudyDate as Date, AccessionNumber as Number, InstitutionName as Institution, ReferringPhysician as Referrer, PerformingPhysiciansName as Performer", "Studies", condition + QString("PatientsUID='%1'").arg(node->UID));
-      logger.debug ( "ctkDICOMModelPrivate::updateQueries for Patient: query is: " + query );
       break;
+      }
     case ctkDICOMModel::StudyType:
-      //query = QString("SELECT SeriesInstanceUID as UID, SeriesDescription as Name, BodyPartExamined as Scan, SeriesDate as Date, AcquisitionNumber as Number FROM Series WHERE StudyInstanceUID='%1'").arg(node->UID);
-      if(this->SearchParameters["Series"].toString() != "")
+      if (!parameters["Series"].toString().isEmpty())
         {
-        condition.append("SeriesDescription LIKE \"%" + this->SearchParameters["Series"].toString() + "%\"" + " AND ");
+        conditions << "SeriesDescription LIKE ?";
+        bindings << QString("%" + parameters["Series"].toString() + "%");
         }
-      query = this->generateQuery("SeriesInstanceUID as UID, SeriesDescription as Name, Modality as Age, SeriesNumber as Scan, BodyPartExamined as \"Subject ID\", SeriesDate as Date, AcquisitionNumber as Number","Series",condition + QString("StudyInstanceUID='%1'").arg(node->UID));
-      logger.debug ( "ctkDICOMModelPrivate::updateQueries for Study: query is: " + query );
       break;
     case ctkDICOMModel::SeriesType:
-      if(this->SearchParameters["ID"].toString() != "")
+      if (!parameters["ID"].toString().isEmpty())
         {
-        condition.append("SOPInstanceUID LIKE \"%" + this->SearchParameters["ID"].toString() + "%\"" + " AND ");
+        conditions << "SOPInstanceUID LIKE ?";
+        bindings << QString("%" + parameters["ID"].toString() + "%");
         }
-      //query = QString("SELECT Filename as UID, Filename as Name, SeriesInstanceUID as Date FROM Images WHERE SeriesInstanceUID='%1'").arg(node->UID);
-      query = this->generateQuery("SOPInstanceUID as UID, Filename as Name, SeriesInstanceUID as Date", "Images", condition + QString("SeriesInstanceUID='%1'").arg(node->UID));
-      logger.debug ( "ctkDICOMModelPrivate::updateQueries for Series: query is: " + query );
       break;
-    case ctkDICOMModel::ImageType:
+    default:
       break;
     }
-  node->Query = QSqlQuery(query, this->DataBase);
-  foreach(Node* child, node->Children)
+  if (!level.ParentColumn.isEmpty())
+    {
+    conditions << level.ParentColumn + " = ?";
+    bindings << node->UID;
+    }
+
+  // Keyset pagination: rows are ordered by (sort key, UID) and the next page
+  // starts right after the last fetched row instead of using an offset.
+  const QString uidColumn = level.Columns[0];
+  const int sortField = level.Aliases.indexOf(this->SortColumn);
+  const QString sortKey = sortField > 0 ?
+    QString("IFNULL(%1, '')").arg(level.Columns[sortField]) : QString();
+  const bool ascending = this->SortOrder == Qt::AscendingOrder;
+  const QString op = ascending ? ">" : "<";
+  const QString direction = ascending ? "ASC" : "DESC";
+  if (!node->Rows.isEmpty())
+    {
+    const QVector<QVariant>& lastRow = node->Rows.last();
+    if (sortKey.isEmpty())
+      {
+      conditions << QString("%1 %2 ?").arg(uidColumn).arg(op);
+      bindings << lastRow[0];
+      }
+    else
+      {
+      QVariant lastKey = lastRow[sortField].isNull() ?
+        QVariant(QString("")) : lastRow[sortField];
+      conditions << QString("(%1 %2 ? OR (%1 = ? AND %3 %2 ?))")
+        .arg(sortKey).arg(op).arg(uidColumn);
+      bindings << lastKey << lastKey << lastRow[0];
+      }
+    }
+
+  QStringList fields;
+  for (int i = 0; i < level.Columns.size(); ++i)
+    {
+    fields << QString("%1 as \"%2\"").arg(level.Columns[i]).arg(level.Aliases[i]);
+    }
+  QString res = QString("SELECT ") + fields.join(", ") + QString(" FROM ") + level.Table;
+  if (!conditions.isEmpty())
+    {
+    res += QString(" WHERE ") + conditions.join(" AND ");
+    }
+  res += QString(" ORDER BY ");
+  if (!sortKey.isEmpty())
     {
-    this->updateQueries(child);
+    res += sortKey + " " + direction + ", ";
     }
+  res += uidColumn + " " + direction + " LIMIT ?";
+  bindings << limit;
+  return res;
+}
+
+//------------------------------------------------------------------------------
+QSqlQuery& ctkDICOMModelPrivate::preparedQuery(const QString& statement)const
+{
+  QHash<QString, QSqlQuery>::iterator it = this->PreparedQueries.find(statement);
+  if (it == this->PreparedQueries.end())
+    {
+    // A handful of statements per level (with/without keyset, number of
+    // modalities...), don't let the cache grow with unusual searches.
+    if (this->PreparedQueries.size() > 64)
+      {
+      this->PreparedQueries.clear();
+      }
+    QSqlQuery query(this->DataBase);
+    query.setForwardOnly(true);
+    if (!query.prepare(statement))
+      {
+      logger.error("ctkDICOMModelPrivate::preparedQuery: " + query.lastError().text()
+                   + " in: " + statement);
+      }
+    logger.debug("ctkDICOMModelPrivate::preparedQuery: prepared " + statement);
+    it = this->PreparedQueries.insert(statement, query);
+    }
+  return it.value();
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMModelPrivate::execPageQuery(QSqlQuery& query, const QVariantList& bindings,
+                                         ctkDICOMModelRows& rows)
+{
+  for (int i = 0; i < bindings.size(); ++i)
+    {
+    query.bindValue(i, bindings[i]);
+    }
+  if (!query.exec())
+    {
+    logger.error("ctkDICOMModelPrivate::execPageQuery: " + query.lastError().text());
+    return false;
+    }
+  const int columnCount = query.record().count();
+  while (query.next())
+    {
+    QVector<QVariant> row(columnCount);
+    for (int column = 0; column < columnCount; ++column)
+      {
+      row[column] = query.value(column);
+      }
+    rows.append(row);
+    }
+  // Release the statement so it doesn't hold a read lock on the database
+  query.finish();
+  return true;
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMModelPrivate::fetchRows(const Node* node, int limit, ctkDICOMModelRows& rows)const
+{
+  if (!this->DataBase.isOpen() || node->Type >= this->Levels.size())
+    {
+    return false;
+    }
+  QVariantList bindings;
+  QString statement = this->pageQuery(node, this->SearchParameters, limit, bindings);
+  return ctkDICOMModelPrivate::execPageQuery(this->preparedQuery(statement), bindings, rows);
 }
 
 //------------------------------------------------------------------------------
@@ -374,52 +588,148 @@ void ctkDICOMModelPrivate::fetch(const QModelIndex& indexValue, int limit)
 {
   Q_Q(ctkDICOMModel);
   Node* node = this->nodeFromIndex(indexValue);
-  if (node->AtEnd || limit <= node->RowCount || node->Fetching/*|| bottom.column() == -1*/)
+  if (!node || node->AtEnd || limit <= node->RowCount || node->Fetching/*|| bottom.column() == -1*/)
     {
     return;
     }
   node->Fetching = true;
 
-  int newRowCount;
-  const int oldRowCount = node->RowCount;
-
-  // try to seek directly
-  if (node->Query.seek(limit - 1))
-    {
-    newRowCount = limit;
-    }
-  else
+  const int requested = limit - node->RowCount;
+  ctkDICOMModelRows rows;
+  if (!this->fetchRows(node, requested, rows) || rows.size() < requested)
     {
-    newRowCount = qMax(oldRowCount, 1);
-    if (node->Query.seek(newRowCount - 1))
-      {
-      while (node->Query.next())
-        {
-        ++newRowCount;
-        }
-      }
-    else
-      {
-      // empty or invalid query
-      newRowCount = 0;
-      }
     node->AtEnd = true; // this is the end.
     }
-  if (newRowCount > 0 && newRowCount > node->RowCount)
+  if (!rows.isEmpty())
     {
-    q->beginInsertRows(indexValue, node->RowCount, newRowCount - 1);
-    node->RowCount = newRowCount;
+    q->beginInsertRows(indexValue, node->RowCount, node->RowCount + rows.size() - 1);
+    node->Rows += rows;
+    node->RowCount = node->Rows.size();
     node->Fetching = false;
     q->endInsertRows();
     }
   else
     {
-    node->RowCount = newRowCount;
     node->Fetching = false;
     }
 }
 
+//------------------------------------------------------------------------------
+void ctkDICOMModelPrivate::resetRootNode()
+{
+  delete this->RootNode;
+  this->RootNode = 0;
+  this->PreparedQueries.clear();
+  if (this->DataBase.tables().empty())
+    {
+    //Q_ASSERT(d->DataBase.isOpen());
+    return;
+    }
+  this->RootNode = this->createNode(-1, QModelIndex());
+}
 
+//------------------------------------------------------------------------------
+bool ctkDICOMModelPrivate::canSearchInBackground()const
+{
+  // SQLite connections can't be shared between threads: the background search
+  // opens its own connection, which only sees the same data for file databases.
+  QString databaseName = this->DataBase.databaseName();
+  return this->DataBase.isOpen() &&
+         this->DataBase.driverName() == "QSQLITE" &&
+         !databaseName.isEmpty() &&
+         databaseName != ":memory:" &&
+         !databaseName.startsWith("file::memory:");
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMModelPrivate::isCurrentSearch(int generation)const
+{
+  QMutexLocker locker(&this->SearchMutex);
+  return generation == this->SearchGeneration;
+}
+
+//------------------------------------------------------------------------------
+int ctkDICOMModelPrivate::cancelSearch()
+{
+  QMutexLocker locker(&this->SearchMutex);
+  this->SearchResult.clear();
+  this->SearchError.clear();
+  this->SearchResultGeneration = -1;
+  return ++this->SearchGeneration;
+}
+
+//------------------------------------------------------------------------------
+ctkDICOMModelSearchTask::ctkDICOMModelSearchTask(ctkDICOMModelPrivate* dPtr, int generation,
+                                                 const QString& statement,
+                                                 const QVariantList& bindings)
+  : d(dPtr)
+  , Generation(generation)
+  , Statement(statement)
+  , Bindings(bindings)
+{
+  this->DriverName = d->DataBase.driverName();
+  this->DatabaseName = d->DataBase.databaseName();
+  this->ConnectOptions = d->DataBase.connectOptions();
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMModelSearchTask::run()
+{
+  if (!d->isCurrentSearch(this->Generation))
+    {
+    return;
+    }
+  ctkDICOMModelRows rows;
+  bool success = false;
+  QString error;
+  // Generations start at 0 in every model: other models may search at the same time
+  QString connectionName = QString("ctkDICOMModel_search_%1_%2_%3")
+    .arg(quintptr(d)).arg(quintptr(this)).arg(this->Generation);
+  {
+    QSqlDatabase database = QSqlDatabase::addDatabase(this->DriverName, connectionName);
+    database.setDatabaseName(this->DatabaseName);
+    database.setConnectOptions(this->ConnectOptions);
+    if (database.open())
+      {
+      QSqlQuery query(database);
+      query.setForwardOnly(true);
+      success = query.prepare(this->Statement) &&
+        ctkDICOMModelPrivate::execPageQuery(query, this->Bindings, rows);
+      if (!success)
+        {
+        error = query.lastError().text();
+        }
+      }
+    else
+      {
+      error = database.lastError().text();
+      logger.error("ctkDICOMModelSearchTask: " + error);
+      }
+    database.close();
+  }
+  QSqlDatabase::removeDatabase(connectionName);
+
+  {
+    QMutexLocker locker(&d->SearchMutex);
+    if (this->Generation != d->SearchGeneration)
+      {
+      // A newer search (or a reset) superseded this one
+      return;
+      }
+    if (!success)
+      {
+      rows.clear();
+      if (error.isEmpty())
+        {
+        error = QString("Search failed");
+        }
+      }
+    d->SearchResult = rows;
+    d->SearchError = error;
+    d->SearchResultGeneration = this->Generation;
+  }
+  QMetaObject::invokeMethod(d->q_func(), "applySearchResults", Qt::QueuedConnection);
+}
 
 //------------------------------------------------------------------------------
 ctkDICOMModel::ctkDICOMModel(QObject* parentObject)
@@ -433,6 +743,10 @@ ctkDICOMModel::ctkDICOMModel(QObject* parentObject)
 //------------------------------------------------------------------------------
 ctkDICOMModel::~ctkDICOMModel()
 {
+  Q_D(ctkDICOMModel);
+  d->SearchTimer.stop();
+  d->cancelSearch();
+  d->SearchPool.waitForDone();
 }
 
 //------------------------------------------------------------------------------
@@ -487,12 +801,12 @@ QVariant ctkDICOMModel::data ( const QModelIndex & dataIndex, int role ) const
     }
   QModelIndex parentIndex = this->parent(dataIndex);
   Node* parentNode = d->nodeFromIndex(parentIndex);
-  if (dataIndex.row() >= parentNode->RowCount)
+  if (!parentNode || parentNode->Type >= d->Levels.size())
     {
-    const_cast<ctkDICOMModelPrivate *>(d)->fetch(dataIndex, dataIndex.row());
+    return QVariant();
     }
   QString columnName = d->Headers[dataIndex.column()][Qt::DisplayRole].toString();
-  int field = parentNode->Query.record().indexOf(columnName);
+  int field = d->Levels[parentNode->Type].Aliases.indexOf(columnName);
   if (field < 0)
     {
     // Not all the columns are in the record, it's ok to have no field here.
@@ -564,7 +878,7 @@ void ctkDICOMModel::fetchMore ( const QModelIndex & parentValue )
 {
   Q_D(ctkDICOMModel);
   Node* node = d->nodeFromIndex(parentValue);
-  d->fetch(parentValue, qMax(node->RowCount, 0) + 256);
+  d->fetch(parentValue, qMax(node->RowCount, 0) + d->PageSize);
 }
 
 //------------------------------------------------------------------------------
@@ -610,15 +924,22 @@ bool ctkDICOMModel::hasChildren ( const QModelIndex & parentIndex ) const
   // just means that the children haven't been fetched yet
   if (node->RowCount == 0 && !node->AtEnd)
     {
+    // Views call hasChildren() on every paint: the node is probed only once.
+    if (node->HasUnfetchedChildren)
+      {
+      return true;
+      }
     // We don't want to fetch the data because we don't want to add children
     // to the index yet (it would be a mess to add rows inside a hasChildren)
     //const_cast<qCTKDCMTKModelPrivate*>(d)->fetch(parentIndex, 1);
-    bool res = node->Query.seek(0);
+    ctkDICOMModelRows firstRow;
+    bool res = d->fetchRows(node, 1, firstRow) && !firstRow.isEmpty();
     if (!res)
       {
       // now we know there is no children to the node, don't try next time.
       node->AtEnd = true;
       }
+    node->HasUnfetchedChildren = res;
     return res;
     }
   return node->RowCount > 0;
@@ -653,17 +974,9 @@ QModelIndex ctkDICOMModel::index ( int row, int column, const QModelIndex & pare
     return QModelIndex();
     }
   Node* parentNode = d->nodeFromIndex(parentIndex);
-  int field = 0;// always 0//parentNode->Query.record().indexOf("UID");
+  int field = 0;// always 0, the UID
   QString uid = d->value(parentIndex, row, field).toString();
-  Node* node = 0;
-  foreach(Node* tmpNode, parentNode->Children)
-    {
-    if (tmpNode->UID == uid)
-      {
-      node = tmpNode;
-      break;
-      }
-    }
+  Node* node = parentNode->ChildrenByUID.value(uid, 0);
   // TODO: Here it is assumed that ctkDICOMModel::index is called with valid
   // arguments, we should probably be a bit more careful.
   if (node == 0)
@@ -846,70 +1159,146 @@ void ctkDICOMModel::setDatabase(const QSqlDatabase &db)
 {
   Q_D(ctkDICOMModel);
 
+  d->SearchTimer.stop();
+  d->cancelSearch();
+
   this->beginResetModel();
   d->DataBase = db;
+  d->resetRootNode();
+  this->endResetModel();
 
-  delete d->RootNode;
-  d->RootNode = 0;
+  d->fetch(QModelIndex(), d->PageSize);
+}
 
-  if (d->DataBase.tables().empty())
-    {
-    //Q_ASSERT(d->DataBase.isOpen());
-    this->endResetModel();
-    return;
-    }
+//------------------------------------------------------------------------------
+void ctkDICOMModel::setDatabase(const QSqlDatabase &db,const QMap<QString, QVariant>& parameters)
+{
+  Q_D(ctkDICOMModel);
+  d->SearchParameters = parameters;
+  this->setDatabase(db);
+}
 
-  d->RootNode = d->createNode(-1, QModelIndex());
+//------------------------------------------------------------------------------
+QMap<QString, QVariant> ctkDICOMModel::searchParameters()const
+{
+  Q_D(const ctkDICOMModel);
+  return d->SearchTimer.isActive() ? d->PendingSearchParameters : d->SearchParameters;
+}
 
-  this->endResetModel();
+//------------------------------------------------------------------------------
+void ctkDICOMModel::setSearchParameters(const QMap<QString, QVariant>& parameters)
+{
+  Q_D(ctkDICOMModel);
+  // Invalidate any search in flight and restart the delay: only the last
+  // parameters typed are searched for.
+  d->cancelSearch();
+  d->PendingSearchParameters = parameters;
+  d->SearchTimer.start();
+}
 
-  // TODO, use hasQuerySize everywhere, not only in setDataBase()
-  bool hasQuerySize = d->RootNode->Query.driver()->hasFeature(QSqlDriver::QuerySize);
-  if (hasQuerySize && d->RootNode->Query.size() > 0)
-    {
-    int newRowCount= d->RootNode->Query.size();
-    beginInsertRows(QModelIndex(), 0, qMax(0, newRowCount - 1));
-    d->RootNode->RowCount = newRowCount;
-    d->RootNode->AtEnd = true;
-    endInsertRows();
-    }
-  d->fetch(QModelIndex(), 256);
+//------------------------------------------------------------------------------
+int ctkDICOMModel::searchDelay()const
+{
+  Q_D(const ctkDICOMModel);
+  return d->SearchTimer.interval();
 }
 
 //------------------------------------------------------------------------------
-void ctkDICOMModel::setDatabase(const QSqlDatabase &db,const QMap<QString, QVariant>& parameters)
+void ctkDICOMModel::setSearchDelay(int msecs)
 {
   Q_D(ctkDICOMModel);
+  d->SearchTimer.setInterval(qMax(0, msecs));
+}
 
-  this->beginResetModel();
-  d->DataBase = db;
-  d->SearchParameters = parameters;
+//------------------------------------------------------------------------------
+bool ctkDICOMModel::isSearching()const
+{
+  Q_D(const ctkDICOMModel);
+  if (d->SearchTimer.isActive())
+    {
+    return true;
+    }
+  // The current search has been started and its results are not applied yet.
+  // Superseded searches may still be running, they are not waited for.
+  QMutexLocker locker(&d->SearchMutex);
+  return d->RunningSearchGeneration == d->SearchGeneration;
+}
 
-  delete d->RootNode;
-  d->RootNode = 0;
+//------------------------------------------------------------------------------
+void ctkDICOMModel::cancelSearch()
+{
+  Q_D(ctkDICOMModel);
+  d->SearchTimer.stop();
+  d->cancelSearch();
+}
 
-  if (d->DataBase.tables().empty())
+//------------------------------------------------------------------------------
+void ctkDICOMModel::startSearch()
+{
+  Q_D(ctkDICOMModel);
+  d->SearchTimer.stop();
+  int generation = d->cancelSearch();
+  if (!d->canSearchInBackground() || d->DataBase.tables().empty())
     {
-    //Q_ASSERT(d->DataBase.isOpen());
-    this->endResetModel();
+    d->SearchParameters = d->PendingSearchParameters;
+    this->setDatabase(d->DataBase);
+    emit searchFinished();
     return;
     }
 
-  d->RootNode = d->createNode(-1, QModelIndex());
+  // The root node is not modified until the results are applied, build the
+  // query from a detached node.
+  Node root;
+  root.Type = RootType;
+  root.Parent = 0;
+  QVariantList bindings;
+  QString statement = d->pageQuery(&root, d->PendingSearchParameters, d->PageSize, bindings);
+  {
+    QMutexLocker locker(&d->SearchMutex);
+    d->RunningSearchGeneration = generation;
+  }
+  d->SearchPool.start(new ctkDICOMModelSearchTask(d, generation, statement, bindings));
+}
 
-  this->endResetModel();
+//------------------------------------------------------------------------------
+void ctkDICOMModel::applySearchResults()
+{
+  Q_D(ctkDICOMModel);
+  ctkDICOMModelRows rows;
+  QString error;
+  {
+    QMutexLocker locker(&d->SearchMutex);
+    if (d->SearchResultGeneration != d->SearchGeneration)
+      {
+      return;
+      }
+    rows = d->SearchResult;
+    error = d->SearchError;
+    d->SearchResult.clear();
+    d->SearchError.clear();
+    d->SearchResultGeneration = -1;
+    d->RunningSearchGeneration = -1;
+  }
+
+  if (!error.isEmpty())
+    {
+    // Not finding anything and failing to search are different:
+    // keep the rows of the previous search
+    emit searchFailed(error);
+    return;
+    }
 
-  // TODO, use hasQuerySize everywhere, not only in setDataBase()
-  bool hasQuerySize = d->RootNode->Query.driver()->hasFeature(QSqlDriver::QuerySize);
-  if (hasQuerySize && d->RootNode->Query.size() > 0)
+  this->beginResetModel();
+  d->SearchParameters = d->PendingSearchParameters;
+  d->resetRootNode();
+  if (d->RootNode)
     {
-    int newRowCount= d->RootNode->Query.size();
-    beginInsertRows(QModelIndex(), 0, qMax(0, newRowCount - 1));
-    d->RootNode->RowCount = newRowCount;
-    d->RootNode->AtEnd = true;
-    endInsertRows();
+    d->RootNode->Rows = rows;
+    d->RootNode->RowCount = rows.size();
+    d->RootNode->AtEnd = rows.size() < d->PageSize;
     }
-  d->fetch(QModelIndex(), 256);
+  this->endResetModel();
+  emit searchFinished();
 }
 
 //------------------------------------------------------------------------------
@@ -953,15 +1342,15 @@ void ctkDICOMModel::sort(int column, Qt::SortOrder order)
   this->changePersistentIndexList(oldIndexList, newIndexList);
   emit layoutChanged();
   */
+  d->SearchTimer.stop();
+  d->cancelSearch();
   this->beginResetModel();
-  delete d->RootNode;
-  d->RootNode = 0;
-  d->Sort = QString("\"%1\" %2")
-    .arg(d->Headers[column][Qt::DisplayRole].toString())
-    .arg(order == Qt::AscendingOrder ? "ASC" : "DESC");
-  d->RootNode = d->createNode(-1, QModelIndex());
-
+  d->SortColumn = d->Headers[column][Qt::DisplayRole].toString();
+  d->SortOrder = order;
+  d->resetRootNode();
   this->endResetModel();
+
+  d->fetch(QModelIndex(), d->PageSize);
 }
 
 //------------------------------------------------------------------------------
@@ -41,6 +41,9 @@ class CTK_DICOM_CORE_EXPORT ctkDICOMModel
   Q_ENUMS(IndexType)
   /// startLevel contains the hierarchy depth the model contains
   Q_PROPERTY(IndexType endLevel READ endLevel WRITE setEndLevel);
+  /// Delay in milliseconds between the last call to setSearchParameters()
+  /// and the execution of the search. 300ms by default.
+  Q_PROPERTY(int searchDelay READ searchDelay WRITE setSearchDelay);
 public:
 
   enum {
@@ -62,6 +65,15 @@ public:
   void setDatabase(const QSqlDatabase& dataBase);
   void setDatabase(const QSqlDatabase& dataBase, const QMap<QString,QVariant>& parameters);
 
+  /// Search parameters used to filter the model, see setSearchParameters()
+  QMap<QString,QVariant> searchParameters()const;
+
+  int searchDelay()const;
+  void setSearchDelay(int msecs);
+
+  /// Return true if a search is scheduled or running.
+  bool isSearching()const;
+
   /// Set it before populating the model
   ctkDICOMModel::IndexType endLevel()const;
   void setEndLevel(ctkDICOMModel::IndexType level);
@@ -84,6 +96,26 @@ public:
   virtual void sort(int column, Qt::SortOrder order = Qt::AscendingOrder);
 public Q_SLOTS:
   virtual void reset();
+
+  /// Filter the model with new search parameters. Unlike setDatabase(), the
+  /// search is delayed by searchDelay() and, for file databases, runs in a
+  /// background thread: a search superseded by a later call is discarded.
+  /// searchFinished() is emitted once the model is populated. If the search
+  /// can't be run, searchFailed() is emitted instead and the model keeps its rows.
+  void setSearchParameters(const QMap<QString,QVariant>& parameters);
+  /// Discard the scheduled or running search, if any.
+  void cancelSearch();
+
+Q_SIGNALS:
+  void searchFinished();
+  /// Emitted when a background search fails, with the database error.
+  /// The model is not reset, it still shows the results of the previous search.
+  void searchFailed(const QString& error);
+
+protected Q_SLOTS:
+  void startSearch();
+  void applySearchResults();
+
 protected:
   QScopedPointer<ctkDICOMModelPrivate> d_ptr;
 
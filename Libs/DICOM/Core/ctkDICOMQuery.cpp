@@ -29,6 +29,12 @@
 #include <QDirIterator>
 #include <QFileInfo>
 #include <QDebug>
+#include <QHash>
+#include <QMutex>
+#include <QQueue>
+#include <QRunnable>
+#include <QThreadPool>
+#include <QWaitCondition>
 
 // ctkDICOMCore includes
 #include "ctkDICOMQuery.h"
@@ -53,6 +59,83 @@
 
 static ctkLogger logger ( "org.commontk.dicom.DICOMQuery" );
 
+//------------------------------------------------------------------------------
+/// Series level C-FIND responses of one study
+struct ctkDICOMSeriesQueryResult
+{
+  QString StudyInstanceUID;
+  bool Success;
+  /// Owned by the result
+  QList<DcmDataset*> Datasets;
+};
+
+//------------------------------------------------------------------------------
+/// Studies found by the study level C-FIND are queued here, as soon as their
+/// response arrives, and the series level C-FIND requests are sent by a pool
+/// of workers, each on its own association. The responses are handed back
+/// to the thread that owns the database connection.
+/// Exactly one result is pushed for each queued study, unless canceled.
+class ctkDICOMSeriesQueryQueue
+{
+public:
+  ctkDICOMSeriesQueryQueue();
+  /// Cancel and wait for the workers, then delete results that were not popped
+  ~ctkDICOMSeriesQueryQueue();
+
+  /// Start \a numberOfWorkers workers that send \a seriesQuery for each queued study
+  void start(int numberOfWorkers, const DcmDataset& seriesQuery,
+             const QString& callingAETitle, const QString& calledAETitle,
+             const QString& host, int port);
+
+  void addStudy(const QString& studyInstanceUID);
+  /// No more studies are added
+  void close();
+  /// Workers stop taking studies
+  void cancel();
+
+  /// Blocks until a study is queued. Returns false if no more studies will be queued.
+  bool takeStudy(QString& studyInstanceUID);
+  /// Called by a worker when it exits. The last one fails all the remaining studies,
+  /// so that a server accepting fewer associations than requested is still handled.
+  void workerExited();
+
+  void pushResult(const ctkDICOMSeriesQueryResult& result);
+  /// Waits at most \a timeout milliseconds for results, then returns all available results
+  QList<ctkDICOMSeriesQueryResult> popResults(unsigned long timeout);
+
+protected:
+  void failQueuedStudies();
+
+  QMutex Mutex;
+  QWaitCondition StudyAdded;
+  QWaitCondition ResultAdded;
+  QQueue<QString> Studies;
+  QList<ctkDICOMSeriesQueryResult> Results;
+  int NumberOfWorkers;
+  bool Closed;
+  bool Canceled;
+  QThreadPool Pool;
+};
+
+//------------------------------------------------------------------------------
+/// Sends the series level C-FIND requests of queued studies on its own association
+class ctkDICOMSeriesQueryTask : public QRunnable
+{
+public:
+  ctkDICOMSeriesQueryTask(ctkDICOMSeriesQueryQueue* queue, const DcmDataset& seriesQuery,
+                          const QString& callingAETitle, const QString& calledAETitle,
+                          const QString& host, int port);
+  virtual void run();
+
+protected:
+  ctkDICOMSeriesQueryQueue* Queue;
+  DcmDataset SeriesQuery;
+  QString CallingAETitle;
+  QString CalledAETitle;
+  QString Host;
+  int Port;
+};
+
 //------------------------------------------------------------------------------
 // A customized implemenation so that Qt signals can be emitted
 // when query results are obtained
@@ -60,9 +143,20 @@ class ctkDICOMQuerySCUPrivate : public DcmSCU
 {
 public:
   ctkDICOMQuery *query;
+  /// If set, the series of each found study are queried right away, and
+  /// the study and the series found so far are inserted into database
+  ctkDICOMSeriesQueryQueue *seriesQueryQueue;
+  ctkDICOMDatabase *database;
+  /// Study level responses by StudyInstanceUID, owned by the responses
+  QHash<QString, DcmDataset*> studyDatasets;
+  /// Number of studies whose series are inserted
+  int numberOfQueriedStudies;
   ctkDICOMQuerySCUPrivate()
     {
     this->query = 0;
+    this->seriesQueryQueue = 0;
+    this->database = 0;
+    this->numberOfQueriedStudies = 0;
     };
   ~ctkDICOMQuerySCUPrivate() {};
   virtual OFCondition handleFINDResponse(const T_ASC_PresentationContextID  presID,
@@ -73,10 +167,20 @@ public:
         {
         logger.debug ( "FIND RESPONSE" );
         emit this->query->debug("Got a find response!");
+        if (this->seriesQueryQueue && response->m_dataset != NULL)
+          {
+          this->studyFound(response->m_dataset);
+          }
         return this->DcmSCU::handleFINDResponse(presID, response, waitForNextResponse);
         }
       return DIMSE_NULLKEY;
     };
+
+  /// Insert a study level response and queue its series level query.
+  /// The series found so far for the other studies are inserted too.
+  void studyFound(DcmDataset* dataset);
+  /// Insert the series of the studies whose series level query is done
+  void insertSeriesResults(const QList<ctkDICOMSeriesQueryResult>& results);
 };
 
 //------------------------------------------------------------------------------
@@ -89,11 +193,16 @@ public:
   /// Add a StudyInstanceUID to be queried
   void addStudyInstanceUIDAndDataset(const QString& StudyInstanceUID, DcmDataset* dataset );
 
+  /// Insert a series level response, completed with the patient of the study
+  static void insertSeriesDataset(ctkDICOMDatabase& database, DcmDataset* studyDataset,
+                                  DcmDataset* seriesDataset);
+
   QString                 CallingAETitle;
   QString                 CalledAETitle;
   QString                 Host;
   int                     Port;
   bool                    PreferCGET;
+  int                     MaximumNumberOfAssociations;
   QMap<QString,QVariant>  Filters;
   ctkDICOMQuerySCUPrivate SCU;
   DcmDataset*             Query;
@@ -112,6 +221,7 @@ ctkDICOMQueryPrivate::ctkDICOMQueryPrivate()
   this->Port = 0;
   this->Canceled = false;
   this->PreferCGET = false;
+  this->MaximumNumberOfAssociations = 4;
 }
 
 //------------------------------------------------------------------------------
@@ -127,6 +237,266 @@ void ctkDICOMQueryPrivate::addStudyInstanceUIDAndDataset( const QString& s, DcmD
   this->StudyDatasetList.append ( dataset );
 }
 
+//------------------------------------------------------------------------------
+void ctkDICOMQueryPrivate::insertSeriesDataset(ctkDICOMDatabase& database, DcmDataset* studyDataset,
+                                               DcmDataset* seriesDataset)
+{
+  // add the patient elements not provided for the series level query
+  OFString patientName, patientID;
+  if (studyDataset && studyDataset->findAndGetOFStringArray(DCM_PatientName, patientName).good())
+    {
+    seriesDataset->putAndInsertOFStringArray(DCM_PatientName, patientName);
+    }
+  if (studyDataset && studyDataset->findAndGetOFStringArray(DCM_PatientID, patientID).good())
+    {
+    seriesDataset->putAndInsertOFStringArray(DCM_PatientID, patientID);
+    }
+  // insert series dataset
+  database.insert ( seriesDataset, false /* do not store */, false /* no thumbnail */ );
+}
+
+//------------------------------------------------------------------------------
+// ctkDICOMQuerySCUPrivate methods
+
+//------------------------------------------------------------------------------
+void ctkDICOMQuerySCUPrivate::studyFound(DcmDataset* dataset)
+{
+  // The series are inserted as soon as they arrive, their study first
+  this->database->insert ( dataset, false /* do not store to disk*/, false /* no thumbnail*/);
+  OFString studyInstanceUID;
+  dataset->findAndGetOFString ( DCM_StudyInstanceUID, studyInstanceUID );
+  this->query->d_func()->addStudyInstanceUIDAndDataset ( studyInstanceUID.c_str(), dataset );
+  this->studyDatasets.insert ( studyInstanceUID.c_str(), dataset );
+  emit this->query->progress(QString("Processing: ") + QString(studyInstanceUID.c_str()));
+  this->seriesQueryQueue->addStudy ( studyInstanceUID.c_str() );
+
+  this->insertSeriesResults ( this->seriesQueryQueue->popResults(0) );
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMQuerySCUPrivate::insertSeriesResults(const QList<ctkDICOMSeriesQueryResult>& results)
+{
+  foreach ( const ctkDICOMSeriesQueryResult& result, results )
+    {
+    DcmDataset *studyDataset = this->studyDatasets.value ( result.StudyInstanceUID );
+    foreach ( DcmDataset *dataset, result.Datasets )
+      {
+      ctkDICOMQueryPrivate::insertSeriesDataset ( *this->database, studyDataset, dataset );
+      delete dataset;
+      }
+    if ( result.Success )
+      {
+      logger.debug ( "Find succeded on Series level for Study: " + result.StudyInstanceUID );
+      emit this->query->progress(QString("Find succeded on Series level for Study: ") + result.StudyInstanceUID);
+      }
+    else
+      {
+      logger.error ( "Find on Series level failed for Study: " + result.StudyInstanceUID );
+      emit this->query->progress(QString("Find on Series level failed for Study: ") + result.StudyInstanceUID);
+      }
+    ++this->numberOfQueriedStudies;
+    }
+}
+
+//------------------------------------------------------------------------------
+// ctkDICOMSeriesQueryQueue methods
+
+//------------------------------------------------------------------------------
+ctkDICOMSeriesQueryQueue::ctkDICOMSeriesQueryQueue()
+  : NumberOfWorkers(0)
+  , Closed(false)
+  , Canceled(false)
+{
+}
+
+//------------------------------------------------------------------------------
+ctkDICOMSeriesQueryQueue::~ctkDICOMSeriesQueryQueue()
+{
+  this->cancel();
+  this->Pool.waitForDone();
+  foreach(const ctkDICOMSeriesQueryResult& result, this->Results)
+    {
+    qDeleteAll(result.Datasets);
+    }
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMSeriesQueryQueue::start(int numberOfWorkers, const DcmDataset& seriesQuery,
+                                     const QString& callingAETitle, const QString& calledAETitle,
+                                     const QString& host, int port)
+{
+  {
+    QMutexLocker locker(&this->Mutex);
+    this->NumberOfWorkers = numberOfWorkers;
+  }
+  this->Pool.setMaxThreadCount(numberOfWorkers);
+  for (int i = 0; i < numberOfWorkers; ++i)
+    {
+    this->Pool.start(new ctkDICOMSeriesQueryTask(this, seriesQuery,
+      callingAETitle, calledAETitle, host, port));
+    }
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMSeriesQueryQueue::addStudy(const QString& studyInstanceUID)
+{
+  QMutexLocker locker(&this->Mutex);
+  this->Studies.enqueue(studyInstanceUID);
+  if (this->NumberOfWorkers == 0)
+    {
+    this->failQueuedStudies();
+    }
+  this->StudyAdded.wakeOne();
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMSeriesQueryQueue::close()
+{
+  QMutexLocker locker(&this->Mutex);
+  this->Closed = true;
+  this->StudyAdded.wakeAll();
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMSeriesQueryQueue::cancel()
+{
+  QMutexLocker locker(&this->Mutex);
+  this->Canceled = true;
+  this->StudyAdded.wakeAll();
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMSeriesQueryQueue::takeStudy(QString& studyInstanceUID)
+{
+  QMutexLocker locker(&this->Mutex);
+  while (this->Studies.isEmpty() && !this->Closed && !this->Canceled)
+    {
+    this->StudyAdded.wait(&this->Mutex);
+    }
+  if (this->Canceled || this->Studies.isEmpty())
+    {
+    return false;
+    }
+  studyInstanceUID = this->Studies.dequeue();
+  return true;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMSeriesQueryQueue::workerExited()
+{
+  QMutexLocker locker(&this->Mutex);
+  --this->NumberOfWorkers;
+  if (this->NumberOfWorkers == 0)
+    {
+    this->failQueuedStudies();
+    }
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMSeriesQueryQueue::failQueuedStudies()
+{
+  while (!this->Studies.isEmpty())
+    {
+    ctkDICOMSeriesQueryResult result;
+    result.StudyInstanceUID = this->Studies.dequeue();
+    result.Success = false;
+    this->Results.append(result);
+    }
+  this->ResultAdded.wakeAll();
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMSeriesQueryQueue::pushResult(const ctkDICOMSeriesQueryResult& result)
+{
+  QMutexLocker locker(&this->Mutex);
+  this->Results.append(result);
+  this->ResultAdded.wakeAll();
+}
+
+//------------------------------------------------------------------------------
+QList<ctkDICOMSeriesQueryResult> ctkDICOMSeriesQueryQueue::popResults(unsigned long timeout)
+{
+  QMutexLocker locker(&this->Mutex);
+  if (this->Results.isEmpty())
+    {
+    this->ResultAdded.wait(&this->Mutex, timeout);
+    }
+  QList<ctkDICOMSeriesQueryResult> results = this->Results;
+  this->Results.clear();
+  return results;
+}
+
+//------------------------------------------------------------------------------
+// ctkDICOMSeriesQueryTask methods
+
+//------------------------------------------------------------------------------
+ctkDICOMSeriesQueryTask::ctkDICOMSeriesQueryTask(ctkDICOMSeriesQueryQueue* queue,
+                                                 const DcmDataset& seriesQuery,
+                                                 const QString& callingAETitle,
+                                                 const QString& calledAETitle,
+                                                 const QString& host, int port)
+  : Queue(queue)
+  , SeriesQuery(seriesQuery)
+  , CallingAETitle(callingAETitle)
+  , CalledAETitle(calledAETitle)
+  , Host(host)
+  , Port(port)
+{
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMSeriesQueryTask::run()
+{
+  DcmSCU scu;
+  scu.setAETitle ( OFString(this->CallingAETitle.toStdString().c_str()) );
+  scu.setPeerAETitle ( OFString(this->CalledAETitle.toStdString().c_str()) );
+  scu.setPeerHostName ( OFString(this->Host.toStdString().c_str()) );
+  scu.setPeerPort ( this->Port );
+
+  OFList<OFString> transferSyntaxes;
+  transferSyntaxes.push_back ( UID_LittleEndianExplicitTransferSyntax );
+  transferSyntaxes.push_back ( UID_BigEndianExplicitTransferSyntax );
+  transferSyntaxes.push_back ( UID_LittleEndianImplicitTransferSyntax );
+  scu.addPresentationContext ( UID_FINDStudyRootQueryRetrieveInformationModel, transferSyntaxes );
+
+  if ( !scu.initNetwork().good() || !scu.negotiateAssociation().good() )
+    {
+    logger.debug ( "Series level association could not be negotiated" );
+    this->Queue->workerExited();
+    return;
+    }
+  T_ASC_PresentationContextID presentationContext =
+    scu.findPresentationContextID ( UID_FINDStudyRootQueryRetrieveInformationModel, "" );
+
+  QString studyInstanceUID;
+  while ( scu.isConnected() && this->Queue->takeStudy(studyInstanceUID) )
+    {
+    this->SeriesQuery.putAndInsertString ( DCM_StudyInstanceUID, studyInstanceUID.toStdString().c_str() );
+    OFList<QRResponse *> responses;
+    OFCondition status = scu.sendFINDRequest ( presentationContext, &this->SeriesQuery, &responses );
+
+    ctkDICOMSeriesQueryResult result;
+    result.StudyInstanceUID = studyInstanceUID;
+    result.Success = status.good();
+    for ( OFListIterator(QRResponse*) it = responses.begin(); it != responses.end(); it++ )
+      {
+      if ( result.Success && (*it)->m_dataset != NULL )
+        {
+        // take ownership of the dataset
+        result.Datasets.append ( (*it)->m_dataset );
+        (*it)->m_dataset = NULL;
+        }
+      delete *it;
+      }
+    this->Queue->pushResult(result);
+    }
+  if ( scu.isConnected() )
+    {
+    scu.closeAssociation ( DCMSCU_RELEASE_ASSOCIATION );
+    }
+  this->Queue->workerExited();
+}
+
 //------------------------------------------------------------------------------
 // ctkDICOMQuery methods
 
@@ -229,6 +599,20 @@ QMap<QString,QVariant> ctkDICOMQuery::filters()const
   return d->Filters;
 }
 
+//------------------------------------------------------------------------------
+void ctkDICOMQuery::setMaximumNumberOfAssociations ( int maximumNumberOfAssociations )
+{
+  Q_D(ctkDICOMQuery);
+  d->MaximumNumberOfAssociations = qMax(1, maximumNumberOfAssociations);
+}
+
+//------------------------------------------------------------------------------
+int ctkDICOMQuery::maximumNumberOfAssociations()const
+{
+  Q_D(const ctkDICOMQuery);
+  return d->MaximumNumberOfAssociations;
+}
+
 //------------------------------------------------------------------------------
 QStringList ctkDICOMQuery::studyInstanceUIDQueried()const
 {
@@ -261,6 +645,7 @@ bool ctkDICOMQuery::query(ctkDICOMDatabase& database )
   if (d->Canceled) {return false;}
 
   d->StudyInstanceUIDList.clear();
+  d->StudyDatasetList.clear();
   d->SCU.setAETitle ( OFString(this->callingAETitle().toStdString().c_str()) );
   d->SCU.setPeerAETitle ( OFString(this->calledAETitle().toStdString().c_str()) );
   d->SCU.setPeerHostName ( OFString(this->host().toStdString().c_str()) );
@@ -378,6 +763,20 @@ bool ctkDICOMQuery::query(ctkDICOMDatabase& database )
     d->Query->putAndInsertString ( DCM_StudyDate, dateRange.toLatin1().data() );
     logger.debug("Query on study date " + dateRange);
     }
+  /* Only ask for series attributes in the series level queries. */
+  DcmDataset seriesQuery;
+  seriesQuery.insertEmptyElement ( DCM_SeriesNumber );
+  seriesQuery.insertEmptyElement ( DCM_SeriesDescription );
+  seriesQuery.insertEmptyElement ( DCM_SeriesInstanceUID );
+  seriesQuery.insertEmptyElement ( DCM_SeriesDate );
+  seriesQuery.insertEmptyElement ( DCM_SeriesTime );
+  seriesQuery.insertEmptyElement ( DCM_Modality );
+  seriesQuery.insertEmptyElement ( DCM_NumberOfSeriesRelatedInstances ); // Number of images in the series
+
+  /* Add user-defined filters */
+  seriesQuery.putAndInsertOFStringArray(DCM_SeriesDescription, seriesDescription.toLatin1().data());
+  seriesQuery.putAndInsertString ( DCM_QueryRetrieveLevel, "SERIES" );
+
   emit progress(30);
   if (d->Canceled) {return false;}
 
@@ -399,7 +798,21 @@ bool ctkDICOMQuery::query(ctkDICOMDatabase& database )
   emit progress(40);
   if (d->Canceled) {return false;}
 
+  // Series level queries are sent on separate associations while the
+  // study level responses are still arriving
+  ctkDICOMSeriesQueryQueue seriesQueryQueue;
+  if ( d->MaximumNumberOfAssociations > 1 )
+    {
+    seriesQueryQueue.start ( d->MaximumNumberOfAssociations, seriesQuery,
+      this->callingAETitle(), this->calledAETitle(), this->host(), this->port() );
+    d->SCU.seriesQueryQueue = &seriesQueryQueue;
+    d->SCU.database = &database;
+    d->SCU.studyDatasets.clear();
+    d->SCU.numberOfQueriedStudies = 0;
+    }
   OFCondition status = d->SCU.sendFINDRequest ( presentationContext, d->Query, &responses );
+  d->SCU.seriesQueryQueue = 0;
+  seriesQueryQueue.close();
   if ( !status.good() )
     {
     logger.error ( "Find failed" );
@@ -413,6 +826,23 @@ bool ctkDICOMQuery::query(ctkDICOMDatabase& database )
   emit progress(50);
   if (d->Canceled) {return false;}
 
+  if ( d->MaximumNumberOfAssociations > 1 )
+    {
+    // Free the association for the series level queries
+    d->SCU.closeAssociation ( DCMSCU_RELEASE_ASSOCIATION );
+
+    // The studies are inserted, insert the series that are still expected
+    int numberOfStudies = d->StudyInstanceUIDList.count();
+    while ( d->SCU.numberOfQueriedStudies < numberOfStudies )
+      {
+      emit progress(50 + (50 * d->SCU.numberOfQueriedStudies) / numberOfStudies);
+      if (d->Canceled) {return false;}
+      d->SCU.insertSeriesResults ( seriesQueryQueue.popResults(100) );
+      }
+    emit progress(100);
+    return true;
+    }
+
   for ( OFListIterator(QRResponse*) it = responses.begin(); it != responses.end(); it++ )
     {
     DcmDataset *dataset = (*it)->m_dataset;
@@ -428,21 +858,7 @@ bool ctkDICOMQuery::query(ctkDICOMDatabase& database )
       }
     }
 
-  /* Only ask for series attributes now. This requires kicking out the rest of former query. */
-  d->Query->clear();
-  d->Query->insertEmptyElement ( DCM_SeriesNumber );
-  d->Query->insertEmptyElement ( DCM_SeriesDescription );
-  d->Query->insertEmptyElement ( DCM_SeriesInstanceUID );
-  d->Query->insertEmptyElement ( DCM_SeriesDate );
-  d->Query->insertEmptyElement ( DCM_SeriesTime );
-  d->Query->insertEmptyElement ( DCM_Modality );
-  d->Query->insertEmptyElement ( DCM_NumberOfSeriesRelatedInstances ); // Number of images in the series
-
-  /* Add user-defined filters */
-  d->Query->putAndInsertOFStringArray(DCM_SeriesDescription, seriesDescription.toLatin1().data());
-
   // Now search each within each Study that was identified
-  d->Query->putAndInsertString ( DCM_QueryRetrieveLevel, "SERIES" );
   float progressRatio = 25. / d->StudyInstanceUIDList.count();
   int i = 0; 
 
@@ -450,18 +866,15 @@ bool ctkDICOMQuery::query(ctkDICOMDatabase& database )
   foreach ( QString StudyInstanceUID, d->StudyInstanceUIDList )
     {
     DcmDataset *studyDataset = datasetIterator.next();
-    DcmElement *patientName, *patientID;
-    studyDataset->findAndGetElement(DCM_PatientName, patientName);
-    studyDataset->findAndGetElement(DCM_PatientID, patientID);
 
     logger.debug ( "Starting Series C-FIND for Study: " + StudyInstanceUID );
     emit progress(QString("Starting Series C-FIND for Study: ") + StudyInstanceUID);
     emit progress(50 + (progressRatio * i++));
     if (d->Canceled) {return false;}
 
-    d->Query->putAndInsertString ( DCM_StudyInstanceUID, StudyInstanceUID.toStdString().c_str() );
+    seriesQuery.putAndInsertString ( DCM_StudyInstanceUID, StudyInstanceUID.toStdString().c_str() );
     OFList<QRResponse *> responses;
-    status = d->SCU.sendFINDRequest ( presentationContext, d->Query, &responses );
+    status = d->SCU.sendFINDRequest ( presentationContext, &seriesQuery, &responses );
     if ( status.good() )
       {
       for ( OFListIterator(QRResponse*) it = responses.begin(); it != responses.end(); it++ )
@@ -469,11 +882,7 @@ bool ctkDICOMQuery::query(ctkDICOMDatabase& database )
         DcmDataset *dataset = (*it)->m_dataset;
         if ( dataset != NULL )
           {
-          // add the patient elements not provided for the series level query
-          dataset->insert( patientName, true );
-          dataset->insert( patientID, true );
-          // insert series dataset 
-          database.insert ( dataset, false /* do not store */, false /* no thumbnail */ );
+          ctkDICOMQueryPrivate::insertSeriesDataset ( database, studyDataset, dataset );
           }
         }
       logger.debug ( "Find succeded on Series level for Study: " + StudyInstanceUID );
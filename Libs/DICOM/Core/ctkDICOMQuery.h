@@ -44,6 +44,7 @@ class CTK_DICOM_CORE_EXPORT ctkDICOMQuery : public QObject
   Q_PROPERTY(QString host READ host WRITE setHost);
   Q_PROPERTY(int port READ port WRITE setPort);
   Q_PROPERTY(bool preferCGET READ preferCGET WRITE setPreferCGET);
+  Q_PROPERTY(int maximumNumberOfAssociations READ maximumNumberOfAssociations WRITE setMaximumNumberOfAssociations);
 
 public:
   explicit ctkDICOMQuery(QObject* parent = 0);
@@ -68,6 +69,14 @@ public:
   /// false by default
   void setPreferCGET ( bool preferCGET );
   bool preferCGET()const;
+  /// Maximum number of associations used in parallel for the series level
+  /// C-FIND requests. The series of a study are queried as soon as the study
+  /// is found, and the results are inserted into the database as they arrive.
+  /// With 1, the series are queried one study after the other on the study
+  /// level association.
+  /// 4 by default.
+  void setMaximumNumberOfAssociations ( int maximumNumberOfAssociations );
+  int maximumNumberOfAssociations()const;
 
   /// Query a remote DICOM Image Store SCP
   /// You must at least set the host and port before calling query()
@@ -122,7 +131,7 @@ private:
   Q_DECLARE_PRIVATE(ctkDICOMQuery);
   Q_DISABLE_COPY(ctkDICOMQuery);
 
-  friend class ctkDICOMQuerySCUPrivate;  // for access to queryResponseHandled
+  friend class ctkDICOMQuerySCUPrivate;  // inserts the study level responses as they arrive
 };
 
 #endif
@@ -94,9 +94,8 @@ public:
         emit this->retrieve->progress("Got STORE request for " + qInstanceUID);
         emit this->retrieve->progress(0);
         continueCGETSession = !this->retrieve->wasCanceled();
-        if (this->retrieve && this->retrieve->database())
+        if (this->retrieve->storeInstance(incomingObject))
           {
-          this->retrieve->database()->insert(incomingObject);
           return EC_Normal;
           }
         else
@@ -708,6 +707,18 @@ bool ctkDICOMRetrieve::getSeries(const QString& studyInstanceUID,
   return d->get ( studyInstanceUID, seriesInstanceUID, ctkDICOMRetrievePrivate::RetrieveSeries );
 }
 
+//------------------------------------------------------------------------------
+bool ctkDICOMRetrieve::storeInstance(DcmDataset* dataset)
+{
+  Q_D(ctkDICOMRetrieve);
+  if (!d->Database)
+    {
+    return false;
+    }
+  d->Database->insert(dataset);
+  return true;
+}
+
 //------------------------------------------------------------------------------
 void ctkDICOMRetrieve::cancel()
 {
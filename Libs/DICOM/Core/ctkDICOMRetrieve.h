@@ -33,6 +33,7 @@
 #include "ctkDICOMDatabase.h"
 
 class ctkDICOMRetrievePrivate;
+class DcmDataset;
 
 /// \ingroup DICOM_Core
 class CTK_DICOM_CORE_EXPORT ctkDICOMRetrieve : public QObject
@@ -115,6 +116,11 @@ Q_SIGNALS:
   void done(const bool& error);
 
 protected:
+  /// Called for each instance received through CGET. The default implementation
+  /// inserts \a dataset into the database. \a dataset is deleted after the call.
+  /// \return false if the instance could not be stored
+  virtual bool storeInstance(DcmDataset* dataset);
+
   QScopedPointer<ctkDICOMRetrievePrivate> d_ptr;
 
 private:
@@ -0,0 +1,689 @@
+/*=========================================================================
+
+  Library:   CTK
+
+  Copyright (c) Kitware Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0.txt
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=========================================================================*/
+
+// Qt includes
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QQueue>
+#include <QRunnable>
+#include <QSet>
+#include <QThreadPool>
+#include <QWaitCondition>
+
+// ctkDICOMCore includes
+#include "ctkDICOMRetrieve.h"
+#include "ctkDICOMRetrieveScheduler.h"
+#include "ctkLogger.h"
+
+// DCMTK includes
+#include <dcmtk/dcmdata/dcdatset.h>
+#include <dcmtk/dcmdata/dcdeftag.h>
+#include <dcmtk/dcmdata/dcrledrg.h>  /* for DcmRLEDecoderRegistration */
+#include <dcmtk/dcmdata/dcrleerg.h>  /* for DcmRLEEncoderRegistration */
+#include <dcmtk/dcmjpeg/djdecode.h>  /* for dcmjpeg decoders */
+#include <dcmtk/dcmjpeg/djencode.h>  /* for dcmjpeg encoders */
+
+static ctkLogger logger("org.commontk.dicom.DICOMRetrieveScheduler");
+
+//------------------------------------------------------------------------------
+struct ctkDICOMRetrieveSchedulerJob
+{
+  QString StudyInstanceUID;
+  /// Empty for the retrieve of a whole study
+  QString SeriesInstanceUID;
+  int Priority;
+};
+
+//------------------------------------------------------------------------------
+/// Instance received by a worker, or the end of a retrieve if Dataset is null
+struct ctkDICOMRetrieveSchedulerEntry
+{
+  DcmDataset* Dataset;
+  ctkDICOMRetrieveSchedulerJob Job;
+  bool Success;
+};
+
+//------------------------------------------------------------------------------
+class ctkDICOMRetrieveSchedulerPrivate
+{
+  Q_DECLARE_PUBLIC(ctkDICOMRetrieveScheduler);
+
+protected:
+  ctkDICOMRetrieveScheduler* const q_ptr;
+
+public:
+  ctkDICOMRetrieveSchedulerPrivate(ctkDICOMRetrieveScheduler& obj);
+  ~ctkDICOMRetrieveSchedulerPrivate();
+
+  void enqueue(const ctkDICOMRetrieveSchedulerJob& job);
+
+  /// Called by workers. Returns false and unregisters the worker if no job is queued.
+  bool takeJob(ctkDICOMRetrieveSchedulerJob& job, ctkDICOMRetrieve* retrieve);
+  /// Called by workers. Blocks while the queue of received instances is full.
+  /// Takes ownership of \a dataset.
+  void pushReceivedInstance(DcmDataset* dataset, const ctkDICOMRetrieveSchedulerJob& job,
+                            ctkDICOMRetrieve* retrieve);
+  /// Called by workers when a retrieve is finished
+  void finishJob(const ctkDICOMRetrieveSchedulerJob& job, bool success, ctkDICOMRetrieve* retrieve);
+
+  /// Wait at most \a msecs milliseconds for received entries and take them
+  QList<ctkDICOMRetrieveSchedulerEntry> takeReceived(unsigned long msecs);
+
+  void scheduleProcessing();
+
+  // Connectivity, read by the workers when they start a retrieve
+  QString CallingAETitle;
+  QString CalledAETitle;
+  QString Host;
+  int Port;
+  QString MoveDestinationAETitle;
+  bool PreferCGET;
+  int MaximumNumberOfAssociations;
+  int MaximumNumberOfQueuedInstances;
+  QSharedPointer<ctkDICOMDatabase> Database;
+
+  mutable QMutex Mutex;
+  QWaitCondition NotFull;
+  QWaitCondition Received;
+  /// Sorted by decreasing priority, in the order of the requests for the same priority
+  QList<ctkDICOMRetrieveSchedulerJob> Jobs;
+  QQueue<ctkDICOMRetrieveSchedulerEntry> ReceivedEntries;
+  int NumberOfQueuedInstances;
+  /// Queued and running retrieves, and finished retrieves that are not reported yet
+  int NumberOfPendingRetrieves;
+  int NumberOfWorkers;
+  QSet<ctkDICOMRetrieve*> RunningRetrieves;
+  bool ProcessingScheduled;
+  QThreadPool Pool;
+};
+
+//------------------------------------------------------------------------------
+/// ctkDICOMRetrieve handing the received instances over to the scheduler
+class ctkDICOMRetrieveSchedulerRetrieve : public ctkDICOMRetrieve
+{
+public:
+  ctkDICOMRetrieveSchedulerRetrieve(ctkDICOMRetrieveSchedulerPrivate* scheduler)
+    : Scheduler(scheduler)
+    {
+    }
+
+  ctkDICOMRetrieveSchedulerJob Job;
+
+protected:
+  virtual bool storeInstance(DcmDataset* dataset)
+    {
+    // the received dataset is deleted by the SCU once this returns
+    this->Scheduler->pushReceivedInstance(new DcmDataset(*dataset), this->Job, this);
+    return true;
+    }
+
+  ctkDICOMRetrieveSchedulerPrivate* Scheduler;
+};
+
+//------------------------------------------------------------------------------
+/// Runs queued retrieves on its own association until no retrieve is queued
+class ctkDICOMRetrieveSchedulerWorker : public QRunnable
+{
+public:
+  ctkDICOMRetrieveSchedulerWorker(ctkDICOMRetrieveSchedulerPrivate* scheduler)
+    : Scheduler(scheduler)
+    {
+    }
+  virtual void run();
+
+protected:
+  ctkDICOMRetrieveSchedulerPrivate* Scheduler;
+};
+
+//------------------------------------------------------------------------------
+void ctkDICOMRetrieveSchedulerWorker::run()
+{
+  ctkDICOMRetrieveSchedulerRetrieve retrieve(this->Scheduler);
+  bool preferCGET = true;
+  bool hasDatabase = false;
+  ctkDICOMRetrieveSchedulerJob job;
+  while (this->Scheduler->takeJob(job, &retrieve))
+    {
+    {
+      QMutexLocker locker(&this->Scheduler->Mutex);
+      retrieve.setCallingAETitle(this->Scheduler->CallingAETitle);
+      retrieve.setCalledAETitle(this->Scheduler->CalledAETitle);
+      retrieve.setHost(this->Scheduler->Host);
+      retrieve.setPort(this->Scheduler->Port);
+      retrieve.setMoveDestinationAETitle(this->Scheduler->MoveDestinationAETitle);
+      preferCGET = this->Scheduler->PreferCGET;
+      hasDatabase = !this->Scheduler->Database.isNull();
+    }
+    retrieve.Job = job;
+    bool success = false;
+    if (preferCGET && !hasDatabase)
+      {
+      // The received instances would be lost
+      logger.error("Cannot retrieve study " + job.StudyInstanceUID + " series " + job.SeriesInstanceUID
+                   + " with CGET: no database is set.");
+      }
+    else if (job.SeriesInstanceUID.isEmpty())
+      {
+      success = preferCGET ? retrieve.getStudy(job.StudyInstanceUID)
+                           : retrieve.moveStudy(job.StudyInstanceUID);
+      }
+    else
+      {
+      success = preferCGET ? retrieve.getSeries(job.StudyInstanceUID, job.SeriesInstanceUID)
+                           : retrieve.moveSeries(job.StudyInstanceUID, job.SeriesInstanceUID);
+      }
+    this->Scheduler->finishJob(job, success, &retrieve);
+    }
+}
+
+//------------------------------------------------------------------------------
+// ctkDICOMRetrieveSchedulerPrivate methods
+
+//------------------------------------------------------------------------------
+ctkDICOMRetrieveSchedulerPrivate::ctkDICOMRetrieveSchedulerPrivate(ctkDICOMRetrieveScheduler& obj)
+  : q_ptr(&obj)
+  , Port(0)
+  , PreferCGET(true)
+  , MaximumNumberOfAssociations(4)
+  , MaximumNumberOfQueuedInstances(64)
+  , NumberOfQueuedInstances(0)
+  , NumberOfPendingRetrieves(0)
+  , NumberOfWorkers(0)
+  , ProcessingScheduled(false)
+{
+  this->Pool.setMaxThreadCount(this->MaximumNumberOfAssociations);
+
+  // Register the codecs before the workers create their ctkDICOMRetrieve,
+  // the registration is not thread-safe.
+  DJDecoderRegistration::registerCodecs();
+  DJEncoderRegistration::registerCodecs();
+  DcmRLEEncoderRegistration::registerCodecs();
+  DcmRLEDecoderRegistration::registerCodecs();
+}
+
+//------------------------------------------------------------------------------
+ctkDICOMRetrieveSchedulerPrivate::~ctkDICOMRetrieveSchedulerPrivate()
+{
+  foreach(const ctkDICOMRetrieveSchedulerEntry& entry, this->ReceivedEntries)
+    {
+    delete entry.Dataset;
+    }
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMRetrieveSchedulerPrivate::enqueue(const ctkDICOMRetrieveSchedulerJob& job)
+{
+  QMutexLocker locker(&this->Mutex);
+  int index = 0;
+  while (index < this->Jobs.count() && this->Jobs[index].Priority >= job.Priority)
+    {
+    ++index;
+    }
+  this->Jobs.insert(index, job);
+  ++this->NumberOfPendingRetrieves;
+  if (this->NumberOfWorkers < this->MaximumNumberOfAssociations)
+    {
+    ++this->NumberOfWorkers;
+    this->Pool.start(new ctkDICOMRetrieveSchedulerWorker(this));
+    }
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMRetrieveSchedulerPrivate::takeJob(ctkDICOMRetrieveSchedulerJob& job,
+                                               ctkDICOMRetrieve* retrieve)
+{
+  QMutexLocker locker(&this->Mutex);
+  // Exit if the maximum number of associations has been lowered
+  if (this->Jobs.isEmpty() || this->NumberOfWorkers > this->MaximumNumberOfAssociations)
+    {
+    --this->NumberOfWorkers;
+    return false;
+    }
+  job = this->Jobs.takeFirst();
+  retrieve->setWasCanceled(false);
+  this->RunningRetrieves.insert(retrieve);
+  return true;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMRetrieveSchedulerPrivate::pushReceivedInstance(DcmDataset* dataset,
+                                                            const ctkDICOMRetrieveSchedulerJob& job,
+                                                            ctkDICOMRetrieve* retrieve)
+{
+  QMutexLocker locker(&this->Mutex);
+  while (this->NumberOfQueuedInstances >= this->MaximumNumberOfQueuedInstances
+         && !retrieve->wasCanceled())
+    {
+    this->NotFull.wait(&this->Mutex);
+    }
+  if (retrieve->wasCanceled())
+    {
+    delete dataset;
+    return;
+    }
+  ctkDICOMRetrieveSchedulerEntry entry;
+  entry.Dataset = dataset;
+  entry.Job = job;
+  entry.Success = true;
+  this->ReceivedEntries.enqueue(entry);
+  ++this->NumberOfQueuedInstances;
+  this->Received.wakeAll();
+  this->scheduleProcessing();
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMRetrieveSchedulerPrivate::finishJob(const ctkDICOMRetrieveSchedulerJob& job,
+                                                 bool success, ctkDICOMRetrieve* retrieve)
+{
+  QMutexLocker locker(&this->Mutex);
+  this->RunningRetrieves.remove(retrieve);
+  ctkDICOMRetrieveSchedulerEntry entry;
+  entry.Dataset = 0;
+  entry.Job = job;
+  entry.Success = success && !retrieve->wasCanceled();
+  this->ReceivedEntries.enqueue(entry);
+  this->Received.wakeAll();
+  this->scheduleProcessing();
+}
+
+//------------------------------------------------------------------------------
+QList<ctkDICOMRetrieveSchedulerEntry> ctkDICOMRetrieveSchedulerPrivate::takeReceived(unsigned long msecs)
+{
+  QMutexLocker locker(&this->Mutex);
+  if (this->ReceivedEntries.isEmpty() && msecs > 0)
+    {
+    this->Received.wait(&this->Mutex, msecs);
+    }
+  QList<ctkDICOMRetrieveSchedulerEntry> entries = this->ReceivedEntries;
+  this->ReceivedEntries.clear();
+  this->NumberOfQueuedInstances = 0;
+  this->ProcessingScheduled = false;
+  this->NotFull.wakeAll();
+  return entries;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMRetrieveSchedulerPrivate::scheduleProcessing()
+{
+  Q_Q(ctkDICOMRetrieveScheduler);
+  // Mutex is locked by the caller
+  if (!this->ProcessingScheduled)
+    {
+    this->ProcessingScheduled = true;
+    QMetaObject::invokeMethod(q, "processReceivedInstances", Qt::QueuedConnection);
+    }
+}
+
+//------------------------------------------------------------------------------
+// ctkDICOMRetrieveScheduler methods
+
+//------------------------------------------------------------------------------
+ctkDICOMRetrieveScheduler::ctkDICOMRetrieveScheduler(QObject* parent)
+  : QObject(parent)
+  , d_ptr(new ctkDICOMRetrieveSchedulerPrivate(*this))
+{
+}
+
+//------------------------------------------------------------------------------
+ctkDICOMRetrieveScheduler::~ctkDICOMRetrieveScheduler()
+{
+  Q_D(ctkDICOMRetrieveScheduler);
+  this->cancel();
+  d->Pool.waitForDone();
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMRetrieveScheduler::setCallingAETitle( const QString& callingAETitle )
+{
+  Q_D(ctkDICOMRetrieveScheduler);
+  QMutexLocker locker(&d->Mutex);
+  d->CallingAETitle = callingAETitle;
+}
+
+//------------------------------------------------------------------------------
+QString ctkDICOMRetrieveScheduler::callingAETitle() const
+{
+  Q_D(const ctkDICOMRetrieveScheduler);
+  QMutexLocker locker(&d->Mutex);
+  return d->CallingAETitle;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMRetrieveScheduler::setCalledAETitle( const QString& calledAETitle )
+{
+  Q_D(ctkDICOMRetrieveScheduler);
+  QMutexLocker locker(&d->Mutex);
+  d->CalledAETitle = calledAETitle;
+}
+
+//------------------------------------------------------------------------------
+QString ctkDICOMRetrieveScheduler::calledAETitle() const
+{
+  Q_D(const ctkDICOMRetrieveScheduler);
+  QMutexLocker locker(&d->Mutex);
+  return d->CalledAETitle;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMRetrieveScheduler::setHost( const QString& host )
+{
+  Q_D(ctkDICOMRetrieveScheduler);
+  QMutexLocker locker(&d->Mutex);
+  d->Host = host;
+}
+
+//------------------------------------------------------------------------------
+QString ctkDICOMRetrieveScheduler::host() const
+{
+  Q_D(const ctkDICOMRetrieveScheduler);
+  QMutexLocker locker(&d->Mutex);
+  return d->Host;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMRetrieveScheduler::setPort( int port )
+{
+  Q_D(ctkDICOMRetrieveScheduler);
+  QMutexLocker locker(&d->Mutex);
+  d->Port = port;
+}
+
+//------------------------------------------------------------------------------
+int ctkDICOMRetrieveScheduler::port() const
+{
+  Q_D(const ctkDICOMRetrieveScheduler);
+  QMutexLocker locker(&d->Mutex);
+  return d->Port;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMRetrieveScheduler::setMoveDestinationAETitle( const QString& moveDestinationAETitle )
+{
+  Q_D(ctkDICOMRetrieveScheduler);
+  QMutexLocker locker(&d->Mutex);
+  d->MoveDestinationAETitle = moveDestinationAETitle;
+}
+
+//------------------------------------------------------------------------------
+QString ctkDICOMRetrieveScheduler::moveDestinationAETitle() const
+{
+  Q_D(const ctkDICOMRetrieveScheduler);
+  QMutexLocker locker(&d->Mutex);
+  return d->MoveDestinationAETitle;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMRetrieveScheduler::setPreferCGET( bool preferCGET )
+{
+  Q_D(ctkDICOMRetrieveScheduler);
+  QMutexLocker locker(&d->Mutex);
+  d->PreferCGET = preferCGET;
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMRetrieveScheduler::preferCGET() const
+{
+  Q_D(const ctkDICOMRetrieveScheduler);
+  QMutexLocker locker(&d->Mutex);
+  return d->PreferCGET;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMRetrieveScheduler::setMaximumNumberOfAssociations( int maximumNumberOfAssociations )
+{
+  Q_D(ctkDICOMRetrieveScheduler);
+  QMutexLocker locker(&d->Mutex);
+  d->MaximumNumberOfAssociations = qMax(1, maximumNumberOfAssociations);
+  d->Pool.setMaxThreadCount(d->MaximumNumberOfAssociations);
+  while (d->NumberOfWorkers < qMin(d->MaximumNumberOfAssociations, d->Jobs.count()))
+    {
+    ++d->NumberOfWorkers;
+    d->Pool.start(new ctkDICOMRetrieveSchedulerWorker(d));
+    }
+}
+
+//------------------------------------------------------------------------------
+int ctkDICOMRetrieveScheduler::maximumNumberOfAssociations() const
+{
+  Q_D(const ctkDICOMRetrieveScheduler);
+  QMutexLocker locker(&d->Mutex);
+  return d->MaximumNumberOfAssociations;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMRetrieveScheduler::setMaximumNumberOfQueuedInstances( int maximumNumberOfQueuedInstances )
+{
+  Q_D(ctkDICOMRetrieveScheduler);
+  QMutexLocker locker(&d->Mutex);
+  d->MaximumNumberOfQueuedInstances = qMax(1, maximumNumberOfQueuedInstances);
+  d->NotFull.wakeAll();
+}
+
+//------------------------------------------------------------------------------
+int ctkDICOMRetrieveScheduler::maximumNumberOfQueuedInstances() const
+{
+  Q_D(const ctkDICOMRetrieveScheduler);
+  QMutexLocker locker(&d->Mutex);
+  return d->MaximumNumberOfQueuedInstances;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMRetrieveScheduler::setDatabase(QSharedPointer<ctkDICOMDatabase> dicomDatabase)
+{
+  Q_D(ctkDICOMRetrieveScheduler);
+  QMutexLocker locker(&d->Mutex);
+  d->Database = dicomDatabase;
+}
+
+//------------------------------------------------------------------------------
+QSharedPointer<ctkDICOMDatabase> ctkDICOMRetrieveScheduler::database()const
+{
+  Q_D(const ctkDICOMRetrieveScheduler);
+  QMutexLocker locker(&d->Mutex);
+  return d->Database;
+}
+
+//------------------------------------------------------------------------------
+int ctkDICOMRetrieveScheduler::numberOfPendingRetrieves() const
+{
+  Q_D(const ctkDICOMRetrieveScheduler);
+  QMutexLocker locker(&d->Mutex);
+  return d->NumberOfPendingRetrieves;
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMRetrieveScheduler::waitForDone(int msecs)
+{
+  Q_D(ctkDICOMRetrieveScheduler);
+  QElapsedTimer timer;
+  timer.start();
+  forever
+    {
+    this->processReceivedInstances();
+    if (this->numberOfPendingRetrieves() == 0)
+      {
+      return true;
+      }
+    qint64 remaining = 100;
+    if (msecs >= 0)
+      {
+      remaining = qMin(remaining, msecs - timer.elapsed());
+      if (remaining <= 0)
+        {
+        return false;
+        }
+      }
+    // Wait for received instances, without taking them yet
+    QMutexLocker locker(&d->Mutex);
+    if (d->ReceivedEntries.isEmpty())
+      {
+      d->Received.wait(&d->Mutex, static_cast<unsigned long>(remaining));
+      }
+    }
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMRetrieveScheduler::retrieveStudy( const QString& studyInstanceUID, int priority )
+{
+  Q_D(ctkDICOMRetrieveScheduler);
+  if (studyInstanceUID.isEmpty())
+    {
+    logger.error("Cannot retrieve study: Study Instance UID empty.");
+    return;
+    }
+  ctkDICOMRetrieveSchedulerJob job;
+  job.StudyInstanceUID = studyInstanceUID;
+  job.Priority = priority;
+  d->enqueue(job);
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMRetrieveScheduler::retrieveSeries( const QString& studyInstanceUID,
+                                                const QString& seriesInstanceUID, int priority )
+{
+  Q_D(ctkDICOMRetrieveScheduler);
+  if (studyInstanceUID.isEmpty() || seriesInstanceUID.isEmpty())
+    {
+    logger.error("Cannot retrieve series: Either Study or Series Instance UID empty.");
+    return;
+    }
+  ctkDICOMRetrieveSchedulerJob job;
+  job.StudyInstanceUID = studyInstanceUID;
+  job.SeriesInstanceUID = seriesInstanceUID;
+  job.Priority = priority;
+  d->enqueue(job);
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMRetrieveScheduler::setPriority( const QString& studyInstanceUID,
+                                             const QString& seriesInstanceUID, int priority )
+{
+  Q_D(ctkDICOMRetrieveScheduler);
+  QMutexLocker locker(&d->Mutex);
+  int index = -1;
+  for (int i = 0; i < d->Jobs.count() && index < 0; ++i)
+    {
+    if (d->Jobs[i].StudyInstanceUID == studyInstanceUID
+        && d->Jobs[i].SeriesInstanceUID == seriesInstanceUID)
+      {
+      index = i;
+      }
+    }
+  // the series may be retrieved as part of its study
+  for (int i = 0; i < d->Jobs.count() && index < 0; ++i)
+    {
+    if (d->Jobs[i].StudyInstanceUID == studyInstanceUID
+        && d->Jobs[i].SeriesInstanceUID.isEmpty())
+      {
+      index = i;
+      }
+    }
+  if (index < 0)
+    {
+    return false;
+    }
+  ctkDICOMRetrieveSchedulerJob job = d->Jobs.takeAt(index);
+  job.Priority = priority;
+  index = 0;
+  while (index < d->Jobs.count() && d->Jobs[index].Priority >= job.Priority)
+    {
+    ++index;
+    }
+  d->Jobs.insert(index, job);
+  return true;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMRetrieveScheduler::cancel()
+{
+  Q_D(ctkDICOMRetrieveScheduler);
+  QMutexLocker locker(&d->Mutex);
+  foreach(const ctkDICOMRetrieveSchedulerJob& job, d->Jobs)
+    {
+    ctkDICOMRetrieveSchedulerEntry entry;
+    entry.Dataset = 0;
+    entry.Job = job;
+    entry.Success = false;
+    d->ReceivedEntries.enqueue(entry);
+    }
+  d->Jobs.clear();
+  foreach(ctkDICOMRetrieve* retrieve, d->RunningRetrieves)
+    {
+    retrieve->cancel();
+    }
+  d->NotFull.wakeAll();
+  d->Received.wakeAll();
+  d->scheduleProcessing();
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMRetrieveScheduler::processReceivedInstances()
+{
+  Q_D(ctkDICOMRetrieveScheduler);
+  QList<ctkDICOMRetrieveSchedulerEntry> entries = d->takeReceived(0);
+  if (entries.isEmpty())
+    {
+    return;
+    }
+  if (d->Database)
+    {
+    d->Database->beginBatchInsert();
+    }
+  foreach(const ctkDICOMRetrieveSchedulerEntry& entry, entries)
+    {
+    if (entry.Dataset)
+      {
+      if (d->Database)
+        {
+        OFString sopInstanceUID;
+        entry.Dataset->findAndGetOFString(DCM_SOPInstanceUID, sopInstanceUID);
+        d->Database->insert(entry.Dataset);
+        emit instanceInserted(QString(sopInstanceUID.c_str()));
+        }
+      delete entry.Dataset;
+      }
+    }
+  if (d->Database)
+    {
+    d->Database->endBatchInsert();
+    }
+  // Report the finished retrieves once their instances are inserted
+  foreach(const ctkDICOMRetrieveSchedulerEntry& entry, entries)
+    {
+    if (!entry.Dataset)
+      {
+      int numberOfPendingRetrieves = 0;
+      {
+        QMutexLocker locker(&d->Mutex);
+        numberOfPendingRetrieves = --d->NumberOfPendingRetrieves;
+      }
+      if (!entry.Success)
+        {
+        logger.error("Retrieve failed for study " + entry.Job.StudyInstanceUID
+                     + " series " + entry.Job.SeriesInstanceUID);
+        }
+      emit retrieveFinished(entry.Job.StudyInstanceUID, entry.Job.SeriesInstanceUID, entry.Success);
+      if (numberOfPendingRetrieves == 0)
+        {
+        emit finished();
+        }
+      }
+    }
+}
@@ -0,0 +1,142 @@
+/*=========================================================================
+
+  Library:   CTK
+
+  Copyright (c) Kitware Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0.txt
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=========================================================================*/
+
+#ifndef __ctkDICOMRetrieveScheduler_h
+#define __ctkDICOMRetrieveScheduler_h
+
+// Qt includes
+#include <QObject>
+#include <QSharedPointer>
+
+#include "ctkDICOMCoreExport.h"
+
+// CTK Core includes
+#include "ctkDICOMDatabase.h"
+
+class ctkDICOMRetrieveSchedulerPrivate;
+
+/// \ingroup DICOM_Core
+///
+/// Retrieves studies and series from a peer host on several associations in parallel.
+///
+/// Retrieves are queued and run by up to maximumNumberOfAssociations workers,
+/// each using its own ctkDICOMRetrieve. Queued retrieves with a higher priority
+/// are started first, for example the series the user is currently viewing.
+///
+/// Instances received through CGET are handed over to the thread of the
+/// scheduler through a bounded queue and inserted into the database there,
+/// so that the network transfer is not slowed down by the database insertion.
+/// The queue is emptied when the event loop runs, or in waitForDone().
+class CTK_DICOM_CORE_EXPORT ctkDICOMRetrieveScheduler : public QObject
+{
+  Q_OBJECT
+  Q_PROPERTY(QString callingAETitle READ callingAETitle WRITE setCallingAETitle);
+  Q_PROPERTY(QString calledAETitle READ calledAETitle WRITE setCalledAETitle);
+  Q_PROPERTY(QString host READ host WRITE setHost);
+  Q_PROPERTY(int port READ port WRITE setPort);
+  Q_PROPERTY(QString moveDestinationAETitle READ moveDestinationAETitle WRITE setMoveDestinationAETitle);
+  Q_PROPERTY(bool preferCGET READ preferCGET WRITE setPreferCGET);
+  Q_PROPERTY(int maximumNumberOfAssociations READ maximumNumberOfAssociations WRITE setMaximumNumberOfAssociations);
+  Q_PROPERTY(int maximumNumberOfQueuedInstances READ maximumNumberOfQueuedInstances WRITE setMaximumNumberOfQueuedInstances);
+
+public:
+  explicit ctkDICOMRetrieveScheduler(QObject* parent = 0);
+  /// Cancel all retrieves and wait for the workers
+  virtual ~ctkDICOMRetrieveScheduler();
+
+  /// Connectivity, see ctkDICOMRetrieve.
+  /// Changes apply to the retrieves started afterwards.
+  Q_INVOKABLE void setCallingAETitle( const QString& callingAETitle );
+  Q_INVOKABLE QString callingAETitle() const;
+  Q_INVOKABLE void setCalledAETitle( const QString& calledAETitle );
+  Q_INVOKABLE QString calledAETitle() const;
+  Q_INVOKABLE void setHost( const QString& host );
+  Q_INVOKABLE QString host() const;
+  Q_INVOKABLE void setPort( int port );
+  Q_INVOKABLE int port() const;
+  Q_INVOKABLE void setMoveDestinationAETitle( const QString& moveDestinationAETitle );
+  Q_INVOKABLE QString moveDestinationAETitle() const;
+  /// Use CGET instead of CMOVE, so that the instances are inserted into the database.
+  /// Retrieves with CGET fail if no database is set.
+  /// true by default
+  Q_INVOKABLE void setPreferCGET( bool preferCGET );
+  Q_INVOKABLE bool preferCGET() const;
+
+  /// Maximum number of retrieves running in parallel, each on its own association.
+  /// 4 by default.
+  Q_INVOKABLE void setMaximumNumberOfAssociations( int maximumNumberOfAssociations );
+  Q_INVOKABLE int maximumNumberOfAssociations() const;
+  /// Maximum number of received instances waiting to be inserted into the database.
+  /// Workers stop receiving while the queue is full.
+  /// 64 by default.
+  Q_INVOKABLE void setMaximumNumberOfQueuedInstances( int maximumNumberOfQueuedInstances );
+  Q_INVOKABLE int maximumNumberOfQueuedInstances() const;
+
+  /// Database the instances received through CGET are inserted into.
+  /// It must be used from the thread of the scheduler only.
+  void setDatabase(QSharedPointer<ctkDICOMDatabase> dicomDatabase);
+  Q_INVOKABLE QSharedPointer<ctkDICOMDatabase> database()const;
+
+  /// Number of retrieves that are queued or running
+  Q_INVOKABLE int numberOfPendingRetrieves() const;
+
+  /// Insert received instances until all retrieves are finished
+  /// or until \a msecs milliseconds have passed (no time limit if negative).
+  /// \return true if all retrieves are finished
+  Q_INVOKABLE bool waitForDone(int msecs = -1);
+
+public Q_SLOTS:
+  /// Queue the retrieve of a study. Retrieves of higher \a priority are started first.
+  void retrieveStudy( const QString& studyInstanceUID, int priority = 0 );
+  /// Queue the retrieve of a series. Retrieves of higher \a priority are started first.
+  void retrieveSeries( const QString& studyInstanceUID, const QString& seriesInstanceUID,
+                       int priority = 0 );
+  /// Change the priority of a queued retrieve. If the series is not queued
+  /// on its own, the priority of the retrieve of its study is changed.
+  /// Leave \a seriesInstanceUID empty for the retrieve of the whole study.
+  /// \return false if no matching retrieve is queued
+  bool setPriority( const QString& studyInstanceUID, const QString& seriesInstanceUID,
+                    int priority );
+  /// Remove the queued retrieves and cancel the running ones
+  void cancel();
+
+Q_SIGNALS:
+  /// Emitted when a retrieve is finished and all its received instances are inserted.
+  /// \a seriesInstanceUID is empty for the retrieve of a study.
+  void retrieveFinished(const QString& studyInstanceUID, const QString& seriesInstanceUID,
+                        bool success);
+  /// Emitted after an instance received through CGET is inserted into the database
+  void instanceInserted(const QString& sopInstanceUID);
+  /// Emitted when no more retrieves are pending
+  void finished();
+
+protected Q_SLOTS:
+  /// Insert the received instances and report the finished retrieves
+  void processReceivedInstances();
+
+protected:
+  QScopedPointer<ctkDICOMRetrieveSchedulerPrivate> d_ptr;
+
+private:
+  Q_DECLARE_PRIVATE(ctkDICOMRetrieveScheduler);
+  Q_DISABLE_COPY(ctkDICOMRetrieveScheduler);
+};
+
+#endif
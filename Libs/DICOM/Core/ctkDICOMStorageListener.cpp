@@ -0,0 +1,638 @@
+/*=========================================================================
+
+  Library:   CTK
+
+  Copyright (c) Kitware Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0.txt
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=========================================================================*/
+
+// Qt includes
+#include <QMutex>
+#include <QQueue>
+#include <QRunnable>
+#include <QThreadPool>
+#include <QWaitCondition>
+
+// ctkDICOMCore includes
+#include "ctkDICOMStorageListener.h"
+#include "ctkLogger.h"
+
+// DCMTK includes
+#include <dcmtk/dcmnet/assoc.h>
+#include <dcmtk/dcmnet/dimse.h>
+#include <dcmtk/dcmdata/dcdatset.h>
+#include <dcmtk/dcmdata/dcdeftag.h>
+#include <dcmtk/dcmdata/dcuid.h>
+
+static ctkLogger logger("org.commontk.dicom.DICOMStorageListener");
+
+//------------------------------------------------------------------------------
+class ctkDICOMStorageListenerPrivate
+{
+  Q_DECLARE_PUBLIC(ctkDICOMStorageListener);
+
+protected:
+  ctkDICOMStorageListener* const q_ptr;
+
+  friend class ctkDICOMStorageListenerAssociationTask;
+
+public:
+  ctkDICOMStorageListenerPrivate(ctkDICOMStorageListener& obj);
+  ~ctkDICOMStorageListenerPrivate();
+
+  /// Called by the acceptor. Returns false if the maximum number of associations is reached.
+  bool addAssociation();
+  /// Called by the association workers
+  void removeAssociation();
+  /// Called by the association workers. Blocks while the queue is full.
+  /// Takes ownership of \a dataset.
+  void pushReceivedInstance(DcmDataset* dataset);
+  QList<DcmDataset*> takeReceivedInstances();
+  bool isStopping() const;
+  /// Called by the association workers
+  bool hasDatabase() const;
+
+  QString AETitle;
+  int Port;
+  int MaximumNumberOfAssociations;
+  int MaximumNumberOfQueuedInstances;
+  int DimseTimeout;
+  QSharedPointer<ctkDICOMDatabase> Database;
+
+  T_ASC_Network* Network;
+
+  mutable QMutex Mutex;
+  QWaitCondition NotFull;
+  QQueue<DcmDataset*> ReceivedInstances;
+  int NumberOfActiveAssociations;
+  int NumberOfReceivedInstances;
+  int NumberOfInsertedInstances;
+  bool Listening;
+  bool Stopping;
+  bool ProcessingScheduled;
+  QThreadPool Pool;
+};
+
+//------------------------------------------------------------------------------
+/// Serves a single association until it is released or aborted
+class ctkDICOMStorageListenerAssociationTask : public QRunnable
+{
+public:
+  ctkDICOMStorageListenerAssociationTask(ctkDICOMStorageListenerPrivate* listener,
+                                         T_ASC_Association* association)
+    : Listener(listener)
+    , Association(association)
+    , Refused(false)
+    {
+    }
+  virtual void run();
+
+  /// Refuses the received instance if there is no database to insert it into
+  static void storeProgress(void* callbackData, T_DIMSE_StoreProgress* progress,
+                            T_DIMSE_C_StoreRQ* request, char* imageFileName,
+                            DcmDataset** imageDataSet, T_DIMSE_C_StoreRSP* response,
+                            DcmDataset** statusDetail);
+
+protected:
+  ctkDICOMStorageListenerPrivate* Listener;
+  T_ASC_Association* Association;
+  /// Set by storeProgress() if the instance being received is refused
+  bool Refused;
+};
+
+//------------------------------------------------------------------------------
+/// Accepts associations and hands them over to association tasks
+class ctkDICOMStorageListenerAcceptTask : public QRunnable
+{
+public:
+  ctkDICOMStorageListenerAcceptTask(ctkDICOMStorageListenerPrivate* listener)
+    : Listener(listener)
+    {
+    }
+  virtual void run();
+
+protected:
+  /// \return false if the association has been rejected
+  bool negotiate(T_ASC_Association* association);
+
+  ctkDICOMStorageListenerPrivate* Listener;
+};
+
+//------------------------------------------------------------------------------
+bool ctkDICOMStorageListenerAcceptTask::negotiate(T_ASC_Association* association)
+{
+  QString aeTitle;
+  {
+    QMutexLocker locker(&this->Listener->Mutex);
+    aeTitle = this->Listener->AETitle;
+  }
+  T_ASC_RejectParameters rejection;
+  rejection.source = ASC_SOURCE_SERVICEUSER;
+  if (!aeTitle.isEmpty() && aeTitle != QString(association->params->DULparams.calledAPTitle).trimmed())
+    {
+    rejection.result = ASC_RESULT_REJECTEDPERMANENT;
+    rejection.reason = ASC_REASON_SU_CALLEDAETITLENOTRECOGNIZED;
+    ASC_rejectAssociation(association, &rejection);
+    return false;
+    }
+  if (!this->Listener->addAssociation())
+    {
+    // the sender may try again later
+    rejection.result = ASC_RESULT_REJECTEDTRANSIENT;
+    rejection.reason = ASC_REASON_SU_NOREASON;
+    ASC_rejectAssociation(association, &rejection);
+    return false;
+    }
+
+  const char* transferSyntaxes[] = {
+    UID_LittleEndianExplicitTransferSyntax,
+    UID_BigEndianExplicitTransferSyntax,
+    UID_LittleEndianImplicitTransferSyntax,
+    UID_DeflatedExplicitVRLittleEndianTransferSyntax,
+    UID_JPEGProcess1TransferSyntax,
+    UID_JPEGProcess2_4TransferSyntax,
+    UID_JPEGProcess14SV1TransferSyntax,
+    UID_JPEGLSLosslessTransferSyntax,
+    UID_JPEGLSLossyTransferSyntax,
+    UID_JPEG2000LosslessOnlyTransferSyntax,
+    UID_JPEG2000TransferSyntax,
+    UID_RLELosslessTransferSyntax };
+  int numberOfTransferSyntaxes = sizeof(transferSyntaxes) / sizeof(transferSyntaxes[0]);
+  const char* verificationSyntaxes[] = { UID_VerificationSOPClass };
+
+  OFCondition status = ASC_acceptContextsWithPreferredTransferSyntaxes(association->params,
+    verificationSyntaxes, 1, transferSyntaxes, numberOfTransferSyntaxes);
+  if (status.good())
+    {
+    status = ASC_acceptContextsWithPreferredTransferSyntaxes(association->params,
+      dcmAllStorageSOPClassUIDs, numberOfAllDcmStorageSOPClassUIDs,
+      transferSyntaxes, numberOfTransferSyntaxes);
+    }
+  if (status.good())
+    {
+    ASC_setAPTitles(association->params, NULL, NULL, association->params->DULparams.calledAPTitle);
+    status = ASC_acknowledgeAssociation(association);
+    }
+  if (status.bad())
+    {
+    logger.error(QString("Association negotiation failed: ") + status.text());
+    this->Listener->removeAssociation();
+    return false;
+    }
+  return true;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMStorageListenerAcceptTask::run()
+{
+  while (!this->Listener->isStopping())
+    {
+    T_ASC_Association* association = NULL;
+    // wake up every second to check whether the listener is stopped
+    OFCondition status = ASC_receiveAssociation(this->Listener->Network, &association,
+      ASC_DEFAULTMAXPDU, NULL, NULL, OFFalse, DUL_NOBLOCK, 1);
+    if (status.good() && this->negotiate(association))
+      {
+      this->Listener->Pool.start(new ctkDICOMStorageListenerAssociationTask(this->Listener, association));
+      continue;
+      }
+    if (status.bad() && status != DUL_NOASSOCIATIONREQUEST)
+      {
+      logger.error(QString("Receiving association failed: ") + status.text());
+      }
+    if (association)
+      {
+      ASC_dropAssociation(association);
+      ASC_destroyAssociation(&association);
+      }
+    }
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMStorageListenerAssociationTask::storeProgress(void* callbackData,
+  T_DIMSE_StoreProgress* progress, T_DIMSE_C_StoreRQ* request, char* imageFileName,
+  DcmDataset** imageDataSet, T_DIMSE_C_StoreRSP* response, DcmDataset** statusDetail)
+{
+  Q_UNUSED(request);
+  Q_UNUSED(imageFileName);
+  Q_UNUSED(imageDataSet);
+  Q_UNUSED(statusDetail);
+  ctkDICOMStorageListenerAssociationTask* task =
+    reinterpret_cast<ctkDICOMStorageListenerAssociationTask*>(callbackData);
+  if (progress->state == DIMSE_StoreEnd && !task->Listener->hasDatabase())
+    {
+    // the sender must not consider the instance as stored
+    response->DimseStatus = STATUS_STORE_Refused_OutOfResources;
+    task->Refused = true;
+    }
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMStorageListenerAssociationTask::run()
+{
+  ctkDICOMStorageListener* q = this->Listener->q_ptr;
+  QString callingAETitle = QString(this->Association->params->DULparams.callingAPTitle).trimmed();
+  emit q->associationAccepted(callingAETitle);
+  int dimseTimeout = q->dimseTimeout();
+
+  OFCondition status = EC_Normal;
+  while (status.good())
+    {
+    if (this->Listener->isStopping())
+      {
+      ASC_abortAssociation(this->Association);
+      break;
+      }
+    T_ASC_PresentationContextID presentationContextID;
+    T_DIMSE_Message message;
+    // wake up every second to check whether the listener is stopped
+    status = DIMSE_receiveCommand(this->Association, DIMSE_NONBLOCKING, 1,
+                                  &presentationContextID, &message, NULL);
+    if (status == DIMSE_NODATAAVAILABLE)
+      {
+      status = EC_Normal;
+      continue;
+      }
+    if (status.bad())
+      {
+      break;
+      }
+    if (message.CommandField == DIMSE_C_ECHO_RQ)
+      {
+      status = DIMSE_sendEchoResponse(this->Association, presentationContextID,
+                                      &message.msg.CEchoRQ, STATUS_Success, NULL);
+      }
+    else if (message.CommandField == DIMSE_C_STORE_RQ)
+      {
+      DcmDataset* dataset = NULL;
+      this->Refused = false;
+      // A stalled sender must not keep the worker, and therefore stop(), waiting forever.
+      // The transfer cannot be resumed once it has timed out, the association is aborted.
+      status = DIMSE_storeProvider(this->Association, presentationContextID, &message.msg.CStoreRQ,
+                                   NULL, OFFalse, &dataset,
+                                   &ctkDICOMStorageListenerAssociationTask::storeProgress,
+                                   this, DIMSE_NONBLOCKING, dimseTimeout);
+      if (status.good() && dataset && !this->Refused)
+        {
+        // Blocks while the queue is full. The next request is then not read,
+        // which throttles the sender.
+        this->Listener->pushReceivedInstance(dataset);
+        }
+      else
+        {
+        delete dataset;
+        }
+      }
+    else
+      {
+      logger.error(QString("Unsupported DIMSE command received: %1").arg(message.CommandField));
+      status = DIMSE_BADCOMMANDTYPE;
+      }
+    }
+
+  if (status == DUL_PEERREQUESTEDRELEASE)
+    {
+    ASC_acknowledgeRelease(this->Association);
+    }
+  else if (status.bad() && status != DUL_PEERABORTEDASSOCIATION)
+    {
+    emit q->error(QString("Association with %1 failed: %2").arg(callingAETitle).arg(status.text()));
+    ASC_abortAssociation(this->Association);
+    }
+  ASC_dropSCPAssociation(this->Association);
+  ASC_destroyAssociation(&this->Association);
+  this->Listener->removeAssociation();
+  emit q->associationReleased(callingAETitle);
+}
+
+//------------------------------------------------------------------------------
+// ctkDICOMStorageListenerPrivate methods
+
+//------------------------------------------------------------------------------
+ctkDICOMStorageListenerPrivate::ctkDICOMStorageListenerPrivate(ctkDICOMStorageListener& obj)
+  : q_ptr(&obj)
+  , Port(0)
+  , MaximumNumberOfAssociations(4)
+  , MaximumNumberOfQueuedInstances(64)
+  , DimseTimeout(30)
+  , Network(NULL)
+  , NumberOfActiveAssociations(0)
+  , NumberOfReceivedInstances(0)
+  , NumberOfInsertedInstances(0)
+  , Listening(false)
+  , Stopping(false)
+  , ProcessingScheduled(false)
+{
+}
+
+//------------------------------------------------------------------------------
+ctkDICOMStorageListenerPrivate::~ctkDICOMStorageListenerPrivate()
+{
+  qDeleteAll(this->ReceivedInstances);
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMStorageListenerPrivate::addAssociation()
+{
+  QMutexLocker locker(&this->Mutex);
+  if (this->NumberOfActiveAssociations >= this->MaximumNumberOfAssociations)
+    {
+    return false;
+    }
+  ++this->NumberOfActiveAssociations;
+  return true;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMStorageListenerPrivate::removeAssociation()
+{
+  QMutexLocker locker(&this->Mutex);
+  --this->NumberOfActiveAssociations;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMStorageListenerPrivate::pushReceivedInstance(DcmDataset* dataset)
+{
+  Q_Q(ctkDICOMStorageListener);
+  QMutexLocker locker(&this->Mutex);
+  while (this->ReceivedInstances.count() >= this->MaximumNumberOfQueuedInstances
+         && !this->Stopping)
+    {
+    this->NotFull.wait(&this->Mutex);
+    }
+  this->ReceivedInstances.enqueue(dataset);
+  ++this->NumberOfReceivedInstances;
+  if (!this->ProcessingScheduled)
+    {
+    this->ProcessingScheduled = true;
+    QMetaObject::invokeMethod(q, "processReceivedInstances", Qt::QueuedConnection);
+    }
+}
+
+//------------------------------------------------------------------------------
+QList<DcmDataset*> ctkDICOMStorageListenerPrivate::takeReceivedInstances()
+{
+  QMutexLocker locker(&this->Mutex);
+  QList<DcmDataset*> datasets = this->ReceivedInstances;
+  this->ReceivedInstances.clear();
+  this->ProcessingScheduled = false;
+  this->NotFull.wakeAll();
+  return datasets;
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMStorageListenerPrivate::isStopping() const
+{
+  QMutexLocker locker(&this->Mutex);
+  return this->Stopping;
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMStorageListenerPrivate::hasDatabase() const
+{
+  QMutexLocker locker(&this->Mutex);
+  return !this->Database.isNull();
+}
+
+//------------------------------------------------------------------------------
+// ctkDICOMStorageListener methods
+
+//------------------------------------------------------------------------------
+ctkDICOMStorageListener::ctkDICOMStorageListener(QObject* parent)
+  : QObject(parent)
+  , d_ptr(new ctkDICOMStorageListenerPrivate(*this))
+{
+}
+
+//------------------------------------------------------------------------------
+ctkDICOMStorageListener::~ctkDICOMStorageListener()
+{
+  this->stop();
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMStorageListener::setAETitle( const QString& aeTitle )
+{
+  Q_D(ctkDICOMStorageListener);
+  QMutexLocker locker(&d->Mutex);
+  d->AETitle = aeTitle;
+}
+
+//------------------------------------------------------------------------------
+QString ctkDICOMStorageListener::AETitle() const
+{
+  Q_D(const ctkDICOMStorageListener);
+  QMutexLocker locker(&d->Mutex);
+  return d->AETitle;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMStorageListener::setPort( int port )
+{
+  Q_D(ctkDICOMStorageListener);
+  d->Port = port;
+}
+
+//------------------------------------------------------------------------------
+int ctkDICOMStorageListener::port() const
+{
+  Q_D(const ctkDICOMStorageListener);
+  return d->Port;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMStorageListener::setMaximumNumberOfAssociations( int maximumNumberOfAssociations )
+{
+  Q_D(ctkDICOMStorageListener);
+  QMutexLocker locker(&d->Mutex);
+  d->MaximumNumberOfAssociations = qMax(1, maximumNumberOfAssociations);
+  // one more thread for accepting associations
+  d->Pool.setMaxThreadCount(qMax(d->Pool.maxThreadCount(), d->MaximumNumberOfAssociations + 1));
+}
+
+//------------------------------------------------------------------------------
+int ctkDICOMStorageListener::maximumNumberOfAssociations() const
+{
+  Q_D(const ctkDICOMStorageListener);
+  QMutexLocker locker(&d->Mutex);
+  return d->MaximumNumberOfAssociations;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMStorageListener::setMaximumNumberOfQueuedInstances( int maximumNumberOfQueuedInstances )
+{
+  Q_D(ctkDICOMStorageListener);
+  QMutexLocker locker(&d->Mutex);
+  d->MaximumNumberOfQueuedInstances = qMax(1, maximumNumberOfQueuedInstances);
+  d->NotFull.wakeAll();
+}
+
+//------------------------------------------------------------------------------
+int ctkDICOMStorageListener::maximumNumberOfQueuedInstances() const
+{
+  Q_D(const ctkDICOMStorageListener);
+  QMutexLocker locker(&d->Mutex);
+  return d->MaximumNumberOfQueuedInstances;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMStorageListener::setDimseTimeout( int dimseTimeout )
+{
+  Q_D(ctkDICOMStorageListener);
+  QMutexLocker locker(&d->Mutex);
+  d->DimseTimeout = qMax(1, dimseTimeout);
+}
+
+//------------------------------------------------------------------------------
+int ctkDICOMStorageListener::dimseTimeout() const
+{
+  Q_D(const ctkDICOMStorageListener);
+  QMutexLocker locker(&d->Mutex);
+  return d->DimseTimeout;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMStorageListener::setDatabase(QSharedPointer<ctkDICOMDatabase> dicomDatabase)
+{
+  Q_D(ctkDICOMStorageListener);
+  QMutexLocker locker(&d->Mutex);
+  d->Database = dicomDatabase;
+}
+
+//------------------------------------------------------------------------------
+QSharedPointer<ctkDICOMDatabase> ctkDICOMStorageListener::database()const
+{
+  Q_D(const ctkDICOMStorageListener);
+  QMutexLocker locker(&d->Mutex);
+  return d->Database;
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMStorageListener::start()
+{
+  Q_D(ctkDICOMStorageListener);
+  if (d->Listening)
+    {
+    return true;
+    }
+  if (!d->hasDatabase())
+    {
+    // received instances would be acknowledged and then dropped
+    logger.error("Cannot listen without database");
+    emit error("Cannot listen without database");
+    return false;
+    }
+  OFCondition status = ASC_initializeNetwork(NET_ACCEPTOR, d->Port, 30, &d->Network);
+  if (status.bad())
+    {
+    logger.error(QString("Cannot listen on port %1: %2").arg(d->Port).arg(status.text()));
+    emit error(QString("Cannot listen on port %1").arg(d->Port));
+    d->Network = NULL;
+    return false;
+    }
+  {
+    QMutexLocker locker(&d->Mutex);
+    d->Stopping = false;
+    d->NumberOfReceivedInstances = 0;
+    d->NumberOfInsertedInstances = 0;
+    d->Pool.setMaxThreadCount(d->MaximumNumberOfAssociations + 1);
+  }
+  d->Listening = true;
+  d->Pool.start(new ctkDICOMStorageListenerAcceptTask(d));
+  logger.info(QString("Listening on port %1").arg(d->Port));
+  return true;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMStorageListener::stop()
+{
+  Q_D(ctkDICOMStorageListener);
+  if (!d->Listening)
+    {
+    return;
+    }
+  {
+    QMutexLocker locker(&d->Mutex);
+    d->Stopping = true;
+    d->NotFull.wakeAll();
+  }
+  d->Pool.waitForDone();
+  ASC_dropNetwork(&d->Network);
+  d->Network = NULL;
+  d->Listening = false;
+  this->processReceivedInstances();
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMStorageListener::isListening() const
+{
+  Q_D(const ctkDICOMStorageListener);
+  return d->Listening;
+}
+
+//------------------------------------------------------------------------------
+int ctkDICOMStorageListener::numberOfActiveAssociations() const
+{
+  Q_D(const ctkDICOMStorageListener);
+  QMutexLocker locker(&d->Mutex);
+  return d->NumberOfActiveAssociations;
+}
+
+//------------------------------------------------------------------------------
+int ctkDICOMStorageListener::numberOfReceivedInstances() const
+{
+  Q_D(const ctkDICOMStorageListener);
+  QMutexLocker locker(&d->Mutex);
+  return d->NumberOfReceivedInstances;
+}
+
+//------------------------------------------------------------------------------
+int ctkDICOMStorageListener::numberOfInsertedInstances() const
+{
+  Q_D(const ctkDICOMStorageListener);
+  QMutexLocker locker(&d->Mutex);
+  return d->NumberOfInsertedInstances;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMStorageListener::processReceivedInstances()
+{
+  Q_D(ctkDICOMStorageListener);
+  QList<DcmDataset*> datasets = d->takeReceivedInstances();
+  if (datasets.isEmpty())
+    {
+    return;
+    }
+  QSharedPointer<ctkDICOMDatabase> database = this->database();
+  if (!database)
+    {
+    // only queued if there was a database when the instances were received
+    logger.error(QString("No database, %1 received instances are dropped").arg(datasets.count()));
+    qDeleteAll(datasets);
+    return;
+    }
+  database->beginBatchInsert();
+  foreach(DcmDataset* dataset, datasets)
+    {
+    database->insert(dataset, true /* store file */, true /* generate thumbnail */);
+    }
+  database->endBatchInsert();
+  qDeleteAll(datasets);
+  {
+    QMutexLocker locker(&d->Mutex);
+    d->NumberOfInsertedInstances += datasets.count();
+  }
+  emit instancesInserted(datasets.count());
+}
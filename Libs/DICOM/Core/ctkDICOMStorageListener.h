@@ -0,0 +1,131 @@
+/*=========================================================================
+
+  Library:   CTK
+
+  Copyright (c) Kitware Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0.txt
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=========================================================================*/
+
+#ifndef __ctkDICOMStorageListener_h
+#define __ctkDICOMStorageListener_h
+
+// Qt includes
+#include <QObject>
+#include <QSharedPointer>
+
+#include "ctkDICOMCoreExport.h"
+
+// CTK Core includes
+#include "ctkDICOMDatabase.h"
+
+class ctkDICOMStorageListenerPrivate;
+
+/// \ingroup DICOM_Core
+///
+/// DICOM storage SCP receiving instances sent by other nodes (C-STORE)
+/// and inserting them into a database.
+///
+/// Each association is served by its own worker thread, up to
+/// maximumNumberOfAssociations; further association requests are rejected
+/// as transient so that the sender retries later. Received datasets are
+/// handed over through a bounded queue to the thread of the listener, and
+/// inserted there in batches, without an intermediate file. While the queue
+/// is full, the workers stop reading from the network, which throttles the
+/// senders.
+/// The queue is emptied when the event loop runs, or by calling
+/// processReceivedInstances().
+class CTK_DICOM_CORE_EXPORT ctkDICOMStorageListener : public QObject
+{
+  Q_OBJECT
+  Q_PROPERTY(QString AETitle READ AETitle WRITE setAETitle);
+  Q_PROPERTY(int port READ port WRITE setPort);
+  Q_PROPERTY(int maximumNumberOfAssociations READ maximumNumberOfAssociations WRITE setMaximumNumberOfAssociations);
+  Q_PROPERTY(int maximumNumberOfQueuedInstances READ maximumNumberOfQueuedInstances WRITE setMaximumNumberOfQueuedInstances);
+  Q_PROPERTY(int dimseTimeout READ dimseTimeout WRITE setDimseTimeout);
+  Q_PROPERTY(bool listening READ isListening);
+
+public:
+  explicit ctkDICOMStorageListener(QObject* parent = 0);
+  /// Stop listening and insert the instances that are already received
+  virtual ~ctkDICOMStorageListener();
+
+  /// Application entity title of the listener. Associations calling another
+  /// AE title are rejected. Any called AE title is accepted if empty.
+  /// Empty by default
+  Q_INVOKABLE void setAETitle( const QString& aeTitle );
+  Q_INVOKABLE QString AETitle() const;
+  /// Port the listener accepts associations on, e.g. 11112.
+  /// 0 by default.
+  Q_INVOKABLE void setPort( int port );
+  Q_INVOKABLE int port() const;
+  /// Maximum number of associations that are served in parallel.
+  /// 4 by default.
+  Q_INVOKABLE void setMaximumNumberOfAssociations( int maximumNumberOfAssociations );
+  Q_INVOKABLE int maximumNumberOfAssociations() const;
+  /// Maximum number of received instances waiting to be inserted into the database.
+  /// 64 by default.
+  Q_INVOKABLE void setMaximumNumberOfQueuedInstances( int maximumNumberOfQueuedInstances );
+  Q_INVOKABLE int maximumNumberOfQueuedInstances() const;
+  /// Seconds that the transfer of a dataset may stall before the association
+  /// is aborted. This is also the longest time that stop() waits for a sender.
+  /// 30 by default.
+  Q_INVOKABLE void setDimseTimeout( int dimseTimeout );
+  Q_INVOKABLE int dimseTimeout() const;
+
+  /// Database the received instances are inserted into (and stored in its folder).
+  /// It must be used from the thread of the listener only.
+  /// Instances received while no database is set are refused.
+  void setDatabase(QSharedPointer<ctkDICOMDatabase> dicomDatabase);
+  Q_INVOKABLE QSharedPointer<ctkDICOMDatabase> database()const;
+
+  /// Start accepting associations.
+  /// \return false if no database is set or if the port cannot be opened
+  Q_INVOKABLE bool start();
+  /// Close the port, abort the open associations,
+  /// and insert the instances that are already received.
+  /// A dataset that is being transferred is received first (see dimseTimeout()).
+  Q_INVOKABLE void stop();
+  bool isListening() const;
+
+  /// Number of associations currently served
+  Q_INVOKABLE int numberOfActiveAssociations() const;
+  /// Number of instances received since start()
+  Q_INVOKABLE int numberOfReceivedInstances() const;
+  /// Number of received instances inserted into the database since start()
+  Q_INVOKABLE int numberOfInsertedInstances() const;
+
+public Q_SLOTS:
+  /// Insert the received instances into the database
+  void processReceivedInstances();
+
+Q_SIGNALS:
+  /// Emitted after a batch of received instances is inserted
+  void instancesInserted(int numberOfInstances);
+  void associationAccepted(const QString& callingAETitle);
+  void associationReleased(const QString& callingAETitle);
+  /// Emitted for errors of the network or of associations
+  void error(const QString& message);
+
+protected:
+  QScopedPointer<ctkDICOMStorageListenerPrivate> d_ptr;
+
+private:
+  Q_DECLARE_PRIVATE(ctkDICOMStorageListener);
+  Q_DISABLE_COPY(ctkDICOMStorageListener);
+
+  friend class ctkDICOMStorageListenerAssociationTask;  // for emitting signals
+};
+
+#endif
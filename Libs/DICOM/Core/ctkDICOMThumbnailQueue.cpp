@@ -0,0 +1,201 @@
+/*=========================================================================
+
+  Library:   CTK
+
+  Copyright (c) Kitware Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0.txt
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=========================================================================*/
+
+// Qt includes
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMetaObject>
+#include <QMutexLocker>
+#include <QThread>
+
+// ctkDICOM includes
+#include "ctkDICOMAbstractThumbnailGenerator.h"
+#include "ctkDICOMDatabase.h"
+#include "ctkDICOMThumbnailQueue_p.h"
+
+// DCMTK includes
+#include <dcmtk/dcmimgle/dcmimage.h>
+
+//------------------------------------------------------------------------------
+// ctkDICOMThumbnailTask methods
+
+//------------------------------------------------------------------------------
+ctkDICOMThumbnailTask::ctkDICOMThumbnailTask(ctkDICOMThumbnailQueue* queue,
+  ctkDICOMAbstractThumbnailGenerator* generator, const QString& sopInstanceUID,
+  const QString& filePath, const QString& thumbnailPath)
+  : Queue(queue)
+  , Generator(generator)
+  , SOPInstanceUID(sopInstanceUID)
+  , FilePath(filePath)
+  , ThumbnailPath(thumbnailPath)
+{
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMThumbnailTask::run()
+{
+  bool success = ctkDICOMThumbnailTask::generateThumbnail(this->Generator, this->FilePath, this->ThumbnailPath);
+  this->Queue->thumbnailDone(this->Generator, this->SOPInstanceUID, this->ThumbnailPath, success);
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMThumbnailTask::generateThumbnail(ctkDICOMAbstractThumbnailGenerator* generator,
+  const QString& filePath, const QString& thumbnailPath)
+{
+  QFileInfo thumbnailInfo(thumbnailPath);
+  if (thumbnailInfo.exists() && (thumbnailInfo.lastModified() > QFileInfo(filePath).lastModified()))
+  {
+    return true;
+  }
+  QDir().mkpath(thumbnailInfo.absolutePath());
+  DicomImage dcmImage(QDir::toNativeSeparators(filePath).toLatin1());
+  if (!generator->generateThumbnail(&dcmImage, thumbnailPath))
+  {
+    return false;
+  }
+  QFile::remove(ctkDICOMThumbnailTask::seriesAtlasPath(thumbnailInfo.absolutePath()));
+  return true;
+}
+
+//------------------------------------------------------------------------------
+QString ctkDICOMThumbnailTask::seriesAtlasPath(const QString& seriesThumbnailDirectory)
+{
+  return seriesThumbnailDirectory + ".atlas.png";
+}
+
+//------------------------------------------------------------------------------
+// ctkDICOMThumbnailQueue methods
+
+//------------------------------------------------------------------------------
+ctkDICOMThumbnailQueue::ctkDICOMThumbnailQueue(ctkDICOMDatabase* database)
+  : Database(database)
+{
+  // Leave threads for parsing and inserting the files being indexed
+  this->Pool.setMaxThreadCount(qMax(1, QThread::idealThreadCount() / 2));
+}
+
+//------------------------------------------------------------------------------
+ctkDICOMThumbnailQueue::~ctkDICOMThumbnailQueue()
+{
+  this->waitForDone();
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMThumbnailQueue::setMaximumThreadCount(int threadCount)
+{
+  this->Pool.setMaxThreadCount(qMax(1, threadCount));
+}
+
+//------------------------------------------------------------------------------
+int ctkDICOMThumbnailQueue::maximumThreadCount() const
+{
+  return this->Pool.maxThreadCount();
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMThumbnailQueue::enqueue(ctkDICOMAbstractThumbnailGenerator* generator,
+  const QString& sopInstanceUID, const QString& filePath, const QString& thumbnailPath)
+{
+  if (!generator)
+  {
+    return;
+  }
+  {
+    QMutexLocker locker(&this->Mutex);
+    QSet<QString>& seriesThumbnailPaths =
+      this->QueuedThumbnailPaths[QFileInfo(thumbnailPath).absolutePath()];
+    if (seriesThumbnailPaths.contains(thumbnailPath))
+    {
+      return;
+    }
+    seriesThumbnailPaths.insert(thumbnailPath);
+  }
+  this->Pool.start(new ctkDICOMThumbnailTask(this, generator, sopInstanceUID, filePath, thumbnailPath));
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMThumbnailQueue::waitForDone()
+{
+  this->Pool.waitForDone();
+}
+
+//------------------------------------------------------------------------------
+int ctkDICOMThumbnailQueue::numberOfQueuedThumbnails() const
+{
+  QMutexLocker locker(&this->Mutex);
+  int count = 0;
+  foreach(const QSet<QString>& seriesThumbnailPaths, this->QueuedThumbnailPaths)
+  {
+    count += seriesThumbnailPaths.size();
+  }
+  return count;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMThumbnailQueue::thumbnailDone(ctkDICOMAbstractThumbnailGenerator* generator,
+  const QString& sopInstanceUID, const QString& thumbnailPath, bool success)
+{
+  QString seriesThumbnailDirectory = QFileInfo(thumbnailPath).absolutePath();
+  bool seriesDone = false;
+  bool seriesUpdated = false;
+  {
+    QMutexLocker locker(&this->Mutex);
+    if (success)
+    {
+      this->UpdatedSeries.insert(seriesThumbnailDirectory);
+    }
+    QHash<QString, QSet<QString> >::iterator seriesIt = this->QueuedThumbnailPaths.find(seriesThumbnailDirectory);
+    if (seriesIt != this->QueuedThumbnailPaths.end())
+    {
+      seriesIt->remove(thumbnailPath);
+      if (seriesIt->isEmpty())
+      {
+        this->QueuedThumbnailPaths.erase(seriesIt);
+        seriesDone = true;
+        seriesUpdated = this->UpdatedSeries.remove(seriesThumbnailDirectory);
+      }
+    }
+  }
+  if (seriesDone && seriesUpdated)
+  {
+    QMutexLocker locker(&this->AtlasMutex);
+    generator->generateSeriesAtlas(seriesThumbnailDirectory,
+      ctkDICOMThumbnailTask::seriesAtlasPath(seriesThumbnailDirectory));
+  }
+  if (!this->Database)
+  {
+    return;
+  }
+  // Signals are emitted in the thread of the database
+  if (success)
+  {
+    QMetaObject::invokeMethod(this->Database, "thumbnailReady", Qt::QueuedConnection,
+      Q_ARG(QString, sopInstanceUID), Q_ARG(QString, thumbnailPath));
+  }
+  if (seriesDone && seriesUpdated)
+  {
+    // thumbs/StudyInstanceUID/SeriesInstanceUID
+    QFileInfo seriesInfo(seriesThumbnailDirectory);
+    QMetaObject::invokeMethod(this->Database, "seriesThumbnailsReady", Qt::QueuedConnection,
+      Q_ARG(QString, QFileInfo(seriesInfo.absolutePath()).fileName()),
+      Q_ARG(QString, seriesInfo.fileName()));
+  }
+}
@@ -0,0 +1,113 @@
+/*=========================================================================
+
+  Library:   CTK
+
+  Copyright (c) Kitware Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0.txt
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=========================================================================*/
+
+#ifndef __ctkDICOMThumbnailQueue_p_h
+#define __ctkDICOMThumbnailQueue_p_h
+
+// Qt includes
+#include <QHash>
+#include <QMutex>
+#include <QRunnable>
+#include <QSet>
+#include <QString>
+#include <QThreadPool>
+
+class ctkDICOMAbstractThumbnailGenerator;
+class ctkDICOMDatabase;
+class ctkDICOMThumbnailQueue;
+
+//------------------------------------------------------------------------------
+/// \ingroup DICOM_Core
+///
+/// Render the thumbnail of a single file, unless an up-to-date thumbnail exists.
+class ctkDICOMThumbnailTask : public QRunnable
+{
+public:
+  ctkDICOMThumbnailTask(ctkDICOMThumbnailQueue* queue, ctkDICOMAbstractThumbnailGenerator* generator,
+                        const QString& sopInstanceUID, const QString& filePath, const QString& thumbnailPath);
+  virtual void run();
+
+  /// Render the thumbnail of \a filePath to \a thumbnailPath, creating its directory if needed.
+  /// \return true if the thumbnail has been written
+  static bool generateThumbnail(ctkDICOMAbstractThumbnailGenerator* generator,
+                                const QString& filePath, const QString& thumbnailPath);
+
+  /// Path of the thumbnail atlas of the series whose thumbnails are in \a seriesThumbnailDirectory
+  /// (see ctkDICOMThumbnailAtlas). The atlas is removed whenever a thumbnail of the series changes.
+  static QString seriesAtlasPath(const QString& seriesThumbnailDirectory);
+
+protected:
+  ctkDICOMThumbnailQueue* Queue;
+  ctkDICOMAbstractThumbnailGenerator* Generator;
+  QString SOPInstanceUID;
+  QString FilePath;
+  QString ThumbnailPath;
+};
+
+//------------------------------------------------------------------------------
+/// \ingroup DICOM_Core
+///
+/// Generate thumbnails on a pool of background threads for ctkDICOMDatabase.
+/// Queued thumbnails are tracked per series: a thumbnail already waiting for its
+/// series is not queued again, and a series is reported once all its queued
+/// thumbnails are done, however many times its instances are queued meanwhile.
+/// Once a series is done, the generator packs its thumbnails into the series
+/// atlas (see ctkDICOMAbstractThumbnailGenerator::generateSeriesAtlas).
+/// ctkDICOMDatabase::thumbnailReady is emitted in the thread of the database
+/// for each generated thumbnail, and ctkDICOMDatabase::seriesThumbnailsReady
+/// once per completed series, after its atlas is written.
+class ctkDICOMThumbnailQueue
+{
+public:
+  ctkDICOMThumbnailQueue(ctkDICOMDatabase* database);
+  /// Wait for the queued thumbnails
+  ~ctkDICOMThumbnailQueue();
+
+  void setMaximumThreadCount(int threadCount);
+  int maximumThreadCount() const;
+
+  /// Queue the generation of a thumbnail. The generator must remain valid
+  /// until the thumbnail is generated and must be reentrant.
+  void enqueue(ctkDICOMAbstractThumbnailGenerator* generator, const QString& sopInstanceUID,
+               const QString& filePath, const QString& thumbnailPath);
+
+  /// Block until all queued thumbnails are generated
+  void waitForDone();
+
+  int numberOfQueuedThumbnails() const;
+
+protected:
+  friend class ctkDICOMThumbnailTask;
+  /// Called by the tasks. Generates the series atlas once the series is done.
+  void thumbnailDone(ctkDICOMAbstractThumbnailGenerator* generator,
+                     const QString& sopInstanceUID, const QString& thumbnailPath, bool success);
+
+  ctkDICOMDatabase* Database;
+  QThreadPool Pool;
+  mutable QMutex Mutex;
+  /// Paths of the queued thumbnails by series thumbnail directory
+  QHash<QString, QSet<QString> > QueuedThumbnailPaths;
+  /// Series thumbnail directories with at least one thumbnail generated since they were queued
+  QSet<QString> UpdatedSeries;
+  /// Serializes the writing of series atlases
+  QMutex AtlasMutex;
+};
+
+#endif
@@ -22,12 +22,15 @@
 // Qt includes
 #include <QApplication>
 #include <QLabel>
+#include <QTest>
 
 
 // ctkDICOMCore includes
 #include "ctkDICOMImage.h"
 
 // DCMTK includes
+#include <dcmtk/dcmdata/dcdatset.h>
+#include <dcmtk/dcmdata/dcdeftag.h>
 #include <dcmtk/dcmimgle/dcmimage.h>
 
 // STD includes
@@ -58,6 +61,88 @@ int ctkDICOMImageTest1( int argc, char * argv [] )
   qtImage.setPixmap(pixmap);
   qtImage.show();
 
+  // Cached frames
+  if (ctkImage.frame(0) != ctkImage.frame(0))
+    {
+    std::cerr << "Cached frame differs from the rendered frame" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // Raw pixels and window applied on them
+  QVector<quint16> pixels = ctkImage.rawFrame(0);
+  double minimum = 0.;
+  double maximum = 0.;
+  if (pixels.size() != static_cast<int>(dcmtkImage.getWidth() * dcmtkImage.getHeight())
+      || !ctkImage.rawFrameRange(minimum, maximum) || minimum >= maximum)
+    {
+    std::cerr << "Failed to get the raw pixels of the frame" << std::endl;
+    return EXIT_FAILURE;
+    }
+  QImage windowedImage = ctkImage.frame(0, (minimum + maximum) / 2., maximum - minimum);
+  if (windowedImage.size() != ctkImage.frame(0).size())
+    {
+    std::cerr << "Failed to apply a window on the raw pixels" << std::endl;
+    return EXIT_FAILURE;
+    }
+  // A window below the pixel values renders a white image
+  QImage whiteImage = ctkImage.frame(0, minimum - 1000., 10.);
+  if (whiteImage.isNull() || qGray(whiteImage.pixel(0, 0)) != 255)
+    {
+    std::cerr << "Window not applied on the raw pixels" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  ctkImage.clearFrameCache();
+  ctkImage.setFrameCacheSize(0);
+  if (ctkImage.frame(0).isNull())
+    {
+    std::cerr << "Failed to render a frame without cache" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // A single request of a multi-frame image doesn't prefetch the next frames
+  const int rows = 64;
+  const int columns = 64;
+  const int frameCount = 4;
+  QVector<Uint16> multiFramePixels(rows * columns * frameCount);
+  for (int i = 0; i < multiFramePixels.size(); ++i)
+    {
+    multiFramePixels[i] = static_cast<Uint16>(i % 4096);
+    }
+  DcmDataset multiFrameDataset;
+  multiFrameDataset.putAndInsertUint16(DCM_SamplesPerPixel, 1);
+  multiFrameDataset.putAndInsertString(DCM_PhotometricInterpretation, "MONOCHROME2");
+  multiFrameDataset.putAndInsertString(DCM_NumberOfFrames, QString::number(frameCount).toLatin1().constData());
+  multiFrameDataset.putAndInsertUint16(DCM_Rows, rows);
+  multiFrameDataset.putAndInsertUint16(DCM_Columns, columns);
+  multiFrameDataset.putAndInsertUint16(DCM_BitsAllocated, 16);
+  multiFrameDataset.putAndInsertUint16(DCM_BitsStored, 12);
+  multiFrameDataset.putAndInsertUint16(DCM_HighBit, 11);
+  multiFrameDataset.putAndInsertUint16(DCM_PixelRepresentation, 0);
+  multiFrameDataset.putAndInsertUint16Array(DCM_PixelData,
+    multiFramePixels.constData(), multiFramePixels.size());
+  DicomImage multiFrameDcmtkImage(&multiFrameDataset, EXS_LittleEndianExplicit);
+  if (multiFrameDcmtkImage.getFrameCount() != static_cast<unsigned long>(frameCount))
+    {
+    std::cerr << "Failed to create a multi-frame image" << std::endl;
+    return EXIT_FAILURE;
+    }
+  ctkDICOMImage multiFrameImage(&multiFrameDcmtkImage);
+  if (multiFrameImage.frame(0).isNull())
+    {
+    std::cerr << "Failed to render the first frame of a multi-frame image" << std::endl;
+    return EXIT_FAILURE;
+    }
+  // Give a prefetcher, if any, the time to render frames
+  QTest::qWait(200);
+  if (multiFrameImage.numberOfCachedFrames() != 1)
+    {
+    std::cerr << "A single frame request cached " << multiFrameImage.numberOfCachedFrames()
+              << " frames, expected 1" << std::endl;
+    return EXIT_FAILURE;
+    }
+  multiFrameImage.clearFrameCache();
+
   if (argc > 2 && QString(argv[2]) == "-I")
     {
     return app.exec();
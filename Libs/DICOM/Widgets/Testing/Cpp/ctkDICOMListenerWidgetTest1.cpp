@@ -24,6 +24,7 @@
 
 // ctkDICOMCore includes
 #include "ctkDICOMListenerWidget.h"
+#include "ctkDICOMStorageListener.h"
 
 // STD includes
 #include <iostream>
@@ -33,6 +34,11 @@ int ctkDICOMListenerWidgetTest1( int argc, char * argv [] )
   QApplication app(argc, argv);
 
   ctkDICOMListenerWidget listenerWidget;
+  if (!listenerWidget.listener() || listenerWidget.listener()->isListening())
+    {
+    std::cerr << "ctkDICOMListenerWidget::listener() failed" << std::endl;
+    return EXIT_FAILURE;
+    }
   listenerWidget.show();
 
   if (argc <= 1 || QString(argv[1]) != "-I")
@@ -0,0 +1,144 @@
+/*=============================================================================
+
+  Library: CTK
+
+  Copyright (c) German Cancer Research Center,
+    Division of Medical and Biological Informatics
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=============================================================================*/
+
+// Qt includes
+#include <QApplication>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QImage>
+
+// CTK includes
+#include "ctkUtils.h"
+
+// ctkDICOMWidgets includes
+#include "ctkDICOMThumbnailAtlas.h"
+#include "ctkDICOMThumbnailGenerator.h"
+
+// STD includes
+#include <iostream>
+#include <cstdlib>
+
+int ctkDICOMThumbnailAtlasTest1( int argc, char * argv [] )
+{
+  QApplication app(argc, argv);
+
+  QDir databaseDirectory = QDir::temp();
+  ctk::removeDirRecursively(databaseDirectory.absoluteFilePath("ctkDICOMThumbnailAtlasTest1"));
+  databaseDirectory.mkpath("ctkDICOMThumbnailAtlasTest1");
+  databaseDirectory.cd("ctkDICOMThumbnailAtlasTest1");
+  QString thumbnailDirectory = ctkDICOMThumbnailAtlas::thumbnailDirectory(
+    databaseDirectory.absolutePath(), "1.2.3", "1.2.3.4");
+  QDir().mkpath(thumbnailDirectory);
+
+  ctkDICOMThumbnailAtlas atlas;
+  if (atlas.load(databaseDirectory.absolutePath(), "1.2.3", "1.2.3.4") || !atlas.isNull())
+    {
+    std::cerr << "ctkDICOMThumbnailAtlas: atlas loaded without thumbnails" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // Thumbnails of different sizes and colors
+  QStringList sopInstanceUIDs;
+  for (int i = 0; i < 5; ++i)
+    {
+    QImage thumbnail(16 + i, 12, QImage::Format_RGB32);
+    thumbnail.fill(qRgb(40 * i, 0, 255 - 40 * i));
+    sopInstanceUIDs << QString("1.2.3.4.%1").arg(i);
+    thumbnail.save(thumbnailDirectory + "/" + sopInstanceUIDs.last() + ".png", "PNG");
+    }
+
+  if (!atlas.load(databaseDirectory.absolutePath(), "1.2.3", "1.2.3.4")
+    || atlas.sopInstanceUIDs() != sopInstanceUIDs
+    || !QFile::exists(ctkDICOMThumbnailAtlas::atlasPath(databaseDirectory.absolutePath(), "1.2.3", "1.2.3.4")))
+    {
+    std::cerr << "ctkDICOMThumbnailAtlas: failed to generate the atlas" << std::endl;
+    return EXIT_FAILURE;
+    }
+  for (int i = 0; i < 5; ++i)
+    {
+    QImage thumbnail = atlas.thumbnail(sopInstanceUIDs[i]);
+    if (thumbnail.size() != QSize(16 + i, 12)
+      || thumbnail.pixel(thumbnail.width() - 1, thumbnail.height() - 1) != qRgb(40 * i, 0, 255 - 40 * i))
+      {
+      std::cerr << "ctkDICOMThumbnailAtlas: wrong thumbnail " << i << std::endl;
+      return EXIT_FAILURE;
+      }
+    }
+  if (!atlas.thumbnail("1.2.3.4.5").isNull() || atlas.contains("1.2.3.4.5"))
+    {
+    std::cerr << "ctkDICOMThumbnailAtlas: unexpected thumbnail" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // Removing a thumbnail regenerates the atlas
+  QFile::remove(thumbnailDirectory + "/" + sopInstanceUIDs.takeLast() + ".png");
+  ctkDICOMThumbnailAtlas updatedAtlas;
+  if (!updatedAtlas.load(databaseDirectory.absolutePath(), "1.2.3", "1.2.3.4")
+    || updatedAtlas.sopInstanceUIDs() != sopInstanceUIDs)
+    {
+    std::cerr << "ctkDICOMThumbnailAtlas: atlas not updated" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // The thumbnail pipeline writes the atlas through the generator
+  QString atlasPath = ctkDICOMThumbnailAtlas::atlasPath(databaseDirectory.absolutePath(), "1.2.3", "1.2.3.4");
+  QFile::remove(atlasPath);
+  ctkDICOMThumbnailGenerator generator;
+  ctkDICOMThumbnailAtlas generatedAtlas;
+  if (!generator.generateSeriesAtlas(thumbnailDirectory, atlasPath)
+    || !generatedAtlas.load(atlasPath)
+    || generatedAtlas.sopInstanceUIDs() != sopInstanceUIDs)
+    {
+    std::cerr << "ctkDICOMThumbnailGenerator: failed to generate the series atlas" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // An atlas generated right after its thumbnails is loaded as is
+  QDateTime generated = QFileInfo(atlasPath).lastModified();
+  ctkDICOMThumbnailAtlas loadedAtlas;
+  if (!ctkDICOMThumbnailAtlas::isUpToDate(thumbnailDirectory, atlasPath)
+    || !loadedAtlas.load(databaseDirectory.absolutePath(), "1.2.3", "1.2.3.4")
+    || loadedAtlas.sopInstanceUIDs() != sopInstanceUIDs
+    || QFileInfo(atlasPath).lastModified() != generated)
+    {
+    std::cerr << "ctkDICOMThumbnailAtlas: freshly generated atlas generated again" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // Adding a thumbnail makes the atlas out of date
+  QImage addedThumbnail(16, 12, QImage::Format_RGB32);
+  addedThumbnail.fill(qRgb(0, 255, 0));
+  sopInstanceUIDs << "1.2.3.4.9";
+  addedThumbnail.save(thumbnailDirectory + "/" + sopInstanceUIDs.last() + ".png", "PNG");
+  if (ctkDICOMThumbnailAtlas::isUpToDate(thumbnailDirectory, atlasPath)
+    || !loadedAtlas.load(databaseDirectory.absolutePath(), "1.2.3", "1.2.3.4")
+    || loadedAtlas.sopInstanceUIDs() != sopInstanceUIDs)
+    {
+    std::cerr << "ctkDICOMThumbnailAtlas: atlas not updated with the added thumbnail" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  ctk::removeDirRecursively(databaseDirectory.absolutePath());
+
+  return EXIT_SUCCESS;
+}
@@ -112,6 +112,8 @@ ctkDICOMAppWidgetPrivate::ctkDICOMAppWidgetPrivate(ctkDICOMAppWidget* parent): q
   DICOMDatabase = QSharedPointer<ctkDICOMDatabase> (new ctkDICOMDatabase);
   ThumbnailGenerator = QSharedPointer <ctkDICOMThumbnailGenerator> (new ctkDICOMThumbnailGenerator);
   DICOMDatabase->setThumbnailGenerator(ThumbnailGenerator.data());
+  // The thumbnails widget is refreshed as the thumbnails are written
+  DICOMDatabase->setAsynchronousThumbnailGeneration(true);
   DICOMIndexer = QSharedPointer<ctkDICOMIndexer> (new ctkDICOMIndexer);
   IndexerProgress = 0;
   UpdateSchemaProgress = 0;
@@ -305,6 +307,11 @@ ctkDICOMAppWidget::ctkDICOMAppWidget(QWidget* _parent):Superclass(_parent),
 
   connect(d->ThumbnailsWidget, SIGNAL(selected(ctkThumbnailLabel)), this, SLOT(onThumbnailSelected(ctkThumbnailLabel)));
   connect(d->ThumbnailsWidget, SIGNAL(doubleClicked(ctkThumbnailLabel)), this, SLOT(onThumbnailDoubleClicked(ctkThumbnailLabel)));
+  // Thumbnails of inserted instances are generated in the background
+  connect(d->DICOMDatabase.data(), SIGNAL(thumbnailReady(QString,QString)),
+          d->ThumbnailsWidget, SLOT(onThumbnailReady(QString,QString)));
+  connect(d->DICOMDatabase.data(), SIGNAL(seriesThumbnailsReady(QString,QString)),
+          d->ThumbnailsWidget, SLOT(onSeriesThumbnailsReady(QString,QString)));
   connect(d->ImportDialog, SIGNAL(fileSelected(QString)),this,SLOT(onImportDirectory(QString)));
 
   connect(d->QueryRetrieveWidget, SIGNAL(canceled()), d->QueryRetrieveWidget, SLOT(hide()) );
@@ -315,6 +322,8 @@ ctkDICOMAppWidget::ctkDICOMAppWidget(QWidget* _parent):Superclass(_parent),
   connect(d->ImagePreview, SIGNAL(imageDisplayed(int,int)), this, SLOT(onImagePreviewDisplayed(int,int)));
 
   connect(d->SearchOption, SIGNAL(parameterChanged()), this, SLOT(onSearchParameterChanged()));
+  connect(&d->DICOMModel, SIGNAL(searchFinished()), this, SLOT(onSearchFinished()));
+  connect(&d->DICOMModel, SIGNAL(searchFailed(QString)), this, SLOT(onSearchFailed(QString)));
 
   connect(d->PlaySlider, SIGNAL(valueChanged(int)), d->ImagePreview, SLOT(displayImage(int)));
 }
@@ -989,8 +998,12 @@ void ctkDICOMAppWidget::onThumbnailWidthSliderValueChanged(int val){
 //----------------------------------------------------------------------------
 void ctkDICOMAppWidget::onSearchParameterChanged(){
   Q_D(ctkDICOMAppWidget);
-  d->DICOMModel.setDatabase(d->DICOMDatabase->database(), d->SearchOption->parameters());
+  d->DICOMModel.setSearchParameters(d->SearchOption->parameters());
+}
 
+//----------------------------------------------------------------------------
+void ctkDICOMAppWidget::onSearchFinished(){
+  Q_D(ctkDICOMAppWidget);
   this->onModelSelected(d->DICOMModel.index(0,0));
   d->ThumbnailsWidget->clearThumbnails();
   d->ThumbnailsWidget->addThumbnails(d->DICOMModel.index(0,0));
@@ -998,6 +1011,13 @@ void ctkDICOMAppWidget::onSearchParameterChanged(){
   d->ImagePreview->onModelSelected(d->DICOMModel.index(0,0));
 }
 
+//----------------------------------------------------------------------------
+void ctkDICOMAppWidget::onSearchFailed(const QString& error){
+  // The model still shows the results of the previous search
+  QMessageBox::warning(this, tr("DICOM Search"),
+    tr("The database could not be searched:\n%1").arg(error));
+}
+
 //----------------------------------------------------------------------------
 void ctkDICOMAppWidget::onImagePreviewDisplayed(int imageID, int count){
   Q_D(ctkDICOMAppWidget);
@@ -151,6 +151,12 @@ protected Q_SLOTS:
     /// To be called when search parameters in query widget changed
     void onSearchParameterChanged();
 
+    /// To be called when the model is populated with the search results
+    void onSearchFinished();
+
+    /// To be called when the search could not be run
+    void onSearchFailed(const QString& error);
+
     /// To be called after image preview displayed an image
     void onImagePreviewDisplayed(int imageID, int count);
 
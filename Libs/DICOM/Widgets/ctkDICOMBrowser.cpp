@@ -45,6 +45,7 @@
 
 // ctkDICOMCore includes
 #include "ctkDICOMDatabase.h"
+#include "ctkDICOMExporter.h"
 #include "ctkDICOMIndexer.h"
 
 // ctkDICOMWidgets includes
@@ -80,6 +81,7 @@ public:
 
   QSharedPointer<ctkDICOMDatabase> DICOMDatabase;
   QSharedPointer<ctkDICOMIndexer> DICOMIndexer;
+  QSharedPointer<ctkDICOMExporter> DICOMExporter;
   QProgressDialog *IndexerProgress;
   QProgressDialog *UpdateSchemaProgress;
   QProgressDialog *UpdateDisplayedFieldsProgress;
@@ -87,6 +89,12 @@ public:
 
   void showIndexerDialog();
   void showUpdateSchemaDialog();
+  void showExportDialog();
+  void showExportError(const QString& errorString);
+  /// Start the export of the series, studies or patients \a uids with \a exportMethod.
+  /// The files of their series are looked up by the exporter.
+  void startExport(const QString& dirPath, const QStringList& uids,
+                   bool (ctkDICOMExporter::*exportMethod)(const QString&, const QStringList&));
 
   // used when suspending the ctkDICOMModel
   QSqlDatabase EmptyDatabase;
@@ -141,6 +149,7 @@ ctkDICOMBrowserPrivate::ctkDICOMBrowserPrivate(ctkDICOMBrowser* parent): q_ptr(p
   QueryRetrieveWidget = 0;
   DICOMDatabase = QSharedPointer<ctkDICOMDatabase> (new ctkDICOMDatabase);
   DICOMIndexer = QSharedPointer<ctkDICOMIndexer> (new ctkDICOMIndexer);
+  DICOMExporter = QSharedPointer<ctkDICOMExporter> (new ctkDICOMExporter);
   IndexerProgress = 0;
   UpdateSchemaProgress = 0;
   UpdateDisplayedFieldsProgress = 0;
@@ -241,6 +250,62 @@ void ctkDICOMBrowserPrivate::showIndexerDialog()
   IndexerProgress->show();
 }
 
+//----------------------------------------------------------------------------
+void ctkDICOMBrowserPrivate::showExportDialog()
+{
+  Q_Q(ctkDICOMBrowser);
+  if (ExportProgress == 0)
+  {
+    //
+    // Set up the Export Progress Dialog
+    //
+    ExportProgress = new QProgressDialog(q->tr("DICOM Export"), "Cancel", 0, 100, q,
+         Qt::WindowTitleHint | Qt::WindowSystemMenuHint);
+    ExportProgress->setWindowModality(Qt::ApplicationModal);
+    ExportProgress->setMinimumDuration(0);
+
+    q->connect(DICOMExporter.data(), SIGNAL(progress(int)), ExportProgress, SLOT(setValue(int)));
+    // stop copying files if canceled
+    q->connect(ExportProgress, SIGNAL(canceled()), DICOMExporter.data(), SLOT(cancel()));
+    // close the dialog and report errors
+    q->connect(DICOMExporter.data(), SIGNAL(finished(bool)), q, SLOT(onExportFinished(bool)));
+  }
+  int numberOfFiles = DICOMExporter->numberOfFiles();
+  ExportProgress->reset();
+  ExportProgress->setLabelText(q->tr("Exporting %1 files").arg(numberOfFiles));
+  ExportProgress->setMaximum(numberOfFiles);
+  ExportProgress->setValue(0);
+  ExportProgress->show();
+}
+
+//----------------------------------------------------------------------------
+void ctkDICOMBrowserPrivate::startExport(const QString& dirPath, const QStringList& uids,
+  bool (ctkDICOMExporter::*exportMethod)(const QString&, const QStringList&))
+{
+  Q_Q(ctkDICOMBrowser);
+  if (this->DICOMExporter->isRunning())
+  {
+    this->showExportError(q->tr("An export is already running."));
+    return;
+  }
+  this->DICOMExporter->setDatabase(this->DICOMDatabase.data());
+  if (!(this->DICOMExporter.data()->*exportMethod)(dirPath, uids))
+  {
+    this->showExportError(this->DICOMExporter->errorString());
+    return;
+  }
+  this->showExportDialog();
+}
+
+//----------------------------------------------------------------------------
+void ctkDICOMBrowserPrivate::showExportError(const QString& errorString)
+{
+  ctkMessageBox exportErrorMessageBox;
+  exportErrorMessageBox.setText(errorString + QString("\n\nHalting export."));
+  exportErrorMessageBox.setIcon(QMessageBox::Warning);
+  exportErrorMessageBox.exec();
+}
+
 //----------------------------------------------------------------------------
 // ctkDICOMBrowser methods
 
@@ -1218,165 +1283,35 @@ void ctkDICOMBrowser::onSeriesRightClicked(const QPoint &point)
 void ctkDICOMBrowser::exportSelectedSeries(QString dirPath, QStringList uids)
 {
   Q_D(ctkDICOMBrowser);
-
-  foreach (const QString& uid, uids)
-  {
-    QStringList filesForSeries = d->DICOMDatabase->filesForSeries(uid);
-
-    // Use the first file to get the overall series information
-    QString firstFilePath = filesForSeries[0];
-    QHash<QString,QString> descriptions (d->DICOMDatabase->descriptionsForFile(firstFilePath));
-    QString patientName = descriptions["PatientsName"];
-    QString patientIDTag = QString("0010,0020");
-    QString patientID = d->DICOMDatabase->fileValue(firstFilePath, patientIDTag);
-    QString studyDescription = descriptions["StudyDescription"];
-    QString seriesDescription = descriptions["SeriesDescription"];
-    QString studyDateTag = QString("0008,0020");
-    QString studyDate = d->DICOMDatabase->fileValue(firstFilePath,studyDateTag);
-    QString seriesNumberTag = QString("0020,0011");
-    QString seriesNumber = d->DICOMDatabase->fileValue(firstFilePath,seriesNumberTag);
-
-    QString sep = "/";
-    QString nameSep = "-";
-    QString destinationDir = dirPath + sep + patientID;
-    if (!patientName.isEmpty())
-    {
-      destinationDir += nameSep + patientName;
-    }
-    destinationDir += sep + studyDate;
-    if (!studyDescription.isEmpty())
-    {
-      destinationDir += nameSep + studyDescription;
-    }
-    destinationDir += sep + seriesNumber;
-    if (!seriesDescription.isEmpty())
-    {
-      destinationDir += nameSep + seriesDescription;
-    }
-    destinationDir += sep;
-
-    // make sure only ascii characters are in the directory path
-    destinationDir = destinationDir.toLatin1();
-    // replace any question marks that were used as replacements for non ascii
-    // characters with underscore
-    destinationDir.replace("?", "_");
-
-    // create the destination directory if necessary
-    if (!QDir().exists(destinationDir))
-    {
-      if (!QDir().mkpath(destinationDir))
-      {
-        QString errorString =
-          QString("Unable to create export destination directory:\n\n")
-          + destinationDir
-          + QString("\n\nHalting export.");
-        ctkMessageBox createDirectoryErrorMessageBox;
-        createDirectoryErrorMessageBox.setText(errorString);
-        createDirectoryErrorMessageBox.setIcon(QMessageBox::Warning);
-        createDirectoryErrorMessageBox.exec();
-        return;
-      }
-    }
-
-    // show progress
-    if (d->ExportProgress == 0)
-    {
-      d->ExportProgress = new QProgressDialog(this->tr("DICOM Export"), "Close", 0, 100, this, Qt::WindowTitleHint | Qt::WindowSystemMenuHint);
-      d->ExportProgress->setWindowModality(Qt::ApplicationModal);
-      d->ExportProgress->setMinimumDuration(0);
-    }
-    QLabel *exportLabel = new QLabel(this->tr("Exporting series ") + seriesNumber);
-    d->ExportProgress->setLabel(exportLabel);
-    d->ExportProgress->setValue(0);
-
-    int fileNumber = 0;
-    int numFiles = filesForSeries.size();
-    d->ExportProgress->setMaximum(numFiles);
-    foreach (const QString& filePath, filesForSeries)
-    {
-      QString destinationFileName = destinationDir;
-
-      QString fileNumberString;
-      // sequentially number the files
-      fileNumberString.sprintf("%06d", fileNumber);
-
-      destinationFileName += fileNumberString + QString(".dcm");
-
-      // replace non ASCII characters
-      destinationFileName = destinationFileName.toLatin1();
-      // replace any question marks that were used as replacements for non ascii
-      // characters with underscore
-      destinationFileName.replace("?", "_");
-
-      if (!QFile::exists(filePath))
-      {
-        d->ExportProgress->setValue(numFiles);
-        QString errorString = QString("Export source file not found:\n\n")
-          + filePath
-          + QString("\n\nHalting export.\n\nError may be fixed via Repair.");
-        ctkMessageBox copyErrorMessageBox;
-        copyErrorMessageBox.setText(errorString);
-        copyErrorMessageBox.setIcon(QMessageBox::Warning);
-        copyErrorMessageBox.exec();
-        return;
-      }
-      if (QFile::exists(destinationFileName))
-      {
-        d->ExportProgress->setValue(numFiles);
-        QString errorString = QString("Export destination file already exists:\n\n")
-          + destinationFileName
-          + QString("\n\nHalting export.");
-        ctkMessageBox copyErrorMessageBox;
-        copyErrorMessageBox.setText(errorString);
-        copyErrorMessageBox.setIcon(QMessageBox::Warning);
-        copyErrorMessageBox.exec();
-        return;
-      }
-
-      bool copyResult = QFile::copy(filePath, destinationFileName);
-      if (!copyResult)
-      {
-        d->ExportProgress->setValue(numFiles);
-        QString errorString = QString("Failed to copy\n\n")
-          + filePath
-          + QString("\n\nto\n\n")
-          + destinationFileName
-          + QString("\n\nHalting export.");
-        ctkMessageBox copyErrorMessageBox;
-        copyErrorMessageBox.setText(errorString);
-        copyErrorMessageBox.setIcon(QMessageBox::Warning);
-        copyErrorMessageBox.exec();
-        return;
-        }
-
-      fileNumber++;
-      d->ExportProgress->setValue(fileNumber);
-    }
-    d->ExportProgress->setValue(numFiles);
-  }
+  d->startExport(dirPath, uids, &ctkDICOMExporter::exportSeries);
 }
 
 //----------------------------------------------------------------------------
 void ctkDICOMBrowser::exportSelectedStudies(QString dirPath, QStringList uids)
 {
   Q_D(ctkDICOMBrowser);
-
-  foreach (const QString& uid, uids)
-  {
-    QStringList seriesUIDs = d->DICOMDatabase->seriesForStudy(uid);
-    this->exportSelectedSeries(dirPath, seriesUIDs);
-  }
+  d->startExport(dirPath, uids, &ctkDICOMExporter::exportStudies);
 }
 
 //----------------------------------------------------------------------------
 void ctkDICOMBrowser::exportSelectedPatients(QString dirPath, QStringList uids)
+{
+  Q_D(ctkDICOMBrowser);
+  d->startExport(dirPath, uids, &ctkDICOMExporter::exportPatients);
+}
+
+//----------------------------------------------------------------------------
+void ctkDICOMBrowser::onExportFinished(bool success)
 {
   Q_D(ctkDICOMBrowser);
 
-  foreach (const QString& uid, uids)
+  if (d->ExportProgress)
+  {
+    d->ExportProgress->reset();
+  }
+  if (!success && !d->DICOMExporter->wasCanceled())
   {
-    QStringList studiesUIDs = d->DICOMDatabase->studiesForPatient(uid);
-    this->exportSelectedStudies(dirPath, studiesUIDs);
+    d->showExportError(d->DICOMExporter->errorString());
   }
 }
 
@@ -246,7 +246,8 @@ protected Q_SLOTS:
     /// Called when a right mouse click is made in the series table
     void onSeriesRightClicked(const QPoint &point);
 
-    /// Called to export the series associated with the selected UIDs
+    /// Called to export the series associated with the selected UIDs.
+    /// Files are copied in the background, see ctkDICOMExporter.
     /// \sa exportSelectedStudies, exportSelectedPatients
     void exportSelectedSeries(QString dirPath, QStringList uids);
     /// Called to export the studies associated with the selected UIDs
@@ -255,6 +256,8 @@ protected Q_SLOTS:
     /// Called to export the patients associated with the selected UIDs
     /// \sa exportSelectedStudies, exportSelectedSeries
     void exportSelectedPatients(QString dirPath, QStringList uids);
+    /// Called when the files of the selected UIDs are exported
+    void onExportFinished(bool success);
 
     /// To be called when dialog finishes
     void onQueryRetrieveFinished();
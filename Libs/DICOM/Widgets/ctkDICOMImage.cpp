@@ -20,8 +20,13 @@
 =========================================================================*/
 
 // Qt includes
+#include <QAtomicInt>
+#include <QCache>
 #include <QDebug>
+#include <QMutex>
+#include <QRunnable>
 #include <QString>
+#include <QThreadPool>
 
 // ctkDICOMCore includes
 #include "ctkDICOMImage.h"
@@ -29,11 +34,41 @@
 
 // DCMTK includes
 #include <dcmtk/dcmimgle/dcmimage.h>
+#include <dcmtk/dcmimgle/dipixel.h>
 #include <dcmtk/ofstd/ofbmanip.h>
 
 static ctkLogger logger ( "org.commontk.dicom.DICOMImage" );
 struct Node;
 
+//------------------------------------------------------------------------------
+/// Cached renderings of a frame
+struct ctkDICOMImageFrame
+{
+  ctkDICOMImageFrame()
+    : HasWindow(false)
+    , WindowCenter(0.)
+    , WindowWidth(0.)
+    {
+    }
+
+  /// Size in kilobytes, used as cost in the cache
+  int cost() const
+    {
+    return (this->Image.bytesPerLine() * this->Image.height()
+            + this->Pixels.size() * static_cast<int>(sizeof(quint16))) / 1024 + 1;
+    }
+
+  /// Rendered with the VOI transformation of the DicomImage
+  QImage Image;
+  /// Window of the DicomImage when Image was rendered, if any
+  bool HasWindow;
+  double WindowCenter;
+  double WindowWidth;
+
+  /// See ctkDICOMImage::rawFrame()
+  QVector<quint16> Pixels;
+};
+
 //------------------------------------------------------------------------------
 class ctkDICOMImagePrivate
 {
@@ -41,8 +76,37 @@ class ctkDICOMImagePrivate
 public:
   ctkDICOMImagePrivate(ctkDICOMImage&);
 
+  /// Return true and set the window if the VOI transformation is a window.
+  /// DicomMutex must be locked.
+  bool window(double& center, double& width) const;
+  /// DicomMutex must be locked.
+  QImage renderFrame(int frame) const;
+  /// DicomMutex must be locked.
+  QVector<quint16> renderRawFrame(int frame) const;
+
+  /// Return the cached frame if it was rendered with the given window
+  bool cachedImage(int frame, bool hasWindow, double center, double width, QImage& image) const;
+  bool cachedPixels(int frame, QVector<quint16>& pixels) const;
+  void cacheImage(int frame, const QImage& image, bool hasWindow, double center, double width) const;
+  void cachePixels(int frame, const QVector<quint16>& pixels) const;
+
+  /// Start rendering the frames following \a frame in the scroll direction
+  void prefetch(int frame, bool raw) const;
+  void stopPrefetch() const;
+
   ::DicomImage* DicomImage;
 
+  /// Protects the DicomImage, used by the prefetcher
+  mutable QMutex DicomMutex;
+  mutable QMutex CacheMutex;
+  mutable QCache<int, ctkDICOMImageFrame> Frames;
+
+  int PrefetchCount;
+  mutable int LastFrame;
+  mutable int PrefetchDirection;
+  mutable QAtomicInt PrefetchGeneration;
+  mutable QThreadPool PrefetchPool;
+
 protected:
   ctkDICOMImage* const q_ptr;
 
@@ -51,8 +115,299 @@ private:
 };
 
 //------------------------------------------------------------------------------
-ctkDICOMImagePrivate::ctkDICOMImagePrivate(ctkDICOMImage& o):q_ptr(&o)
+/// Renders frames in advance until it is superseded by another prefetch
+class ctkDICOMImagePrefetcher : public QRunnable
+{
+public:
+  ctkDICOMImagePrefetcher(const ctkDICOMImagePrivate* image, int generation)
+    : Image(image)
+    , Generation(generation)
+    , Raw(false)
+    {
+    }
+  virtual void run();
+
+  const ctkDICOMImagePrivate* Image;
+  int Generation;
+  QList<int> Frames;
+  bool Raw;
+};
+
+//------------------------------------------------------------------------------
+void ctkDICOMImagePrefetcher::run()
+{
+  foreach (int frame, this->Frames)
+    {
+    if (this->Image->PrefetchGeneration.fetchAndAddOrdered(0) != this->Generation)
+      {
+      return;
+      }
+    if (this->Raw)
+      {
+      QVector<quint16> pixels;
+      if (this->Image->cachedPixels(frame, pixels))
+        {
+        continue;
+        }
+      {
+        QMutexLocker locker(&this->Image->DicomMutex);
+        pixels = this->Image->renderRawFrame(frame);
+      }
+      this->Image->cachePixels(frame, pixels);
+      }
+    else
+      {
+      QImage image;
+      double center = 0.;
+      double width = 0.;
+      bool hasWindow = false;
+      {
+        QMutexLocker locker(&this->Image->DicomMutex);
+        hasWindow = this->Image->window(center, width);
+        if (this->Image->cachedImage(frame, hasWindow, center, width, image))
+          {
+          continue;
+          }
+        image = this->Image->renderFrame(frame);
+      }
+      this->Image->cacheImage(frame, image, hasWindow, center, width);
+      }
+    }
+}
+
+//------------------------------------------------------------------------------
+/// Map the pixel values of a frame to 16 bits
+template <class T>
+static void ctkDICOMImageScalePixels(const void* data, unsigned long offset, unsigned long count,
+                                     double minimum, double scale, quint16* pixels)
 {
+  const T* values = static_cast<const T*>(data) + offset;
+  for (unsigned long i = 0; i < count; ++i)
+    {
+    double value = (static_cast<double>(values[i]) - minimum) * scale + 0.5;
+    pixels[i] = static_cast<quint16>(qBound(0., value, 65535.));
+    }
+}
+
+//------------------------------------------------------------------------------
+ctkDICOMImagePrivate::ctkDICOMImagePrivate(ctkDICOMImage& o)
+  : DicomImage(0)
+  , Frames(65536)
+  , PrefetchCount(8)
+  , LastFrame(-1)
+  , PrefetchDirection(1)
+  , PrefetchGeneration(0)
+  , q_ptr(&o)
+{
+  this->PrefetchPool.setMaxThreadCount(1);
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMImagePrivate::window(double& center, double& width) const
+{
+  return this->DicomImage && this->DicomImage->isMonochrome()
+    && this->DicomImage->getWindow(center, width);
+}
+
+//------------------------------------------------------------------------------
+QImage ctkDICOMImagePrivate::renderFrame(int frame) const
+{
+  // this way of converting the dicom image to a qpixmap was adopted from some code from
+  // the DCMTK forum, posted by Joerg Riesmayer, see http://forum.dcmtk.org/viewtopic.php?t=120
+  QImage image;
+  if ((this->DicomImage != NULL) && (this->DicomImage->getStatus() == EIS_Normal))
+    {
+    /* get image extension */
+    const unsigned long width = this->DicomImage->getWidth();
+    const unsigned long height = this->DicomImage->getHeight();
+    QString header = QString("P5 %1 %2 255\n").arg(width).arg(height);
+    const unsigned long offset = header.length();
+    const unsigned long length = width * height + offset;
+    /* create output buffer for DicomImage class */
+    QByteArray buffer;
+    buffer.append(header);
+    buffer.resize(length);
+
+    /* copy PGM header to buffer */
+
+    if (this->DicomImage->getOutputData(static_cast<void *>(buffer.data() + offset), length - offset, 8, frame))
+      {
+
+      if (!image.loadFromData( buffer ))
+        {
+        logger.error("QImage couldn't created");
+        }
+      }
+    }
+  return image;
+}
+
+//------------------------------------------------------------------------------
+QVector<quint16> ctkDICOMImagePrivate::renderRawFrame(int frame) const
+{
+  QVector<quint16> pixels;
+  if (!this->DicomImage || this->DicomImage->getStatus() != EIS_Normal
+      || !this->DicomImage->isMonochrome())
+    {
+    return pixels;
+    }
+  // The intermediate data holds the modality values of all the frames
+  const DiPixel* interData = this->DicomImage->getInterData();
+  const unsigned long count = this->DicomImage->getWidth() * this->DicomImage->getHeight();
+  const unsigned long offset = static_cast<unsigned long>(frame) * count;
+  double minimum = 0.;
+  double maximum = 0.;
+  if (!interData || interData->getData() == NULL || frame < 0
+      || offset + count > interData->getCount()
+      || !this->DicomImage->getMinMaxValues(minimum, maximum))
+    {
+    return pixels;
+    }
+  const double scale = maximum > minimum ? 65535. / (maximum - minimum) : 0.;
+  pixels.resize(static_cast<int>(count));
+  const void* data = interData->getData();
+  switch (interData->getRepresentation())
+    {
+    case EPR_Uint8:
+      ctkDICOMImageScalePixels<Uint8>(data, offset, count, minimum, scale, pixels.data());
+      break;
+    case EPR_Sint8:
+      ctkDICOMImageScalePixels<Sint8>(data, offset, count, minimum, scale, pixels.data());
+      break;
+    case EPR_Uint16:
+      ctkDICOMImageScalePixels<Uint16>(data, offset, count, minimum, scale, pixels.data());
+      break;
+    case EPR_Sint16:
+      ctkDICOMImageScalePixels<Sint16>(data, offset, count, minimum, scale, pixels.data());
+      break;
+    case EPR_Uint32:
+      ctkDICOMImageScalePixels<Uint32>(data, offset, count, minimum, scale, pixels.data());
+      break;
+    case EPR_Sint32:
+      ctkDICOMImageScalePixels<Sint32>(data, offset, count, minimum, scale, pixels.data());
+      break;
+    default:
+      pixels.clear();
+      break;
+    }
+  return pixels;
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMImagePrivate::cachedImage(int frame, bool hasWindow, double center, double width,
+                                       QImage& image) const
+{
+  QMutexLocker locker(&this->CacheMutex);
+  ctkDICOMImageFrame* cachedFrame = this->Frames.object(frame);
+  if (!cachedFrame || cachedFrame->Image.isNull() || cachedFrame->HasWindow != hasWindow
+      || (hasWindow && (cachedFrame->WindowCenter != center || cachedFrame->WindowWidth != width)))
+    {
+    return false;
+    }
+  image = cachedFrame->Image;
+  return true;
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMImagePrivate::cachedPixels(int frame, QVector<quint16>& pixels) const
+{
+  QMutexLocker locker(&this->CacheMutex);
+  ctkDICOMImageFrame* cachedFrame = this->Frames.object(frame);
+  if (!cachedFrame || cachedFrame->Pixels.isEmpty())
+    {
+    return false;
+    }
+  pixels = cachedFrame->Pixels;
+  return true;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMImagePrivate::cacheImage(int frame, const QImage& image,
+                                      bool hasWindow, double center, double width) const
+{
+  if (image.isNull())
+    {
+    return;
+    }
+  QMutexLocker locker(&this->CacheMutex);
+  ctkDICOMImageFrame* cachedFrame = new ctkDICOMImageFrame;
+  if (this->Frames.contains(frame))
+    {
+    *cachedFrame = *this->Frames.object(frame);
+    }
+  cachedFrame->Image = image;
+  cachedFrame->HasWindow = hasWindow;
+  cachedFrame->WindowCenter = center;
+  cachedFrame->WindowWidth = width;
+  // Replaces and deletes the previous entry, the cost is updated
+  this->Frames.insert(frame, cachedFrame, cachedFrame->cost());
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMImagePrivate::cachePixels(int frame, const QVector<quint16>& pixels) const
+{
+  if (pixels.isEmpty())
+    {
+    return;
+    }
+  QMutexLocker locker(&this->CacheMutex);
+  ctkDICOMImageFrame* cachedFrame = new ctkDICOMImageFrame;
+  if (this->Frames.contains(frame))
+    {
+    *cachedFrame = *this->Frames.object(frame);
+    }
+  cachedFrame->Pixels = pixels;
+  this->Frames.insert(frame, cachedFrame, cachedFrame->cost());
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMImagePrivate::prefetch(int frame, bool raw) const
+{
+  const int frameCount = this->DicomImage ? static_cast<int>(this->DicomImage->getFrameCount()) : 0;
+  const int lastFrame = this->LastFrame;
+  this->LastFrame = frame;
+  if (frame == lastFrame)
+    {
+    return;
+    }
+  // Only scrolling (two consecutive frames) shows a direction. One-shot
+  // requests and jumps don't prefetch, and cancel the running prefetcher.
+  if (lastFrame < 0 || qAbs(frame - lastFrame) != 1)
+    {
+    this->PrefetchGeneration.fetchAndAddOrdered(1);
+    return;
+    }
+  this->PrefetchDirection = frame > lastFrame ? 1 : -1;
+  if (this->PrefetchCount <= 0 || this->Frames.maxCost() <= 0 || frameCount <= 1)
+    {
+    return;
+    }
+  // Supersede the running prefetcher
+  int generation = this->PrefetchGeneration.fetchAndAddOrdered(1) + 1;
+  ctkDICOMImagePrefetcher* prefetcher = new ctkDICOMImagePrefetcher(this, generation);
+  prefetcher->Raw = raw;
+  for (int i = 1; i <= this->PrefetchCount; ++i)
+    {
+    int nextFrame = frame + i * this->PrefetchDirection;
+    if (nextFrame < 0 || nextFrame >= frameCount)
+      {
+      break;
+      }
+    prefetcher->Frames << nextFrame;
+    }
+  if (prefetcher->Frames.isEmpty())
+    {
+    delete prefetcher;
+    return;
+    }
+  this->PrefetchPool.start(prefetcher);
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMImagePrivate::stopPrefetch() const
+{
+  this->PrefetchGeneration.fetchAndAddOrdered(1);
+  this->PrefetchPool.waitForDone();
 }
 
 //------------------------------------------------------------------------------
@@ -81,6 +436,8 @@ ctkDICOMImage::ctkDICOMImage(DicomImage* dicomImage, QObject* parentValue)
 //------------------------------------------------------------------------------
 ctkDICOMImage::~ctkDICOMImage()
 {
+  Q_D(ctkDICOMImage);
+  d->stopPrefetch();
 }
 
 //------------------------------------------------------------------------------
@@ -106,32 +463,156 @@ QImage ctkDICOMImage::frame(int frame) const
 {
   Q_D(const ctkDICOMImage);
 
-  // this way of converting the dicom image to a qpixmap was adopted from some code from
-  // the DCMTK forum, posted by Joerg Riesmayer, see http://forum.dcmtk.org/viewtopic.php?t=120
   QImage image;
-  if ((d->DicomImage != NULL) && (d->DicomImage->getStatus() == EIS_Normal))
-    {
-    /* get image extension */
-    const unsigned long width = d->DicomImage->getWidth();
-    const unsigned long height = d->DicomImage->getHeight();
-    QString header = QString("P5 %1 %2 255\n").arg(width).arg(height);
-    const unsigned long offset = header.length();
-    const unsigned long length = width * height + offset;
-    /* create output buffer for DicomImage class */
-    QByteArray buffer;
-    buffer.append(header);
-    buffer.resize(length);
+  {
+    QMutexLocker locker(&d->DicomMutex);
+    double center = 0.;
+    double width = 0.;
+    bool hasWindow = d->window(center, width);
+    if (!d->cachedImage(frame, hasWindow, center, width, image))
+      {
+      image = d->renderFrame(frame);
+      d->cacheImage(frame, image, hasWindow, center, width);
+      }
+  }
+  d->prefetch(frame, false);
+  return image;
+}
 
-    /* copy PGM header to buffer */
+//------------------------------------------------------------------------------
+QImage ctkDICOMImage::frame(int frame, double windowCenter, double windowWidth) const
+{
+  Q_D(const ctkDICOMImage);
 
-    if (d->DicomImage->getOutputData(static_cast<void *>(buffer.data() + offset), length - offset, 8, frame))
+  double minimum = 0.;
+  double maximum = 0.;
+  QVector<quint16> pixels = this->rawFrame(frame);
+  if (pixels.isEmpty() || !this->rawFrameRange(minimum, maximum))
+    {
+    return QImage();
+    }
+  bool inverted = false;
+  {
+    QMutexLocker locker(&d->DicomMutex);
+    inverted = d->DicomImage->getPhotometricInterpretation() == EPI_Monochrome1;
+  }
+
+  // Lookup table of the linear VOI function, see DICOM PS3.3 C.11.2.1.2
+  QVector<uchar> lookupTable(65536);
+  const double step = maximum > minimum ? (maximum - minimum) / 65535. : 0.;
+  const double lower = windowCenter - 0.5 - (windowWidth - 1.) / 2.;
+  const double upper = windowCenter - 0.5 + (windowWidth - 1.) / 2.;
+  for (int i = 0; i < 65536; ++i)
+    {
+    double value = minimum + i * step;
+    double output = 0.;
+    if (value <= lower)
+      {
+      output = 0.;
+      }
+    else if (value > upper)
+      {
+      output = 255.;
+      }
+    else
       {
+      output = ((value - (windowCenter - 0.5)) / qMax(windowWidth - 1., 1.) + 0.5) * 255.;
+      }
+    uchar gray = static_cast<uchar>(qBound(0., output + 0.5, 255.));
+    lookupTable[i] = inverted ? 255 - gray : gray;
+    }
 
-      if (!image.loadFromData( buffer ))
-        {
-        logger.error("QImage couldn't created");
-        }
+  const int width = static_cast<int>(d->DicomImage->getWidth());
+  const int height = static_cast<int>(d->DicomImage->getHeight());
+  QImage image(width, height, QImage::Format_Indexed8);
+  QVector<QRgb> colorTable(256);
+  for (int i = 0; i < 256; ++i)
+    {
+    colorTable[i] = qRgb(i, i, i);
+    }
+  image.setColorTable(colorTable);
+  const quint16* pixel = pixels.constData();
+  for (int y = 0; y < height; ++y)
+    {
+    uchar* line = image.scanLine(y);
+    for (int x = 0; x < width; ++x)
+      {
+      line[x] = lookupTable[*pixel++];
       }
     }
   return image;
 }
+
+//------------------------------------------------------------------------------
+QVector<quint16> ctkDICOMImage::rawFrame(int frame) const
+{
+  Q_D(const ctkDICOMImage);
+
+  QVector<quint16> pixels;
+  if (!d->cachedPixels(frame, pixels))
+    {
+    {
+      QMutexLocker locker(&d->DicomMutex);
+      pixels = d->renderRawFrame(frame);
+    }
+    d->cachePixels(frame, pixels);
+    }
+  d->prefetch(frame, true);
+  return pixels;
+}
+
+//------------------------------------------------------------------------------
+bool ctkDICOMImage::rawFrameRange(double& minimum, double& maximum) const
+{
+  Q_D(const ctkDICOMImage);
+  QMutexLocker locker(&d->DicomMutex);
+  return d->DicomImage && d->DicomImage->isMonochrome()
+    && d->DicomImage->getMinMaxValues(minimum, maximum);
+}
+
+//------------------------------------------------------------------------------
+int ctkDICOMImage::frameCacheSize() const
+{
+  Q_D(const ctkDICOMImage);
+  QMutexLocker locker(&d->CacheMutex);
+  return d->Frames.maxCost();
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMImage::setFrameCacheSize(int kilobytes)
+{
+  Q_D(ctkDICOMImage);
+  QMutexLocker locker(&d->CacheMutex);
+  d->Frames.setMaxCost(qMax(0, kilobytes));
+}
+
+//------------------------------------------------------------------------------
+int ctkDICOMImage::numberOfCachedFrames() const
+{
+  Q_D(const ctkDICOMImage);
+  QMutexLocker locker(&d->CacheMutex);
+  return d->Frames.count();
+}
+
+//------------------------------------------------------------------------------
+int ctkDICOMImage::prefetchCount() const
+{
+  Q_D(const ctkDICOMImage);
+  return d->PrefetchCount;
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMImage::setPrefetchCount(int count)
+{
+  Q_D(ctkDICOMImage);
+  d->PrefetchCount = qMax(0, count);
+}
+
+//------------------------------------------------------------------------------
+void ctkDICOMImage::clearFrameCache()
+{
+  Q_D(ctkDICOMImage);
+  d->stopPrefetch();
+  QMutexLocker locker(&d->CacheMutex);
+  d->Frames.clear();
+}
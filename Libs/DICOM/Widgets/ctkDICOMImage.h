@@ -25,6 +25,7 @@
 // Qt includes
 #include <QObject>
 #include <QImage>
+#include <QVector>
 
 #include "ctkDICOMWidgetsExport.h"
 
@@ -37,10 +38,23 @@ class DicomImage;
 ///
 /// This class wraps a DicomImage object and exposes it as a Qt class.
 ///
+/// Rendered frames are kept in a cache of frameCacheSize kilobytes, and
+/// when consecutive frames are requested one after the other (e.g. while
+/// scrolling through a cine), the next prefetchCount frames in the scroll
+/// direction are rendered in a background thread. A single request doesn't
+/// start the prefetcher.
+/// Because the prefetcher uses the DicomImage, clearFrameCache() must be
+/// called before changing dicomImage() directly.
+///
 class CTK_DICOM_WIDGETS_EXPORT ctkDICOMImage : public QObject
 {
   Q_OBJECT
   Q_PROPERTY(unsigned long frameCount READ frameCount);
+  /// Memory budget of the frame cache in kilobytes, 65536 (64MB) by default.
+  /// 0 disables the cache and the prefetcher.
+  Q_PROPERTY(int frameCacheSize READ frameCacheSize WRITE setFrameCacheSize);
+  /// Number of frames rendered in advance, 8 by default. 0 disables the prefetcher.
+  Q_PROPERTY(int prefetchCount READ prefetchCount WRITE setPrefetchCount);
 public:
   ///  \brief Construct a ctkDICOMImage
   /// The dicomImage pointer must remain valid during all the life of
@@ -61,8 +75,38 @@ public:
   ///
   /// \brief Returns a specific frame of the dicom image
   ///
+  /// The frame is rendered with the VOI transformation of dicomImage().
+  /// If that transformation is a window, frames rendered with another
+  /// window are not reused from the cache.
+  ///
   QImage frame(int frame = 0) const;
 
+  ///
+  /// \brief Returns a specific frame of a monochrome image rendered with a window.
+  ///
+  /// \a windowCenter and \a windowWidth are in modality units, as in
+  /// DicomImage::setWindow(). The frame is rendered from rawFrame(), so
+  /// changing the window does not render the image with DCMTK again.
+  /// Returns a null image for color images.
+  ///
+  QImage frame(int frame, double windowCenter, double windowWidth) const;
+
+  ///
+  /// \brief Returns the pixel values of a frame of a monochrome image, without VOI transformation.
+  ///
+  /// Modality values (after rescale slope/intercept or modality LUT) are
+  /// linearly mapped to 16 bits, the range of modality values of the image
+  /// being mapped to [0, 65535], see rawFrameRange().
+  /// Pixels are returned row by row. Returns an empty buffer for color images.
+  ///
+  QVector<quint16> rawFrame(int frame = 0) const;
+
+  ///
+  /// \brief Range of modality values mapped to [0, 65535] by rawFrame()
+  /// \sa DicomImage::getMinMaxValues()
+  ///
+  bool rawFrameRange(double& minimum, double& maximum) const;
+
   ///
   /// \brief Returns the number of frames contained in the dicom image.
   /// \sa DicomImage::getFrameCount()
@@ -73,6 +117,22 @@ public:
   ///
   unsigned long frameCount() const;
 
+  int frameCacheSize() const;
+  void setFrameCacheSize(int kilobytes);
+  /// Number of frames currently in the cache, rendered or prefetched
+  int numberOfCachedFrames() const;
+
+  int prefetchCount() const;
+  void setPrefetchCount(int count);
+
+  ///
+  /// \brief Remove all the frames from the cache and stop the prefetcher.
+  ///
+  /// Must be called before changing dicomImage() directly, e.g. its pixel
+  /// data or its VOI transformation.
+  ///
+  Q_INVOKABLE void clearFrameCache();
+
 protected:
   QScopedPointer<ctkDICOMImagePrivate> d_ptr;
 
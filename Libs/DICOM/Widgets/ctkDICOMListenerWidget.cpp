@@ -18,6 +18,14 @@
 
 =========================================================================*/
 
+// Qt includes
+#include <QElapsedTimer>
+#include <QTimer>
+
+// ctkDICOMCore includes
+#include "ctkDICOMDatabase.h"
+#include "ctkDICOMStorageListener.h"
+
 // ctkDICOMWidgets includes
 #include "ctkDICOMListenerWidget.h"
 #include "ui_ctkDICOMListenerWidget.h"
@@ -26,7 +34,17 @@
 class ctkDICOMListenerWidgetPrivate: public Ui_ctkDICOMListenerWidget
 {
 public:
-  ctkDICOMListenerWidgetPrivate(){}
+  ctkDICOMListenerWidgetPrivate()
+    : Listener(0)
+    , LastNumberOfInsertedInstances(0)
+    {
+    }
+
+  ctkDICOMStorageListener* Listener;
+  /// Throughput is computed from the inserted instances since the last update
+  QTimer StatisticsTimer;
+  QElapsedTimer ElapsedSinceLastUpdate;
+  int LastNumberOfInsertedInstances;
 };
 
 //----------------------------------------------------------------------------
@@ -44,11 +62,106 @@ ctkDICOMListenerWidget::ctkDICOMListenerWidget(QWidget* parentWidget)
   Q_D(ctkDICOMListenerWidget);
 
   d->setupUi(this);
+  d->Listener = new ctkDICOMStorageListener(this);
+  d->AssociationsSpinBox->setValue(d->Listener->maximumNumberOfAssociations());
+  d->StatisticsTimer.setInterval(1000);
+
+  connect(d->ListenButton, SIGNAL(toggled(bool)),
+          this, SLOT(setListening(bool)));
+  connect(&d->StatisticsTimer, SIGNAL(timeout()),
+          this, SLOT(updateStatistics()));
+  connect(d->Listener, SIGNAL(instancesInserted(int)),
+          this, SLOT(updateStatistics()));
 }
 
 //----------------------------------------------------------------------------
 ctkDICOMListenerWidget::~ctkDICOMListenerWidget()
 {
+  Q_D(ctkDICOMListenerWidget);
+  // Stopping inserts the instances that are already received
+  d->Listener->disconnect(this);
+  d->Listener->stop();
+}
+
+//----------------------------------------------------------------------------
+void ctkDICOMListenerWidget::setDatabase(QSharedPointer<ctkDICOMDatabase> database)
+{
+  Q_D(ctkDICOMListenerWidget);
+  d->Listener->setDatabase(database);
+}
+
+//----------------------------------------------------------------------------
+ctkDICOMStorageListener* ctkDICOMListenerWidget::listener()const
+{
+  Q_D(const ctkDICOMListenerWidget);
+  return d->Listener;
 }
 
+//----------------------------------------------------------------------------
+void ctkDICOMListenerWidget::setListening(bool listening)
+{
+  Q_D(ctkDICOMListenerWidget);
+  if (listening && !d->Listener->isListening())
+    {
+    d->Listener->setAETitle(d->AETitleLineEdit->text());
+    d->Listener->setPort(d->PortSpinBox->value());
+    d->Listener->setMaximumNumberOfAssociations(d->AssociationsSpinBox->value());
+    if (d->Listener->start())
+      {
+      d->LastNumberOfInsertedInstances = 0;
+      d->ElapsedSinceLastUpdate.start();
+      d->StatisticsTimer.start();
+      }
+    }
+  else if (!listening && d->Listener->isListening())
+    {
+    d->StatisticsTimer.stop();
+    d->Listener->stop();
+    }
+
+  bool isListening = d->Listener->isListening();
+  d->AETitleLineEdit->setEnabled(!isListening);
+  d->PortSpinBox->setEnabled(!isListening);
+  d->AssociationsSpinBox->setEnabled(!isListening);
+  bool wasBlocked = d->ListenButton->blockSignals(true);
+  d->ListenButton->setChecked(isListening);
+  d->ListenButton->blockSignals(wasBlocked);
+  QString status = tr("Stopped");
+  if (isListening)
+    {
+    status = tr("Listening on port %1").arg(d->Listener->port());
+    }
+  else if (listening)
+    {
+    // ctkDICOMStorageListener::start() refuses to listen without database
+    status = d->Listener->database().isNull() ?
+      tr("Cannot listen without database") :
+      tr("Cannot listen on port %1").arg(d->PortSpinBox->value());
+    }
+  d->StatusLabel->setText(status);
+  this->updateStatistics();
+}
 
+//----------------------------------------------------------------------------
+void ctkDICOMListenerWidget::updateStatistics()
+{
+  Q_D(ctkDICOMListenerWidget);
+  int numberOfInsertedInstances = d->Listener->numberOfInsertedInstances();
+  d->AssociationsLabel->setText(QString::number(d->Listener->numberOfActiveAssociations()));
+  d->ReceivedLabel->setText(QString::number(d->Listener->numberOfReceivedInstances()));
+  d->InsertedLabel->setText(QString::number(numberOfInsertedInstances));
+
+  // the throughput is only updated by the timer, so that it is averaged over a second
+  if (this->sender() == &d->StatisticsTimer)
+    {
+    double seconds = d->ElapsedSinceLastUpdate.restart() / 1000.;
+    double throughput = seconds > 0. ?
+      (numberOfInsertedInstances - d->LastNumberOfInsertedInstances) / seconds : 0.;
+    d->LastNumberOfInsertedInstances = numberOfInsertedInstances;
+    d->ThroughputLabel->setText(tr("%1 instances/s").arg(throughput, 0, 'f', 1));
+    }
+  else if (!d->Listener->isListening())
+    {
+    d->ThroughputLabel->setText(tr("%1 instances/s").arg(0., 0, 'f', 1));
+    }
+}
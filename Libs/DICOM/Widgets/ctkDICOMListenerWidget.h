@@ -22,20 +22,40 @@
 #define __ctkDICOMListenerWidget_h
 
 // Qt includes 
+#include <QSharedPointer>
 #include <QWidget>
 
 #include "ctkDICOMWidgetsExport.h"
 
+class ctkDICOMDatabase;
 class ctkDICOMListenerWidgetPrivate;
+class ctkDICOMStorageListener;
 
 /// \ingroup DICOM_Widgets
+/// Controls a ctkDICOMStorageListener receiving instances from other DICOM nodes
+/// into the database, and shows the number of received instances and the throughput.
 class CTK_DICOM_WIDGETS_EXPORT ctkDICOMListenerWidget : public QWidget
 {
+  Q_OBJECT
 public:
   typedef QWidget Superclass;
   explicit ctkDICOMListenerWidget(QWidget* parent=0);
   virtual ~ctkDICOMListenerWidget();
 
+  /// Database the received instances are inserted into
+  void setDatabase(QSharedPointer<ctkDICOMDatabase> database);
+
+  /// Listener controlled by the widget
+  ctkDICOMStorageListener* listener()const;
+
+public Q_SLOTS:
+  /// Start or stop listening with the AE title, port, and number of
+  /// associations entered in the widget
+  void setListening(bool listening);
+
+protected Q_SLOTS:
+  void updateStatistics();
+
 protected:
   QScopedPointer<ctkDICOMListenerWidgetPrivate> d_ptr;
 
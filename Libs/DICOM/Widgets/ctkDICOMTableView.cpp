@@ -46,6 +46,8 @@ public:
   void showFilterActiveWarning(bool);
 
   QString queryTableName() const;
+  /// Column of the UIDs of the queried table
+  QString queryTableKey() const;
 
   void applyColumnProperties();
 
@@ -56,6 +58,12 @@ public:
 
   QStringList currentSelection;
 
+  /// UIDs the query was last restricted to by setQuery()
+  QStringList queryUIDs;
+  /// Set if the search box filters the query through the database search index
+  bool searchActive;
+  QStringList searchUIDs;
+
   /// Key = QString for columns, Values = QStringList
   QHash<QString, QStringList> sqlWhereConditions;
 
@@ -64,6 +72,7 @@ public:
 //------------------------------------------------------------------------------
 ctkDICOMTableViewPrivate::ctkDICOMTableViewPrivate(ctkDICOMTableView &obj)
   : q_ptr(&obj)
+  , searchActive(false)
 {
   this->dicomSQLFilterModel = new QSortFilterProxyModel(&obj);
   this->dicomDatabase = new ctkDICOMDatabase(&obj);
@@ -73,6 +82,7 @@ ctkDICOMTableViewPrivate::ctkDICOMTableViewPrivate(ctkDICOMTableView &obj)
 ctkDICOMTableViewPrivate::ctkDICOMTableViewPrivate(ctkDICOMTableView &obj, ctkDICOMDatabase* db)
   : q_ptr(&obj)
   , dicomDatabase(db)
+  , searchActive(false)
 {
   this->dicomSQLFilterModel = new QSortFilterProxyModel(&obj);
 }
@@ -121,9 +131,6 @@ void ctkDICOMTableViewPrivate::init()
                    SIGNAL(customContextMenuRequested(const QPoint&)),
                    q, SLOT(onCustomContextMenuRequested(const QPoint&)));
 
-  QObject::connect(this->leSearchBox, SIGNAL(textChanged(QString)),
-                   this->dicomSQLFilterModel, SLOT(setFilterWildcard(QString)));
-
   QObject::connect(this->leSearchBox, SIGNAL(textChanged(QString)), q, SLOT(onFilterChanged()));
 }
 
@@ -133,6 +140,21 @@ QString ctkDICOMTableViewPrivate::queryTableName() const
   return this->lblTableName->text();
 }
 
+//----------------------------------------------------------------------------
+QString ctkDICOMTableViewPrivate::queryTableKey() const
+{
+  QString tableName = this->queryTableName();
+  if (tableName == "Studies")
+  {
+    return QString("StudyInstanceUID");
+  }
+  else if (tableName == "Series")
+  {
+    return QString("SeriesInstanceUID");
+  }
+  return QString("UID");
+}
+
 //----------------------------------------------------------------------------
 void ctkDICOMTableViewPrivate::showFilterActiveWarning(bool showWarning)
 {
@@ -338,10 +360,24 @@ void ctkDICOMTableView::onFilterChanged()
 {
   Q_D(ctkDICOMTableView);
 
+  QString text = d->leSearchBox->text();
+  if (d->dicomDatabase != 0 && d->dicomDatabase->hasSearchIndex())
+  {
+    // Only the matching rows are queried, the search index does not scan the tables
+    d->searchActive = !text.trimmed().isEmpty();
+    d->searchUIDs = d->searchActive ?
+      d->dicomDatabase->searchUIDs(text, d->queryTableName()) : QStringList();
+    this->setQuery(d->queryUIDs);
+  }
+  else
+  {
+    d->dicomSQLFilterModel->setFilterWildcard(text);
+  }
+
   const QStringList uids = this->uidsForAllRows();
 
   d->showFilterActiveWarning( d->dicomSQLFilterModel->rowCount() == 0 &&
-                              d->dicomSQLModel.rowCount() != 0);
+                              (d->dicomSQLModel.rowCount() != 0 || d->searchActive) );
 
   d->tblDicomDatabaseView->clearSelection();
   emit queryChanged(uids);
@@ -404,6 +440,7 @@ bool ctkDICOMTableView::eventFilter(QObject *obj, QEvent *event)
 void ctkDICOMTableView::setQuery(const QStringList &uids)
 {
   Q_D(ctkDICOMTableView);
+  d->queryUIDs = uids;
   QString query = ("select distinct %1.* from Patients, Series, Studies where "
                    "Patients.UID = Studies.PatientsUID and Studies.StudyInstanceUID = Series.StudyInstanceUID");
 
@@ -425,6 +462,11 @@ void ctkDICOMTableView::setQuery(const QStringList &uids)
       ++i;
     }
   }
+  if (d->searchActive)
+  {
+    query += " and %1."+d->queryTableKey()+" in ( '";
+    query.append(d->searchUIDs.join("','")).append("')");
+  }
   if (d->dicomDatabase != 0 && d->dicomDatabase->isOpen())
   {
     d->dicomSQLModel.setQuery(query.arg(d->queryTableName()), d->dicomDatabase->database());
@@ -0,0 +1,237 @@
+/*=========================================================================
+
+  Library:   CTK
+
+  Copyright (c) Kitware Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0.txt
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=========================================================================*/
+
+// Qt includes
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QImageReader>
+#include <QPainter>
+#include <QTemporaryFile>
+
+// ctk includes
+#include "ctkLogger.h"
+
+// ctkDICOMWidgets includes
+#include "ctkDICOMThumbnailAtlas.h"
+
+// STD includes
+#include <cmath>
+
+static ctkLogger logger("org.commontk.DICOM.Widgets.ctkDICOMThumbnailAtlas");
+
+/// Key of the offset table in the text entries of the atlas image
+static const char* ctkDICOMThumbnailAtlasTableKey = "ctkDICOMThumbnailAtlas";
+/// Key of the names of the thumbnail files the atlas has been generated from
+static const char* ctkDICOMThumbnailAtlasFilesKey = "ctkDICOMThumbnailAtlasFiles";
+
+//----------------------------------------------------------------------------
+static QStringList ctkDICOMThumbnailAtlasThumbnails(const QString& thumbnailDirectory)
+{
+  return QDir(thumbnailDirectory).entryList(QStringList() << "*.png", QDir::Files, QDir::Name);
+}
+
+//----------------------------------------------------------------------------
+ctkDICOMThumbnailAtlas::ctkDICOMThumbnailAtlas()
+{
+}
+
+//----------------------------------------------------------------------------
+QString ctkDICOMThumbnailAtlas::thumbnailDirectory(const QString& databaseDirectory,
+  const QString& studyInstanceUID, const QString& seriesInstanceUID)
+{
+  return databaseDirectory + "/thumbs/" + studyInstanceUID + "/" + seriesInstanceUID;
+}
+
+//----------------------------------------------------------------------------
+QString ctkDICOMThumbnailAtlas::atlasPath(const QString& databaseDirectory,
+  const QString& studyInstanceUID, const QString& seriesInstanceUID)
+{
+  return ctkDICOMThumbnailAtlas::thumbnailDirectory(databaseDirectory, studyInstanceUID, seriesInstanceUID)
+    + ".atlas.png";
+}
+
+//----------------------------------------------------------------------------
+bool ctkDICOMThumbnailAtlas::generate(const QString& thumbnailDirectory, const QString& atlasPath)
+{
+  QStringList thumbnailFiles = ctkDICOMThumbnailAtlasThumbnails(thumbnailDirectory);
+  QList<QImage> thumbnails;
+  QStringList sopInstanceUIDs;
+  QSize cellSize(0, 0);
+  foreach (const QString& thumbnailFile, thumbnailFiles)
+    {
+    QString thumbnailPath = thumbnailDirectory + "/" + thumbnailFile;
+    QImage thumbnail(thumbnailPath);
+    if (thumbnail.isNull())
+      {
+      logger.warn("Failed to read thumbnail " + thumbnailPath);
+      continue;
+      }
+    thumbnails << thumbnail;
+    sopInstanceUIDs << QFileInfo(thumbnailFile).completeBaseName();
+    cellSize = cellSize.expandedTo(thumbnail.size());
+    }
+  if (thumbnails.isEmpty())
+    {
+    QFile::remove(atlasPath);
+    return false;
+    }
+
+  // Square grid of cells large enough for any thumbnail
+  const int columns = static_cast<int>(std::ceil(std::sqrt(static_cast<double>(thumbnails.count()))));
+  const int rows = (thumbnails.count() + columns - 1) / columns;
+  QImage atlas(columns * cellSize.width(), rows * cellSize.height(), QImage::Format_RGB32);
+  atlas.fill(0);
+  QStringList table;
+  {
+    QPainter painter(&atlas);
+    for (int i = 0; i < thumbnails.count(); ++i)
+      {
+      QPoint origin((i % columns) * cellSize.width(), (i / columns) * cellSize.height());
+      painter.drawImage(origin, thumbnails[i]);
+      table << QString("%1 %2 %3 %4 %5").arg(sopInstanceUIDs[i])
+        .arg(origin.x()).arg(origin.y())
+        .arg(thumbnails[i].width()).arg(thumbnails[i].height());
+      }
+  }
+  atlas.setText(ctkDICOMThumbnailAtlasTableKey, table.join("\n"));
+  // Thumbnails added or removed after the listing make the atlas out of date
+  atlas.setText(ctkDICOMThumbnailAtlasFilesKey, thumbnailFiles.join("\n"));
+
+  // Write to a temporary file first so that a partially written atlas is never
+  // loaded. The atlas of a series may be written by several threads at once.
+  QTemporaryFile temporaryFile(atlasPath + ".XXXXXX");
+  if (!temporaryFile.open() || !atlas.save(&temporaryFile, "PNG"))
+    {
+    logger.error("Failed to write thumbnail atlas " + temporaryFile.fileName());
+    return false;
+    }
+  temporaryFile.close();
+  QFile::remove(atlasPath);
+  if (!temporaryFile.rename(atlasPath))
+    {
+    logger.error("Failed to write thumbnail atlas " + atlasPath);
+    return false;
+    }
+  temporaryFile.setAutoRemove(false);
+  return true;
+}
+
+//----------------------------------------------------------------------------
+bool ctkDICOMThumbnailAtlas::isUpToDate(const QString& thumbnailDirectory, const QString& atlasPath)
+{
+  // Only the header and text entries of the atlas are read
+  QImageReader atlasReader(atlasPath);
+  if (!atlasReader.canRead())
+    {
+    return false;
+    }
+  QStringList thumbnailFiles = ctkDICOMThumbnailAtlasThumbnails(thumbnailDirectory);
+  return !thumbnailFiles.isEmpty()
+    && atlasReader.text(ctkDICOMThumbnailAtlasFilesKey) == thumbnailFiles.join("\n");
+}
+
+//----------------------------------------------------------------------------
+bool ctkDICOMThumbnailAtlas::load(const QString& databaseDirectory,
+  const QString& studyInstanceUID, const QString& seriesInstanceUID)
+{
+  QString thumbnailDirectory = ctkDICOMThumbnailAtlas::thumbnailDirectory(
+    databaseDirectory, studyInstanceUID, seriesInstanceUID);
+  QString atlasPath = ctkDICOMThumbnailAtlas::atlasPath(
+    databaseDirectory, studyInstanceUID, seriesInstanceUID);
+  if (ctkDICOMThumbnailAtlas::isUpToDate(thumbnailDirectory, atlasPath)
+      && this->load(atlasPath))
+    {
+    return true;
+    }
+  return ctkDICOMThumbnailAtlas::generate(thumbnailDirectory, atlasPath)
+    && this->load(atlasPath);
+}
+
+//----------------------------------------------------------------------------
+bool ctkDICOMThumbnailAtlas::load(const QString& atlasPath)
+{
+  this->Image = QImage();
+  this->SOPInstanceUIDs.clear();
+  this->ThumbnailRects.clear();
+
+  QImage atlas(atlasPath);
+  if (atlas.isNull())
+    {
+    return false;
+    }
+  QStringList table = atlas.text(ctkDICOMThumbnailAtlasTableKey).split("\n", QString::SkipEmptyParts);
+  foreach (const QString& entry, table)
+    {
+    QStringList fields = entry.split(" ");
+    if (fields.count() != 5)
+      {
+      logger.error("Invalid thumbnail atlas " + atlasPath);
+      this->SOPInstanceUIDs.clear();
+      this->ThumbnailRects.clear();
+      return false;
+      }
+    QRect rect(fields[1].toInt(), fields[2].toInt(), fields[3].toInt(), fields[4].toInt());
+    this->SOPInstanceUIDs << fields[0];
+    this->ThumbnailRects[fields[0]] = rect;
+    }
+  this->Image = atlas;
+  return true;
+}
+
+//----------------------------------------------------------------------------
+bool ctkDICOMThumbnailAtlas::isNull()const
+{
+  return this->Image.isNull();
+}
+
+//----------------------------------------------------------------------------
+QStringList ctkDICOMThumbnailAtlas::sopInstanceUIDs()const
+{
+  return this->SOPInstanceUIDs;
+}
+
+//----------------------------------------------------------------------------
+bool ctkDICOMThumbnailAtlas::contains(const QString& sopInstanceUID)const
+{
+  return this->ThumbnailRects.contains(sopInstanceUID);
+}
+
+//----------------------------------------------------------------------------
+QImage ctkDICOMThumbnailAtlas::thumbnail(const QString& sopInstanceUID)const
+{
+  if (!this->ThumbnailRects.contains(sopInstanceUID))
+    {
+    return QImage();
+    }
+  return this->Image.copy(this->ThumbnailRects.value(sopInstanceUID));
+}
+
+//----------------------------------------------------------------------------
+QRect ctkDICOMThumbnailAtlas::thumbnailRect(const QString& sopInstanceUID)const
+{
+  return this->ThumbnailRects.value(sopInstanceUID);
+}
+
+//----------------------------------------------------------------------------
+QImage ctkDICOMThumbnailAtlas::image()const
+{
+  return this->Image;
+}
@@ -0,0 +1,90 @@
+/*=========================================================================
+
+  Library:   CTK
+
+  Copyright (c) Kitware Inc.
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+      http://www.apache.org/licenses/LICENSE-2.0.txt
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=========================================================================*/
+
+#ifndef __ctkDICOMThumbnailAtlas_h
+#define __ctkDICOMThumbnailAtlas_h
+
+// Qt includes
+#include <QHash>
+#include <QImage>
+#include <QRect>
+#include <QStringList>
+
+#include "ctkDICOMWidgetsExport.h"
+
+/// \ingroup DICOM_Widgets
+///
+/// \brief Thumbnails of all the instances of a series packed in a single image.
+///
+/// The atlas of a series is written next to the directory of the thumbnails
+/// of its instances, as <tt>thumbs/StudyInstanceUID/SeriesInstanceUID.atlas.png</tt>.
+/// The offset table, giving the rectangle of the thumbnail of each
+/// SOP Instance UID, is stored as a text entry of the PNG file, so that the
+/// atlas is read in a single file access.
+///
+/// The atlas is generated by ctkDICOMThumbnailGenerator once ctkDICOMDatabase has
+/// generated the thumbnails of a series in the background, otherwise from the
+/// thumbnails the first time it is loaded.
+/// ctkDICOMDatabase removes it whenever it writes or removes a thumbnail of the
+/// series, and it is generated again if thumbnail files have been added or
+/// removed since. Loading and generation can be done in any thread.
+class CTK_DICOM_WIDGETS_EXPORT ctkDICOMThumbnailAtlas
+{
+public:
+  ctkDICOMThumbnailAtlas();
+
+  /// Path of the thumbnail directory of a series
+  static QString thumbnailDirectory(const QString& databaseDirectory,
+                                    const QString& studyInstanceUID, const QString& seriesInstanceUID);
+  /// Path of the atlas of a series
+  static QString atlasPath(const QString& databaseDirectory,
+                           const QString& studyInstanceUID, const QString& seriesInstanceUID);
+
+  /// Pack the thumbnails found in \a thumbnailDirectory into \a atlasPath.
+  /// \return false if no thumbnail is found or the atlas cannot be written
+  static bool generate(const QString& thumbnailDirectory, const QString& atlasPath);
+
+  /// Return true if the atlas exists and was generated from the thumbnail files
+  /// found in \a thumbnailDirectory. The thumbnails are listed but not read.
+  static bool isUpToDate(const QString& thumbnailDirectory, const QString& atlasPath);
+
+  /// Load the atlas of a series, generating it first if it is not up to date.
+  bool load(const QString& databaseDirectory,
+            const QString& studyInstanceUID, const QString& seriesInstanceUID);
+  /// Load an atlas file without checking the thumbnails
+  bool load(const QString& atlasPath);
+
+  bool isNull()const;
+  /// SOP Instance UIDs of the packed thumbnails
+  QStringList sopInstanceUIDs()const;
+  bool contains(const QString& sopInstanceUID)const;
+  /// Return the thumbnail of an instance, a null image if it is not in the atlas
+  QImage thumbnail(const QString& sopInstanceUID)const;
+  /// Rectangle of the thumbnail of an instance in image()
+  QRect thumbnailRect(const QString& sopInstanceUID)const;
+  QImage image()const;
+
+protected:
+  QImage Image;
+  QStringList SOPInstanceUIDs;
+  QHash<QString, QRect> ThumbnailRects;
+};
+
+#endif
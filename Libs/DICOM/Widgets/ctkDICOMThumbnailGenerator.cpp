@@ -20,6 +20,7 @@
 =========================================================================*/
 
 // ctkDICOMCore includes
+#include "ctkDICOMThumbnailAtlas.h"
 #include "ctkDICOMThumbnailGenerator.h"
 #include "ctkLogger.h"
 
@@ -135,3 +136,14 @@ bool ctkDICOMThumbnailGenerator::generateThumbnail(DicomImage *dcmImage, const Q
     image.scaled(128,128,Qt::KeepAspectRatio).save(path,"PNG");
     return true;
 }
+
+//------------------------------------------------------------------------------
+bool ctkDICOMThumbnailGenerator::generateSeriesAtlas(const QString& thumbnailDirectory,
+                                                      const QString& atlasPath)
+{
+  if (ctkDICOMThumbnailAtlas::isUpToDate(thumbnailDirectory, atlasPath))
+    {
+    return true;
+    }
+  return ctkDICOMThumbnailAtlas::generate(thumbnailDirectory, atlasPath);
+}
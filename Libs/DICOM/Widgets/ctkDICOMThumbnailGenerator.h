@@ -43,6 +43,8 @@ public:
   virtual ~ctkDICOMThumbnailGenerator();
 
   virtual bool generateThumbnail(DicomImage* dcmImage, const QString& path );
+  /// Generate the ctkDICOMThumbnailAtlas of the series, unless it is up to date
+  virtual bool generateSeriesAtlas(const QString& thumbnailDirectory, const QString& atlasPath);
 
 protected:
   QScopedPointer<ctkDICOMThumbnailGeneratorPrivate> d_ptr;
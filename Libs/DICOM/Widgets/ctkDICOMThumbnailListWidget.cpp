@@ -25,10 +25,16 @@
 #include <QFileInfo>
 #include <QGridLayout>
 #include <QMetaType>
+#include <QMutex>
 #include <QPersistentModelIndex>
 #include <QPixmap>
 #include <QPushButton>
 #include <QResizeEvent>
+#include <QRunnable>
+#include <QScrollBar>
+#include <QSet>
+#include <QThreadPool>
+#include <QTimer>
 
 // ctk includes
 #include "ctkLogger.h"
@@ -44,6 +50,7 @@
 #include "ctkDICOMModel.h"
 
 // ctkDICOMWidgets includes
+#include "ctkDICOMThumbnailAtlas.h"
 #include "ctkDICOMThumbnailListWidget.h"
 #include "ctkThumbnailLabel.h"
 
@@ -57,6 +64,16 @@ static ctkLogger logger("org.commontk.DICOM.Widgets.ctkDICOMThumbnailListWidget"
 
 Q_DECLARE_METATYPE(QPersistentModelIndex);
 
+//----------------------------------------------------------------------------
+/// Thumbnail of a series instance, its label is created when it is scrolled
+/// into view.
+struct ctkDICOMThumbnailListWidgetPendingThumbnail
+{
+  QPersistentModelIndex SourceIndex;
+  QString SOPInstanceUID;
+  QString Text;
+};
+
 //----------------------------------------------------------------------------
 class ctkDICOMThumbnailListWidgetPrivate : ctkThumbnailListWidgetPrivate
 {
@@ -75,6 +92,40 @@ public:
   void addStudyThumbnails(const QModelIndex& studyIndex);
   void addSeriesThumbnails(const QModelIndex& seriesIndex);
 
+  /// Forget the series thumbnails and ignore the atlas being loaded, if any
+  void clearPendingThumbnails();
+  /// Create the labels of the pending thumbnails up to \a index included
+  void createPendingThumbnails(int index);
+  /// Number of thumbnails in the viewport and in the next viewport
+  int visibleThumbnailCount()const;
+  /// Make the thumbnail of RestoredSourceIndex current again after a reload.
+  /// \return false if there is no such thumbnail
+  bool restoreCurrentThumbnail();
+
+  /// Loads the series atlas, one series at a time
+  QThreadPool AtlasLoaderPool;
+  /// Incremented each time the series thumbnails are cleared
+  QAtomicInt Generation;
+  /// Atlas loaded in the pool, guarded by AtlasMutex
+  QMutex AtlasMutex;
+  ctkDICOMThumbnailAtlas LoadedAtlas;
+  int LoadedAtlasGeneration;
+
+  ctkDICOMThumbnailAtlas Atlas;
+  QList<ctkDICOMThumbnailListWidgetPendingThumbnail> PendingThumbnails;
+  int CreatedThumbnailCount;
+
+  /// Index whose thumbnails are shown. Unlike CurrentSelectedModel, it is
+  /// invalidated when the model is reset.
+  QPersistentModelIndex DisplayedIndex;
+  /// Studies whose thumbnails are shown, and the series if a single series is shown
+  QSet<QString> DisplayedStudyInstanceUIDs;
+  QString DisplayedSeriesInstanceUID;
+  /// Coalesces the thumbnails generated for the shown series
+  QTimer ReloadTimer;
+  /// Source index of the current thumbnail when the thumbnails are reloaded
+  QPersistentModelIndex RestoredSourceIndex;
+
 private:
   Q_DISABLE_COPY( ctkDICOMThumbnailListWidgetPrivate );
 };
@@ -86,10 +137,62 @@ private:
 ctkDICOMThumbnailListWidgetPrivate
 ::ctkDICOMThumbnailListWidgetPrivate(ctkDICOMThumbnailListWidget* parent)
   : Superclass(parent)
+  , Generation(0)
+  , LoadedAtlasGeneration(-1)
+  , CreatedThumbnailCount(0)
 {
-
+  this->AtlasLoaderPool.setMaxThreadCount(1);
+  this->ReloadTimer.setSingleShot(true);
+  this->ReloadTimer.setInterval(1000);
 }
 
+//----------------------------------------------------------------------------
+class ctkDICOMThumbnailAtlasLoader : public QRunnable
+{
+public:
+  ctkDICOMThumbnailAtlasLoader(ctkDICOMThumbnailListWidget* widget,
+                               ctkDICOMThumbnailListWidgetPrivate* widgetPrivate, int generation,
+                               const QString& databaseDirectory,
+                               const QString& studyInstanceUID, const QString& seriesInstanceUID)
+    : Widget(widget)
+    , WidgetPrivate(widgetPrivate)
+    , Generation(generation)
+    , DatabaseDirectory(databaseDirectory)
+    , StudyInstanceUID(studyInstanceUID)
+    , SeriesInstanceUID(seriesInstanceUID)
+  {
+  }
+
+  virtual void run()
+  {
+    if (this->Generation != this->WidgetPrivate->Generation.fetchAndAddOrdered(0))
+      {
+      return;
+      }
+    ctkDICOMThumbnailAtlas atlas;
+    if (!atlas.load(this->DatabaseDirectory, this->StudyInstanceUID, this->SeriesInstanceUID))
+      {
+      logger.debug("No thumbnail for series " + this->SeriesInstanceUID);
+      }
+    QMutexLocker locker(&this->WidgetPrivate->AtlasMutex);
+    if (this->Generation != this->WidgetPrivate->Generation.fetchAndAddOrdered(0))
+      {
+      return;
+      }
+    this->WidgetPrivate->LoadedAtlas = atlas;
+    this->WidgetPrivate->LoadedAtlasGeneration = this->Generation;
+    QMetaObject::invokeMethod(this->Widget, "onAtlasLoaded", Qt::QueuedConnection);
+  }
+
+protected:
+  ctkDICOMThumbnailListWidget* Widget;
+  ctkDICOMThumbnailListWidgetPrivate* WidgetPrivate;
+  int Generation;
+  QString DatabaseDirectory;
+  QString StudyInstanceUID;
+  QString SeriesInstanceUID;
+};
+
 //----------------------------------------------------------------------------
 void ctkDICOMThumbnailListWidgetPrivate
 ::addPatientThumbnails(const QModelIndex &index)
@@ -107,6 +210,7 @@ void ctkDICOMThumbnailListWidgetPrivate
     for(int i=0; i<studyCount; i++)
       {
       QModelIndex studyIndex = patientIndex.child(i, 0);
+      this->DisplayedStudyInstanceUIDs.insert(model->data(studyIndex, ctkDICOMModel::UIDRole).toString());
       QModelIndex seriesIndex = studyIndex.child(0, 0);
       model->fetchMore(seriesIndex);
       const int imageCount = model->rowCount(seriesIndex);
@@ -131,6 +235,7 @@ void ctkDICOMThumbnailListWidgetPrivate
     }
   model->fetchMore(studyIndex);
   const int seriesCount = model->rowCount(studyIndex);
+  this->DisplayedStudyInstanceUIDs.insert(model->data(studyIndex, ctkDICOMModel::UIDRole).toString());
 
   for(int i=0; i<seriesCount; i++)
     {
@@ -155,6 +260,10 @@ void ctkDICOMThumbnailListWidgetPrivate
     return;
     }
   model->fetchMore(seriesIndex);
+  QString studyInstanceUID = model->data(seriesIndex.parent(), ctkDICOMModel::UIDRole).toString();
+  QString seriesInstanceUID = model->data(seriesIndex, ctkDICOMModel::UIDRole).toString();
+  this->DisplayedStudyInstanceUIDs.insert(studyInstanceUID);
+  this->DisplayedSeriesInstanceUID = seriesInstanceUID;
 
   const int imageCount = model->rowCount(seriesIndex);
   logger.debug(QString("Thumbs: %1").arg(imageCount));
@@ -162,8 +271,126 @@ void ctkDICOMThumbnailListWidgetPrivate
     {
     QModelIndex imageIndex = seriesIndex.child(i,0);
 
-    this->addThumbnailWidget(imageIndex, imageIndex, QString("Image %1").arg(i));
+    ctkDICOMThumbnailListWidgetPendingThumbnail thumbnail;
+    thumbnail.SourceIndex = imageIndex;
+    thumbnail.SOPInstanceUID = model->data(imageIndex, ctkDICOMModel::UIDRole).toString();
+    thumbnail.Text = QString("Image %1").arg(i);
+    this->PendingThumbnails << thumbnail;
+    }
+  if (this->PendingThumbnails.isEmpty())
+    {
+    return;
     }
+
+  // The labels are created once the atlas is loaded, see onAtlasLoaded()
+  Q_Q(ctkDICOMThumbnailListWidget);
+  this->AtlasLoaderPool.start(new ctkDICOMThumbnailAtlasLoader(
+    q, this, this->Generation.fetchAndAddOrdered(0), this->DatabaseDirectory,
+    studyInstanceUID, seriesInstanceUID));
+}
+
+//----------------------------------------------------------------------------
+void ctkDICOMThumbnailListWidgetPrivate::clearPendingThumbnails()
+{
+  this->Generation.ref();
+  this->Atlas = ctkDICOMThumbnailAtlas();
+  this->PendingThumbnails.clear();
+  this->CreatedThumbnailCount = 0;
+  this->DisplayedIndex = QPersistentModelIndex();
+  this->DisplayedStudyInstanceUIDs.clear();
+  this->DisplayedSeriesInstanceUID.clear();
+  this->ReloadTimer.stop();
+}
+
+//----------------------------------------------------------------------------
+bool ctkDICOMThumbnailListWidgetPrivate::restoreCurrentThumbnail()
+{
+  Q_Q(ctkDICOMThumbnailListWidget);
+  QPersistentModelIndex sourceIndex = this->RestoredSourceIndex;
+  this->RestoredSourceIndex = QPersistentModelIndex();
+  if (!sourceIndex.isValid())
+    {
+    return false;
+    }
+  // The label of a series thumbnail may not be created yet
+  for (int i = this->CreatedThumbnailCount; !this->Atlas.isNull() && i < this->PendingThumbnails.count(); ++i)
+    {
+    if (this->PendingThumbnails[i].SourceIndex == sourceIndex)
+      {
+      this->createPendingThumbnails(i);
+      break;
+      }
+    }
+  QLayout* layout = this->ScrollAreaContentWidget->layout();
+  for (int i = 0; i < layout->count(); ++i)
+    {
+    if (layout->itemAt(i)->widget()->property("sourceIndex").value<QPersistentModelIndex>() == sourceIndex)
+      {
+      q->setCurrentThumbnail(i);
+      return true;
+      }
+    }
+  return false;
+}
+
+//----------------------------------------------------------------------------
+void ctkDICOMThumbnailListWidgetPrivate::createPendingThumbnails(int index)
+{
+  index = qMin(index, this->PendingThumbnails.count() - 1);
+  for (; this->CreatedThumbnailCount <= index; ++this->CreatedThumbnailCount)
+    {
+    const ctkDICOMThumbnailListWidgetPendingThumbnail& thumbnail =
+      this->PendingThumbnails[this->CreatedThumbnailCount];
+    ctkThumbnailLabel* widget = new ctkThumbnailLabel(this->ScrollAreaContentWidget);
+    widget->setText(thumbnail.Text);
+    if(this->ThumbnailSize.isValid())
+      {
+      widget->setFixedSize(this->ThumbnailSize);
+      }
+    widget->setPixmap(QPixmap::fromImage(this->Atlas.thumbnail(thumbnail.SOPInstanceUID)));
+
+    QVariant var;
+    var.setValue(thumbnail.SourceIndex);
+    widget->setProperty("sourceIndex", var);
+
+    this->addThumbnail(widget);
+    }
+}
+
+//----------------------------------------------------------------------------
+int ctkDICOMThumbnailListWidgetPrivate::visibleThumbnailCount()const
+{
+  Q_Q(const ctkDICOMThumbnailListWidget);
+  QLayout* layout = this->ScrollAreaContentWidget->layout();
+  QSize cellSize = this->ThumbnailSize;
+  if (!cellSize.isValid() && layout->count() > 0)
+    {
+    cellSize = layout->itemAt(0)->widget()->sizeHint();
+    }
+  if (cellSize.isEmpty())
+    {
+    return 1;
+    }
+  ctkFlowLayout* flowLayout = qobject_cast<ctkFlowLayout*>(layout);
+  cellSize += QSize(qMax(flowLayout->horizontalSpacing(), 0), qMax(flowLayout->verticalSpacing(), 0));
+
+  // Thumbnails fill lines along the flow, lines are scrolled across it
+  QSize viewportSize = this->ScrollArea->viewport()->size();
+  int thumbnailsPerLine = 0;
+  int lines = 0;
+  if (q->flow() == Qt::Horizontal)
+    {
+    thumbnailsPerLine = viewportSize.width() / cellSize.width();
+    lines = (this->ScrollArea->verticalScrollBar()->value() + 2 * viewportSize.height())
+      / cellSize.height() + 1;
+    }
+  else
+    {
+    thumbnailsPerLine = viewportSize.height() / cellSize.height();
+    lines = (this->ScrollArea->horizontalScrollBar()->value() + 2 * viewportSize.width())
+      / cellSize.width() + 1;
+    }
+  return qMax(thumbnailsPerLine, 1) * lines;
 }
 
 //----------------------------------------------------------------------------
@@ -215,13 +442,23 @@ void ctkDICOMThumbnailListWidgetPrivate
 ctkDICOMThumbnailListWidget::ctkDICOMThumbnailListWidget(QWidget* _parent)
   : Superclass(new ctkDICOMThumbnailListWidgetPrivate(this), _parent)
 {
+  Q_D(ctkDICOMThumbnailListWidget);
 
+  this->connect(d->ScrollArea->verticalScrollBar(), SIGNAL(valueChanged(int)),
+                SLOT(createVisibleThumbnails()));
+  this->connect(d->ScrollArea->horizontalScrollBar(), SIGNAL(valueChanged(int)),
+                SLOT(createVisibleThumbnails()));
+  this->connect(&d->ReloadTimer, SIGNAL(timeout()),
+                SLOT(reloadThumbnails()));
 }
 
 //----------------------------------------------------------------------------
 ctkDICOMThumbnailListWidget::~ctkDICOMThumbnailListWidget()
 {
+  Q_D(ctkDICOMThumbnailListWidget);
 
+  d->Generation.ref();
+  d->AtlasLoaderPool.waitForDone();
 }
 
 //----------------------------------------------------------------------------
@@ -248,6 +485,16 @@ void ctkDICOMThumbnailListWidget::selectThumbnailFromIndex(const QModelIndex &in
 
   if(model)
     {
+    // The label of a series thumbnail may not be created yet
+    for (int i = d->CreatedThumbnailCount; !d->Atlas.isNull() && i < d->PendingThumbnails.count(); ++i)
+      {
+      if (d->PendingThumbnails[i].SourceIndex == index)
+        {
+        d->createPendingThumbnails(i);
+        break;
+        }
+      }
+
     int count = d->ScrollAreaContentWidget->layout()->count();
 
     for(int i=0; i<count; i++)
@@ -271,6 +518,7 @@ void ctkDICOMThumbnailListWidget::addThumbnails(const QModelIndex &index)
 {
   Q_D(ctkDICOMThumbnailListWidget);
 
+  d->clearPendingThumbnails();
   this->clearThumbnails();
 
   ctkDICOMModel* model = const_cast<ctkDICOMModel*>(qobject_cast<const ctkDICOMModel*>(index.model()));
@@ -280,6 +528,7 @@ void ctkDICOMThumbnailListWidget::addThumbnails(const QModelIndex &index)
     QModelIndex index0 = index.sibling(index.row(), 0);
 
     d->CurrentSelectedModel = index0;
+    d->DisplayedIndex = index0;
 
     if ( model->data(index0,ctkDICOMModel::TypeRole) == static_cast<int>(ctkDICOMModel::PatientType) )
       {
@@ -297,3 +546,128 @@ void ctkDICOMThumbnailListWidget::addThumbnails(const QModelIndex &index)
 
   this->setCurrentThumbnail(0);
 }
+
+//----------------------------------------------------------------------------
+void ctkDICOMThumbnailListWidget::onAtlasLoaded()
+{
+  Q_D(ctkDICOMThumbnailListWidget);
+  {
+    QMutexLocker locker(&d->AtlasMutex);
+    if (d->LoadedAtlasGeneration != d->Generation.fetchAndAddOrdered(0))
+      {
+      return;
+      }
+    d->Atlas = d->LoadedAtlas;
+    d->LoadedAtlas = ctkDICOMThumbnailAtlas();
+    d->LoadedAtlasGeneration = -1;
+  }
+
+  // Instances without thumbnail are not listed
+  QList<ctkDICOMThumbnailListWidgetPendingThumbnail>::iterator it = d->PendingThumbnails.begin();
+  while (it != d->PendingThumbnails.end())
+    {
+    if (d->Atlas.contains(it->SOPInstanceUID))
+      {
+      ++it;
+      }
+    else
+      {
+      it = d->PendingThumbnails.erase(it);
+      }
+    }
+
+  this->createVisibleThumbnails();
+  if (!d->restoreCurrentThumbnail())
+    {
+    this->setCurrentThumbnail(0);
+    }
+}
+
+//----------------------------------------------------------------------------
+void ctkDICOMThumbnailListWidget::onThumbnailReady(const QString& sopInstanceUID,
+                                                   const QString& thumbnailPath)
+{
+  Q_D(ctkDICOMThumbnailListWidget);
+  // thumbs/StudyInstanceUID/SeriesInstanceUID/SOPInstanceUID.png
+  QFileInfo seriesInfo(QFileInfo(thumbnailPath).absolutePath());
+  QString studyInstanceUID = QFileInfo(seriesInfo.absolutePath()).fileName();
+  if (!d->DisplayedStudyInstanceUIDs.contains(studyInstanceUID)
+      || (!d->DisplayedSeriesInstanceUID.isEmpty()
+          && (d->DisplayedSeriesInstanceUID != seriesInfo.fileName()
+              || d->Atlas.contains(sopInstanceUID))))
+    {
+    return;
+    }
+  // More thumbnails of the series are likely to come
+  if (!d->ReloadTimer.isActive())
+    {
+    d->ReloadTimer.start();
+    }
+}
+
+//----------------------------------------------------------------------------
+void ctkDICOMThumbnailListWidget::onSeriesThumbnailsReady(const QString& studyInstanceUID,
+                                                          const QString& seriesInstanceUID)
+{
+  Q_D(ctkDICOMThumbnailListWidget);
+  if (!d->DisplayedStudyInstanceUIDs.contains(studyInstanceUID)
+      || (!d->DisplayedSeriesInstanceUID.isEmpty()
+          && d->DisplayedSeriesInstanceUID != seriesInstanceUID))
+    {
+    return;
+    }
+  this->reloadThumbnails();
+}
+
+//----------------------------------------------------------------------------
+void ctkDICOMThumbnailListWidget::reloadThumbnails()
+{
+  Q_D(ctkDICOMThumbnailListWidget);
+  d->ReloadTimer.stop();
+  QModelIndex displayedIndex = d->DisplayedIndex;
+  if (!displayedIndex.isValid())
+    {
+    return;
+    }
+  QPersistentModelIndex currentSourceIndex;
+  int current = this->currentThumbnail();
+  QLayout* layout = d->ScrollAreaContentWidget->layout();
+  if (current >= 0 && current < layout->count())
+    {
+    currentSourceIndex = layout->itemAt(current)->widget()->property("sourceIndex").value<QPersistentModelIndex>();
+    }
+  this->addThumbnails(displayedIndex);
+  d->RestoredSourceIndex = currentSourceIndex;
+  // Thumbnails of patients and studies are already created, the series
+  // thumbnails once the atlas is loaded
+  if (d->DisplayedSeriesInstanceUID.isEmpty())
+    {
+    d->restoreCurrentThumbnail();
+    }
+}
+
+//----------------------------------------------------------------------------
+void ctkDICOMThumbnailListWidget::createVisibleThumbnails()
+{
+  Q_D(ctkDICOMThumbnailListWidget);
+  if (d->Atlas.isNull() || d->CreatedThumbnailCount >= d->PendingThumbnails.count())
+    {
+    return;
+    }
+  if (d->ScrollAreaContentWidget->layout()->count() < d->CreatedThumbnailCount)
+    {
+    // clearThumbnails() was called
+    d->clearPendingThumbnails();
+    return;
+    }
+  // The size of the first label gives the size of the others
+  d->createPendingThumbnails(0);
+  d->createPendingThumbnails(d->visibleThumbnailCount() - 1);
+}
+
+//----------------------------------------------------------------------------
+void ctkDICOMThumbnailListWidget::resizeEvent(QResizeEvent* event)
+{
+  this->Superclass::resizeEvent(event);
+  this->createVisibleThumbnails();
+}
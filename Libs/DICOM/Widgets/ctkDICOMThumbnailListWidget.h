@@ -29,12 +29,19 @@ class ctkDICOMThumbnailListWidgetPrivate;
 class ctkThumbnailWidget;
 
 /// \ingroup DICOM_Widgets
+///
+/// The thumbnails of the instances of a series are read from the series
+/// thumbnail atlas (see ctkDICOMThumbnailAtlas) in a background thread, and
+/// thumbnail labels are created as they are scrolled into view.
+/// Instances without thumbnail are not shown until the thumbnails are
+/// reloaded, e.g. from ctkDICOMDatabase::thumbnailReady.
 class CTK_DICOM_WIDGETS_EXPORT ctkDICOMThumbnailListWidget : public ctkThumbnailListWidget
 {
   Q_OBJECT
 public:
   typedef ctkThumbnailListWidget Superclass;
   explicit ctkDICOMThumbnailListWidget(QWidget* parent=0);
+  /// Wait for the atlas being loaded, if any
   virtual ~ctkDICOMThumbnailListWidget();
 
   void setDatabaseDirectory(const QString& directory);
@@ -47,6 +54,24 @@ private:
 
 public Q_SLOTS:
   void addThumbnails(const QModelIndex& index);
+
+  /// Reload the shown thumbnails, keeping the current thumbnail
+  void reloadThumbnails();
+  /// Connect to ctkDICOMDatabase::thumbnailReady so that the thumbnails
+  /// generated in the background are shown. Reloads are coalesced.
+  void onThumbnailReady(const QString& sopInstanceUID, const QString& thumbnailPath);
+  /// Connect to ctkDICOMDatabase::seriesThumbnailsReady so that the
+  /// thumbnails of the shown series are reloaded once they are all generated.
+  void onSeriesThumbnailsReady(const QString& studyInstanceUID, const QString& seriesInstanceUID);
+
+protected Q_SLOTS:
+  /// Create the labels of the series thumbnails once the atlas is loaded
+  void onAtlasLoaded();
+  /// Create the labels of the series thumbnails scrolled into view
+  void createVisibleThumbnails();
+
+protected:
+  virtual void resizeEvent(QResizeEvent* event);
 };
 
 #endif
@@ -196,3 +196,25 @@ void ctkEATopicWildcardTestSuite::testEventDeliveryForWildcardTopic7()
   handlerRegistration.unregister();
 }
 
+
+//----------------------------------------------------------------------------
+void ctkEATopicWildcardTestSuite::testEventDeliveryForWildcardTopic8()
+{
+  ctkDictionary properties;
+  properties.insert(ctkEventConstants::EVENT_TOPIC, "a/b/*");
+  ctkEATopicWildcardTestHelper handler;
+  ctkServiceRegistration handlerRegistration = context->registerService<ctkEventHandler>(&handler, properties);
+  eventAdmin->sendEvent(ctkEvent("a/b/c"));
+  QVERIFY2(!handler.clearLastEvent().isNull(), "Did not receive event published to topic 'a/b/c' while listening to 'a/b/*'");
+
+  properties.insert(ctkEventConstants::EVENT_TOPIC, "x/y");
+  handlerRegistration.setProperties(properties);
+  eventAdmin->sendEvent(ctkEvent("a/b/c"));
+  QVERIFY2(handler.clearLastEvent().isNull(), "Received event published to topic 'a/b/c' while listening to 'x/y'");
+  eventAdmin->sendEvent(ctkEvent("x/y"));
+  QVERIFY2(!handler.clearLastEvent().isNull(), "Did not receive event published to topic 'x/y' while listening to 'x/y'");
+
+  handlerRegistration.unregister();
+  eventAdmin->sendEvent(ctkEvent("x/y"));
+  QVERIFY2(handler.lastEvent().isNull(), "Received event published to topic 'x/y' after unregistering");
+}
@@ -120,6 +120,13 @@ private Q_SLOTS:
    */
   void testEventDeliveryForWildcardTopic7();
 
+  /*
+   * Ensures ctkEventAdmin delivers events according to the topics of an
+   * ctkEventHandler after they changed from "a/b/&#42;" to "x/y", and does not
+   * deliver events to it after it has been unregistered.
+   */
+  void testEventDeliveryForWildcardTopic8();
+
 
 private:
 
@@ -0,0 +1,133 @@
+/*=============================================================================
+
+  Library: CTK
+
+  Copyright (c) German Cancer Research Center,
+    Division of Medical and Biological Informatics
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=============================================================================*/
+
+
+#include "ctkPluginFrameworkPerfLDAPTestSuite_p.h"
+
+#include <ctkHighPrecisionTimer.h>
+#include <ctkLDAPExpr_p.h>
+#include <ctkServiceProperties_p.h>
+
+#include <QTest>
+
+//----------------------------------------------------------------------------
+ctkPluginFrameworkPerfLDAPTestSuite::ctkPluginFrameworkPerfLDAPTestSuite()
+  : QObject(0)
+  , nEvaluations(100000)
+{
+  this->setObjectName("ctkPluginFrameworkPerfLDAPTestSuite");
+}
+
+//----------------------------------------------------------------------------
+void ctkPluginFrameworkPerfLDAPTestSuite::initTestCase()
+{
+  filters << "(objectclass=org.commontk.test.PerfTestService)"
+          << "(service.pid=my.service.*)"
+          << "(service.pid=*.service.4*)"
+          << "(perf.service.value>=10)"
+          << "(perf.service.ranking<=0.5)"
+          << "(perf.service.name~=perfservice)"
+          << "(perf.service.topics=org/commontk/*)"
+          << "(!(perf.service.missing=*))"
+          << "(&(objectclass=org.commontk.test.PerfTestService)(perf.service.value>=10)(!(service.pid=*.0)))"
+          << "(|(perf.service.value<=5)(service.pid=my.service.1*)(perf.service.name=Perf*Service))";
+
+  for (int i = 0; i < 4; ++i)
+  {
+    ctkDictionary props;
+    props.insert("objectclass", QStringList("org.commontk.test.PerfTestService"));
+    props.insert("service.id", static_cast<qlonglong>(i + 1));
+    props.insert("service.pid", QString("my.service.%1").arg(i * 14));
+    props.insert("perf.service.value", i * 7);
+    props.insert("perf.service.ranking", i * 0.25);
+    props.insert("perf.service.name", i % 2 ? "Perf Service" : "Other Service");
+    props.insert("perf.service.topics", QStringList() << "org/commontk/perf" << QString("topic/%1").arg(i));
+    properties.push_back(props);
+  }
+}
+
+//----------------------------------------------------------------------------
+void ctkPluginFrameworkPerfLDAPTestSuite::testCompiledResults()
+{
+  foreach (const QString& filter, filters)
+  {
+    ctkLDAPExpr ldap(filter);
+    foreach (const ctkDictionary& props, properties)
+    {
+      ctkServiceProperties p(props);
+      QVERIFY2(ldap.evaluate(p, true) == ldap.evaluateTree(p, true), qPrintable(filter));
+      QVERIFY2(ldap.evaluate(p, false) == ldap.evaluateTree(p, false), qPrintable(filter));
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+void ctkPluginFrameworkPerfLDAPTestSuite::testEvaluateTree()
+{
+  log() << "evaluating" << filters.size() << "filters" << nEvaluations
+        << "times by walking the expression trees";
+
+  ctkHighPrecisionTimer t;
+  t.start();
+  int matches = evaluate(false);
+  int ms = t.elapsedMilli();
+  log() << "evaluate tree took" << ms << "ms," << matches << "matches";
+}
+
+//----------------------------------------------------------------------------
+void ctkPluginFrameworkPerfLDAPTestSuite::testEvaluateCompiled()
+{
+  log() << "evaluating" << filters.size() << "filters" << nEvaluations
+        << "times with the compiled programs";
+
+  ctkHighPrecisionTimer t;
+  t.start();
+  int matches = evaluate(true);
+  int ms = t.elapsedMilli();
+  log() << "evaluate compiled took" << ms << "ms," << matches << "matches";
+}
+
+//----------------------------------------------------------------------------
+int ctkPluginFrameworkPerfLDAPTestSuite::evaluate(bool compiled)
+{
+  QList<ctkLDAPExpr> exprs;
+  foreach (const QString& filter, filters)
+  {
+    exprs.push_back(ctkLDAPExpr(filter));
+  }
+  QList<ctkServiceProperties> props;
+  foreach (const ctkDictionary& dictionary, properties)
+  {
+    props.push_back(ctkServiceProperties(dictionary));
+  }
+
+  int matches = 0;
+  for (int i = 0; i < nEvaluations; ++i)
+  {
+    const ctkLDAPExpr& ldap = exprs[i % exprs.size()];
+    const ctkServiceProperties& p = props[i % props.size()];
+    if (compiled ? ldap.evaluate(p, false) : ldap.evaluateTree(p, false))
+    {
+      ++matches;
+    }
+  }
+  return matches;
+}
@@ -0,0 +1,72 @@
+/*=============================================================================
+
+  Library: CTK
+
+  Copyright (c) German Cancer Research Center,
+    Division of Medical and Biological Informatics
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=============================================================================*/
+
+
+#ifndef CTKPLUGINFRAMEWORKPERFLDAPTESTSUITE_P_H
+#define CTKPLUGINFRAMEWORKPERFLDAPTESTSUITE_P_H
+
+#include "ctkTestSuiteInterface.h"
+
+#include <ctkPluginFramework_global.h>
+
+#include <QDebug>
+#include <QStringList>
+
+class ctkPluginFrameworkPerfLDAPTestSuite : public QObject, public ctkTestSuiteInterface
+{
+  Q_OBJECT
+  Q_INTERFACES(ctkTestSuiteInterface)
+
+private:
+
+  int nEvaluations;
+
+  QStringList filters;
+  QList<ctkDictionary> properties;
+
+public:
+
+  ctkPluginFrameworkPerfLDAPTestSuite();
+
+  QDebug log()
+  {
+    return qDebug() << "ldap_perf:";
+  }
+
+private Q_SLOTS:
+
+  void initTestCase();
+
+  /*
+   * Ensures the compiled filters give the same results as the evaluation
+   * of the parsed expression trees.
+   */
+  void testCompiledResults();
+
+  void testEvaluateTree();
+  void testEvaluateCompiled();
+
+private:
+
+  int evaluate(bool compiled);
+};
+
+#endif // CTKPLUGINFRAMEWORKPERFLDAPTESTSUITE_P_H
@@ -37,6 +37,8 @@ ctkPluginFrameworkPerfRegistryTestSuite::ctkPluginFrameworkPerfRegistryTestSuite
   , pc(context)
   , nListeners(100)
   , nServices(1000)
+  , nLookupThreads(8)
+  , nLookups(200)
   , nRegistered(0)
   , nUnregistering(0)
   , nModified(0)
@@ -136,6 +138,56 @@ void ctkPluginFrameworkPerfRegistryTestSuite::registerServices(int n)
   }
 }
 
+//----------------------------------------------------------------------------
+void ctkPluginFrameworkPerfRegistryTestSuite::testConcurrentLookups()
+{
+  int ms1 = lookupServices(1, QString(), nServices);
+  int msN = lookupServices(nLookupThreads, QString(), nServices);
+  QVERIFY2(ms1 >= 0 && msN >= 0, "Lookups must return the registered services");
+  log() << "lookups by class in 1 thread took" << ms1 << "ms, in"
+        << nLookupThreads << "threads" << msN << "ms";
+}
+
+//----------------------------------------------------------------------------
+void ctkPluginFrameworkPerfRegistryTestSuite::testConcurrentFilteredLookups()
+{
+  QString filter("(service.pid=my.service.42)");
+  int ms1 = lookupServices(1, filter, 1);
+  int msN = lookupServices(nLookupThreads, filter, 1);
+  QVERIFY2(ms1 >= 0 && msN >= 0, "Lookups must return the registered service");
+  log() << "lookups by" << filter << "in 1 thread took" << ms1 << "ms, in"
+        << nLookupThreads << "threads" << msN << "ms";
+}
+
+//----------------------------------------------------------------------------
+int ctkPluginFrameworkPerfRegistryTestSuite::lookupServices(int nThreads, const QString& filter, int expected)
+{
+  log() << "looking up services" << nLookups << "times in" << nThreads << "threads, filter=" << filter;
+
+  QList<ctkServiceLookupThread*> threads;
+  for (int i = 0; i < nThreads; i++)
+  {
+    threads.push_back(new ctkServiceLookupThread(pc, filter, nLookups, expected));
+  }
+
+  ctkHighPrecisionTimer t;
+  t.start();
+  foreach (ctkServiceLookupThread* thread, threads)
+  {
+    thread->start();
+  }
+  int nFailures = 0;
+  foreach (ctkServiceLookupThread* thread, threads)
+  {
+    thread->wait();
+    nFailures += thread->failures();
+  }
+  int ms = t.elapsedMilli();
+  qDeleteAll(threads);
+
+  return nFailures > 0 ? -1 : ms;
+}
+
 //----------------------------------------------------------------------------
 void ctkPluginFrameworkPerfRegistryTestSuite::testModifyServices()
 {
@@ -166,6 +218,58 @@ void ctkPluginFrameworkPerfRegistryTestSuite::modifyServices()
   }
 }
 
+//----------------------------------------------------------------------------
+void ctkPluginFrameworkPerfRegistryTestSuite::testModifiedServicesLookups()
+{
+  QCOMPARE(pc->getServiceReferences<IPerfTestService>("(service.pid=my.service.42)").size(), 0);
+  QCOMPARE(pc->getServiceReferences<IPerfTestService>("(perf.service.value=84)").size(), 1);
+  QCOMPARE(pc->getServiceReferences<IPerfTestService>(
+             "(|(service.pid=my.service.42)(perf.service.value=84))").size(), 1);
+
+  ctkServiceReference ref = pc->getServiceReference<IPerfTestService>();
+  QString filter = QString("(service.id=%1)").arg(ref.getProperty("service.id").toLongLong());
+  QCOMPARE(pc->getServiceReferences<IPerfTestService>(filter).size(), 1);
+  QCOMPARE(pc->getServiceReferences("", filter).size(), 1);
+  QCOMPARE(pc->getServiceReferences("org.commontk.NoSuchService", filter).size(), 0);
+}
+
+//----------------------------------------------------------------------------
+void ctkPluginFrameworkPerfRegistryTestSuite::testMultiValuedLookups()
+{
+  PerfTestService service;
+  ctkDictionary props;
+  props.insert("service.pid", QStringList() << "my.service.a" << "my.service.b");
+  ctkServiceRegistration reg = pc->registerService<IPerfTestService>(&service, props);
+
+  QCOMPARE(pc->getServiceReferences<IPerfTestService>("(service.pid=my.service.a)").size(), 1);
+  QCOMPARE(pc->getServiceReferences<IPerfTestService>(
+             "(&(service.pid=my.service.a)(service.pid=my.service.b))").size(), 1);
+  QCOMPARE(pc->getServiceReferences<IPerfTestService>(
+             "(&(service.pid=my.service.a)(service.pid=my.service.c))").size(), 0);
+  QCOMPARE(pc->getServiceReferences<IPerfTestService>(
+             "(&(service.pid=my.service.b)(|(service.pid=my.service.a)(service.pid=my.service.c)))").size(), 1);
+
+  reg.unregister();
+}
+
+//----------------------------------------------------------------------------
+void ctkPluginFrameworkPerfRegistryTestSuite::testServiceFactoryLookups()
+{
+  PerfTestServiceFactory factory(pc);
+  ctkDictionary props;
+  props.insert("service.pid", "my.service.factory");
+  ctkServiceRegistration reg =
+      pc->registerService<IPerfTestService>(&factory, props);
+
+  ctkServiceReference ref = reg.getReference();
+  QObject* service = pc->getService(ref);
+  QVERIFY2(service != 0, "The service factory must produce a service");
+  QCOMPARE(factory.lookedUpServices, 1);
+
+  pc->ungetService(ref);
+  reg.unregister();
+}
+
 //----------------------------------------------------------------------------
 void ctkPluginFrameworkPerfRegistryTestSuite::testUnregisterServices()
 {
@@ -219,3 +323,58 @@ void ctkServiceListener::serviceChanged(const ctkServiceEvent& ev)
     break;
   }
 }
+
+//----------------------------------------------------------------------------
+PerfTestServiceFactory::PerfTestServiceFactory(ctkPluginContext* pc)
+  : lookedUpServices(-1), pc(pc)
+{
+}
+
+//----------------------------------------------------------------------------
+QObject* PerfTestServiceFactory::getService(QSharedPointer<ctkPlugin> plugin,
+                                            ctkServiceRegistration registration)
+{
+  Q_UNUSED(plugin)
+  Q_UNUSED(registration)
+
+  // The framework holds the registration of this factory meanwhile, and
+  // the filter is evaluated against it
+  lookedUpServices = pc->getServiceReferences<IPerfTestService>(
+                       "(service.pid=my.service.factory)").size();
+  return new PerfTestService();
+}
+
+//----------------------------------------------------------------------------
+void PerfTestServiceFactory::ungetService(QSharedPointer<ctkPlugin> plugin,
+                                          ctkServiceRegistration registration,
+                                          QObject* service)
+{
+  Q_UNUSED(plugin)
+  Q_UNUSED(registration)
+  delete service;
+}
+
+//----------------------------------------------------------------------------
+ctkServiceLookupThread::ctkServiceLookupThread(ctkPluginContext* pc, const QString& filter,
+                                               int nLookups, int expected)
+  : pc(pc), filter(filter), nLookups(nLookups), expected(expected), nFailures(0)
+{
+}
+
+//----------------------------------------------------------------------------
+int ctkServiceLookupThread::failures() const
+{
+  return nFailures;
+}
+
+//----------------------------------------------------------------------------
+void ctkServiceLookupThread::run()
+{
+  for (int i = 0; i < nLookups; i++)
+  {
+    if (pc->getServiceReferences<IPerfTestService>(filter).size() != expected)
+    {
+      nFailures++;
+    }
+  }
+}
@@ -24,9 +24,11 @@
 #define CTKPLUGINFRAMEWORKPERFREGISTRYTESTSUITE_P_H
 
 #include "ctkTestSuiteInterface.h"
+#include "ctkServiceFactory.h"
 #include "ctkServiceRegistration.h"
 
 #include <QDebug>
+#include <QThread>
 
 class ctkPluginContext;
 class ctkServiceEvent;
@@ -44,6 +46,8 @@ private:
 
   int nListeners;
   int nServices;
+  int nLookupThreads;
+  int nLookups;
 
   int nRegistered;
   int nUnregistering;
@@ -68,6 +72,8 @@ private:
 
   void addListeners(int n);
   void registerServices(int n);
+  // Return the time taken in ms, -1 if a lookup returned an unexpected number of services
+  int lookupServices(int nThreads, const QString& filter, int expected);
   void modifyServices();
   void unregisterServices();
 
@@ -79,7 +85,29 @@ private Q_SLOTS:
   void testAddListeners();
   void testRegisterServices();
 
+  /*
+   * Look up the registered services from several threads at once, as
+   * event delivery does.
+   */
+  void testConcurrentLookups();
+  void testConcurrentFilteredLookups();
+
   void testModifyServices();
+  /*
+   * The modified services have no service.pid anymore, the
+   * indexed lookups must not find them.
+   */
+  void testModifiedServicesLookups();
+  /*
+   * A service matches several equality filters on the same indexed,
+   * multi-valued property.
+   */
+  void testMultiValuedLookups();
+  /*
+   * A service factory looking up services while the framework gets
+   * its service must not deadlock.
+   */
+  void testServiceFactoryLookups();
   void testUnregisterServices();
 };
 
@@ -100,6 +128,28 @@ protected Q_SLOTS:
   void serviceChanged(const ctkServiceEvent& ev);
 };
 
+class ctkServiceLookupThread : public QThread
+{
+public:
+
+  ctkServiceLookupThread(ctkPluginContext* pc, const QString& filter,
+                         int nLookups, int expected);
+
+  int failures() const;
+
+protected:
+
+  void run();
+
+private:
+
+  ctkPluginContext* pc;
+  QString filter;
+  int nLookups;
+  int expected;
+  int nFailures;
+};
+
 struct IPerfTestService
 {
   virtual ~IPerfTestService() {}
@@ -113,5 +163,24 @@ class PerfTestService : public QObject, public IPerfTestService
   Q_INTERFACES(IPerfTestService)
 };
 
+class PerfTestServiceFactory : public QObject, public ctkServiceFactory
+{
+  Q_OBJECT
+  Q_INTERFACES(ctkServiceFactory)
+
+public:
+
+  PerfTestServiceFactory(ctkPluginContext* pc);
+
+  QObject* getService(QSharedPointer<ctkPlugin> plugin, ctkServiceRegistration registration);
+  void ungetService(QSharedPointer<ctkPlugin> plugin, ctkServiceRegistration registration,
+                    QObject* service);
+
+  int lookedUpServices;
+
+private:
+
+  ctkPluginContext* pc;
+};
 
 #endif // CTKPLUGINFRAMEWORKPERFREGISTRYTESTSUITE_P_H
@@ -22,13 +22,14 @@
 #include "ctkPluginFrameworkTestPerfActivator_p.h"
 
 #include "ctkPluginFrameworkPerfRegistryTestSuite_p.h"
+#include "ctkPluginFrameworkPerfLDAPTestSuite_p.h"
 
 #include <QtPlugin>
 
 
 //----------------------------------------------------------------------------
 ctkPluginFrameworkTestPerfActivator::ctkPluginFrameworkTestPerfActivator()
-  : perfTestSuite(0)
+  : perfTestSuite(0), perfLDAPTestSuite(0)
 {
 
 }
@@ -37,6 +38,7 @@ ctkPluginFrameworkTestPerfActivator::ctkPluginFrameworkTestPerfActivator()
 ctkPluginFrameworkTestPerfActivator::~ctkPluginFrameworkTestPerfActivator()
 {
   delete perfTestSuite;
+  delete perfLDAPTestSuite;
 }
 
 //----------------------------------------------------------------------------
@@ -44,6 +46,9 @@ void ctkPluginFrameworkTestPerfActivator::start(ctkPluginContext* context)
 {
   perfTestSuite = new ctkPluginFrameworkPerfRegistryTestSuite(context);
   context->registerService<ctkTestSuiteInterface>(perfTestSuite);
+
+  perfLDAPTestSuite = new ctkPluginFrameworkPerfLDAPTestSuite();
+  context->registerService<ctkTestSuiteInterface>(perfLDAPTestSuite);
 }
 
 //----------------------------------------------------------------------------
@@ -53,6 +58,8 @@ void ctkPluginFrameworkTestPerfActivator::stop(ctkPluginContext* context)
 
   delete perfTestSuite;
   perfTestSuite = 0;
+  delete perfLDAPTestSuite;
+  perfLDAPTestSuite = 0;
 }
 
 #if QT_VERSION < QT_VERSION_CHECK(5,0,0)
@@ -46,6 +46,7 @@ public:
 private:
 
   QObject* perfTestSuite;
+  QObject* perfLDAPTestSuite;
 };
 
 #endif // CTKPLUGINFRAMEWORKTESTPERFACTIVATOR_H
@@ -27,6 +27,7 @@
 #include <ctkPluginException.h>
 #include <ctkServiceException.h>
 
+#include <QCryptographicHash>
 #include <QDir>
 #include <QTest>
 #include <QDebug>
@@ -539,6 +540,90 @@ void ctkPluginFrameworkTestSuite::frame070a()
   QVERIFY2(versionA1 != versionA, "framework test plug-in, update of plug-in failed, version info unchanged :FRAME070A:Fail");
 }
 
+//----------------------------------------------------------------------------
+// Get the resource store of a test plug-in library, named after the hash of its content
+static QFileInfo getResourceStore(ctkPluginContext* pc, const QString& pluginName)
+{
+  QDir testPluginDir(pc->getProperty("pluginfw.testDir").toString());
+  QStringList libFilter;
+  libFilter << "*" + pluginName + ".dll" << "*" + pluginName + ".so" << "*" + pluginName + ".dylib";
+  QFileInfoList libs = testPluginDir.entryInfoList(libFilter, QDir::Files);
+  if (libs.isEmpty())
+  {
+    return QFileInfo();
+  }
+
+  QFile lib(libs.front().absoluteFilePath());
+  lib.open(QIODevice::ReadOnly);
+  QString contentHash = QCryptographicHash::hash(lib.readAll(), QCryptographicHash::Sha1).toHex();
+
+  // The data directory of the plug-in is <storage>/data/<id>/
+  QDir storageDir = pc->getDataFile("resources").absoluteDir();
+  storageDir.cdUp();
+  storageDir.cdUp();
+  return QFileInfo(storageDir.absoluteFilePath("resources/" + contentHash + ".res"));
+}
+
+//----------------------------------------------------------------------------
+// Check that the resources of pluginA_test are stored by the hash of its library:
+// an unchanged library reuses its store, a changed library gets a new one,
+// and a missing or corrupted store is written again.
+void ctkPluginFrameworkTestSuite::frame075a()
+{
+  QFileInfo storeA = getResourceStore(pc, "pluginA_test");
+  QFileInfo storeA1 = getResourceStore(pc, "pluginA1_test");
+  QVERIFY2(storeA.filePath() != storeA1.filePath(), "pluginA_test and pluginA1_test have the same content hash");
+  QVERIFY2(storeA.exists(), "No resource store for pluginA_test");
+  // pluginA_test has been updated from the changed library pluginA1_test
+  QVERIFY2(storeA1.exists(), "No resource store for the updated pluginA_test");
+
+  pA->uninstall();
+  clearEvents();
+  QDateTime storeAModified = storeA.lastModified();
+  qint64 storeASize = storeA.size();
+  pA = ctkPluginFrameworkTestUtil::installPlugin(pc, "pluginA_test");
+  storeA.refresh();
+  QVERIFY2(storeA.lastModified() == storeAModified, "The resource store of an unchanged library was written again");
+  QCOMPARE(pA->getHeaders().value(ctkPluginConstants::PLUGIN_SYMBOLICNAME), QString("pluginA.test"));
+
+  pA->uninstall();
+  clearEvents();
+  QVERIFY(QFile::remove(storeA.absoluteFilePath()));
+  pA = ctkPluginFrameworkTestUtil::installPlugin(pc, "pluginA_test");
+  storeA.refresh();
+  QVERIFY2(storeA.exists() && storeA.size() == storeASize, "A missing resource store was not written again");
+  QCOMPARE(pA->getHeaders().value(ctkPluginConstants::PLUGIN_SYMBOLICNAME), QString("pluginA.test"));
+
+  QList<QByteArray> corruptedStores;
+  {
+    QFile store(storeA.absoluteFilePath());
+    QVERIFY(store.open(QIODevice::ReadOnly));
+    QByteArray content = store.readAll();
+    // Truncated data, truncated index, and an index entry with an invalid path size
+    corruptedStores << content.left(content.size() - 1)
+                    << content.left(12)
+                    << content.left(12) + QByteArray(4, '\x7f') + content.mid(16);
+  }
+  foreach (const QByteArray& corruptedStore, corruptedStores)
+  {
+    pA->uninstall();
+    clearEvents();
+    // Do not overwrite the mapped store of the uninstalled plug-in
+    QVERIFY(QFile::remove(storeA.absoluteFilePath()));
+    QFile store(storeA.absoluteFilePath());
+    QVERIFY(store.open(QIODevice::WriteOnly));
+    store.write(corruptedStore);
+    store.close();
+
+    pA = ctkPluginFrameworkTestUtil::installPlugin(pc, "pluginA_test");
+    storeA.refresh();
+    QVERIFY2(storeA.size() == storeASize, "A corrupted resource store was not written again");
+    QCOMPARE(pA->getHeaders().value(ctkPluginConstants::PLUGIN_SYMBOLICNAME), QString("pluginA.test"));
+  }
+
+  clearEvents();
+}
+
 //----------------------------------------------------------------------------
 void ctkPluginFrameworkTestSuite::frameworkListener(const ctkPluginFrameworkEvent& fwEvent)
 {
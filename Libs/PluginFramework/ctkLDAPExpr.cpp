@@ -24,8 +24,10 @@ limitations under the License.
 #include <ctkException.h>
 
 #include <QSet>
+#include <QSharedPointer>
 #include <QVariant>
 #include <QStringList>
+#include <QVector>
 
 #include <stdexcept>
 
@@ -88,6 +90,80 @@ public:
 
 };
 
+/**
+\brief Compiled LDAP Expression
+
+The expression tree is flattened into a list of instructions. AND and OR
+expressions short-circuit by jumping to the end of the expression, hence
+the program is evaluated in a single loop without recursion.
+
+The operand of each comparison is converted once to all the types it may
+be compared with, and wildcard patterns are split at the wildcards.
+\ingroup ctkPluginFramework
+*/
+class ctkLDAPExprProgram
+{
+public:
+
+  //!
+  void compile(const ctkLDAPExpr& expr);
+
+  //! Run the program. Same result as ctkLDAPExpr::evaluateTree().
+  bool evaluate(const ctkServiceProperties& p, bool matchCase) const;
+
+private:
+
+  enum OpCode
+  {
+    COMPARE,       // result = comparisons[arg]
+    JUMP_IF_FALSE, // if (!result) goto arg
+    JUMP_IF_TRUE,  // if (result) goto arg
+    NOT            // result = !result
+  };
+
+  struct Instruction
+  {
+    OpCode opCode;
+    int arg;
+  };
+
+  struct Comparison
+  {
+    QString attrName;
+    int op;
+    //! The operand, with WILDCARD in place of unescaped '*'
+    QString value;
+    //! The operand split at the wildcards
+    QStringList segments;
+    //! The length of the operand without the wildcards
+    int minLength;
+    //! Presence test "(name=*)"
+    bool isPresent;
+    //! The operand as compared by APPROX
+    QString approxValue;
+    //! The operand as compared with boolean values
+    bool differsFromTrue;
+    bool differsFromFalse;
+    //! The operand as compared with numeric values
+    int intValue;
+    float floatValue;
+    double doubleValue;
+    qlonglong longValue;
+  };
+
+  //!
+  static bool compare(const QVariant& obj, const Comparison& c);
+
+  //!
+  static bool compareString(const QString& s, const Comparison& c);
+
+  //! Same as ctkLDAPExpr::patSubstr() with the pattern split at the wildcards
+  static bool patSubstr(const QString& s, const Comparison& c);
+
+  QVector<Instruction> m_instructions;
+  QVector<Comparison> m_comparisons;
+};
+
 /**
 \brief LDAP Expression Data
 \date 19 May 2010
@@ -104,14 +180,16 @@ public:
   }
 
   ctkLDAPExprData( int op, QString attrName, QString attrValue )
-    : m_operator(op), m_attrName(attrName), m_attrValue(attrValue)
+    : m_operator(op), m_attrName(attrName), m_attrNameLower(attrName.toLower()),
+    m_attrValue(attrValue)
   {
   }
 
   ctkLDAPExprData( const ctkLDAPExprData& other )
     : QSharedData(other), m_operator(other.m_operator),
     m_args(other.m_args), m_attrName(other.m_attrName),
-    m_attrValue(other.m_attrValue)
+    m_attrNameLower(other.m_attrNameLower),
+    m_attrValue(other.m_attrValue), m_program(other.m_program)
   {
   }
 
@@ -122,7 +200,11 @@ public:
   //!
   QString m_attrName;
   //!
+  QString m_attrNameLower;
+  //!
   QString m_attrValue;
+  //! The compiled expression, only set on the root of a parsed filter
+  QSharedPointer<ctkLDAPExprProgram> m_program;
 };
 
 //----------------------------------------------------------------------------
@@ -151,6 +233,10 @@ ctkLDAPExpr::ctkLDAPExpr( const QString &filter )
     ps.error(GARBAGE + " '" + ps.rest() + "'");
   }
 
+  QSharedPointer<ctkLDAPExprProgram> program(new ctkLDAPExprProgram());
+  program->compile(expr);
+  expr.d->m_program = program;
+
   d = expr.d;
 }
 
@@ -186,38 +272,42 @@ ctkLDAPExpr::~ctkLDAPExpr()
 
 //----------------------------------------------------------------------------
 bool ctkLDAPExpr::getMatchedObjectClasses(QSet<QString>& objClasses) const
+{
+  return getMatchedValues(ctkPluginConstants::OBJECTCLASS, objClasses);
+}
+
+//----------------------------------------------------------------------------
+bool ctkLDAPExpr::getMatchedValues(const QString& attrName, QSet<QString>& values) const
 {
   if (d->m_operator == EQ)
   {
-    if (d->m_attrName.compare(ctkPluginConstants::OBJECTCLASS, Qt::CaseInsensitive) == 0 &&
+    if (d->m_attrName.compare(attrName, Qt::CaseInsensitive) == 0 &&
       d->m_attrValue.indexOf(WILDCARD) < 0) 
     {
-      objClasses.insert( d->m_attrValue );
+      values.insert( d->m_attrValue );
       return true;
     }
     return false;
   }
   else if (d->m_operator == AND) 
   {
+    // Multi-valued attributes can match several operands at once, so the
+    // values of the operands are not intersected. The values of the most
+    // selective operand are a superset of the matching values, the
+    // candidates they select must still be evaluated against the filter.
     bool result = false;
+    QSet<QString> smallest;
     for (int i = 0; i < d->m_args.size( ); i++)
     {
       QSet<QString> r;
-      if(d->m_args[i].getMatchedObjectClasses(r))
+      if(d->m_args[i].getMatchedValues(attrName, r) &&
+         (!result || r.size() < smallest.size()))
       {
         result = true;
-        if (objClasses.empty())
-        {
-          objClasses = r;
-        }
-        else
-        {
-          // if AND op and classes in several operands,
-          // then only the intersection is possible.
-          objClasses.intersect(r);
-        }
+        smallest = r;
       }
     }
+    values += smallest;
     return result;
   }
   else if (d->m_operator == OR)
@@ -225,13 +315,13 @@ bool ctkLDAPExpr::getMatchedObjectClasses(QSet<QString>& objClasses) const
     for (int i = 0; i < d->m_args.length( ); i++)
     {
       QSet<QString> r;
-      if (d->m_args[i].getMatchedObjectClasses(r))
+      if (d->m_args[i].getMatchedValues(attrName, r))
       {
-        objClasses += r;
+        values += r;
       }
       else
       {
-        objClasses.clear();
+        values.clear();
         return false;
       }
     }
@@ -253,7 +343,7 @@ bool ctkLDAPExpr::isSimple(
 
   if (d->m_operator == EQ) {
     int index;
-    if ((index = keywords.indexOf(matchCase ? d->m_attrName : d->m_attrName.toLower())) >= 0 &&
+    if ((index = keywords.indexOf(matchCase ? d->m_attrName : d->m_attrNameLower)) >= 0 &&
       d->m_attrValue.indexOf(WILDCARD) < 0) {
         cache[index] = QStringList(d->m_attrValue);
         return true;
@@ -282,6 +372,16 @@ bool ctkLDAPExpr::query( const QString &filter, const ctkDictionary &pd )
 
 //----------------------------------------------------------------------------
 bool ctkLDAPExpr::evaluate( const ctkServiceProperties &p, bool matchCase ) const
+{
+  if (d->m_program)
+  {
+    return d->m_program->evaluate(p, matchCase);
+  }
+  return evaluateTree(p, matchCase);
+}
+
+//----------------------------------------------------------------------------
+bool ctkLDAPExpr::evaluateTree( const ctkServiceProperties &p, bool matchCase ) const
 {
   if ((d->m_operator & SIMPLE) != 0) {
     // try case sensitive match first
@@ -292,18 +392,18 @@ bool ctkLDAPExpr::evaluate( const ctkServiceProperties &p, bool matchCase ) cons
     switch (d->m_operator) {
     case AND:
       for (int i = 0; i < d->m_args.length( ); i++) {
-        if (!d->m_args[i].evaluate(p, matchCase))
+        if (!d->m_args[i].evaluateTree(p, matchCase))
           return false;
       }
       return true;
     case OR:
       for (int i = 0; i < d->m_args.length( ); i++) {
-        if (d->m_args[i].evaluate(p, matchCase))
+        if (d->m_args[i].evaluateTree(p, matchCase))
           return true;
       }
       return false;
     case NOT:
-      return !d->m_args[0].evaluate(p, matchCase);
+      return !d->m_args[0].evaluateTree(p, matchCase);
     default:
       return false; // Cannot happen
     }
@@ -318,7 +418,15 @@ bool ctkLDAPExpr::compare( const QVariant &obj, int op, const QString &s ) const
   if (op == EQ && s == WILDCARD_QString )
     return true;
   try {
-    if ( obj.canConvert<QString>( ) ) {
+    // Lists first: a QStringList can be converted to a QString too
+    if (obj.type() == QVariant::StringList || obj.type() == QVariant::List) {
+      QList<QVariant> list = obj.toList();
+      QList<QVariant>::Iterator it;
+      for (it=list.begin(); it != list.end( ); it++)
+         if (compare(*it, op, s))
+           return true;
+      return false;
+    } else if ( obj.canConvert<QString>( ) ) {
       return compareString(obj.toString(), op, s);
     } else if (obj.canConvert<char>( ) ) {
       return compareString(obj.toString(), op, s);
@@ -369,13 +477,6 @@ bool ctkLDAPExpr::compare( const QVariant &obj, int op, const QString &s ) const
         return obj.toLongLong() == s.toLongLong( );
       }
     } 
-    else if (obj.canConvert< QList<QVariant> >()) {
-      QList<QVariant> list = obj.toList();
-      QList<QVariant>::Iterator it;
-      for (it=list.begin(); it != list.end( ); it++)
-         if (compare(*it, op, s))
-           return true;
-    } 
   } catch (...) {
     // This might happen if a QString-to-datatype conversion fails
     // Just consider it a false match and ignore the exception
@@ -447,6 +548,222 @@ bool ctkLDAPExpr::patSubstr( const QString &s, const QString &pat )
   return s.isNull() ? false : patSubstr(s,0,pat,0);
 }
 
+//----------------------------------------------------------------------------
+void ctkLDAPExprProgram::compile( const ctkLDAPExpr& expr )
+{
+  const ctkLDAPExprData* d = expr.d.constData();
+  if ((d->m_operator & ctkLDAPExpr::SIMPLE) != 0)
+  {
+    Comparison c;
+    c.attrName = d->m_attrName;
+    c.op = d->m_operator;
+    c.value = d->m_attrValue;
+    c.segments = d->m_attrValue.split(ctkLDAPExpr::WILDCARD);
+    c.minLength = d->m_attrValue.size() - (c.segments.size() - 1);
+    c.isPresent = c.op == ctkLDAPExpr::EQ && c.value == ctkLDAPExpr::WILDCARD_QString;
+    c.approxValue = ctkLDAPExpr::fixupString(c.value);
+    c.differsFromTrue = c.value.compare("true", Qt::CaseInsensitive) != 0;
+    c.differsFromFalse = c.value.compare("false", Qt::CaseInsensitive) != 0;
+    c.intValue = c.value.toInt();
+    c.floatValue = c.value.toFloat();
+    c.doubleValue = c.value.toDouble();
+    c.longValue = c.value.toLongLong();
+
+    Instruction instruction = { COMPARE, m_comparisons.size() };
+    m_comparisons.push_back(c);
+    m_instructions.push_back(instruction);
+  }
+  else if (d->m_operator == ctkLDAPExpr::NOT)
+  {
+    compile(d->m_args[0]);
+    Instruction instruction = { NOT, 0 };
+    m_instructions.push_back(instruction);
+  }
+  else
+  {
+    // AND stops at the first false operand, OR at the first true one
+    OpCode jump = d->m_operator == ctkLDAPExpr::AND ? JUMP_IF_FALSE : JUMP_IF_TRUE;
+    QVector<int> jumps;
+    for (int i = 0; i < d->m_args.size(); ++i)
+    {
+      compile(d->m_args[i]);
+      if (i < d->m_args.size() - 1)
+      {
+        Instruction instruction = { jump, -1 };
+        jumps.push_back(m_instructions.size());
+        m_instructions.push_back(instruction);
+      }
+    }
+    for (int i = 0; i < jumps.size(); ++i)
+    {
+      m_instructions[jumps[i]].arg = m_instructions.size();
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+bool ctkLDAPExprProgram::evaluate( const ctkServiceProperties& p, bool matchCase ) const
+{
+  bool result = false;
+  const int size = m_instructions.size();
+  for (int pc = 0; pc < size; )
+  {
+    const Instruction& instruction = m_instructions[pc];
+    switch (instruction.opCode)
+    {
+    case COMPARE:
+    {
+      const Comparison& c = m_comparisons[instruction.arg];
+      // try case sensitive match first
+      int index = p.findCaseSensitive(c.attrName);
+      if (index < 0 && !matchCase) index = p.find(c.attrName);
+      result = index < 0 ? false : compare(p.value(index), c);
+      ++pc;
+      break;
+    }
+    case JUMP_IF_FALSE:
+      pc = result ? pc + 1 : instruction.arg;
+      break;
+    case JUMP_IF_TRUE:
+      pc = result ? instruction.arg : pc + 1;
+      break;
+    case NOT:
+      result = !result;
+      ++pc;
+      break;
+    }
+  }
+  return result;
+}
+
+//----------------------------------------------------------------------------
+bool ctkLDAPExprProgram::compare( const QVariant& obj, const Comparison& c )
+{
+  // The types are tried in the same order as in ctkLDAPExpr::compare()
+  if (obj.isNull())
+    return false;
+  if (c.isPresent)
+    return true;
+  // Lists first: a QStringList can be converted to a QString too
+  if (obj.type() == QVariant::StringList || obj.type() == QVariant::List)
+  {
+    const QList<QVariant> list = obj.toList();
+    for (QList<QVariant>::ConstIterator it = list.begin(); it != list.end(); ++it)
+    {
+      if (compare(*it, c))
+        return true;
+    }
+    return false;
+  }
+  if (obj.canConvert<QString>() || obj.canConvert<char>())
+  {
+    return compareString(obj.toString(), c);
+  }
+  else if (obj.canConvert<bool>())
+  {
+    if (c.op == ctkLDAPExpr::LE || c.op == ctkLDAPExpr::GE)
+      return false;
+    return obj.toBool() ? c.differsFromTrue : c.differsFromFalse;
+  }
+  else if (obj.canConvert<ctkLDAPExpr::Byte>() || obj.canConvert<int>())
+  {
+    switch (c.op)
+    {
+    case ctkLDAPExpr::LE:
+      return obj.toInt() <= c.intValue;
+    case ctkLDAPExpr::GE:
+      return obj.toInt() >= c.intValue;
+    default: /*APPROX and EQ*/
+      return obj.toInt() == c.intValue;
+    }
+  }
+  else if (obj.canConvert<float>())
+  {
+    switch (c.op)
+    {
+    case ctkLDAPExpr::LE:
+      return obj.toFloat() <= c.floatValue;
+    case ctkLDAPExpr::GE:
+      return obj.toFloat() >= c.floatValue;
+    default: /*APPROX and EQ*/
+      return obj.toFloat() == c.floatValue;
+    }
+  }
+  else if (obj.canConvert<double>())
+  {
+    switch (c.op)
+    {
+    case ctkLDAPExpr::LE:
+      return obj.toDouble() <= c.doubleValue;
+    case ctkLDAPExpr::GE:
+      return obj.toDouble() >= c.doubleValue;
+    default: /*APPROX and EQ*/
+      return obj.toDouble() == c.doubleValue;
+    }
+  }
+  else if (obj.canConvert<qlonglong>())
+  {
+    switch (c.op)
+    {
+    case ctkLDAPExpr::LE:
+      return obj.toLongLong() <= c.longValue;
+    case ctkLDAPExpr::GE:
+      return obj.toLongLong() >= c.longValue;
+    default: /*APPROX and EQ*/
+      return obj.toLongLong() == c.longValue;
+    }
+  }
+  return false;
+}
+
+//----------------------------------------------------------------------------
+bool ctkLDAPExprProgram::compareString( const QString& s, const Comparison& c )
+{
+  switch (c.op)
+  {
+  case ctkLDAPExpr::LE:
+    return s.compare(c.value) <= 0;
+  case ctkLDAPExpr::GE:
+    return s.compare(c.value) >= 0;
+  case ctkLDAPExpr::EQ:
+    return patSubstr(s, c);
+  case ctkLDAPExpr::APPROX:
+    return c.approxValue == ctkLDAPExpr::fixupString(s);
+  default:
+    return false;
+  }
+}
+
+//----------------------------------------------------------------------------
+bool ctkLDAPExprProgram::patSubstr( const QString& s, const Comparison& c )
+{
+  if (s.isNull())
+    return false;
+
+  const QStringList& segments = c.segments;
+  if (segments.size() == 1)
+    return s == c.value;
+
+  // The first and last segments are anchored, the ones in between are
+  // matched at their leftmost position
+  if (s.size() < c.minLength || !s.startsWith(segments.first()) || !s.endsWith(segments.last()))
+    return false;
+
+  int pos = segments.first().size();
+  const int end = s.size() - segments.last().size();
+  for (int i = 1; i < segments.size() - 1; ++i)
+  {
+    const QString& segment = segments[i];
+    if (segment.isEmpty())
+      continue;
+    int found = s.indexOf(segment, pos);
+    if (found < 0 || found + segment.size() > end)
+      return false;
+    pos = found + segment.size();
+  }
+  return true;
+}
+
 //----------------------------------------------------------------------------
 ctkLDAPExpr ctkLDAPExpr::parseExpr( ParseState &ps )
 {
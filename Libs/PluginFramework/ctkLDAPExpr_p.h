@@ -32,15 +32,21 @@ limitations under the License.
 #include <QStringList>
 
 class ctkLDAPExprData;
+class ctkLDAPExprProgram;
 
 /**
 \ingroup PluginFramework
 \brief LDAP Expression
+
+A filter parsed from a string is compiled into a flat program, in which
+the operands of the comparisons are converted once to the types they may
+be compared with. evaluate() runs this program.
+
 \date 19 May 2010
 \author Xavi Planes
 \ingroup ctkPluginFramework
 */
-class ctkLDAPExpr {
+class CTK_PLUGINFW_EXPORT ctkLDAPExpr {
 
 public:
 
@@ -84,6 +90,19 @@ public:
    */
   bool getMatchedObjectClasses(QSet<QString>& objClasses) const;
 
+  /**
+   * Get a set of values, one of which an attribute must be equal to for this
+   * LDAP expression to match, like getMatchedObjectClasses() does for the
+   * <code>objectclass</code> attribute. The set is not exact, the expression
+   * must still be evaluated against the properties having one of these values.
+   *
+   * \param attrName The attribute name, matched case insensitively.
+   * \param values The set of matched values will be added to values.
+   * \return If the set cannot be determined, <code>false</code> is returned,
+   *         <code>true</code> otherwise.
+   */
+  bool getMatchedValues(const QString& attrName, QSet<QString>& values) const;
+
   /**
    * Checks if this LDAP expression is "simple". The definition of
    * a simple filter is:
@@ -126,12 +145,21 @@ public:
   //! Evaluate this LDAP filter.
   bool evaluate(const ctkServiceProperties &p, bool matchCase) const;
 
+  /**
+   * Evaluate this LDAP filter by walking the parsed expression tree. This
+   * gives the same result as evaluate() and is used as a reference by the
+   * tests and benchmarks.
+   */
+  bool evaluateTree(const ctkServiceProperties &p, bool matchCase) const;
+
   //!
   const QString toString() const;
 
 
 private:
 
+  friend class ctkLDAPExprProgram;
+
   class ParseState;
 
   //!
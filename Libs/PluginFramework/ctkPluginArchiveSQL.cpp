@@ -22,8 +22,8 @@
 #include "ctkPluginArchiveSQL_p.h"
 
 #include "ctkPluginException.h"
+#include "ctkPluginResourceStore_p.h"
 #include "ctkPluginStorageSQL_p.h"
-#include "ctkPluginDatabaseException.h"
 
 #include <QStringList>
 #include <QFile>
@@ -99,29 +99,21 @@ QString ctkPluginArchiveSQL::getLibLocation() const
 //----------------------------------------------------------------------------
 QByteArray ctkPluginArchiveSQL::getPluginResource(const QString& component) const
 {
-  try
+  if (resources.isNull())
   {
-    return storage->getPluginResource(key, component);
-  }
-  catch (const ctkPluginDatabaseException& exc)
-  {
-    qDebug() << QString("Getting plugin resource %1 failed:").arg(component) << exc;
     return QByteArray();
   }
+  return resources->getResource(component);
 }
 
 //----------------------------------------------------------------------------
 QStringList ctkPluginArchiveSQL::findResourcesPath(const QString& path) const
 {
-  try
-  {
-    return storage->findResourcesPath(key, path);
-  }
-  catch (const ctkPluginDatabaseException& exc)
+  if (resources.isNull())
   {
-    qDebug() << QString("Getting plugin resource paths for %1 failed:").arg(path) << exc;
+    return QStringList();
   }
-  return QStringList();
+  return resources->findResourcesPath(path);
 }
 
 //----------------------------------------------------------------------------
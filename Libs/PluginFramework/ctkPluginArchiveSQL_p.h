@@ -33,6 +33,7 @@
 #include "ctkPluginManifest_p.h"
 
 // CTK foraward declarations
+class ctkPluginResourceStore;
 class ctkPluginStorageSQL;
 
 /**
@@ -110,7 +111,8 @@ public:
 
   /**
    * Get a Qt resource as a byte array from a plugin. The resource
-   * is cached and may be aquired even if the plugin is not active.
+   * is read from the resource store of the plugin and may be aquired
+   * even if the plugin is not active.
    *
    * @param component Resource to get the byte array from.
    * @return QByteArray to the entry (empty if it doesn't exist).
@@ -188,6 +190,13 @@ public:
 
   int key;
 
+  /**
+   * The hash of the plugin library content, naming its resource store.
+   */
+  QString contentHash;
+
+  QSharedPointer<ctkPluginResourceStore> resources;
+
 private:
 
   int autostartSetting;
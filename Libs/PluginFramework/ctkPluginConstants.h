@@ -122,6 +122,19 @@ struct CTK_PLUGINFW_EXPORT ctkPluginConstants {
    */
   static const QString FRAMEWORK_PRELOAD_LIBRARIES; // = "org.commontk.pluginfw.preloadlibs"
 
+  /**
+   * Specifies the service properties for which the framework keeps an index
+   * of the registered services by property value. The value of this property
+   * must be either of type QString or QStringList.
+   *
+   * Service lookups whose filter requires one of these properties to be equal
+   * to given values, like <code>(service.pid=my.service)</code>, only evaluate
+   * the filter against the services having these values. If this property is
+   * not set, the <code>service.id</code> and <code>service.pid</code>
+   * properties are indexed.
+   */
+  static const QString FRAMEWORK_SERVICE_INDEXED_PROPERTIES; // = "org.commontk.pluginfw.service.indexedproperties"
+
   /**
    * Manifest header identifying the plugin's symbolic name.
    *
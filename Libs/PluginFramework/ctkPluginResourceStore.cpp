@@ -0,0 +1,305 @@
+/*=============================================================================
+
+  Library: CTK
+
+  Copyright (c) German Cancer Research Center,
+    Division of Medical and Biological Informatics
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=============================================================================*/
+
+
+#include "ctkPluginResourceStore_p.h"
+
+#include <QBuffer>
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDebug>
+#include <QDirIterator>
+#include <QFileInfo>
+#include <QSet>
+#include <QTemporaryFile>
+
+namespace {
+
+const char magic[] = "CTKRES01";
+const int magicSize = sizeof(magic) - 1;
+
+}
+
+//----------------------------------------------------------------------------
+ctkPluginResourceStore::ctkPluginResourceStore(const QString& path)
+  : file(path), opened(false), data(0)
+{
+}
+
+//----------------------------------------------------------------------------
+QString ctkPluginResourceStore::getPath() const
+{
+  return file.fileName();
+}
+
+//----------------------------------------------------------------------------
+QByteArray ctkPluginResourceStore::getResource(const QString& res) const
+{
+  QMutexLocker lock(&mutex);
+  if (!open())
+  {
+    return QByteArray();
+  }
+
+  QString resourcePath = res.startsWith('/') ? res : QString("/") + res;
+  QHash<QString, QPair<qint64, qint64> >::ConstIterator it = resources.find(resourcePath);
+  if (it == resources.end())
+  {
+    return QByteArray();
+  }
+
+  // The pages of the resource are only read from disk now
+  return QByteArray(reinterpret_cast<const char*>(data + it.value().first),
+                    static_cast<int>(it.value().second));
+}
+
+//----------------------------------------------------------------------------
+bool ctkPluginResourceStore::isValid() const
+{
+  QMutexLocker lock(&mutex);
+  if (!opened && !file.exists())
+  {
+    return false;
+  }
+  return open();
+}
+
+//----------------------------------------------------------------------------
+QStringList ctkPluginResourceStore::findResourcesPath(const QString& path) const
+{
+  QMutexLocker lock(&mutex);
+  if (!open())
+  {
+    return QStringList();
+  }
+
+  QString resourcePath = path.startsWith('/') ? path : QString("/") + path;
+  if (!resourcePath.endsWith('/'))
+    resourcePath += "/";
+
+  QSet<QString> paths;
+  QHashIterator<QString, QPair<qint64, qint64> > it(resources);
+  while (it.hasNext())
+  {
+    const QString& currPath = it.next().key();
+    if (!currPath.startsWith(resourcePath)) continue;
+
+    QStringList components = currPath.mid(resourcePath.size()).split('/', QString::SkipEmptyParts);
+    if (components.size() == 1)
+    {
+      paths << components.front();
+    }
+    else if (components.size() > 1)
+    {
+      paths << components.front() + "/";
+    }
+  }
+
+  return paths.toList();
+}
+
+//----------------------------------------------------------------------------
+bool ctkPluginResourceStore::open() const
+{
+  if (opened)
+  {
+    return data != 0;
+  }
+  opened = true;
+
+  if (!file.open(QIODevice::ReadOnly))
+  {
+    qWarning() << "Could not open plugin resource store" << file.fileName() << ":" << file.errorString();
+    return false;
+  }
+
+  const qint64 size = file.size();
+  const uchar* map = size > 0 ? file.map(0, size) : 0;
+  if (map == 0 || size < magicSize || qstrncmp(reinterpret_cast<const char*>(map), magic, magicSize) != 0)
+  {
+    qWarning() << "Invalid plugin resource store" << file.fileName();
+    file.close();
+    return false;
+  }
+
+  // Read the index without copying the mapped file
+  QByteArray content = QByteArray::fromRawData(reinterpret_cast<const char*>(map), static_cast<int>(size));
+  QBuffer buffer(&content);
+  buffer.open(QIODevice::ReadOnly);
+  buffer.seek(magicSize);
+  QDataStream in(&buffer);
+  in.setVersion(QDataStream::Qt_4_6);
+
+  quint32 count = 0;
+  in >> count;
+  QList<QPair<QString, QPair<qint64, qint64> > > entries;
+  for (quint32 i = 0; i < count && in.status() == QDataStream::Ok; ++i)
+  {
+    // Check the size of the path before QDataStream allocates it
+    quint32 pathSize = 0;
+    in >> pathSize;
+    if (in.status() != QDataStream::Ok || pathSize % 2 != 0 || pathSize > buffer.bytesAvailable())
+    {
+      in.setStatus(QDataStream::ReadCorruptData);
+      break;
+    }
+    buffer.seek(buffer.pos() - static_cast<qint64>(sizeof(pathSize)));
+
+    QString resourcePath;
+    qint64 offset = 0;
+    qint64 resourceSize = 0;
+    in >> resourcePath >> offset >> resourceSize;
+    entries.push_back(qMakePair(resourcePath, qMakePair(offset, resourceSize)));
+  }
+
+  // Offsets are relative to the data following the index
+  const qint64 dataStart = buffer.pos();
+  if (in.status() != QDataStream::Ok)
+  {
+    qWarning() << "Invalid plugin resource store" << file.fileName();
+    file.close();
+    return false;
+  }
+  for (int i = 0; i < entries.size(); ++i)
+  {
+    const qint64 offset = dataStart + entries[i].second.first;
+    const qint64 resourceSize = entries[i].second.second;
+    if (offset < dataStart || resourceSize < 0 || resourceSize > size - offset)
+    {
+      qWarning() << "Invalid plugin resource store" << file.fileName();
+      resources.clear();
+      file.close();
+      return false;
+    }
+    resources.insert(entries[i].first, qMakePair(offset, resourceSize));
+  }
+
+  data = map;
+  return true;
+}
+
+//----------------------------------------------------------------------------
+bool ctkPluginResourceStore::write(const QString& resourcePrefix, const QString& path)
+{
+  QList<QPair<QString, QString> > resourceFiles;
+  QDirIterator dirIter(resourcePrefix, QDirIterator::Subdirectories);
+  while (dirIter.hasNext())
+  {
+    QString resourcePath = dirIter.next();
+    if (QFileInfo(resourcePath).isDir()) continue;
+
+    resourceFiles.push_back(qMakePair(resourcePath.mid(resourcePrefix.size()-1), resourcePath));
+  }
+
+  // The resources of a plugin are small, write the index first and then
+  // the data, so the sizes must be known in advance
+  QList<QByteArray> resourceData;
+  for (int i = 0; i < resourceFiles.size(); ++i)
+  {
+    QFile resourceFile(resourceFiles[i].second);
+    if (!resourceFile.open(QIODevice::ReadOnly))
+    {
+      qWarning() << "Could not read plugin resource" << resourceFiles[i].second << ":" << resourceFile.errorString();
+      return false;
+    }
+    // The store is keyed by the content hash of the library and never
+    // written again: an incomplete resource must not end up in it
+    QByteArray bytes = resourceFile.readAll();
+    if (resourceFile.error() != QFile::NoError || bytes.size() != resourceFile.size())
+    {
+      qWarning() << "Could not read plugin resource" << resourceFiles[i].second << ":" << resourceFile.errorString();
+      return false;
+    }
+    resourceData.push_back(bytes);
+    resourceFile.close();
+  }
+
+  // Plugins with the same library content, possibly in other processes,
+  // may write the same store at the same time
+  QTemporaryFile out(path + ".XXXXXX");
+  if (!out.open())
+  {
+    qWarning() << "Could not write plugin resource store" << out.fileName() << ":" << out.errorString();
+    return false;
+  }
+
+  out.write(magic, magicSize);
+  QDataStream stream(&out);
+  stream.setVersion(QDataStream::Qt_4_6);
+  stream << static_cast<quint32>(resourceFiles.size());
+  qint64 offset = 0;
+  for (int i = 0; i < resourceFiles.size(); ++i)
+  {
+    const qint64 resourceSize = resourceData[i].size();
+    stream << resourceFiles[i].first << offset << resourceSize;
+    offset += resourceSize;
+  }
+  foreach (const QByteArray& bytes, resourceData)
+  {
+    stream.writeRawData(bytes.constData(), bytes.size());
+  }
+
+  bool success = stream.status() == QDataStream::Ok && out.error() == QFile::NoError;
+  out.close();
+
+  if (!success)
+  {
+    qWarning() << "Could not write plugin resource store" << out.fileName() << ":" << out.errorString();
+    return false;
+  }
+
+  // Never map a partially written store
+  QFile::remove(path);
+  if (!out.rename(path))
+  {
+    // Another writer of the same content may have renamed its store meanwhile
+    if (QFile::exists(path))
+    {
+      return true;
+    }
+    qWarning() << "Could not write plugin resource store" << path << ":" << out.errorString();
+    return false;
+  }
+  out.setAutoRemove(false);
+  return true;
+}
+
+//----------------------------------------------------------------------------
+QString ctkPluginResourceStore::contentHash(const QString& libPath)
+{
+  QFile lib(libPath);
+  if (!lib.open(QIODevice::ReadOnly))
+  {
+    return QString();
+  }
+
+  QCryptographicHash hash(QCryptographicHash::Sha1);
+  while (!lib.atEnd())
+  {
+    QByteArray chunk = lib.read(1 << 16);
+    if (chunk.isEmpty() && lib.error() != QFile::NoError)
+    {
+      return QString();
+    }
+    hash.addData(chunk);
+  }
+  return QString::fromLatin1(hash.result().toHex());
+}
@@ -0,0 +1,130 @@
+/*=============================================================================
+
+  Library: CTK
+
+  Copyright (c) German Cancer Research Center,
+    Division of Medical and Biological Informatics
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=============================================================================*/
+
+
+#ifndef CTKPLUGINRESOURCESTORE_P_H
+#define CTKPLUGINRESOURCESTORE_P_H
+
+#include <QFile>
+#include <QHash>
+#include <QMutex>
+#include <QPair>
+#include <QStringList>
+
+/**
+ * \ingroup PluginFramework
+ *
+ * A file containing the Qt resources of a plugin, which is memory mapped
+ * when a resource is first requested.
+ *
+ * The file starts with an index giving the offset and the size of each
+ * resource, followed by the resource data. Plugin libraries with the same
+ * content share the same resource store, named after the hash of the
+ * library content (see contentHash()), hence the library of a plugin only
+ * needs to be loaded to extract its resources the first time it is
+ * installed.
+ */
+class ctkPluginResourceStore
+{
+
+public:
+
+  /**
+   * Create a resource store for the given file. The file is not
+   * opened until a resource is requested.
+   *
+   * @param path The path of the resource store file.
+   */
+  ctkPluginResourceStore(const QString& path);
+
+  /**
+   * Get the path of the resource store file.
+   */
+  QString getPath() const;
+
+  /**
+   * Get a resource of the plugin.
+   *
+   * @param res The path to the resource in the plugin, relative to the
+   *        plugin specific resource prefix, but may start with a '/'.
+   * @return The resource data, empty if the resource does not exist.
+   */
+  QByteArray getResource(const QString& res) const;
+
+  /**
+   * Check that the resource store file exists and is not corrupted.
+   * The file is mapped as when a resource is requested.
+   */
+  bool isValid() const;
+
+  /**
+   * Get a list of resource entries under the given path.
+   *
+   * @param path A resource path relative to the plugin specific resource prefix.
+   * @return The entries, directories end with a '/'.
+   */
+  QStringList findResourcesPath(const QString& path) const;
+
+  /**
+   * Write the Qt resources under the given prefix to a resource store
+   * file. The plugin library providing the resources must be loaded.
+   *
+   * @param resourcePrefix The plugin specific resource prefix, like
+   *        <code>:/org.commontk.eventadmin/</code>.
+   * @param path The path of the resource store file.
+   * @return <code>false</code> if a resource could not be read or the file
+   *         could not be written. No file is written in this case.
+   */
+  static bool write(const QString& resourcePrefix, const QString& path);
+
+  /**
+   * Compute the hash of the content of a plugin library, used as the
+   * name of its resource store.
+   *
+   * @param libPath The path to the plugin library.
+   * @return The hexadecimal SHA-1 hash of the library, empty if it
+   *         could not be read.
+   */
+  static QString contentHash(const QString& libPath);
+
+private:
+
+  Q_DISABLE_COPY(ctkPluginResourceStore)
+
+  /**
+   * Map the file and read its index, if not done yet. The caller must
+   * hold <code>mutex</code>.
+   *
+   * @return <code>false</code> if the file is missing or corrupted.
+   */
+  bool open() const;
+
+  mutable QMutex mutex;
+  mutable QFile file;
+  mutable bool opened;
+  mutable const uchar* data;
+
+  // Offset and size of each resource, by its path starting with '/'
+  mutable QHash<QString, QPair<qint64, qint64> > resources;
+
+};
+
+#endif // CTKPLUGINRESOURCESTORE_P_H
@@ -25,17 +25,21 @@
 #include "ctkPluginConstants.h"
 #include "ctkPluginException.h"
 #include "ctkPluginArchiveSQL_p.h"
+#include "ctkPluginResourceStore_p.h"
 #include "ctkPluginStorage_p.h"
 #include "ctkPluginFrameworkUtil_p.h"
 #include "ctkPluginFrameworkContext_p.h"
 #include "ctkServiceException.h"
 
 #include <QFileInfo>
+#include <QSet>
+#include <QSqlRecord>
 #include <QUrl>
 #include <QThread>
 
 //database table names
 #define PLUGINS_TABLE "Plugins"
+// Resources were stored in the database before the resource stores
 #define PLUGIN_RESOURCES_TABLE "PluginResources"
 
 //----------------------------------------------------------------------------
@@ -48,7 +52,8 @@ enum TBindIndexes
   EBindIndex4,
   EBindIndex5,
   EBindIndex6,
-  EBindIndex7
+  EBindIndex7,
+  EBindIndex8
 };
 
 //----------------------------------------------------------------------------
@@ -188,6 +193,8 @@ void ctkPluginStorageSQL::open()
   //Update database based on the recorded timestamps
   updateDB();
 
+  removeUnusedResourceStores();
+
   initNextFreeIds();
 }
 
@@ -260,7 +267,7 @@ void ctkPluginStorageSQL::updateDB()
   // 1. Get the state information of all plug-ins (it is assumed that
   //    plug-ins marked as UNINSTALLED (startlevel == -2) are already removed
 
-  QString statement = "SELECT ID,MAX(Generation),Location,LocalPath,Timestamp,StartLevel,AutoStart,K "
+  QString statement = "SELECT ID,MAX(Generation),Location,LocalPath,Timestamp,StartLevel,AutoStart,K,ContentHash "
                       "FROM " PLUGINS_TABLE " GROUP BY ID";
 
   QList<int> outdatedIds;
@@ -269,7 +276,7 @@ void ctkPluginStorageSQL::updateDB()
   {
     executeQuery(&query, statement);
 
-    // 2. Check the timestamp for each plug-in
+    // 2. Check the timestamp and the resource store for each plug-in
 
     while (query.next())
     {
@@ -278,7 +285,8 @@ void ctkPluginStorageSQL::updateDB()
       // Make sure the QDateTime has the same accuracy as the one in the database
       pluginLastModified = getQDateTimeFromString(getStringFromQDateTime(pluginLastModified));
 
-      if (pluginLastModified > getQDateTimeFromString(query.value(EBindIndex4).toString()))
+      if (pluginLastModified > getQDateTimeFromString(query.value(EBindIndex4).toString()) ||
+          !ctkPluginResourceStore(getResourceStorePath(query.value(EBindIndex8).toString())).isValid())
       {
         QSharedPointer<ctkPluginArchiveSQL> updatedPA(
               new ctkPluginArchiveSQL(this,
@@ -427,33 +435,51 @@ void ctkPluginStorageSQL::insertArchive(QSharedPointer<ctkPluginArchiveSQL> pa,
   resourcePrefix.replace("_", ".");
   resourcePrefix = QString(":/") + resourcePrefix + "/";
 
-  // Load the plugin and cache the resources
+  // Only load plug-ins whose library content was not seen yet, to extract
+  // their resources. Touched or re-installed libraries reuse the resources.
 
-  QPluginLoader pluginLoader;
-  pluginLoader.setLoadHints(getPluginLoadHints());
-  pluginLoader.setFileName(pa->getLibLocation());
-  if (!pluginLoader.load())
+  const QString contentHash = ctkPluginResourceStore::contentHash(pa->getLibLocation());
+  if (contentHash.isEmpty())
   {
-    ctkPluginException exc(QString("The plugin \"%1\" could not be loaded: %2").arg(pa->getLibLocation())
-                           .arg(pluginLoader.errorString()));
-    throw exc;
+    throw ctkPluginException(QString("The plugin \"%1\" could not be read").arg(pa->getLibLocation()));
   }
 
-  QFile manifestResource(resourcePrefix + "META-INF/MANIFEST.MF");
-  manifestResource.open(QIODevice::ReadOnly);
-  QByteArray manifest = manifestResource.readAll();
-  manifestResource.close();
+  const QString resourceStorePath = getResourceStorePath(contentHash);
+  // A missing or corrupted store is written again
+  if (!ctkPluginResourceStore(resourceStorePath).isValid())
+  {
+    QPluginLoader pluginLoader;
+    pluginLoader.setLoadHints(getPluginLoadHints());
+    pluginLoader.setFileName(pa->getLibLocation());
+    if (!pluginLoader.load())
+    {
+      ctkPluginException exc(QString("The plugin \"%1\" could not be loaded: %2").arg(pa->getLibLocation())
+                             .arg(pluginLoader.errorString()));
+      throw exc;
+    }
+
+    bool written = ctkPluginResourceStore::write(resourcePrefix, resourceStorePath);
+    pluginLoader.unload();
+    if (!written)
+    {
+      throw ctkPluginException(QString("The resources of plugin \"%1\" could not be stored in %2")
+                               .arg(pa->getLibLocation()).arg(resourceStorePath));
+    }
+  }
+
+  pa->contentHash = contentHash;
+  pa->resources = QSharedPointer<ctkPluginResourceStore>(new ctkPluginResourceStore(resourceStorePath));
 
   // Finally, complete the ctkPluginArchive information by reading the MANIFEST.MF resource
-  pa->readManifest(manifest);
+  pa->readManifest();
 
   // Assemble the data for the sql records
 
   QString version = pa->getAttribute(ctkPluginConstants::PLUGIN_VERSION);
   if (version.isEmpty()) version = "na";
 
-  QString statement = "INSERT INTO " PLUGINS_TABLE " (ID,Generation,Location,LocalPath,SymbolicName,Version,LastModified,Timestamp,StartLevel,AutoStart) "
-                      "VALUES (?,?,?,?,?,?,?,?,?,?)";
+  QString statement = "INSERT INTO " PLUGINS_TABLE " (ID,Generation,Location,LocalPath,SymbolicName,Version,LastModified,Timestamp,StartLevel,AutoStart,ContentHash) "
+                      "VALUES (?,?,?,?,?,?,?,?,?,?,?)";
 
   QList<QVariant> bindValues;
   bindValues << pa->getPluginId();
@@ -466,33 +492,11 @@ void ctkPluginStorageSQL::insertArchive(QSharedPointer<ctkPluginArchiveSQL> pa,
   bindValues << libTimestamp;
   bindValues << pa->getStartLevel();
   bindValues << pa->getAutostartSetting();
+  bindValues << pa->contentHash;
 
   executeQuery(query, statement, bindValues);
 
   pa->key = query->lastInsertId().toInt();
-
-  // Write the plug-in resource data into the database
-  QDirIterator dirIter(resourcePrefix, QDirIterator::Subdirectories);
-  while (dirIter.hasNext())
-  {
-    QString resourcePath = dirIter.next();
-    if (QFileInfo(resourcePath).isDir()) continue;
-
-    QFile resourceFile(resourcePath);
-    resourceFile.open(QIODevice::ReadOnly);
-    QByteArray resourceData = resourceFile.readAll();
-    resourceFile.close();
-
-    statement = "INSERT INTO " PLUGIN_RESOURCES_TABLE " (K,ResourcePath,Resource) VALUES(?,?,?)";
-    bindValues.clear();
-    bindValues << pa->key;
-    bindValues << resourcePath.mid(resourcePrefix.size()-1);
-    bindValues << resourceData;
-
-    executeQuery(query, statement, bindValues);
-  }
-
-  pluginLoader.unload();
 }
 
 //----------------------------------------------------------------------------
@@ -657,44 +661,6 @@ void ctkPluginStorageSQL::setAutostartSetting(int key, int autostart)
   executeQuery(&query, statement, bindValues);
 }
 
-//----------------------------------------------------------------------------
-QStringList ctkPluginStorageSQL::findResourcesPath(int archiveKey, const QString& path) const
-{
-  QSqlDatabase database = getConnection();
-  QSqlQuery query(database);
-
-  QString statement = "SELECT SUBSTR(ResourcePath,?) FROM PluginResources WHERE K=? AND SUBSTR(ResourcePath,1,?)=?";
-
-  QString resourcePath = path.startsWith('/') ? path : QString("/") + path;
-  if (!resourcePath.endsWith('/'))
-    resourcePath += "/";
-
-  QList<QVariant> bindValues;
-  bindValues.append(resourcePath.size()+1);
-  bindValues.append(archiveKey);
-  bindValues.append(resourcePath.size());
-  bindValues.append(resourcePath);
-
-  executeQuery(&query, statement, bindValues);
-
-  QSet<QString> paths;
-  while (query.next())
-  {
-    QString currPath = query.value(EBindIndex).toString();
-    QStringList components = currPath.split('/', QString::SkipEmptyParts);
-    if (components.size() == 1)
-    {
-      paths << components.front();
-    }
-    else if (components.size() == 2)
-    {
-      paths << components.front() + "/";
-    }
-  }
-
-  return paths.toList();
-}
-
 //----------------------------------------------------------------------------
 void ctkPluginStorageSQL::executeQuery(QSqlQuery *query, const QString &statement, const QList<QVariant> &bindValues) const
 {
@@ -803,29 +769,6 @@ QString ctkPluginStorageSQL::getDatabasePath() const
   return path;
 }
 
-//----------------------------------------------------------------------------
-QByteArray ctkPluginStorageSQL::getPluginResource(int key, const QString& res) const
-{
-  QSqlDatabase database = getConnection();
-  QSqlQuery query(database);
-
-  QString statement = "SELECT Resource FROM PluginResources WHERE K=? AND ResourcePath=?";
-
-  QString resourcePath = res.startsWith('/') ? res : QString("/") + res;
-  QList<QVariant> bindValues;
-  bindValues.append(key);
-  bindValues.append(resourcePath);
-
-  executeQuery(&query, statement, bindValues);
-
-  if (query.next())
-  {
-    return query.value(EBindIndex).toByteArray();
-  }
-
-  return QByteArray();
-}
-
 //----------------------------------------------------------------------------
 void ctkPluginStorageSQL::createTables()
 {
@@ -846,22 +789,8 @@ void ctkPluginStorageSQL::createTables()
                       "LastModified TEXT NOT NULL,"
                       "Timestamp TEXT NOT NULL,"
                       "StartLevel INTEGER NOT NULL,"
-                      "AutoStart INTEGER NOT NULL)");
-    try
-    {
-      executeQuery(&query, statement);
-    }
-    catch (...)
-    {
-      rollbackTransaction(&query);
-      throw;
-    }
-
-    statement = "CREATE TABLE " PLUGIN_RESOURCES_TABLE " ("
-                "K INTEGER NOT NULL,"
-                "ResourcePath TEXT NOT NULL,"
-                "Resource BLOB NOT NULL,"
-                "FOREIGN KEY(K) REFERENCES " PLUGINS_TABLE "(K) ON DELETE CASCADE)";
+                      "AutoStart INTEGER NOT NULL,"
+                      "ContentHash TEXT NOT NULL)");
     try
     {
       executeQuery(&query, statement);
@@ -891,8 +820,10 @@ bool ctkPluginStorageSQL::checkTables() const
 
   bool bTables(false);
   QStringList tables = database.tables();
+  // Databases storing the resources themselves are recreated
   if (tables.contains(PLUGINS_TABLE) &&
-      tables.contains(PLUGIN_RESOURCES_TABLE))
+      !tables.contains(PLUGIN_RESOURCES_TABLE) &&
+      database.record(PLUGINS_TABLE).contains("ContentHash"))
   {
     bTables = true;
   }
@@ -906,7 +837,8 @@ bool ctkPluginStorageSQL::dropTables()
   QSqlDatabase database = getConnection();
   QSqlQuery query(database);
   QStringList expectedTables;
-  expectedTables << PLUGINS_TABLE << PLUGIN_RESOURCES_TABLE;
+  // Drop the referencing table first
+  expectedTables << PLUGIN_RESOURCES_TABLE << PLUGINS_TABLE;
 
   if (database.tables().count() > 0)
   {
@@ -927,15 +859,15 @@ bool ctkPluginStorageSQL::dropTables()
           throw;
         }
       }
-      try
-      {
-        commitTransaction(&query);
-      }
-      catch (...)
-      {
-        rollbackTransaction(&query);
-        throw;
-      }
+    }
+    try
+    {
+      commitTransaction(&query);
+    }
+    catch (...)
+    {
+      rollbackTransaction(&query);
+      throw;
     }
   }
   return true;
@@ -1055,7 +987,7 @@ void ctkPluginStorageSQL::restorePluginArchives()
 {
   QSqlDatabase database = getConnection();
   QSqlQuery query(database);
-  QString statement = "SELECT ID, Location, LocalPath, StartLevel, LastModified, AutoStart, K, MAX(Generation)"
+  QString statement = "SELECT ID, Location, LocalPath, StartLevel, LastModified, AutoStart, K, MAX(Generation), ContentHash"
                       " FROM " PLUGINS_TABLE " WHERE StartLevel != -2 GROUP BY ID"
                       " ORDER BY ID";
 
@@ -1082,6 +1014,9 @@ void ctkPluginStorageSQL::restorePluginArchives()
       QSharedPointer<ctkPluginArchiveSQL> pa(new ctkPluginArchiveSQL(this, location, localPath, id,
                                                                      startLevel, lastModified, autoStart));
       pa->key = query.value(EBindIndex6).toInt();
+      pa->contentHash = query.value(EBindIndex8).toString();
+      pa->resources = QSharedPointer<ctkPluginResourceStore>(
+            new ctkPluginResourceStore(getResourceStorePath(pa->contentHash)));
       pa->readManifest();
       m_archives.append(pa);
     }
@@ -1092,6 +1027,37 @@ void ctkPluginStorageSQL::restorePluginArchives()
   }
 }
 
+//----------------------------------------------------------------------------
+QString ctkPluginStorageSQL::getResourceStorePath(const QString& contentHash) const
+{
+  return ctkPluginFrameworkUtil::getFileStorage(m_framework, "resources").absoluteFilePath(contentHash + ".res");
+}
+
+//----------------------------------------------------------------------------
+void ctkPluginStorageSQL::removeUnusedResourceStores()
+{
+  QSqlDatabase database = getConnection();
+  QSqlQuery query(database);
+
+  QString statement = "SELECT DISTINCT ContentHash FROM " PLUGINS_TABLE;
+  executeQuery(&query, statement);
+
+  QSet<QString> contentHashes;
+  while (query.next())
+  {
+    contentHashes << query.value(EBindIndex).toString();
+  }
+
+  QDir resourceStoreDir = ctkPluginFrameworkUtil::getFileStorage(m_framework, "resources");
+  foreach (const QFileInfo& resourceStore, resourceStoreDir.entryInfoList(QDir::Files))
+  {
+    if (resourceStore.suffix() != "res" || !contentHashes.contains(resourceStore.completeBaseName()))
+    {
+      QFile::remove(resourceStore.absoluteFilePath());
+    }
+  }
+}
+
 //----------------------------------------------------------------------------
 QString ctkPluginStorageSQL::getStringFromQDateTime(const QDateTime& dateTime) const
 {
@@ -135,30 +135,6 @@ public:
    */
   QString getDatabasePath() const;
 
-  /**
-   * Get a Qt resource cached in the database. The resource path \a res
-   * must be relative to the plugin specific resource prefix, but may
-   * start with a '/'.
-   *
-   * @param pluginId The id of the plugin from which to get the resource
-   * @param res The path to the resource in the plugin
-   * @return The byte array of the cached resource
-   *
-   * @throws ctkPluginDatabaseException
-   */
-  QByteArray getPluginResource(int key, const QString& res) const;
-
-  /**
-   * Get a list of resource entries under the given path.
-   *
-   * @param pluginId The id of the plugin from which to get the entries
-   * @param path A resource path relative to the plugin specific resource prefix.
-   * @return A QStringList containing the cached resource entries.
-   *
-   * @throws ctkPluginDatabaseException
-   */
-  QStringList findResourcesPath(int archiveKey, const QString& path) const;
-
   /**
    * Persist the start level
    *
@@ -243,6 +219,21 @@ private:
    */
   QLibrary::LoadHints getPluginLoadHints() const;
 
+  /**
+   * Get the path of the resource store of a plugin library.
+   *
+   * @param contentHash The hash of the plugin library content.
+   */
+  QString getResourceStorePath(const QString& contentHash) const;
+
+  /**
+   * Remove the resource stores of plugin libraries which are not
+   * referenced by the database anymore.
+   *
+   * @throws ctkPluginDatabaseException
+   */
+  void removeUnusedResourceStores();
+
   /**
    *  Helper method that creates the database tables:
    *
@@ -26,8 +26,9 @@ limitations under the License.
 #include <QVariant>
 
 #include "ctkPluginFramework_global.h"
+#include "ctkPluginFrameworkExport.h"
 
-class ctkServiceProperties
+class CTK_PLUGINFW_EXPORT ctkServiceProperties
 {
 
 private:
@@ -0,0 +1,156 @@
+/*=============================================================================
+
+  Library: CTK
+
+  Copyright (c) German Cancer Research Center,
+    Division of Medical and Biological Informatics
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=============================================================================*/
+
+
+#include "ctkServicePropertyIndex_p.h"
+
+#include "ctkServiceProperties_p.h"
+
+//----------------------------------------------------------------------------
+ctkServicePropertyIndex::ctkServicePropertyIndex(const QString& key)
+  : m_key(key)
+{
+}
+
+//----------------------------------------------------------------------------
+QString ctkServicePropertyIndex::key() const
+{
+  return m_key;
+}
+
+//----------------------------------------------------------------------------
+void ctkServicePropertyIndex::add(const ctkServiceRegistration& sr, const ctkServiceProperties& props)
+{
+  int index = props.find(m_key);
+  if (index < 0)
+  {
+    // A missing property never equals a value
+    return;
+  }
+
+  QStringList values;
+  if (!indexValues(props.value(index), values))
+  {
+    m_unindexed.push_back(sr);
+    m_values.insert(sr, QStringList());
+    return;
+  }
+
+  values.removeDuplicates();
+  foreach (const QString& value, values)
+  {
+    m_services[value].push_back(sr);
+  }
+  m_values.insert(sr, values);
+}
+
+//----------------------------------------------------------------------------
+void ctkServicePropertyIndex::remove(const ctkServiceRegistration& sr)
+{
+  QHash<ctkServiceRegistration, QStringList>::Iterator it = m_values.find(sr);
+  if (it == m_values.end())
+  {
+    return;
+  }
+
+  if (it.value().isEmpty())
+  {
+    m_unindexed.removeAll(sr);
+  }
+  foreach (const QString& value, it.value())
+  {
+    QHash<QString, QList<ctkServiceRegistration> >::Iterator s = m_services.find(value);
+    if (s != m_services.end())
+    {
+      s.value().removeAll(sr);
+      if (s.value().isEmpty())
+      {
+        m_services.erase(s);
+      }
+    }
+  }
+  m_values.erase(it);
+}
+
+//----------------------------------------------------------------------------
+int ctkServicePropertyIndex::count(const QSet<QString>& values) const
+{
+  int n = m_unindexed.size();
+  foreach (const QString& value, values)
+  {
+    n += m_services.value(value).size();
+  }
+  return n;
+}
+
+//----------------------------------------------------------------------------
+QList<ctkServiceRegistration> ctkServicePropertyIndex::candidates(const QSet<QString>& values) const
+{
+  QList<ctkServiceRegistration> res = m_unindexed;
+  if (values.size() == 1 && res.isEmpty())
+  {
+    return m_services.value(*values.begin());
+  }
+
+  QSet<ctkServiceRegistration> added;
+  foreach (const QString& value, values)
+  {
+    const QList<ctkServiceRegistration> s = m_services.value(value);
+    for (int i = 0; i < s.size(); ++i)
+    {
+      if (!added.contains(s[i]) && !m_unindexed.contains(s[i]))
+      {
+        added.insert(s[i]);
+        res.push_back(s[i]);
+      }
+    }
+  }
+  return res;
+}
+
+//----------------------------------------------------------------------------
+bool ctkServicePropertyIndex::indexValues(const QVariant& value, QStringList& values)
+{
+  // Mirrors the order in which ctkLDAPExpr compares a property value
+  if (value.isNull())
+  {
+    return true;
+  }
+  // Lists first: a QStringList can be converted to a QString too
+  if (value.type() == QVariant::StringList || value.type() == QVariant::List)
+  {
+    foreach (const QVariant& element, value.toList())
+    {
+      if (!indexValues(element, values))
+      {
+        return false;
+      }
+    }
+    return true;
+  }
+  if (value.canConvert<QString>() || value.canConvert<char>())
+  {
+    values.push_back(value.toString());
+    return true;
+  }
+  // Compared as a number or a boolean, "(key=01)" may match 1
+  return false;
+}
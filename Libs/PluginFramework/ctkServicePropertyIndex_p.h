@@ -0,0 +1,106 @@
+/*=============================================================================
+
+  Library: CTK
+
+  Copyright (c) German Cancer Research Center,
+    Division of Medical and Biological Informatics
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=============================================================================*/
+
+
+#ifndef CTKSERVICEPROPERTYINDEX_P_H
+#define CTKSERVICEPROPERTYINDEX_P_H
+
+#include <QHash>
+#include <QSet>
+#include <QStringList>
+
+#include "ctkServiceRegistration.h"
+
+class ctkServiceProperties;
+
+/**
+ * \ingroup PluginFramework
+ *
+ * Index of the registered services by the value of one service property.
+ *
+ * A service is indexed under the string values an LDAP equality comparison
+ * of its property may match, i.e. the value itself or the values of the
+ * elements of a list. Services whose property value can not be indexed,
+ * for instance a boolean, are candidates for any value.
+ *
+ * The index is guarded by the lock of ctkServices.
+ */
+class ctkServicePropertyIndex
+{
+
+public:
+
+  /**
+   * @param key The service property, matched case insensitively.
+   */
+  ctkServicePropertyIndex(const QString& key);
+
+  QString key() const;
+
+  /**
+   * Add a service to the index.
+   *
+   * @param sr The service registration.
+   * @param props The properties of the service.
+   */
+  void add(const ctkServiceRegistration& sr, const ctkServiceProperties& props);
+
+  /**
+   * Remove a service from the index.
+   *
+   * @param sr The service registration.
+   */
+  void remove(const ctkServiceRegistration& sr);
+
+  /**
+   * Get the number of candidates for the given values. Services indexed
+   * under several of the values are counted several times.
+   */
+  int count(const QSet<QString>& values) const;
+
+  /**
+   * Get the services which may have one of the given values.
+   *
+   * @param values The values of the property.
+   * @return The candidate services, each listed once.
+   */
+  QList<ctkServiceRegistration> candidates(const QSet<QString>& values) const;
+
+private:
+
+  /**
+   * Get the values a property value is indexed under.
+   *
+   * @return <code>false</code> if the value can not be indexed.
+   */
+  static bool indexValues(const QVariant& value, QStringList& values);
+
+  QString m_key;
+
+  QHash<QString, QList<ctkServiceRegistration> > m_services;
+  QList<ctkServiceRegistration> m_unindexed;
+
+  // The values each service is indexed under, used when removing it
+  QHash<ctkServiceRegistration, QStringList> m_values;
+
+};
+
+#endif // CTKSERVICEPROPERTYINDEX_P_H
@@ -120,7 +120,11 @@ void ctkServiceRegistration::setProperties(const ctkDictionary& props)
       before = d->plugin->fwCtx->listeners.getMatchingServiceSlots(d->reference, false);
       QStringList classes = d->properties.value(ctkPluginConstants::OBJECTCLASS).toStringList();
       qlonglong sid = d->properties.value(ctkPluginConstants::SERVICE_ID).toLongLong();
-      d->properties = ctkServices::createServiceProperties(props, classes, sid);
+      {
+        QMutexLocker lock4(&d->lookupLock);
+        d->properties = ctkServices::createServiceProperties(props, classes, sid);
+      }
+      d->plugin->fwCtx->services->updateServiceProperties(*this);
       int new_rank = d->properties.value(ctkPluginConstants::SERVICE_RANKING).toInt();
       if (old_rank != new_rank)
       {
@@ -177,7 +181,10 @@ void ctkServiceRegistration::unregister()
     QMutexLocker lock(&d->eventLock);
     {
       QMutexLocker lock2(&d->propsLock);
-      d->available = false;
+      {
+        QMutexLocker lock3(&d->lookupLock);
+        d->available = false;
+      }
       if (d->plugin)
       {
         for (QHashIterator<QSharedPointer<ctkPlugin>, QObject*> i(d->serviceInstances); i.hasNext();)
@@ -201,7 +208,10 @@ void ctkServiceRegistration::unregister()
       d->dependents.clear();
       d->service = 0;
       d->serviceInstances.clear();
-      d->reference = 0;
+      {
+        QMutexLocker lock3(&d->lookupLock);
+        d->reference = 0;
+      }
       d->unregistering = false;
     }
   }
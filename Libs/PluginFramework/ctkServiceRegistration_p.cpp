@@ -27,7 +27,7 @@ ctkServiceRegistrationPrivate::ctkServiceRegistrationPrivate(
   const ctkDictionary& props)
   : ref(1), service(service), plugin(plugin), reference(this),
     properties(props), available(true), unregistering(false),
-    propsLock()
+    propsLock(), lookupLock()
 {
 
 }
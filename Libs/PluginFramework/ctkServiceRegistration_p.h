@@ -108,6 +108,13 @@ public:
 
   QMutex propsLock;
 
+  /**
+   * Protects available, properties and reference for service lookups.
+   * Unlike propsLock, it is never held while a ctkServiceFactory creates
+   * a service, so a factory can look up services matching its own registration.
+   */
+  QMutex lookupLock;
+
   ctkServiceRegistrationPrivate(ctkPluginPrivate* plugin, QObject* service,
                                 const ctkDictionary& props);
 
@@ -23,6 +23,8 @@
 
 #include <QStringListIterator>
 #include <QMutexLocker>
+#include <QReadLocker>
+#include <QWriteLocker>
 #include <QBuffer>
 
 #include <algorithm>
@@ -33,6 +35,7 @@
 #include "ctkServiceException.h"
 #include "ctkServiceRegistration_p.h"
 #include "ctkLDAPExpr_p.h"
+#include "ctkServicePropertyIndex_p.h"
 
 //----------------------------------------------------------------------------
 struct ServiceRegistrationComparator
@@ -63,9 +66,27 @@ ctkDictionary ctkServices::createServiceProperties(const ctkDictionary& in,
 
 //----------------------------------------------------------------------------
 ctkServices::ctkServices(ctkPluginFrameworkContext* fwCtx)
-  : mutex(), framework(fwCtx)
+  : lock(), framework(fwCtx)
 {
+  QStringList keys;
+  QVariant indexed = fwCtx->props.value(ctkPluginConstants::FRAMEWORK_SERVICE_INDEXED_PROPERTIES);
+  if (indexed.isValid())
+  {
+    keys = indexed.toStringList();
+  }
+  else
+  {
+    keys << ctkPluginConstants::SERVICE_ID << ctkPluginConstants::SERVICE_PID;
+  }
 
+  foreach (QString key, keys)
+  {
+    key = key.trimmed();
+    if (!key.isEmpty())
+    {
+      propertyIndexes.push_back(new ctkServicePropertyIndex(key));
+    }
+  }
 }
 
 //----------------------------------------------------------------------------
@@ -77,9 +98,15 @@ ctkServices::~ctkServices()
 //----------------------------------------------------------------------------
 void ctkServices::clear()
 {
+  QWriteLocker l(&lock);
   services.clear();
   classServices.clear();
+  qDeleteAll(propertyIndexes);
+  propertyIndexes.clear();
   framework = 0;
+
+  QMutexLocker cacheLock(&filterCacheMutex);
+  filterCache.clear();
 }
 
 //----------------------------------------------------------------------------
@@ -116,7 +143,7 @@ ctkServiceRegistration ctkServices::registerService(ctkPluginPrivate* plugin,
   ctkServiceRegistration res(plugin, service,
                              createServiceProperties(properties, classes));
   {
-    QMutexLocker lock(&mutex);
+    QWriteLocker l(&lock);
     services.insert(res, classes);
     for (QStringListIterator i(classes); i.hasNext(); )
     {
@@ -126,6 +153,11 @@ ctkServiceRegistration ctkServices::registerService(ctkPluginPrivate* plugin,
           std::lower_bound(s.begin(), s.end(), res, ServiceRegistrationComparator());
       s.insert(ip, res);
     }
+    // The registration is not returned yet, its properties can not change
+    foreach (ctkServicePropertyIndex* index, propertyIndexes)
+    {
+      index->add(res, res.d_func()->properties);
+    }
   }
 
   ctkServiceReference r = res.getReference();
@@ -139,7 +171,7 @@ ctkServiceRegistration ctkServices::registerService(ctkPluginPrivate* plugin,
 void ctkServices::updateServiceRegistrationOrder(const ctkServiceRegistration& sr,
                                               const QStringList& classes)
 {
-  QMutexLocker lock(&mutex);
+  QWriteLocker l(&lock);
   for (QStringListIterator i(classes); i.hasNext(); )
   {
     QList<ctkServiceRegistration>& s = classServices[i.next()];
@@ -148,6 +180,17 @@ void ctkServices::updateServiceRegistrationOrder(const ctkServiceRegistration& s
   }
 }
 
+//----------------------------------------------------------------------------
+void ctkServices::updateServiceProperties(const ctkServiceRegistration& sr)
+{
+  QWriteLocker l(&lock);
+  foreach (ctkServicePropertyIndex* index, propertyIndexes)
+  {
+    index->remove(sr);
+    index->add(sr, sr.d_func()->properties);
+  }
+}
+
 //----------------------------------------------------------------------------
 bool ctkServices::checkServiceClass(QObject* service, const QString& cls) const
 {
@@ -157,16 +200,15 @@ bool ctkServices::checkServiceClass(QObject* service, const QString& cls) const
 //----------------------------------------------------------------------------
 QList<ctkServiceRegistration> ctkServices::get(const QString& clazz) const
 {
-  QMutexLocker lock(&mutex);
+  QReadLocker l(&lock);
   return classServices.value(clazz);
 }
 
 //----------------------------------------------------------------------------
 ctkServiceReference ctkServices::get(ctkPluginPrivate* plugin, const QString& clazz) const
 {
-  QMutexLocker lock(&mutex);
   try {
-    QList<ctkServiceReference> srs = get_unlocked(clazz, QString(), plugin);
+    QList<ctkServiceReference> srs = get(clazz, QString(), plugin);
     if (framework->debug.service_reference)
     {
       qDebug() << "get service ref" << clazz << "for plugin"
@@ -185,94 +227,165 @@ ctkServiceReference ctkServices::get(ctkPluginPrivate* plugin, const QString& cl
 //----------------------------------------------------------------------------
 QList<ctkServiceReference> ctkServices::get(const QString& clazz, const QString& filter,
                                             ctkPluginPrivate* plugin) const
-{
-  QMutexLocker lock(&mutex);
-  return get_unlocked(clazz, filter, plugin);
-}
-
-//----------------------------------------------------------------------------
-QList<ctkServiceReference> ctkServices::get_unlocked(const QString& clazz, const QString& filter,
-                                                     ctkPluginPrivate* plugin) const
 {
   Q_UNUSED(plugin)
 
-  QListIterator<ctkServiceRegistration>* s = 0;
-  QList<ctkServiceRegistration> v;
   ctkLDAPExpr ldap;
-  if (clazz.isEmpty())
+  if (!filter.isEmpty())
   {
-    if (!filter.isEmpty())
+    ldap = getFilter(filter);
+  }
+
+  // Take a snapshot of the candidate registrations. The lists are
+  // implicitly shared, registrations and unregistrations detach them
+  // instead of modifying the snapshot while it is evaluated.
+  QList<ctkServiceRegistration> v;
+  {
+    QReadLocker l(&lock);
+    bool allServices = false;
+    if (clazz.isEmpty())
     {
-      ldap = ctkLDAPExpr(filter);
       QSet<QString> matched;
-      if (ldap.getMatchedObjectClasses(matched))
+      if (!filter.isEmpty() && ldap.getMatchedObjectClasses(matched))
       {
-        v.clear();
         foreach (QString className, matched)
         {
-          const QList<ctkServiceRegistration>& cl = classServices[className];
-          v += cl;
-        }
-        if (!v.isEmpty())
-        {
-          s = new QListIterator<ctkServiceRegistration>(v);
+          v += classServices.value(className);
         }
-        else
+        if (v.isEmpty())
         {
           return QList<ctkServiceReference>();
         }
       }
       else
       {
-        s = new QListIterator<ctkServiceRegistration>(services.keys());
+        allServices = true;
       }
     }
     else
     {
-      s = new QListIterator<ctkServiceRegistration>(services.keys());
+      v = classServices.value(clazz);
+      if (v.isEmpty())
+      {
+        return QList<ctkServiceReference>();
+      }
+    }
+
+    QList<ctkServiceRegistration> candidates;
+    if (!filter.isEmpty() &&
+        getIndexedCandidates(ldap, allServices ? services.size() : v.size(), candidates))
+    {
+      v.clear();
+      for (int i = 0; i < candidates.size(); ++i)
+      {
+        // The index does not know the class of the lookup
+        if (clazz.isEmpty() || services.value(candidates.at(i)).contains(clazz))
+        {
+          v.push_back(candidates.at(i));
+        }
+      }
+    }
+    else if (allServices)
+    {
+      v = services.keys();
     }
   }
-  else
+
+  QList<ctkServiceReference> res;
+  for (int i = 0; i < v.size(); ++i)
   {
-    QList<ctkServiceRegistration> v = classServices.value(clazz);
-    if (!v.isEmpty())
+    ctkServiceRegistration reg = v.at(i);
+    ctkServiceRegistrationPrivate* sr = reg.d_func();
+    ctkDictionary properties;
+    ctkServiceReference reference;
     {
-      s = new QListIterator<ctkServiceRegistration>(v);
+      // propsLock is held while a ctkServiceFactory creates a service,
+      // which may look up services: use lookupLock instead
+      QMutexLocker lookupLock(&sr->lookupLock);
+      // Skip the services unregistered since the snapshot was taken
+      if (!sr->available)
+      {
+        continue;
+      }
+      properties = sr->properties;
+      reference = sr->reference;
     }
-    else
+    if (filter.isEmpty() || ldap.evaluate(properties, false))
     {
-      return QList<ctkServiceReference>();
+      res.push_back(reference);
     }
-    if (!filter.isEmpty())
+  }
+
+  return res;
+}
+
+//----------------------------------------------------------------------------
+bool ctkServices::getIndexedCandidates(const ctkLDAPExpr& ldap, int count,
+                                       QList<ctkServiceRegistration>& candidates) const
+{
+  // Use the index with the fewest candidates, if any is more selective
+  // than evaluating the filter against all the services of the lookup
+  const ctkServicePropertyIndex* best = 0;
+  QSet<QString> bestValues;
+  foreach (const ctkServicePropertyIndex* index, propertyIndexes)
+  {
+    QSet<QString> values;
+    if (ldap.getMatchedValues(index->key(), values))
     {
-      ldap = ctkLDAPExpr(filter);
+      int n = index->count(values);
+      if (n < count)
+      {
+        best = index;
+        bestValues = values;
+        count = n;
+      }
     }
   }
 
-  QList<ctkServiceReference> res;
-  while (s->hasNext())
+  if (best == 0)
   {
-    ctkServiceRegistration sr = s->next();
-    ctkServiceReference sri = sr.getReference();
+    return false;
+  }
+  candidates = best->candidates(bestValues);
+  return true;
+}
 
-    if (filter.isEmpty() || ldap.evaluate(sr.d_func()->properties, false))
+//----------------------------------------------------------------------------
+ctkLDAPExpr ctkServices::getFilter(const QString& filter) const
+{
+  {
+    QMutexLocker cacheLock(&filterCacheMutex);
+    QHash<QString, ctkLDAPExpr>::ConstIterator it = filterCache.find(filter);
+    if (it != filterCache.end())
     {
-      res.push_back(sri);
+      return it.value();
     }
   }
 
-  delete s;
+  ctkLDAPExpr ldap(filter);
 
-  return res;
+  QMutexLocker cacheLock(&filterCacheMutex);
+  // Plugins usually look up services with a few constant filters, drop
+  // all of them when filters are built on the fly
+  if (filterCache.size() >= 256)
+  {
+    filterCache.clear();
+  }
+  filterCache.insert(filter, ldap);
+  return ldap;
 }
 
 //----------------------------------------------------------------------------
 void ctkServices::removeServiceRegistration(const ctkServiceRegistration& sr)
 {
-  QMutexLocker lock(&mutex);
+  QWriteLocker l(&lock);
 
   QStringList classes = sr.d_func()->properties.value(ctkPluginConstants::OBJECTCLASS).toStringList();
   services.remove(sr);
+  foreach (ctkServicePropertyIndex* index, propertyIndexes)
+  {
+    index->remove(sr);
+  }
   for (QStringListIterator i(classes); i.hasNext(); )
   {
     QString currClass = i.next();
@@ -291,7 +404,7 @@ void ctkServices::removeServiceRegistration(const ctkServiceRegistration& sr)
 //----------------------------------------------------------------------------
 QList<ctkServiceRegistration> ctkServices::getRegisteredByPlugin(ctkPluginPrivate* p) const
 {
-  QMutexLocker lock(&mutex);
+  QReadLocker l(&lock);
 
   QList<ctkServiceRegistration> res;
   for (QHashIterator<ctkServiceRegistration, QStringList> i(services); i.hasNext(); )
@@ -308,7 +421,7 @@ QList<ctkServiceRegistration> ctkServices::getRegisteredByPlugin(ctkPluginPrivat
 //----------------------------------------------------------------------------
 QList<ctkServiceRegistration> ctkServices::getUsedByPlugin(QSharedPointer<ctkPlugin> p) const
 {
-  QMutexLocker lock(&mutex);
+  QReadLocker l(&lock);
 
   QList<ctkServiceRegistration> res;
   for (QHashIterator<ctkServiceRegistration, QStringList> i(services); i.hasNext(); )
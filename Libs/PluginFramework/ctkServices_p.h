@@ -26,22 +26,34 @@
 #include <QHash>
 #include <QObject>
 #include <QMutex>
+#include <QReadWriteLock>
 #include <QStringList>
 
+#include "ctkLDAPExpr_p.h"
 #include "ctkPlugin_p.h"
 #include "ctkServiceRegistration.h"
 
+class ctkServicePropertyIndex;
 
 /**
  * \ingroup PluginFramework
  *
  * Here we handle all the services that are registered in the framework.
+ *
+ * Lookups share a read lock only long enough to take a snapshot of the
+ * implicitly shared lists of candidate registrations, registrations and
+ * unregistrations take the write lock.
+ *
+ * Services are also indexed by the values of the properties listed in the
+ * ctkPluginConstants::FRAMEWORK_SERVICE_INDEXED_PROPERTIES framework
+ * property. Lookups whose filter requires such a property to be equal to
+ * given values only evaluate the filter against the indexed services.
  */
 class ctkServices {
 
 public:
 
-  mutable QMutex mutex;
+  mutable QReadWriteLock lock;
 
   /**
    * Creates a new ctkDictionary object containing <code>in</code>
@@ -154,6 +166,15 @@ public:
                                  ctkPluginPrivate* plugin) const;
 
 
+  /**
+   * The properties of a registered service changed, update the property
+   * indexes. The caller must hold the properties lock of the service.
+   *
+   * @param sr The ctkServiceRegistration object that is registered.
+   */
+  void updateServiceProperties(const ctkServiceRegistration& sr);
+
+
   /**
    * Remove a registered service.
    *
@@ -181,8 +202,42 @@ public:
 
 private:
 
-  QList<ctkServiceReference> get_unlocked(const QString& clazz, const QString& filter,
-                                          ctkPluginPrivate* plugin) const;
+  /**
+   * Compiled filters of the recent lookups, by filter string.
+   */
+  mutable QHash<QString, ctkLDAPExpr> filterCache;
+  mutable QMutex filterCacheMutex;
+
+  /**
+   * Get the compiled filter from the cache, parsing and compiling it
+   * if it was not used recently.
+   *
+   * @param filter The filter string.
+   * @return The compiled filter.
+   * @exception ctkInvalidArgumentException If the filter is invalid.
+   */
+  ctkLDAPExpr getFilter(const QString& filter) const;
+
+  /**
+   * Indexes of the registered services by property value, guarded by
+   * <code>lock</code>.
+   */
+  QList<ctkServicePropertyIndex*> propertyIndexes;
+
+  /**
+   * Get the services which may match the filter according to the property
+   * indexes, if this is fewer services than <code>count</code>. The caller
+   * must hold <code>lock</code>.
+   *
+   * @param ldap The filter.
+   * @param count The number of services to evaluate the filter against
+   *        otherwise.
+   * @param candidates The candidate services.
+   * @return <code>true</code> if an index was used, <code>false</code>
+   *         otherwise.
+   */
+  bool getIndexedCandidates(const ctkLDAPExpr& ldap, int count,
+                            QList<ctkServiceRegistration>& candidates) const;
 
 };
 
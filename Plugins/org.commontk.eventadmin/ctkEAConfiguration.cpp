@@ -36,7 +36,6 @@
 
 const QString ctkEAConfiguration::PID = "org.commontk.eventadmin.impl.EventAdmin";
 
-const QString ctkEAConfiguration::PROP_CACHE_SIZE = "org.commontk.eventadmin.CacheSize";
 const QString ctkEAConfiguration::PROP_THREAD_POOL_SIZE = "org.commontk.eventadmin.ThreadPoolSize";
 const QString ctkEAConfiguration::PROP_TIMEOUT = "org.commontk.eventadmin.Timeout";
 const QString ctkEAConfiguration::PROP_REQUIRE_TOPIC = "org.commontk.eventadmin.RequireTopic";
@@ -93,14 +92,6 @@ void ctkEAConfiguration::configure(const ctkDictionary& config )
 {
   if (config.isEmpty())
   {
-    // The size of various internal caches. At the moment there are 4
-    // internal caches affected. Each will cache the determined amount of
-    // small but frequently used objects (i.e., in case of the default value
-    // we end-up with a total of 120 small objects being cached). A value of less
-    // then 10 triggers the default value.
-    cacheSize = getIntProperty(PROP_CACHE_SIZE,
-                               pluginContext->getProperty(PROP_CACHE_SIZE), 30, 10);
-
     // The size of the internal thread pool. Note that we must execute
     // each synchronous event dispatch that happens in the synchronous event
     // dispatching thread in a new thread, hence a small thread pool is o.k.
@@ -140,7 +131,6 @@ void ctkEAConfiguration::configure(const ctkDictionary& config )
   }
   else
   {
-    cacheSize = getIntProperty(PROP_CACHE_SIZE, config.value(PROP_CACHE_SIZE), 30, 10);
     threadPoolSize = getIntProperty(PROP_THREAD_POOL_SIZE, config.value(PROP_THREAD_POOL_SIZE), 20, 2);
     timeout = getIntProperty(PROP_TIMEOUT, config.value(PROP_TIMEOUT), 5000, INT_MIN);
     requireTopic = getBoolProperty(config.value(PROP_REQUIRE_TOPIC), true);
@@ -214,8 +204,6 @@ void ctkEAConfiguration::startOrUpdate()
 {
   CTK_DEBUG(ctkEventAdminActivator::getLogService())
       << PROP_LOG_LEVEL << "=" << logLevel;
-  CTK_DEBUG(ctkEventAdminActivator::getLogService())
-      << PROP_CACHE_SIZE << "=" << cacheSize;
   CTK_DEBUG(ctkEventAdminActivator::getLogService())
       << PROP_THREAD_POOL_SIZE << "=" << threadPoolSize;
   CTK_DEBUG(ctkEventAdminActivator::getLogService())
@@ -223,13 +211,9 @@ void ctkEAConfiguration::startOrUpdate()
   CTK_DEBUG(ctkEventAdminActivator::getLogService())
       << PROP_REQUIRE_TOPIC << "=" << requireTopic;
 
-  ctkEventAdminService::TopicHandlerFiltersInterface* topicHandlerFilters =
-      new ctkEventAdminService::TopicHandlerFilters(
-        new ctkEventAdminService::TopicCacheMap(cacheSize), requireTopic);
-
-  ctkEventAdminService::FiltersInterface* filters =
-      new ctkEventAdminService::Filters(
-        new ctkEventAdminService::LDAPCacheMap(cacheSize), pluginContext);
+  // Keeps track of the event handlers and their filters while they come and go
+  ctkEATopicHandlerIndex* topicHandlerIndex =
+      new ctkEATopicHandlerIndex(pluginContext, requireTopic);
 
   // Note that this uses a lazy thread pool that will create new threads on
   // demand - in case none of its cached threads is free - until threadPoolSize
@@ -260,7 +244,7 @@ void ctkEAConfiguration::startOrUpdate()
   // below (and not in this HandlerTasks object!)
   ctkEventAdminService::HandlerTasksInterface* handlerTasks =
       new ctkEventAdminService::BlacklistingHandlerTasks(
-        pluginContext, new ctkEventAdminService::BlackList(), topicHandlerFilters, filters);
+        pluginContext, new ctkEventAdminService::BlackList(), topicHandlerIndex);
 
   if (admin == 0)
   {
@@ -297,7 +281,7 @@ QObject* ctkEAConfiguration::tryToCreateMetaTypeProvider(ctkManagedService* mana
 {
   try
   {
-    return new ctkEAMetaTypeProvider(managedService, cacheSize, threadPoolSize,
+    return new ctkEAMetaTypeProvider(managedService, threadPoolSize,
                                      timeout, requireTopic, ignoreTimeout);
   }
   catch (...)
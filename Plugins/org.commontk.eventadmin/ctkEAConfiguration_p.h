@@ -40,14 +40,6 @@ class ctkEAAbstractAdapter;
  * The service knows about the following properties which are read at plugin startup:
  * <p>
  * <p>
- *      <tt>org.commontk.eventadmin.CacheSize</tt> - The size of various internal
- *          caches.
- * </p>
- * The default value is 30. Increase in case of a large number (more then 100) of
- * <tt>ctkEventHandler</tt> services. A value less then 10 triggers the default value.
- * </p>
- * <p>
- * <p>
  *      <tt>org.commontk.eventadmin.ThreadPoolSize</tt> - The size of the thread
  *          pool.
  * </p>
@@ -104,7 +96,6 @@ public:
   /** The PID for the event admin. */
   static const QString PID; // = "org.commontk.eventadmin.impl.EventAdmin"
 
-  static const QString PROP_CACHE_SIZE; // = "org.commontk.eventadmin.CacheSize"
   static const QString PROP_THREAD_POOL_SIZE; // = "org.commontk.eventadmin.ThreadPoolSize"
   static const QString PROP_TIMEOUT; // = "org.commontk.eventadmin.Timeout"
   static const QString PROP_REQUIRE_TOPIC; // = "org.commontk.eventadmin.RequireTopic"
@@ -118,7 +109,6 @@ private:
   /** The plugin context. */
   ctkPluginContext* pluginContext;
 
-  int cacheSize;
 
   int threadPoolSize;
 
@@ -145,10 +145,10 @@ public:
 };
 
 
-ctkEAMetaTypeProvider::ctkEAMetaTypeProvider(ctkManagedService* delegatee, int cacheSize,
+ctkEAMetaTypeProvider::ctkEAMetaTypeProvider(ctkManagedService* delegatee,
                                              int threadPoolSize, int timeout, bool requireTopic,
                                              const QStringList& ignoreTimeout)
-  : m_cacheSize(cacheSize), m_threadPoolSize(threadPoolSize), m_timeout(timeout),
+  : m_threadPoolSize(threadPoolSize), m_timeout(timeout),
     m_requireTopic(requireTopic), m_ignoreTimeout(ignoreTimeout), m_delegatee(delegatee)
 {
 }
@@ -176,12 +176,6 @@ ctkObjectClassDefinitionPtr ctkEAMetaTypeProvider::getObjectClassDefinition(cons
   {
     QList<ctkAttributeDefinitionPtr> adList;
 
-    adList.push_back(ctkAttributeDefinitionPtr(
-                       new AttributeDefinitionImpl(ctkEAConfiguration::PROP_CACHE_SIZE, "Cache Size",
-                                                   "The size of various internal caches. The default value is 30. Increase in case "
-                                                   "of a large number (more then 100) of services. A value less then 10 triggers the "
-                                                   "default value.", QVariant::Int, QStringList(QString::number(m_cacheSize)))));
-
     adList.push_back(ctkAttributeDefinitionPtr(
                        new AttributeDefinitionImpl(ctkEAConfiguration::PROP_THREAD_POOL_SIZE, "Thread Pool Size",
                                                    "The size of the thread pool. The default value is 10. Increase in case of a large amount "
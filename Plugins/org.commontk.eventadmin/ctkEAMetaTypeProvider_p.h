@@ -37,7 +37,6 @@ class ctkEAMetaTypeProvider : public QObject, public ctkMetaTypeProvider, public
 
 private:
 
-  const int m_cacheSize;
   const int m_threadPoolSize;
   const int m_timeout;
   const bool m_requireTopic;
@@ -52,7 +51,7 @@ private:
 
 public:
 
-  ctkEAMetaTypeProvider(ctkManagedService* delegatee, int cacheSize,
+  ctkEAMetaTypeProvider(ctkManagedService* delegatee,
                         int threadPoolSize, int timeout, bool requireTopic,
                         const QStringList& ignoreTimeout);
 
@@ -20,83 +20,68 @@
 =============================================================================*/
 
 
-template<class BlackList, class TopicHandlerFilters, class Filters>
-ctkEABlacklistingHandlerTasks<BlackList, TopicHandlerFilters, Filters>::
+template<class BlackList>
+ctkEABlacklistingHandlerTasks<BlackList>::
 ctkEABlacklistingHandlerTasks(ctkPluginContext* context,
                               ctkEABlackList<BlackList>* blackList,
-                              ctkEATopicHandlerFilters<TopicHandlerFilters>* topicHandlerFilters,
-                              ctkEAFilters<Filters>* filters)
+                              ctkEATopicHandlerIndex* topicHandlerIndex)
   : blackList(blackList), context(context),
-    topicHandlerFilters(topicHandlerFilters), filters(filters)
+    topicHandlerIndex(topicHandlerIndex)
 {
   checkNull(context, "Context");
   checkNull(blackList, "BlackList");
-  checkNull(topicHandlerFilters, "TopicHandlerFilters");
-  checkNull(filters, "Filters");
+  checkNull(topicHandlerIndex, "TopicHandlerIndex");
 }
 
-template<class BlackList, class TopicHandlerFilters, class Filters>
-ctkEABlacklistingHandlerTasks<BlackList, TopicHandlerFilters, Filters>::
+template<class BlackList>
+ctkEABlacklistingHandlerTasks<BlackList>::
 ~ctkEABlacklistingHandlerTasks()
 {
-  delete filters;
-  delete topicHandlerFilters;
+  delete topicHandlerIndex;
   delete blackList;
 }
 
-template<class BlackList, class TopicHandlerFilters, class Filters>
-QList<ctkEAHandlerTask<ctkEABlacklistingHandlerTasks<BlackList, TopicHandlerFilters, Filters> > >
-ctkEABlacklistingHandlerTasks<BlackList, TopicHandlerFilters, Filters>::
+template<class BlackList>
+QList<ctkEAHandlerTask<ctkEABlacklistingHandlerTasks<BlackList> > >
+ctkEABlacklistingHandlerTasks<BlackList>::
 createHandlerTasks(const ctkEvent& event)
 {
   QList<ctkEAHandlerTask<Self> > result;
-  QList<ctkServiceReference> handlerRefs;
+  const QList<ctkEATopicHandlerIndex::Handler> handlers =
+      topicHandlerIndex->handlersForTopic(event.getTopic());
 
-  try
+  for (int i = 0; i < handlers.size(); ++i)
   {
-    handlerRefs = context->getServiceReferences<ctkEventHandler>(
-          topicHandlerFilters->createFilterForTopic(event.getTopic()));
-  }
-  catch (const ctkInvalidArgumentException& e)
-  {
-    CTK_WARN_EXC(ctkEventAdminActivator::getLogService(), &e)
-        << "Invalid EVENT_TOPIC [" << event.getTopic() << "]";
-  }
-
-  for (int i = 0; i < handlerRefs.size(); ++i)
-  {
-    const ctkServiceReference& ref = handlerRefs.at(i);
+    const ctkEATopicHandlerIndex::Handler& handler = handlers.at(i);
+    const ctkServiceReference& ref = handler.ref;
     if (!blackList->contains(ref)
         //TODO security
         //&& ref.getPlugin()->hasPermission(
         //  PermissionsUtil.createSubscribePermission(event.getTopic()))
         )
     {
-      try
+      if (handler.invalidFilter)
       {
-        if (event.matches(filters->createFilter(
-                            ref.getProperty(ctkEventConstants::EVENT_FILTER).toString())))
-        {
-          result.push_back(ctkEAHandlerTask<Self>(ref, event, this));
-        }
-      }
-      catch (const ctkInvalidArgumentException& e)
-      {
-        CTK_WARN_SR_EXC(ctkEventAdminActivator::getLogService(), ref, &e)
-            << "Invalid EVENT_FILTER - Blacklisting ServiceReference ["
+        CTK_WARN_SR(ctkEventAdminActivator::getLogService(), ref)
+            << "Invalid EVENT_FILTER [" << handler.filterError << "] - Blacklisting ServiceReference ["
             << ref << " | Plugin(" << ref.getPlugin() << ")]";
 
         blackList->add(ref);
       }
+      // A handler without filter is interested in all events of its topics
+      else if (!handler.filter || event.matches(handler.filter))
+      {
+        result.push_back(ctkEAHandlerTask<Self>(ref, event, this));
+      }
     }
   }
 
   return result;
 }
 
-template<class BlackList, class TopicHandlerFilters, class Filters>
+template<class BlackList>
 void
-ctkEABlacklistingHandlerTasks<BlackList, TopicHandlerFilters, Filters>::
+ctkEABlacklistingHandlerTasks<BlackList>::
 blackListRef(const ctkServiceReference& handlerRef)
 {
   blackList->add(handlerRef);
@@ -106,9 +91,9 @@ blackListRef(const ctkServiceReference& handlerRef)
       << handlerRef.getPlugin() << ")] due to timeout!";
 }
 
-template<class BlackList, class TopicHandlerFilters, class Filters>
+template<class BlackList>
 ctkEventHandler*
-ctkEABlacklistingHandlerTasks<BlackList, TopicHandlerFilters, Filters>::
+ctkEABlacklistingHandlerTasks<BlackList>::
 getEventHandler(const ctkServiceReference& handlerRef)
 {
   ctkEventHandler* result = (blackList->contains(handlerRef)) ? 0
@@ -117,9 +102,9 @@ getEventHandler(const ctkServiceReference& handlerRef)
   return (result ? result : &nullEventHandler);
 }
 
-template<class BlackList, class TopicHandlerFilters, class Filters>
+template<class BlackList>
 void
-ctkEABlacklistingHandlerTasks<BlackList, TopicHandlerFilters, Filters>::
+ctkEABlacklistingHandlerTasks<BlackList>::
 ungetEventHandler(ctkEventHandler* handler,
                        const ctkServiceReference& handlerRef)
 {
@@ -134,9 +119,9 @@ ungetEventHandler(ctkEventHandler* handler,
   }
 }
 
-template<class BlackList, class TopicHandlerFilters, class Filters>
+template<class BlackList>
 void
-ctkEABlacklistingHandlerTasks<BlackList, TopicHandlerFilters, Filters>::
+ctkEABlacklistingHandlerTasks<BlackList>::
 checkNull(void* object, const QString& name)
 {
   if(object == 0)
@@ -0,0 +1,263 @@
+/*=============================================================================
+
+  Library: CTK
+
+  Copyright (c) German Cancer Research Center,
+    Division of Medical and Biological Informatics
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=============================================================================*/
+
+
+#include "ctkEATopicHandlerIndex_p.h"
+
+#include <ctkException.h>
+#include <ctkPluginContext.h>
+#include <ctkPluginConstants.h>
+#include <ctkServiceEvent.h>
+#include <service/event/ctkEventConstants.h>
+#include <service/event/ctkEventHandler.h>
+
+#include <QVector>
+
+ctkEATopicHandlerIndex::Node::~Node()
+{
+  qDeleteAll(children);
+}
+
+ctkEATopicHandlerIndex::ctkEATopicHandlerIndex(ctkPluginContext* context, bool requireTopic)
+  : context(context), requireTopic(requireTopic)
+{
+  // Connect first, so that no handler registered in between is missed.
+  // Handlers that are reported twice are simply added again.
+  context->connectServiceListener(this, "serviceChanged",
+                                  QString("(") + ctkPluginConstants::OBJECTCLASS + "="
+                                  + qobject_interface_iid<ctkEventHandler*>() + ")");
+
+  QList<ctkServiceReference> refs = context->getServiceReferences<ctkEventHandler>();
+  foreach (const ctkServiceReference& ref, refs)
+  {
+    // Skip handlers unregistered in the meantime
+    if (ref.getPlugin())
+    {
+      addHandler(ref);
+    }
+  }
+}
+
+ctkEATopicHandlerIndex::~ctkEATopicHandlerIndex()
+{
+  try
+  {
+    context->disconnectServiceListener(this, "serviceChanged");
+  }
+  catch (const ctkIllegalStateException&)
+  {
+    // The context is not valid anymore, the listener is already removed
+  }
+}
+
+QList<ctkEATopicHandlerIndex::Handler>
+ctkEATopicHandlerIndex::handlersForTopic(const QString& topic) const
+{
+  // As a simple example, the topic org/commontk/TEST is matched by the
+  // handler topics *, org/*, org/commontk/* and org/commontk/TEST
+  const QStringList segments = topic.split('/');
+
+  QList<Handler> result;
+
+  QReadLocker l(&lock);
+
+  QList<qlonglong> ids = root.wildcardHandlers;
+  if (!requireTopic)
+  {
+    ids += topiclessHandlers;
+  }
+
+  const Node* current = &root;
+  for (int i = 0; i < segments.size(); ++i)
+  {
+    current = current->children.value(segments.at(i));
+    if (current == 0)
+    {
+      break;
+    }
+    ids += (i == segments.size() - 1) ? current->exactHandlers
+                                      : current->wildcardHandlers;
+  }
+
+  // A handler may be interested in several topics matching the same event
+  qSort(ids);
+  qlonglong previousId = -1;
+  foreach (qlonglong id, ids)
+  {
+    if (id != previousId)
+    {
+      result.push_back(handlers.value(id));
+      previousId = id;
+    }
+  }
+
+  return result;
+}
+
+void ctkEATopicHandlerIndex::serviceChanged(const ctkServiceEvent& event)
+{
+  const ctkServiceReference ref = event.getServiceReference();
+  switch (event.getType())
+  {
+  case ctkServiceEvent::REGISTERED:
+  case ctkServiceEvent::MODIFIED:
+    addHandler(ref);
+    break;
+  case ctkServiceEvent::UNREGISTERING:
+  case ctkServiceEvent::MODIFIED_ENDMATCH:
+  {
+    QWriteLocker l(&lock);
+    removeHandler(ref.getProperty(ctkPluginConstants::SERVICE_ID).toLongLong());
+    break;
+  }
+  }
+}
+
+void ctkEATopicHandlerIndex::addHandler(const ctkServiceReference& ref)
+{
+  const qlonglong serviceId = ref.getProperty(ctkPluginConstants::SERVICE_ID).toLongLong();
+
+  Handler handler;
+  handler.ref = ref;
+
+  const QString filter = ref.getProperty(ctkEventConstants::EVENT_FILTER).toString();
+  if (!filter.isEmpty())
+  {
+    try
+    {
+      handler.filter = ctkLDAPSearchFilter(filter);
+    }
+    catch (const ctkInvalidArgumentException& e)
+    {
+      // Reported and blacklisted when the handler is first matched
+      handler.invalidFilter = true;
+      handler.filterError = e.what();
+    }
+  }
+
+  const QVariant topicProperty = ref.getProperty(ctkEventConstants::EVENT_TOPIC);
+  const QStringList topics = topicProperty.isValid() ? topicProperty.toStringList() : QStringList();
+
+  QWriteLocker l(&lock);
+
+  removeHandler(serviceId);
+
+  handlers.insert(serviceId, handler);
+  if (!topicProperty.isValid())
+  {
+    topiclessHandlers.push_back(serviceId);
+    return;
+  }
+
+  handlerTopics.insert(serviceId, topics);
+  foreach (const QString& topic, topics)
+  {
+    if (topic == "*")
+    {
+      root.wildcardHandlers.push_back(serviceId);
+    }
+    else if (topic.endsWith("/*"))
+    {
+      node(topic.left(topic.size() - 2).split('/'), true)->wildcardHandlers.push_back(serviceId);
+    }
+    else
+    {
+      node(topic.split('/'), true)->exactHandlers.push_back(serviceId);
+    }
+  }
+}
+
+void ctkEATopicHandlerIndex::removeHandler(qlonglong serviceId)
+{
+  if (!handlers.remove(serviceId))
+  {
+    return;
+  }
+
+  topiclessHandlers.removeAll(serviceId);
+
+  const QStringList topics = handlerTopics.take(serviceId);
+  foreach (const QString& topic, topics)
+  {
+    if (topic == "*")
+    {
+      root.wildcardHandlers.removeAll(serviceId);
+      continue;
+    }
+
+    const bool wildcard = topic.endsWith("/*");
+    const QStringList segments = (wildcard ? topic.left(topic.size() - 2) : topic).split('/');
+    Node* topicNode = node(segments, false);
+    if (topicNode)
+    {
+      (wildcard ? topicNode->wildcardHandlers : topicNode->exactHandlers).removeAll(serviceId);
+      prune(segments);
+    }
+  }
+}
+
+ctkEATopicHandlerIndex::Node*
+ctkEATopicHandlerIndex::node(const QStringList& segments, bool create)
+{
+  Node* current = &root;
+  foreach (const QString& segment, segments)
+  {
+    Node* child = current->children.value(segment);
+    if (child == 0)
+    {
+      if (!create)
+      {
+        return 0;
+      }
+      child = new Node();
+      current->children.insert(segment, child);
+    }
+    current = child;
+  }
+  return current;
+}
+
+void ctkEATopicHandlerIndex::prune(const QStringList& segments)
+{
+  QVector<Node*> path;
+  path.push_back(&root);
+  foreach (const QString& segment, segments)
+  {
+    Node* child = path.back()->children.value(segment);
+    if (child == 0)
+    {
+      return;
+    }
+    path.push_back(child);
+  }
+
+  for (int i = path.size() - 1; i > 0; --i)
+  {
+    Node* current = path[i];
+    if (!current->children.isEmpty() || !current->exactHandlers.isEmpty()
+        || !current->wildcardHandlers.isEmpty())
+    {
+      return;
+    }
+    path[i-1]->children.remove(segments.at(i-1));
+    delete current;
+  }
+}
@@ -0,0 +1,149 @@
+/*=============================================================================
+
+  Library: CTK
+
+  Copyright (c) German Cancer Research Center,
+    Division of Medical and Biological Informatics
+
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+=============================================================================*/
+
+
+#ifndef CTKEATOPICHANDLERINDEX_P_H
+#define CTKEATOPICHANDLERINDEX_P_H
+
+#include <QObject>
+#include <QHash>
+#include <QReadWriteLock>
+#include <QStringList>
+
+#include <ctkLDAPSearchFilter.h>
+#include <ctkServiceReference.h>
+
+class ctkPluginContext;
+class ctkServiceEvent;
+
+/**
+ * This class keeps track of the registered <tt>ctkEventHandler</tt> services
+ * in a trie of their <tt>EVENT_TOPIC</tt> segments. It registers itself as a
+ * service listener and updates the trie while handlers come and go, hence the
+ * framework does not have to be queried for each sent event.
+ * <p>
+ * The <tt>EVENT_FILTER</tt> of a handler is parsed once, when the handler is
+ * registered or its properties are modified.
+ * <p>
+ * Lookups may happen concurrently from any thread.
+ */
+class ctkEATopicHandlerIndex : public QObject
+{
+  Q_OBJECT
+
+public:
+
+  /**
+   * An event handler service reference together with its parsed
+   * <tt>EVENT_FILTER</tt>.
+   */
+  struct Handler
+  {
+    Handler() : invalidFilter(false) {}
+
+    ctkServiceReference ref;
+
+    /**
+     * The filter of the handler, null if the handler has no
+     * <tt>EVENT_FILTER</tt> and is interested in all events of its topics.
+     */
+    ctkLDAPSearchFilter filter;
+
+    /**
+     * Whether the <tt>EVENT_FILTER</tt> of the handler could not be parsed.
+     */
+    bool invalidFilter;
+
+    /**
+     * The reason why the <tt>EVENT_FILTER</tt> could not be parsed.
+     */
+    QString filterError;
+  };
+
+  /**
+   * The constructor of the index. This will register the index with the
+   * given context as a <tt>ServiceListener</tt> and add the already
+   * registered event handlers.
+   *
+   * @param context The plugin context with which to register as a listener.
+   * @param requireTopic Whether handlers without an <tt>EVENT_TOPIC</tt>
+   *        are ignored. Otherwise, they receive all events.
+   */
+  ctkEATopicHandlerIndex(ctkPluginContext* context, bool requireTopic);
+
+  ~ctkEATopicHandlerIndex();
+
+  /**
+   * Return the handlers whose <tt>EVENT_TOPIC</tt> matches the given
+   * topic, ordered by service id. The filters of the handlers are not
+   * evaluated.
+   *
+   * @param topic The topic of an event
+   * @return The handlers interested in the topic
+   */
+  QList<Handler> handlersForTopic(const QString& topic) const;
+
+public Q_SLOTS:
+
+  /**
+   * Add, update or remove the handler of the event.
+   *
+   * @param event The event of an event handler service
+   */
+  void serviceChanged(const ctkServiceEvent& event);
+
+private:
+
+  struct Node
+  {
+    ~Node();
+
+    QHash<QString, Node*> children;
+
+    // Handlers of the topic ending at this node
+    QList<qlonglong> exactHandlers;
+
+    // Handlers of the topic ending at this node followed by "/*"
+    QList<qlonglong> wildcardHandlers;
+  };
+
+  void addHandler(const ctkServiceReference& ref);
+  // The caller must hold the write lock
+  void removeHandler(qlonglong serviceId);
+
+  // Find the node of the given topic segments, creating it if requested
+  Node* node(const QStringList& segments, bool create);
+  // Delete the nodes of the given topic that have no handler anymore
+  void prune(const QStringList& segments);
+
+  ctkPluginContext* const context;
+  const bool requireTopic;
+
+  mutable QReadWriteLock lock;
+  Node root;
+  QHash<qlonglong, Handler> handlers;
+  // The EVENT_TOPIC of the handlers, used when removing them
+  QHash<qlonglong, QStringList> handlerTopics;
+  // Handlers without EVENT_TOPIC
+  QList<qlonglong> topiclessHandlers;
+};
+
+#endif // CTKEATOPICHANDLERINDEX_P_H